@@ -205,6 +205,9 @@ PRODUCT_PACKAGES += \
 PRODUCT_PACKAGES += \
     android.hardware.radio@1.4 \
     android.hardware.radio.config@1.2 \
+    libsecril-dsds-shim \
+    libsecril-lce \
+    libsecril-shim \
     libxml2
 
 # Ramdisk
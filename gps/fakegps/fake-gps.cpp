@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "fakegps"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <hardware/gps.h>
+#include <log/log.h>
+
+#include "GnssTrace.h"
+
+/*
+ * Legacy gps.h module replaying a trace recorded by the gps shim, so that
+ * gps-replay, the gps shim or anything else loading a GPS HAL can run on
+ * the host without satellites. open() takes no arguments, so it is set up
+ * from the environment:
+ *   FAKEGPS_TRACE  trace to replay (required)
+ *   FAKEGPS_SPEED  replay speed factor, 1 to 1000 (default 1)
+ *
+ * Records come from a thread made with create_thread_cb, as a vendor HAL's
+ * do, spaced as recorded divided by the speed. start() picks up where
+ * stop() left off; the end of the trace reports GPS_STATUS_SESSION_END.
+ * Fix and NMEA times are replayed the same way: the first one is the
+ * current time and the spacing is divided by the speed, so that they stay
+ * in step with the clock whatever the speed.
+ */
+
+using namespace android;
+
+#define MIN_SPEED 1.0
+#define MAX_SPEED 1000.0
+
+static std::mutex sLock;
+static std::condition_variable sCond;
+static bool sRunning;
+static bool sThreadAlive;
+
+static GpsCallbacks sCallbacks;
+static GpsMeasurementCallbacks sMeasurementCallbacks;
+
+/* Only touched by the replay thread once started */
+static GnssTraceReader sReader;
+static int sPendingType;
+static int64_t sPendingUs;
+static double sSpeed = MIN_SPEED;
+static bool sHaveUtcBase;
+static int64_t sUtcBaseMs;          /* CLOCK_REALTIME when the first time was replayed */
+static int64_t sRecordedBaseMs;     /* and what it was in the trace */
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static GpsUtcTime shiftUtc(GpsUtcTime recorded)
+{
+    if (!sHaveUtcBase) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        sUtcBaseMs = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+        sRecordedBaseMs = recorded;
+        sHaveUtcBase = true;
+    }
+    return sUtcBaseMs + llround((recorded - sRecordedBaseMs) / sSpeed);
+}
+
+static void reportStatus(GpsStatusValue value)
+{
+    GpsStatus status = { sizeof(GpsStatus), value };
+
+    if (sCallbacks.status_cb != NULL) {
+        sCallbacks.status_cb(&status);
+    }
+}
+
+static void emit(int type)
+{
+    switch (type) {
+        case GNSS_TRACE_LOCATION: {
+            GpsLocation location = sReader.location();
+            location.timestamp = shiftUtc(location.timestamp);
+            sCallbacks.location_cb(&location);
+            break;
+        }
+
+        case GNSS_TRACE_SV_STATUS: {
+            if (sCallbacks.gnss_sv_status_cb != NULL) {
+                GnssSvStatus status = sReader.svStatus();
+                sCallbacks.gnss_sv_status_cb(&status);
+            }
+            break;
+        }
+
+        case GNSS_TRACE_MEASUREMENT: {
+            gnss_measurement_callback callback;
+            {
+                std::lock_guard<std::mutex> lock(sLock);
+                callback = sMeasurementCallbacks.gnss_measurement_callback;
+            }
+            if (callback != NULL) {
+                static GnssData data;
+                data = sReader.measurement();
+                callback(&data);
+            }
+            break;
+        }
+
+        case GNSS_TRACE_NMEA:
+            if (sCallbacks.nmea_cb != NULL) {
+                sCallbacks.nmea_cb(shiftUtc(sReader.nmeaTimestamp()), sReader.nmea().c_str(),
+                        sReader.nmea().size());
+            }
+            break;
+    }
+}
+
+static void replayLoop(void *arg __unused)
+{
+    std::unique_lock<std::mutex> lock(sLock);
+    int64_t baseNs = monotonicNs();
+    int64_t baseUs = -1;
+    bool ended = false;
+
+    /* Times restart from the current time after a stop(), like the records */
+    sHaveUtcBase = false;
+
+    reportStatus(GPS_STATUS_SESSION_BEGIN);
+
+    while (sRunning) {
+        if (sPendingType == 0) {
+            sPendingType = sReader.next(&sPendingUs);
+            if (sPendingType == 0) {
+                ended = true;
+                break;
+            }
+        }
+        if (baseUs < 0) {
+            baseUs = sPendingUs;
+        }
+
+        /* Waiting may be cut short by stop(), the record stays pending for the next start() */
+        int64_t dueNs = baseNs + static_cast<int64_t>((sPendingUs - baseUs) * 1000 / sSpeed);
+        int64_t waitNs = dueNs - monotonicNs();
+        if (waitNs > 0 && sCond.wait_for(lock, std::chrono::nanoseconds(waitNs),
+                []() { return !sRunning; })) {
+            break;
+        }
+
+        int type = sPendingType;
+        sPendingType = 0;
+
+        lock.unlock();
+        emit(type);
+        lock.lock();
+    }
+
+    if (ended) {
+        ALOGI("%s: end of trace%s", __func__, sReader.truncated() ? ", last record cut short" : "");
+        lock.unlock();
+        reportStatus(GPS_STATUS_SESSION_END);
+        lock.lock();
+    }
+
+    sThreadAlive = false;
+    sCond.notify_all();
+}
+
+static int fakeInit(GpsCallbacks *callbacks)
+{
+    const char *trace = getenv("FAKEGPS_TRACE");
+    const char *speed = getenv("FAKEGPS_SPEED");
+
+    if (callbacks == NULL || callbacks->location_cb == NULL ||
+            callbacks->create_thread_cb == NULL) {
+        return -1;
+    }
+    if (trace == NULL || !sReader.open(trace)) {
+        ALOGE("%s: FAKEGPS_TRACE must name a readable trace", __func__);
+        return -1;
+    }
+
+    sSpeed = speed != NULL ? atof(speed) : MIN_SPEED;
+    if (!(sSpeed >= MIN_SPEED)) {
+        sSpeed = MIN_SPEED;
+    } else if (sSpeed > MAX_SPEED) {
+        sSpeed = MAX_SPEED;
+    }
+    sPendingType = 0;
+
+    memset(&sCallbacks, 0, sizeof(sCallbacks));
+    memcpy(&sCallbacks, callbacks,
+            callbacks->size < sizeof(sCallbacks) ? callbacks->size : sizeof(sCallbacks));
+
+    if (sCallbacks.set_capabilities_cb != NULL) {
+        sCallbacks.set_capabilities_cb(GPS_CAPABILITY_MEASUREMENTS);
+    }
+
+    ALOGI("%s: replaying %s at %.0fx", __func__, trace, sSpeed);
+    return 0;
+}
+
+static int fakeStart()
+{
+    std::lock_guard<std::mutex> lock(sLock);
+
+    if (sThreadAlive) {
+        return 0;
+    }
+
+    sRunning = true;
+    sThreadAlive = true;
+    if (sCallbacks.create_thread_cb("fakegps-replay", replayLoop, NULL) == 0) {
+        sRunning = false;
+        sThreadAlive = false;
+        return -1;
+    }
+    return 0;
+}
+
+static int fakeStop()
+{
+    std::unique_lock<std::mutex> lock(sLock);
+
+    sRunning = false;
+    sCond.notify_all();
+    sCond.wait(lock, []() { return !sThreadAlive; });
+    return 0;
+}
+
+static void fakeCleanup()
+{
+    fakeStop();
+}
+
+static int fakeInjectTime(GpsUtcTime time __unused, int64_t timeReference __unused,
+        int uncertainty __unused)
+{
+    return 0;
+}
+
+static int fakeInjectLocation(double latitude __unused, double longitude __unused,
+        float accuracy __unused)
+{
+    return 0;
+}
+
+static void fakeDeleteAidingData(GpsAidingData flags __unused)
+{
+}
+
+static int fakeSetPositionMode(GpsPositionMode mode __unused,
+        GpsPositionRecurrence recurrence __unused, uint32_t minInterval __unused,
+        uint32_t preferredAccuracy __unused, uint32_t preferredTime __unused)
+{
+    return 0;
+}
+
+static int fakeMeasurementInit(GpsMeasurementCallbacks *callbacks)
+{
+    std::lock_guard<std::mutex> lock(sLock);
+
+    if (callbacks == NULL) {
+        return GPS_MEASUREMENT_ERROR_GENERIC;
+    }
+
+    memset(&sMeasurementCallbacks, 0, sizeof(sMeasurementCallbacks));
+    memcpy(&sMeasurementCallbacks, callbacks,
+            callbacks->size < sizeof(sMeasurementCallbacks) ?
+                    callbacks->size : sizeof(sMeasurementCallbacks));
+    return GPS_MEASUREMENT_OPERATION_SUCCESS;
+}
+
+static void fakeMeasurementClose()
+{
+    std::lock_guard<std::mutex> lock(sLock);
+
+    memset(&sMeasurementCallbacks, 0, sizeof(sMeasurementCallbacks));
+}
+
+static const GpsMeasurementInterface sMeasurementInterface = {
+    .size = sizeof(GpsMeasurementInterface),
+    .init = fakeMeasurementInit,
+    .close = fakeMeasurementClose,
+};
+
+static const void *fakeGetExtension(const char *name)
+{
+    if (name != NULL && strcmp(name, GPS_MEASUREMENT_INTERFACE) == 0) {
+        return &sMeasurementInterface;
+    }
+    return NULL;
+}
+
+static const GpsInterface sInterface = {
+    .size = sizeof(GpsInterface),
+    .init = fakeInit,
+    .start = fakeStart,
+    .stop = fakeStop,
+    .cleanup = fakeCleanup,
+    .inject_time = fakeInjectTime,
+    .inject_location = fakeInjectLocation,
+    .delete_aiding_data = fakeDeleteAidingData,
+    .set_position_mode = fakeSetPositionMode,
+    .get_extension = fakeGetExtension,
+};
+
+static const GpsInterface *fakeGetGpsInterface(struct gps_device_t *device __unused)
+{
+    return &sInterface;
+}
+
+static int fakeClose(struct hw_device_t *device __unused)
+{
+    return 0;
+}
+
+static struct gps_device_t sDevice;
+
+static int fakeOpen(const struct hw_module_t *module, const char *id __unused,
+        struct hw_device_t **device)
+{
+    sDevice.common.tag = HARDWARE_DEVICE_TAG;
+    sDevice.common.version = 0;
+    sDevice.common.module = const_cast<struct hw_module_t *>(module);
+    sDevice.common.close = fakeClose;
+    sDevice.get_gps_interface = fakeGetGpsInterface;
+
+    *device = &sDevice.common;
+    return 0;
+}
+
+static struct hw_module_methods_t sModuleMethods = {
+    .open = fakeOpen,
+};
+
+struct hw_module_t HAL_MODULE_INFO_SYM = {
+    .tag = HARDWARE_MODULE_TAG,
+    .module_api_version = 1,
+    .hal_api_version = HARDWARE_HAL_API_VERSION,
+    .id = GPS_HARDWARE_MODULE_ID,
+    .name = "Fake GPS replaying a trace",
+    .author = "The LineageOS Project",
+    .methods = &sModuleMethods,
+};
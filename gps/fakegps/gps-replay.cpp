@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gps-replay loads a gps.h module, normally the gps shim on top of the fake
+ * GPS, replays a recorded trace through it and reports what reached the
+ * framework side of GpsCallbacks, and how late.
+ *
+ * usage: gps-replay [-l <gps module>] [-s <speed>] <trace>
+ *
+ *   -l  library exporting HMI (default gps.fake-shim.so); use gps.fake.so
+ *       to measure the fake GPS on its own
+ *   -s  replay speed factor, 1 to 1000
+ */
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <hardware/gps.h>
+
+#include "GnssTrace.h"
+#include "LatencyTracker.h"
+
+using namespace android;
+
+/* Slack on top of the trace duration before giving up on the module */
+#define TIMEOUT_SLACK_NS (10 * 1000000000LL)
+
+static double sSpeed = 1.0;
+static int64_t sStartNs;
+
+static std::mutex sLock;
+static std::condition_variable sCond;
+static bool sEnded;
+
+/* When each location was recorded, relative to the first record of the trace */
+static std::vector<int64_t> sLocationDueUs;
+static size_t sLocations;
+static LatencyHistogram sLateness;
+
+static std::atomic<uint64_t> sSvStatus;
+static std::atomic<uint64_t> sMeasurements;
+static std::atomic<uint64_t> sNmea;
+
+struct Thread {
+    void (*start)(void *);
+    void *arg;
+};
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void onLocation(GpsLocation *location __unused)
+{
+    int64_t now = monotonicNs();
+    std::lock_guard<std::mutex> lock(sLock);
+
+    /* Batched fixes come in late by design and still count in order */
+    if (sLocations < sLocationDueUs.size()) {
+        int64_t due = sStartNs +
+                static_cast<int64_t>(sLocationDueUs[sLocations] * 1000 / sSpeed);
+        sLateness.record(now - due);
+    }
+    sLocations++;
+}
+
+static void onStatus(GpsStatus *status)
+{
+    if (status != NULL && status->status == GPS_STATUS_SESSION_END) {
+        std::lock_guard<std::mutex> lock(sLock);
+        sEnded = true;
+        sCond.notify_all();
+    }
+}
+
+static void onGnssSvStatus(GnssSvStatus *status __unused)
+{
+    sSvStatus++;
+}
+
+static void onNmea(GpsUtcTime timestamp __unused, const char *nmea __unused, int length __unused)
+{
+    sNmea++;
+}
+
+static void onGnssMeasurement(GnssData *data __unused)
+{
+    sMeasurements++;
+}
+
+static void onSetCapabilities(uint32_t capabilities __unused)
+{
+}
+
+static void onWakelock()
+{
+}
+
+static void onRequestUtcTime()
+{
+}
+
+static void *threadMain(void *arg)
+{
+    Thread thread = *static_cast<Thread *>(arg);
+
+    delete static_cast<Thread *>(arg);
+    thread.start(thread.arg);
+    return NULL;
+}
+
+static pthread_t onCreateThread(const char *name __unused, void (*start)(void *), void *arg)
+{
+    pthread_t tid;
+
+    if (pthread_create(&tid, NULL, threadMain, new Thread { start, arg }) != 0) {
+        return 0;
+    }
+    pthread_detach(tid);
+    return tid;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-l <gps module>] [-s <speed>] <trace>\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *library = "gps.fake-shim.so";
+    uint64_t expected[GNSS_TRACE_NMEA + 1] = {};
+    int64_t firstUs = -1;
+    int64_t lastUs = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:s:")) != -1) {
+        switch (opt) {
+            case 'l':
+                library = optarg;
+                break;
+            case 's':
+                sSpeed = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || !(sSpeed >= 1.0 && sSpeed <= 1000.0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *tracePath = argv[optind];
+    GnssTraceReader reader;
+    if (!reader.open(tracePath)) {
+        fprintf(stderr, "cannot read trace %s\n", tracePath);
+        return 1;
+    }
+
+    int type;
+    int64_t timeUs;
+    while ((type = reader.next(&timeUs)) != 0) {
+        if (firstUs < 0) {
+            firstUs = timeUs;
+        }
+        lastUs = timeUs;
+        expected[type]++;
+        if (type == GNSS_TRACE_LOCATION) {
+            sLocationDueUs.push_back(timeUs - firstUs);
+        }
+    }
+    if (firstUs < 0) {
+        fprintf(stderr, "%s has no records\n", tracePath);
+        return 1;
+    }
+
+    char speedArg[32];
+    snprintf(speedArg, sizeof(speedArg), "%f", sSpeed);
+    setenv("FAKEGPS_TRACE", tracePath, 1);
+    setenv("FAKEGPS_SPEED", speedArg, 1);
+
+    void *handle = dlopen(library, RTLD_NOW);
+    if (handle == NULL) {
+        fprintf(stderr, "cannot load %s: %s\n", library, dlerror());
+        return 1;
+    }
+
+    auto module = static_cast<struct hw_module_t *>(dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR));
+    struct hw_device_t *device;
+    if (module == NULL || module->methods->open(module, GPS_HARDWARE_MODULE_ID, &device) != 0) {
+        fprintf(stderr, "%s is not a GPS module\n", library);
+        return 1;
+    }
+
+    auto gps = reinterpret_cast<struct gps_device_t *>(device);
+    const GpsInterface *gpsInterface = gps->get_gps_interface(gps);
+
+    GpsCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.size = sizeof(callbacks);
+    callbacks.location_cb = onLocation;
+    callbacks.status_cb = onStatus;
+    callbacks.nmea_cb = onNmea;
+    callbacks.set_capabilities_cb = onSetCapabilities;
+    callbacks.acquire_wakelock_cb = onWakelock;
+    callbacks.release_wakelock_cb = onWakelock;
+    callbacks.create_thread_cb = onCreateThread;
+    callbacks.request_utc_time_cb = onRequestUtcTime;
+    callbacks.gnss_sv_status_cb = onGnssSvStatus;
+
+    if (gpsInterface->init(&callbacks) != 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+
+    auto measurement = static_cast<const GpsMeasurementInterface *>(
+            gpsInterface->get_extension(GPS_MEASUREMENT_INTERFACE));
+    GpsMeasurementCallbacks measurementCallbacks;
+    memset(&measurementCallbacks, 0, sizeof(measurementCallbacks));
+    measurementCallbacks.size = sizeof(measurementCallbacks);
+    measurementCallbacks.gnss_measurement_callback = onGnssMeasurement;
+    if (measurement != NULL) {
+        measurement->init(&measurementCallbacks);
+    }
+
+    sStartNs = monotonicNs();
+    gpsInterface->start();
+
+    int64_t timeoutNs = static_cast<int64_t>((lastUs - firstUs) * 1000 / sSpeed) +
+            TIMEOUT_SLACK_NS;
+    {
+        std::unique_lock<std::mutex> lock(sLock);
+        if (!sCond.wait_for(lock, std::chrono::nanoseconds(timeoutNs),
+                []() { return sEnded; })) {
+            fprintf(stderr, "no GPS_STATUS_SESSION_END, stopping\n");
+        }
+    }
+
+    /* Flushes anything the shim held back */
+    gpsInterface->stop();
+    double seconds = (monotonicNs() - sStartNs) / 1e9;
+
+    printf("library: %s\n", library);
+    printf("trace: %.1f s replayed in %.3f s (%.0fx)\n", (lastUs - firstUs) / 1e6, seconds,
+            seconds > 0 ? (lastUs - firstUs) / 1e6 / seconds : 0.0);
+    printf("  %-12s %10s %10s\n", "callback", "recorded", "delivered");
+    printf("  %-12s %10" PRIu64 " %10zu\n", "location", expected[GNSS_TRACE_LOCATION],
+            sLocations);
+    printf("  %-12s %10" PRIu64 " %10" PRIu64 "\n", "sv status", expected[GNSS_TRACE_SV_STATUS],
+            sSvStatus.load());
+    printf("  %-12s %10" PRIu64 " %10" PRIu64 "\n", "measurement",
+            expected[GNSS_TRACE_MEASUREMENT], sMeasurements.load());
+    printf("  %-12s %10" PRIu64 " %10" PRIu64 "\n", "nmea", expected[GNSS_TRACE_NMEA],
+            sNmea.load());
+    printf("Location lateness against the recorded spacing (us): mean %" PRId64 " p50 %" PRId64
+            " p99 %" PRId64 " max %" PRId64 "\n", sLateness.mean() / 1000,
+            sLateness.percentile(50) / 1000, sLateness.percentile(99) / 1000,
+            sLateness.max() / 1000);
+
+    auto debug = static_cast<const GpsDebugInterface *>(
+            gpsInterface->get_extension(GPS_DEBUG_INTERFACE));
+    if (debug != NULL && debug->get_internal_state != NULL) {
+        static char state[8192];
+        if (debug->get_internal_state(state, sizeof(state)) > 0) {
+            printf("%s", state);
+        }
+    }
+
+    if (measurement != NULL) {
+        measurement->close();
+    }
+    gpsInterface->cleanup();
+    device->close(device);
+
+    fflush(stdout);
+    _exit(0);
+}
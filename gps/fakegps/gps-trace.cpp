@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gps-trace works on traces recorded by the gps shim
+ * (persist.vendor.gps.trace) without loading any GPS module.
+ *
+ * usage: gps-trace dump <trace>
+ *        gps-trace synth [-d <seconds>] [-S <seed>] <out>
+ *        gps-trace bench [-g <geofences>] [-b <batch>] [-i <interval ms>] [-r <repeat>]
+ *                        [-S <seed>] <trace>
+ *
+ *   dump   one line per record
+ *   synth  a 1 Hz walk under 24 satellites with measurements and NMEA,
+ *          for when no recording is at hand (default 600 s)
+ *   bench  times decoding, and runs the recorded fixes through the
+ *          shim's LocationBatcher and GeofenceEngine (default 10000 fences
+ *          within 2 km of the first fix, batches of 60 fixes or 60 s,
+ *          10 passes); reports the deliveries, that is AP wakeups, the
+ *          batches save and the ring's memory next to plain GpsLocation
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <hardware/gps.h>
+
+#include "GeofenceEngine.h"
+#include "GnssTrace.h"
+#include "LocationBatcher.h"
+
+using namespace android;
+
+#define SYNTH_SVS 24
+#define SYNTH_START_UTC_MS 1600000000000LL
+#define SYNTH_BOOT_NS 10000000000LL
+#define SYNTH_WALK_MPS 1.4
+#define METERS_PER_DEGREE 111320.0
+
+/* Same settings as the shim's software geofences */
+#define BENCH_HYSTERESIS_M 10.0
+#define BENCH_DWELL_MS 3000
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s dump <trace>\n", argv0);
+    fprintf(stderr, "       %s synth [-d <seconds>] [-S <seed>] <out>\n", argv0);
+    fprintf(stderr, "       %s bench [-g <geofences>] [-b <batch>] [-i <interval ms>] "
+            "[-r <repeat>] [-S <seed>] <trace>\n", argv0);
+}
+
+static int dump(const char *path)
+{
+    GnssTraceReader reader;
+    int64_t timeUs;
+    int type;
+
+    if (!reader.open(path)) {
+        fprintf(stderr, "cannot read trace %s\n", path);
+        return 1;
+    }
+
+    while ((type = reader.next(&timeUs)) != 0) {
+        switch (type) {
+            case GNSS_TRACE_LOCATION: {
+                const GpsLocation& l = reader.location();
+                printf("%" PRId64 " location %" PRId64 " %.7f %.7f %.1f m +/- %.1f m "
+                        "%.1f m/s %.0f deg flags %#x\n", timeUs, l.timestamp, l.latitude,
+                        l.longitude, l.altitude, l.accuracy, l.speed, l.bearing, l.flags);
+                break;
+            }
+
+            case GNSS_TRACE_SV_STATUS: {
+                const GnssSvStatus& s = reader.svStatus();
+                int used = 0;
+                for (int i = 0; i < s.num_svs; i++) {
+                    used += (s.gnss_sv_list[i].flags & GNSS_SV_FLAGS_USED_IN_FIX) != 0;
+                }
+                printf("%" PRId64 " sv_status %d svs, %d used\n", timeUs, s.num_svs, used);
+                break;
+            }
+
+            case GNSS_TRACE_MEASUREMENT: {
+                const GnssData& d = reader.measurement();
+                printf("%" PRId64 " measurement %zu at %" PRId64 " ns\n", timeUs,
+                        d.measurement_count, d.clock.time_ns);
+                break;
+            }
+
+            case GNSS_TRACE_NMEA: {
+                std::string sentence = reader.nmea();
+                while (!sentence.empty() && (sentence.back() == '\n' || sentence.back() == '\r')) {
+                    sentence.pop_back();
+                }
+                printf("%" PRId64 " nmea %" PRId64 " %s\n", timeUs, reader.nmeaTimestamp(),
+                        sentence.c_str());
+                break;
+            }
+        }
+    }
+
+    if (reader.truncated()) {
+        printf("# last record cut short\n");
+    }
+    return 0;
+}
+
+static std::string nmeaGga(const GpsLocation& fix, int satellites)
+{
+    char body[128];
+    char sentence[160];
+    time_t seconds = fix.timestamp / 1000;
+    struct tm utc;
+    uint8_t checksum = 0;
+
+    gmtime_r(&seconds, &utc);
+    double latitude = fabs(fix.latitude);
+    double longitude = fabs(fix.longitude);
+    snprintf(body, sizeof(body), "GPGGA,%02d%02d%02d.00,%02d%07.4f,%c,%03d%07.4f,%c,1,%02d,"
+            "0.9,%.1f,M,47.0,M,,", utc.tm_hour, utc.tm_min, utc.tm_sec,
+            static_cast<int>(latitude), fmod(latitude, 1.0) * 60, fix.latitude < 0 ? 'S' : 'N',
+            static_cast<int>(longitude), fmod(longitude, 1.0) * 60,
+            fix.longitude < 0 ? 'W' : 'E', satellites, fix.altitude);
+    for (const char *p = body; *p != '\0'; p++) {
+        checksum ^= *p;
+    }
+    snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+    return sentence;
+}
+
+static int synth(int argc, char **argv)
+{
+    int seconds = 600;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:S:")) != -1) {
+        switch (opt) {
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'S':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || seconds < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    GnssTraceWriter writer;
+    if (!writer.open(argv[optind])) {
+        fprintf(stderr, "cannot write %s\n", argv[optind]);
+        return 1;
+    }
+
+    srand48(seed);
+
+    struct Sky {
+        int16_t svid;
+        uint8_t constellation;
+        float elevation;
+        float azimuth;
+        float cn0;
+        double dopplerMps;
+    } sky[SYNTH_SVS];
+    for (int i = 0; i < SYNTH_SVS; i++) {
+        sky[i].svid = i < SYNTH_SVS / 2 ? 2 + i * 2 : 1 + (i - SYNTH_SVS / 2) * 2;
+        sky[i].constellation = i < SYNTH_SVS / 2 ? GNSS_CONSTELLATION_GPS :
+                GNSS_CONSTELLATION_GLONASS;
+        sky[i].elevation = 5 + drand48() * 80;
+        sky[i].azimuth = drand48() * 360;
+        sky[i].cn0 = 0;
+        sky[i].dopplerMps = (drand48() - 0.5) * 1600;
+    }
+
+    GpsLocation fix;
+    memset(&fix, 0, sizeof(fix));
+    fix.size = sizeof(fix);
+    fix.flags = GPS_LOCATION_HAS_LAT_LONG | GPS_LOCATION_HAS_ALTITUDE | GPS_LOCATION_HAS_SPEED |
+            GPS_LOCATION_HAS_BEARING | GPS_LOCATION_HAS_ACCURACY;
+    fix.latitude = 48.137154;
+    fix.longitude = 11.576124;
+    double heading = drand48() * 360;
+
+    static GnssSvStatus status;
+    static GnssData data;
+    size_t nmeaBytes = 0;
+
+    for (int t = 0; t < seconds; t++) {
+        int64_t bootNs = SYNTH_BOOT_NS + t * 1000000000LL;
+        int used = 0;
+
+        heading = fmod(heading + (drand48() - 0.5) * 20 + 360, 360);
+        double radians = heading * M_PI / 180;
+        fix.latitude += SYNTH_WALK_MPS * cos(radians) / METERS_PER_DEGREE;
+        fix.longitude += SYNTH_WALK_MPS * sin(radians) /
+                (METERS_PER_DEGREE * cos(fix.latitude * M_PI / 180));
+        fix.altitude = 519.0 + (drand48() - 0.5) * 4;
+        fix.speed = SYNTH_WALK_MPS + (drand48() - 0.5) * 0.4;
+        fix.bearing = heading;
+        fix.accuracy = 3.0 + drand48() * 5;
+        fix.timestamp = SYNTH_START_UTC_MS + t * 1000LL;
+
+        memset(&status, 0, sizeof(status));
+        memset(&data, 0, sizeof(data));
+        status.size = sizeof(status);
+        data.size = sizeof(data);
+        data.clock.size = sizeof(data.clock);
+        data.clock.flags = GNSS_CLOCK_HAS_FULL_BIAS | GNSS_CLOCK_HAS_BIAS |
+                GNSS_CLOCK_HAS_DRIFT;
+        data.clock.time_ns = bootNs;
+        data.clock.full_bias_ns = -(SYNTH_START_UTC_MS - 315964800000LL + 18000) * 1000000LL;
+        data.clock.bias_ns = (drand48() - 0.5) * 20;
+        data.clock.bias_uncertainty_ns = 10;
+        data.clock.drift_nsps = 12.5 + (drand48() - 0.5);
+        data.clock.drift_uncertainty_nsps = 1;
+
+        for (int i = 0; i < SYNTH_SVS; i++) {
+            Sky& sv = sky[i];
+            sv.elevation += 0.008f * (i % 2 ? 1 : -1);
+            sv.azimuth = fmodf(sv.azimuth + 0.006f, 360);
+            sv.cn0 = 18 + 28 * sinf(sv.elevation * M_PI / 180) + (drand48() - 0.5) * 2;
+            sv.dopplerMps += (drand48() - 0.5) * 0.2;
+
+            GnssSvInfo& info = status.gnss_sv_list[status.num_svs++];
+            info.size = sizeof(info);
+            info.svid = sv.svid;
+            info.constellation = sv.constellation;
+            info.c_n0_dbhz = sv.cn0;
+            info.elevation = sv.elevation;
+            info.azimuth = sv.azimuth;
+            info.flags = GNSS_SV_FLAGS_HAS_EPHEMERIS_DATA | GNSS_SV_FLAGS_HAS_ALMANAC_DATA;
+            if (sv.cn0 > 30 && used < 16) {
+                info.flags |= GNSS_SV_FLAGS_USED_IN_FIX;
+                used++;
+            }
+
+            GnssMeasurement& m = data.measurements[data.measurement_count++];
+            m.size = sizeof(m);
+            m.flags = GNSS_MEASUREMENT_HAS_CARRIER_FREQUENCY;
+            m.svid = sv.svid;
+            m.constellation = sv.constellation;
+            m.state = GNSS_MEASUREMENT_STATE_CODE_LOCK | GNSS_MEASUREMENT_STATE_TOW_DECODED;
+            m.received_sv_time_in_ns = (fix.timestamp % (7 * 86400000LL)) * 1000000LL -
+                    static_cast<int64_t>(70e6 + i * 1e5);
+            m.received_sv_time_uncertainty_in_ns = 20;
+            m.c_n0_dbhz = sv.cn0;
+            m.pseudorange_rate_mps = sv.dopplerMps;
+            m.pseudorange_rate_uncertainty_mps = 0.1;
+            m.carrier_frequency_hz = sv.constellation == GNSS_CONSTELLATION_GPS ?
+                    1575.42e6f : 1602.0e6f;
+        }
+
+        writer.writeMeasurement(bootNs + 10000000, data);
+        writer.writeSvStatus(bootNs + 12000000, status);
+        std::string gga = nmeaGga(fix, used);
+        nmeaBytes += gga.size();
+        writer.writeNmea(bootNs + 14000000, fix.timestamp, gga.c_str(), gga.size());
+        writer.writeLocation(bootNs + 15000000, fix);
+    }
+
+    writer.close();
+
+    /* What the same epochs take as the structs the HAL hands over */
+    size_t raw = seconds * (sizeof(GpsLocation) + sizeof(GnssClock) +
+            SYNTH_SVS * (sizeof(GnssSvInfo) + sizeof(GnssMeasurement))) + nmeaBytes;
+    printf("%" PRIu64 " records in %" PRIu64 " bytes, %.0f bytes per epoch, "
+            "%.1f%% of the %zu bytes of populated structs\n", writer.records(), writer.bytes(),
+            static_cast<double>(writer.bytes()) / seconds, 100.0 * writer.bytes() / raw, raw);
+    return 0;
+}
+
+static int bench(int argc, char **argv)
+{
+    int fences = 10000;
+    int batch = 60;
+    int64_t intervalMs = 60000;
+    int repeat = 10;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "g:b:i:r:S:")) != -1) {
+        switch (opt) {
+            case 'g':
+                fences = atoi(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'i':
+                intervalMs = strtoll(optarg, NULL, 0);
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            case 'S':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || fences < 0 || batch < 1 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    GnssTraceReader reader;
+    if (!reader.open(argv[optind])) {
+        fprintf(stderr, "cannot read trace %s\n", argv[optind]);
+        return 1;
+    }
+
+    std::vector<GpsLocation> fixes;
+    uint64_t records = 0;
+    int64_t start = monotonicNs();
+    for (int pass = 0; pass < repeat; pass++) {
+        int type;
+        reader.rewind();
+        while ((type = reader.next(NULL)) != 0) {
+            records++;
+            if (pass == 0 && type == GNSS_TRACE_LOCATION) {
+                fixes.push_back(reader.location());
+            }
+        }
+    }
+    int64_t decodeNs = monotonicNs() - start;
+
+    if (fixes.empty()) {
+        fprintf(stderr, "no locations in %s\n", argv[optind]);
+        return 1;
+    }
+
+    printf("decode: %" PRIu64 " records, %.0f ns per record\n", records,
+            static_cast<double>(decodeNs) / records);
+
+    /* Flushed like the shim does with the screen off, minus the backlight */
+    std::vector<GpsLocation> drained;
+    std::vector<GpsLocation> delivered;
+    uint64_t flushes = 0;
+    size_t footprint = 0;
+    start = monotonicNs();
+    for (int pass = 0; pass < repeat; pass++) {
+        LocationBatcher batcher(batch);
+        for (const auto& fix : fixes) {
+            if (!batcher.add(fix)) {
+                drained.clear();
+                batcher.drain(&drained);
+                flushes++;
+                batcher.add(fix);
+            }
+            if (batcher.size() >= static_cast<size_t>(batch) ||
+                    fix.timestamp - batcher.oldestTimestamp() >= intervalMs) {
+                drained.clear();
+                batcher.drain(&drained);
+                flushes++;
+            }
+            if (pass == 0) {
+                delivered.insert(delivered.end(), drained.begin(), drained.end());
+                drained.clear();
+            }
+        }
+        drained.clear();
+        batcher.drain(&drained);
+        flushes += drained.empty() ? 0 : 1;
+        if (pass == 0) {
+            delivered.insert(delivered.end(), drained.begin(), drained.end());
+            footprint = batcher.footprint();
+        }
+    }
+    int64_t batchNs = monotonicNs() - start;
+
+    double maxErrorDeg = 0;
+    bool ordered = delivered.size() == fixes.size();
+    for (size_t i = 0; ordered && i < fixes.size(); i++) {
+        ordered = delivered[i].timestamp == fixes[i].timestamp;
+        maxErrorDeg = fmax(maxErrorDeg, fmax(fabs(delivered[i].latitude - fixes[i].latitude),
+                fabs(delivered[i].longitude - fixes[i].longitude)));
+    }
+
+    printf("batcher: %zu fixes, batches of %d or %" PRId64 " ms, %" PRIu64 " deliveries per pass "
+            "instead of %zu, %.0f ns per fix\n", fixes.size(), batch, intervalMs,
+            flushes / repeat, fixes.size(), static_cast<double>(batchNs) / (fixes.size() * repeat));
+    printf("batcher: ring of %zu bytes for %d fixes, %zu as GpsLocation; %s, "
+            "positions within %.1e degrees\n", footprint, batch, batch * sizeof(GpsLocation),
+            ordered ? "all fixes in order" : "FIXES LOST OR REORDERED", maxErrorDeg);
+
+    srand48(seed);
+    std::vector<GeofenceEngine::Transition> transitions;
+    uint64_t transitionCount = 0;
+    uint64_t tested = 0;
+    int64_t geofenceNs = 0;
+    for (int pass = 0; pass < repeat; pass++) {
+        GeofenceEngine engine(BENCH_HYSTERESIS_M, BENCH_DWELL_MS);
+        srand48(seed);
+        for (int id = 0; id < fences; id++) {
+            engine.add(id, fixes[0].latitude + (drand48() - 0.5) * 0.036,
+                    fixes[0].longitude + (drand48() - 0.5) * 0.054, 30 + drand48() * 270,
+                    GPS_GEOFENCE_UNCERTAIN,
+                    GPS_GEOFENCE_ENTERED | GPS_GEOFENCE_EXITED | GPS_GEOFENCE_UNCERTAIN,
+                    5000, 30000);
+        }
+
+        start = monotonicNs();
+        for (const auto& fix : fixes) {
+            transitions.clear();
+            engine.evaluate(fix, &transitions);
+            transitionCount += transitions.size();
+        }
+        geofenceNs += monotonicNs() - start;
+        tested += engine.tested();
+    }
+    printf("geofences: %d fences, %" PRIu64 " transitions and %.1f fences tested per pass, "
+            "%.0f ns per fix\n", fences, transitionCount / repeat,
+            static_cast<double>(tested) / (fixes.size() * repeat),
+            static_cast<double>(geofenceNs) / (fixes.size() * repeat));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *command = argv[1];
+    optind = 2;
+
+    if (strcmp(command, "dump") == 0 && argc == 3) {
+        return dump(argv[2]);
+    }
+    if (strcmp(command, "synth") == 0) {
+        return synth(argc, argv);
+    }
+    if (strcmp(command, "bench") == 0) {
+        return bench(argc, argv);
+    }
+
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AssistCache.h"
+
+namespace android {
+
+#define ASSIST_MAGIC 0x43415047     /* "GPAC" */
+#define ASSIST_VERSION 2
+#define ASSIST_MAX_SECTIONS 8
+/* Large enough for an LnavEphemeris */
+#define ASSIST_RECORD_PAYLOAD 72
+
+struct AssistCache::Section {
+    uint8_t constellation;
+    uint8_t kind;
+    uint16_t count;             /* records, indexed by svid - 1 */
+    uint32_t offset;            /* from the start of the image */
+};
+
+struct AssistCache::Record {
+    int64_t savedUtcMs;
+    uint16_t svid;              /* 0 for an empty slot */
+    uint16_t length;
+    uint32_t reserved;
+    uint8_t payload[ASSIST_RECORD_PAYLOAD];
+};
+
+struct AssistCache::Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sectionCount;
+    uint32_t size;
+    uint32_t crc;               /* CRC-32 of the rest of the image, from "generation" on */
+    uint64_t generation;
+    Position position;          /* utcMs 0 when unknown */
+    Section sections[ASSIST_MAX_SECTIONS];
+};
+
+/* Anything touching this table needs a new ASSIST_VERSION */
+static const struct {
+    GnssConstellationType constellation;
+    AssistCache::Kind kind;
+    uint16_t count;
+} kLayout[] = {
+    { GNSS_CONSTELLATION_GPS, AssistCache::KIND_EPHEMERIS, 32 },
+    { GNSS_CONSTELLATION_GPS, AssistCache::KIND_ALMANAC, 32 },
+};
+
+static const size_t kSectionCount = sizeof(kLayout) / sizeof(kLayout[0]);
+
+static_assert(kSectionCount <= ASSIST_MAX_SECTIONS, "too many assist cache sections");
+
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    static uint32_t table[256];
+    static bool initialized;
+    uint32_t crc = 0xffffffff;
+
+    if (!initialized) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        initialized = true;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+size_t AssistCache::layoutSize()
+{
+    size_t size = sizeof(Header);
+
+    for (size_t i = 0; i < kSectionCount; i++) {
+        size += kLayout[i].count * sizeof(Record);
+    }
+    return size;
+}
+
+AssistCache::AssistCache()
+    : mBase(NULL),
+      mSize(0),
+      mMap(NULL),
+      mSlotSize(0),
+      mSlot(0),
+      mFd(-1),
+      mDirty(false)
+{
+}
+
+AssistCache::~AssistCache()
+{
+    close();
+}
+
+AssistCache::Header *AssistCache::header() const
+{
+    return reinterpret_cast<Header *>(mBase);
+}
+
+uint32_t AssistCache::checksum(const uint8_t *image, size_t size)
+{
+    size_t start = offsetof(Header, generation);
+
+    return crc32(image + start, size - start);
+}
+
+/* Also rejects a slot torn by a crash in the middle of sync() */
+bool AssistCache::isValid(const uint8_t *image, size_t size)
+{
+    const Header *h = reinterpret_cast<const Header *>(image);
+    uint32_t offset = sizeof(Header);
+
+    if (h->magic != ASSIST_MAGIC || h->version != ASSIST_VERSION || h->size != size ||
+            h->sectionCount != kSectionCount) {
+        return false;
+    }
+    for (size_t i = 0; i < kSectionCount; i++) {
+        if (h->sections[i].constellation != kLayout[i].constellation ||
+                h->sections[i].kind != kLayout[i].kind ||
+                h->sections[i].count != kLayout[i].count ||
+                h->sections[i].offset != offset) {
+            return false;
+        }
+        offset += kLayout[i].count * sizeof(Record);
+    }
+    return h->crc == checksum(image, size);
+}
+
+bool AssistCache::open(const char *path)
+{
+    struct stat st;
+    size_t size = layoutSize();
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t slotSize = (size + page - 1) / page * page;
+    int newest = -1;
+
+    close();
+
+    mFd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+    if (mFd < 0) {
+        return false;
+    }
+
+    if ((fstat(mFd, &st) != 0 || static_cast<size_t>(st.st_size) != 2 * slotSize) &&
+            ftruncate(mFd, 2 * slotSize) != 0) {
+        close();
+        return false;
+    }
+
+    void *map = mmap(NULL, 2 * slotSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (map == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mMap = static_cast<uint8_t *>(map);
+    mSlotSize = slotSize;
+
+    for (int slot = 0; slot < 2; slot++) {
+        const uint8_t *image = mMap + slot * slotSize;
+        if (isValid(image, size) && (newest < 0 ||
+                reinterpret_cast<const Header *>(image)->generation >
+                reinterpret_cast<const Header *>(mMap + newest * slotSize)->generation)) {
+            newest = slot;
+        }
+    }
+
+    mImage.resize(size);
+    mBase = mImage.data();
+    mSize = size;
+    if (newest >= 0) {
+        memcpy(mBase, mMap + newest * slotSize, size);
+        mSlot = newest;
+        mDirty = false;
+    } else {
+        reset();
+        mSlot = 1;
+        sync();
+    }
+
+    return true;
+}
+
+void AssistCache::close()
+{
+    if (mBase != NULL) {
+        sync();
+        mImage.clear();
+        mBase = NULL;
+        mSize = 0;
+    }
+    if (mMap != NULL) {
+        munmap(mMap, 2 * mSlotSize);
+        mMap = NULL;
+        mSlotSize = 0;
+    }
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+void AssistCache::reset()
+{
+    Header *h = header();
+    uint32_t offset = sizeof(Header);
+
+    memset(mBase, 0, mSize);
+    h->magic = ASSIST_MAGIC;
+    h->version = ASSIST_VERSION;
+    h->sectionCount = kSectionCount;
+    h->size = mSize;
+    for (size_t i = 0; i < kSectionCount; i++) {
+        h->sections[i].constellation = kLayout[i].constellation;
+        h->sections[i].kind = kLayout[i].kind;
+        h->sections[i].count = kLayout[i].count;
+        h->sections[i].offset = offset;
+        offset += kLayout[i].count * sizeof(Record);
+    }
+    mDirty = true;
+}
+
+/*
+ * The current slot is never written, so whatever a crash leaves of the
+ * other one, open() still finds the last committed image.
+ */
+bool AssistCache::sync()
+{
+    if (mBase == NULL || !mDirty) {
+        return true;
+    }
+
+    int slot = mSlot ^ 1;
+    uint8_t *image = mMap + slot * mSlotSize;
+
+    header()->generation++;
+    header()->crc = checksum(mBase, mSize);
+    memcpy(image, mBase, mSize);
+    if (msync(image, mSlotSize, MS_SYNC) != 0) {
+        return false;
+    }
+
+    mSlot = slot;
+    mDirty = false;
+    return true;
+}
+
+uint64_t AssistCache::generation() const
+{
+    return mBase != NULL ? header()->generation : 0;
+}
+
+void AssistCache::putPosition(const GpsLocation& fix)
+{
+    Position *p;
+
+    if (mBase == NULL || (fix.flags & GPS_LOCATION_HAS_LAT_LONG) == 0) {
+        return;
+    }
+
+    p = &header()->position;
+    p->latitude = fix.latitude;
+    p->longitude = fix.longitude;
+    p->altitude = fix.altitude;
+    p->accuracy = fix.accuracy;
+    p->flags = fix.flags;
+    p->utcMs = fix.timestamp;
+    mDirty = true;
+}
+
+bool AssistCache::position(Position *out) const
+{
+    if (mBase == NULL || header()->position.utcMs == 0) {
+        return false;
+    }
+
+    *out = header()->position;
+    return true;
+}
+
+AssistCache::Record *AssistCache::find(GnssConstellationType constellation, Kind kind,
+        int svid) const
+{
+    const Header *h = header();
+
+    if (mBase == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < kSectionCount; i++) {
+        const Section& s = h->sections[i];
+        if (s.constellation == constellation && s.kind == kind) {
+            if (svid < 1 || svid > s.count) {
+                return NULL;
+            }
+            return reinterpret_cast<Record *>(mBase + s.offset) + svid - 1;
+        }
+    }
+
+    return NULL;
+}
+
+bool AssistCache::putRecord(GnssConstellationType constellation, Kind kind, int svid,
+        const void *data, size_t length, int64_t savedUtcMs)
+{
+    Record *r = find(constellation, kind, svid);
+
+    if (r == NULL || length > sizeof(r->payload)) {
+        return false;
+    }
+
+    r->savedUtcMs = savedUtcMs;
+    r->svid = svid;
+    r->length = length;
+    memcpy(r->payload, data, length);
+    memset(r->payload + length, 0, sizeof(r->payload) - length);
+    mDirty = true;
+    return true;
+}
+
+const void *AssistCache::record(GnssConstellationType constellation, Kind kind, int svid,
+        size_t *length, int64_t *savedUtcMs) const
+{
+    const Record *r = find(constellation, kind, svid);
+
+    if (r == NULL || r->svid == 0) {
+        return NULL;
+    }
+
+    if (length != NULL) {
+        *length = r->length;
+    }
+    if (savedUtcMs != NULL) {
+        *savedUtcMs = r->savedUtcMs;
+    }
+    return r->payload;
+}
+
+size_t AssistCache::countFresh(GnssConstellationType constellation, Kind kind,
+        int64_t nowUtcMs, int64_t maxAgeMs) const
+{
+    size_t count = 0;
+
+    for (int svid = 1; ; svid++) {
+        const Record *r = find(constellation, kind, svid);
+        if (r == NULL) {
+            break;
+        }
+        if (r->svid != 0 && nowUtcMs - r->savedUtcMs >= 0 &&
+                nowUtcMs - r->savedUtcMs <= maxAgeMs) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void AssistCache::clear(GpsAidingData flags)
+{
+    Header *h = header();
+
+    if (mBase == NULL) {
+        return;
+    }
+
+    /* The fix is what dates the clock, so forgetting the time forgets it too */
+    if (flags & (GPS_DELETE_POSITION | GPS_DELETE_TIME)) {
+        memset(&h->position, 0, sizeof(h->position));
+    }
+
+    for (size_t i = 0; i < kSectionCount; i++) {
+        const Section& s = h->sections[i];
+        if ((s.kind == KIND_EPHEMERIS && (flags & GPS_DELETE_EPHEMERIS)) ||
+                (s.kind == KIND_ALMANAC && (flags & GPS_DELETE_ALMANAC))) {
+            memset(mBase + s.offset, 0, s.count * sizeof(Record));
+        }
+    }
+
+    mDirty = true;
+}
+
+} // namespace android
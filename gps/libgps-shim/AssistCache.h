@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_ASSIST_CACHE_H
+#define GPS_SHIM_ASSIST_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Assistance data kept across reboots in a memory mapped file: the last
+ * fix, which also dates the system clock, and decoded navigation data
+ * per constellation. The layout is fixed per version.
+ *
+ * Changes are staged in memory. sync() writes the whole image, with its
+ * CRC, to whichever of the file's two slots is not current, and open()
+ * takes the valid slot with the highest generation. A crash at any point
+ * thus leaves the state of the last completed sync(); only when neither
+ * slot checks out does the cache start over empty.
+ *
+ * Not thread safe.
+ */
+class AssistCache {
+public:
+    enum Kind : uint8_t {
+        KIND_EPHEMERIS = 1,
+        KIND_ALMANAC = 2,
+    };
+
+    struct Position {
+        double latitude;
+        double longitude;
+        double altitude;
+        float accuracy;
+        uint16_t flags;         /* GpsLocationFlags */
+        uint16_t reserved;
+        int64_t utcMs;          /* GPS time of the fix */
+    };
+
+    AssistCache();
+    ~AssistCache();
+
+    /* Maps "path", creating it if needed. False if the file cannot be used at all. */
+    bool open(const char *path);
+    void close();
+
+    bool isOpen() const { return mBase != NULL; }
+
+    void putPosition(const GpsLocation& fix);
+    bool position(Position *out) const;
+
+    /*
+     * Stores one record for (constellation, kind, svid). Returns false if
+     * the layout has no room for it, e.g. a constellation nothing decodes.
+     */
+    bool putRecord(GnssConstellationType constellation, Kind kind, int svid,
+            const void *data, size_t length, int64_t savedUtcMs);
+
+    /* NULL if missing; "length" bytes as given to putRecord(). */
+    const void *record(GnssConstellationType constellation, Kind kind, int svid,
+            size_t *length, int64_t *savedUtcMs) const;
+
+    /* Records saved no more than "maxAgeMs" before "nowUtcMs". */
+    size_t countFresh(GnssConstellationType constellation, Kind kind, int64_t nowUtcMs,
+            int64_t maxAgeMs) const;
+
+    /* Drops what delete_aiding_data() asks the chip to forget, GPS_DELETE_* flags. */
+    void clear(GpsAidingData flags);
+
+    /* Commits pending changes to the file. Returns false on I/O errors. */
+    bool sync();
+
+    uint64_t generation() const;
+
+private:
+    struct Header;
+    struct Section;
+    struct Record;
+
+    static size_t layoutSize();
+    static uint32_t checksum(const uint8_t *image, size_t size);
+    static bool isValid(const uint8_t *image, size_t size);
+
+    Header *header() const;
+    Record *find(GnssConstellationType constellation, Kind kind, int svid) const;
+    void reset();
+
+    std::vector<uint8_t> mImage;
+    uint8_t *mBase;             /* staged image, NULL when closed */
+    size_t mSize;
+    uint8_t *mMap;
+    size_t mSlotSize;           /* layoutSize() rounded up to whole pages */
+    int mSlot;                  /* the slot holding the last committed image */
+    int mFd;
+    bool mDirty;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_ASSIST_CACHE_H
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+
+#include "GeofenceEngine.h"
+
+namespace android {
+
+/* About 280 x 190 m at 48 degrees, close to the size of a typical fence */
+#define CELL_DEGREES 0.0025
+#define LAT_CELLS 72000     /* 180 / CELL_DEGREES */
+#define LON_CELLS 144000    /* 360 / CELL_DEGREES */
+/* Fences spanning more cells are kept out of the grid and tested on every fix */
+#define MAX_FENCE_CELLS 256
+/* Fixes whose 95% circle spans more cells cannot settle fences they are not already near */
+#define MAX_FIX_CELLS 64
+
+#define METERS_PER_DEGREE 111320.0
+/* GpsLocation accuracy is the 68% radius; for a 2D normal the 95% radius is 1.62 times that */
+#define CONFIDENCE_SCALE 1.62
+
+GeofenceEngine::GeofenceEngine(double hysteresisMeters, int64_t dwellMs)
+    : mHysteresis(hysteresisMeters > 0 ? hysteresisMeters : 0),
+      mDwellMs(dwellMs > 0 ? dwellMs : 0),
+      mPass(0),
+      mTested(0)
+{
+}
+
+GeofenceEngine::CellKey GeofenceEngine::cellKey(int64_t latCell, int64_t lonCell)
+{
+    lonCell %= LON_CELLS;
+    if (lonCell < 0) {
+        lonCell += LON_CELLS;
+    }
+    return (static_cast<uint64_t>(latCell) << 32) | static_cast<uint64_t>(lonCell);
+}
+
+static void cellRange(double latitude, double longitude, double meters, double metersPerLon,
+        int64_t *latFirst, int64_t *latLast, int64_t *lonFirst, int64_t *lonLast)
+{
+    double dLat = meters / METERS_PER_DEGREE;
+    double dLon = meters / metersPerLon;
+
+    *latFirst = static_cast<int64_t>(floor((latitude - dLat + 90.0) / CELL_DEGREES));
+    *latLast = static_cast<int64_t>(floor((latitude + dLat + 90.0) / CELL_DEGREES));
+    *lonFirst = static_cast<int64_t>(floor((longitude - dLon + 180.0) / CELL_DEGREES));
+    *lonLast = static_cast<int64_t>(floor((longitude + dLon + 180.0) / CELL_DEGREES));
+}
+
+static double metersPerLonDegree(double latitude)
+{
+    /* Anything this close to a pole spans the whole grid anyway */
+    return METERS_PER_DEGREE * fmax(cos(latitude * M_PI / 180.0), 1e-3);
+}
+
+static int64_t cellCount(int64_t latFirst, int64_t latLast, int64_t lonFirst, int64_t lonLast)
+{
+    return (latLast - latFirst + 1) * (lonLast - lonFirst + 1);
+}
+
+template <typename F>
+void GeofenceEngine::forEachCell(const Fence& fence, F f)
+{
+    int64_t latFirst, latLast, lonFirst, lonLast;
+
+    cellRange(fence.latitude, fence.longitude, fence.radius + mHysteresis,
+            fence.metersPerLonDegree, &latFirst, &latLast, &lonFirst, &lonLast);
+    for (int64_t lat = latFirst; lat <= latLast; lat++) {
+        for (int64_t lon = lonFirst; lon <= lonLast; lon++) {
+            f(cellKey(lat, lon));
+        }
+    }
+}
+
+void GeofenceEngine::index(uint32_t slot)
+{
+    Fence& fence = mFences[slot];
+    int64_t latFirst, latLast, lonFirst, lonLast;
+
+    cellRange(fence.latitude, fence.longitude, fence.radius + mHysteresis,
+            fence.metersPerLonDegree, &latFirst, &latLast, &lonFirst, &lonLast);
+    fence.large = latFirst < 0 || latLast >= LAT_CELLS ||
+            cellCount(latFirst, latLast, lonFirst, lonLast) > MAX_FENCE_CELLS;
+
+    if (fence.large) {
+        mLarge.push_back(slot);
+        return;
+    }
+
+    forEachCell(fence, [this, slot](CellKey key) {
+        mCells[key].push_back(slot);
+    });
+}
+
+static void eraseSlot(std::vector<uint32_t> *slots, uint32_t slot)
+{
+    for (size_t i = 0; i < slots->size(); i++) {
+        if ((*slots)[i] == slot) {
+            (*slots)[i] = slots->back();
+            slots->pop_back();
+            return;
+        }
+    }
+}
+
+void GeofenceEngine::unindex(uint32_t slot)
+{
+    const Fence& fence = mFences[slot];
+
+    if (fence.large) {
+        eraseSlot(&mLarge, slot);
+        return;
+    }
+
+    forEachCell(fence, [this, slot](CellKey key) {
+        auto cell = mCells.find(key);
+        if (cell != mCells.end()) {
+            eraseSlot(&cell->second, slot);
+            if (cell->second.empty()) {
+                mCells.erase(cell);
+            }
+        }
+    });
+}
+
+int32_t GeofenceEngine::add(int32_t id, double latitude, double longitude, double radiusMeters,
+        int lastTransition, int monitorTransitions, int responsivenessMs, int unknownTimerMs)
+{
+    const int allTransitions = GPS_GEOFENCE_ENTERED | GPS_GEOFENCE_EXITED |
+            GPS_GEOFENCE_UNCERTAIN;
+    uint32_t slot;
+
+    if (mIds.count(id) > 0) {
+        return GPS_GEOFENCE_ERROR_ID_EXISTS;
+    }
+    if ((monitorTransitions & ~allTransitions) != 0) {
+        return GPS_GEOFENCE_ERROR_INVALID_TRANSITION;
+    }
+    if (!(radiusMeters > 0) || !(fabs(latitude) <= 90.0) || !(fabs(longitude) <= 180.0)) {
+        return GPS_GEOFENCE_ERROR_GENERIC;
+    }
+
+    if (!mFree.empty()) {
+        slot = mFree.back();
+        mFree.pop_back();
+    } else {
+        slot = mFences.size();
+        mFences.emplace_back();
+    }
+
+    Fence& fence = mFences[slot];
+    fence.id = id;
+    fence.monitor = monitorTransitions;
+    fence.latitude = latitude;
+    fence.longitude = longitude;
+    fence.radius = radiusMeters;
+    fence.metersPerLonDegree = metersPerLonDegree(latitude);
+    fence.dwellMs = responsivenessMs > 0 && responsivenessMs < mDwellMs ?
+            responsivenessMs : mDwellMs;
+    fence.unknownTimerMs = unknownTimerMs > 0 ? unknownTimerMs : 0;
+    fence.candidateSinceMs = 0;
+    fence.undecidedSinceMs = 0;
+    fence.mark = mPass;
+    fence.state = lastTransition == GPS_GEOFENCE_ENTERED ? STATE_INSIDE :
+            lastTransition == GPS_GEOFENCE_EXITED ? STATE_OUTSIDE : STATE_UNKNOWN;
+    fence.candidate = STATE_UNKNOWN;
+    fence.used = true;
+    fence.paused = false;
+
+    mIds[id] = slot;
+    index(slot);
+    if (fence.state != STATE_OUTSIDE) {
+        mActive.push_back(slot);
+    }
+    return GPS_GEOFENCE_OPERATION_SUCCESS;
+}
+
+int32_t GeofenceEngine::remove(int32_t id)
+{
+    auto it = mIds.find(id);
+
+    if (it == mIds.end()) {
+        return GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    }
+
+    uint32_t slot = it->second;
+    unindex(slot);
+    eraseSlot(&mActive, slot);
+    mFences[slot].used = false;
+    mFree.push_back(slot);
+    mIds.erase(it);
+    return GPS_GEOFENCE_OPERATION_SUCCESS;
+}
+
+int32_t GeofenceEngine::pause(int32_t id)
+{
+    auto it = mIds.find(id);
+
+    if (it == mIds.end()) {
+        return GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    }
+
+    mFences[it->second].paused = true;
+    return GPS_GEOFENCE_OPERATION_SUCCESS;
+}
+
+int32_t GeofenceEngine::resume(int32_t id, int monitorTransitions)
+{
+    const int allTransitions = GPS_GEOFENCE_ENTERED | GPS_GEOFENCE_EXITED |
+            GPS_GEOFENCE_UNCERTAIN;
+    auto it = mIds.find(id);
+
+    if (it == mIds.end()) {
+        return GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    }
+    if ((monitorTransitions & ~allTransitions) != 0) {
+        return GPS_GEOFENCE_ERROR_INVALID_TRANSITION;
+    }
+
+    Fence& fence = mFences[it->second];
+    if (fence.paused) {
+        /* Whatever happened while paused is settled by the next fix, without dwelling twice */
+        fence.paused = false;
+        fence.candidate = STATE_UNKNOWN;
+        fence.undecidedSinceMs = 0;
+        mActive.push_back(it->second);
+    }
+    fence.monitor = monitorTransitions;
+    return GPS_GEOFENCE_OPERATION_SUCCESS;
+}
+
+void GeofenceEngine::report(const Fence& fence, int32_t transition,
+        std::vector<Transition> *out)
+{
+    if ((fence.monitor & transition) != 0) {
+        out->push_back({ fence.id, transition });
+    }
+}
+
+void GeofenceEngine::test(uint32_t slot, const GpsLocation& fix, double confidenceRadius,
+        std::vector<Transition> *out)
+{
+    Fence& fence = mFences[slot];
+    int64_t now = fix.timestamp;
+    State observed = STATE_UNKNOWN;
+
+    if (!fence.used || fence.paused || fence.mark == mPass) {
+        return;
+    }
+    fence.mark = mPass;
+    mTested++;
+
+    double dLon = fix.longitude - fence.longitude;
+    if (dLon > 180.0) {
+        dLon -= 360.0;
+    } else if (dLon < -180.0) {
+        dLon += 360.0;
+    }
+    double dy = (fix.latitude - fence.latitude) * METERS_PER_DEGREE;
+    double dx = dLon * fence.metersPerLonDegree;
+    double d2 = dx * dx + dy * dy;
+    double inner = fence.radius - mHysteresis - confidenceRadius;
+    double outer = fence.radius + mHysteresis + confidenceRadius;
+
+    if (inner > 0 && d2 <= inner * inner) {
+        observed = STATE_INSIDE;
+    } else if (d2 >= outer * outer) {
+        observed = STATE_OUTSIDE;
+    }
+
+    if (observed == STATE_UNKNOWN) {
+        fence.candidate = STATE_UNKNOWN;
+        if (fence.state != STATE_UNKNOWN) {
+            if (fence.undecidedSinceMs == 0) {
+                fence.undecidedSinceMs = now;
+            }
+            if (now - fence.undecidedSinceMs >= fence.unknownTimerMs) {
+                fence.state = STATE_UNKNOWN;
+                fence.undecidedSinceMs = 0;
+                report(fence, GPS_GEOFENCE_UNCERTAIN, out);
+            }
+        }
+    } else {
+        fence.undecidedSinceMs = 0;
+        if (observed == fence.state) {
+            fence.candidate = STATE_UNKNOWN;
+        } else {
+            if (fence.candidate != observed) {
+                fence.candidate = observed;
+                fence.candidateSinceMs = now;
+            }
+            if (now - fence.candidateSinceMs >= fence.dwellMs) {
+                fence.state = observed;
+                fence.candidate = STATE_UNKNOWN;
+                report(fence, observed == STATE_INSIDE ?
+                        GPS_GEOFENCE_ENTERED : GPS_GEOFENCE_EXITED, out);
+            }
+        }
+    }
+
+    if (fence.state != STATE_OUTSIDE || fence.candidate != STATE_UNKNOWN ||
+            fence.undecidedSinceMs != 0) {
+        mScratch.push_back(slot);
+    }
+}
+
+void GeofenceEngine::evaluate(const GpsLocation& fix, std::vector<Transition> *out)
+{
+    double confidenceRadius = (fix.flags & GPS_LOCATION_HAS_ACCURACY) != 0 ?
+            fix.accuracy * CONFIDENCE_SCALE : INFINITY;
+    int64_t latFirst, latLast, lonFirst, lonLast;
+
+    if ((fix.flags & GPS_LOCATION_HAS_LAT_LONG) == 0) {
+        return;
+    }
+
+    mPass++;
+    mScratch.clear();
+
+    for (uint32_t slot : mActive) {
+        test(slot, fix, confidenceRadius, out);
+    }
+    for (uint32_t slot : mLarge) {
+        test(slot, fix, confidenceRadius, out);
+    }
+
+    if (isfinite(confidenceRadius)) {
+        cellRange(fix.latitude, fix.longitude, confidenceRadius,
+                metersPerLonDegree(fix.latitude), &latFirst, &latLast, &lonFirst, &lonLast);
+        if (cellCount(latFirst, latLast, lonFirst, lonLast) <= MAX_FIX_CELLS) {
+            for (int64_t lat = latFirst; lat <= latLast; lat++) {
+                for (int64_t lon = lonFirst; lon <= lonLast; lon++) {
+                    auto cell = mCells.find(cellKey(lat, lon));
+                    if (cell == mCells.end()) {
+                        continue;
+                    }
+                    for (uint32_t slot : cell->second) {
+                        test(slot, fix, confidenceRadius, out);
+                    }
+                }
+            }
+        }
+    }
+
+    mActive.swap(mScratch);
+}
+
+} // namespace android
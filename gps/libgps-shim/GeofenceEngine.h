@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_GEOFENCE_ENGINE_H
+#define GPS_SHIM_GEOFENCE_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Software evaluation of circular geofences, following the state machine
+ * documented for GpsGeofencingInterface in gps.h.
+ *
+ * Fences are indexed in a grid of CELL_DEGREES cells, so a fix only tests
+ * the fences around it plus those not known to be outside. A fix puts a
+ * fence inside or outside only if its 95% circle clears the boundary by
+ * the hysteresis margin. The new state must also hold for the dwell time
+ * before it is reported. A fence that stays undecided for its
+ * unknown_timer_ms goes to UNCERTAIN.
+ *
+ * Status codes are the GPS_GEOFENCE_* values of gps.h. Not thread safe.
+ */
+class GeofenceEngine {
+public:
+    struct Transition {
+        int32_t id;
+        int32_t transition;     /* GPS_GEOFENCE_ENTERED, _EXITED or _UNCERTAIN */
+    };
+
+    GeofenceEngine(double hysteresisMeters, int64_t dwellMs);
+
+    int32_t add(int32_t id, double latitude, double longitude, double radiusMeters,
+            int lastTransition, int monitorTransitions, int responsivenessMs,
+            int unknownTimerMs);
+    int32_t remove(int32_t id);
+    int32_t pause(int32_t id);
+    int32_t resume(int32_t id, int monitorTransitions);
+
+    bool contains(int32_t id) const { return mIds.count(id) > 0; }
+    size_t size() const { return mIds.size(); }
+
+    /* Appends the monitored transitions caused by "fix" to "out". */
+    void evaluate(const GpsLocation& fix, std::vector<Transition> *out);
+
+    /* Fences distance-tested so far, to keep an eye on the index. */
+    uint64_t tested() const { return mTested; }
+
+private:
+    enum State : uint8_t {
+        STATE_UNKNOWN,
+        STATE_INSIDE,
+        STATE_OUTSIDE,
+    };
+
+    struct Fence {
+        int32_t id;
+        int32_t monitor;
+        double latitude;
+        double longitude;
+        double radius;
+        double metersPerLonDegree;
+        int64_t dwellMs;
+        int64_t unknownTimerMs;
+        int64_t candidateSinceMs;   /* when "candidate" was first seen */
+        int64_t undecidedSinceMs;   /* 0 while fixes are conclusive */
+        uint32_t mark;              /* last evaluate() pass that tested it */
+        State state;
+        State candidate;            /* STATE_UNKNOWN when not dwelling */
+        bool used;
+        bool paused;
+        bool large;                 /* too big for the grid, always tested */
+    };
+
+    typedef uint64_t CellKey;
+
+    static CellKey cellKey(int64_t latCell, int64_t lonCell);
+    template <typename F> void forEachCell(const Fence& fence, F f);
+
+    void index(uint32_t slot);
+    void unindex(uint32_t slot);
+    void test(uint32_t slot, const GpsLocation& fix, double confidenceRadius,
+            std::vector<Transition> *out);
+    void report(const Fence& fence, int32_t transition, std::vector<Transition> *out);
+
+    double mHysteresis;
+    int64_t mDwellMs;
+    uint32_t mPass;
+    uint64_t mTested;
+
+    std::vector<Fence> mFences;
+    std::vector<uint32_t> mFree;
+    std::unordered_map<int32_t, uint32_t> mIds;
+    std::unordered_map<CellKey, std::vector<uint32_t>> mCells;
+    std::vector<uint32_t> mLarge;
+    /* Fences that a fix far away could still change: not yet known to be outside */
+    std::vector<uint32_t> mActive;
+    std::vector<uint32_t> mScratch;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_GEOFENCE_ENGINE_H
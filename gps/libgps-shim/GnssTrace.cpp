@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <type_traits>
+
+#include "GnssTrace.h"
+
+namespace android {
+
+#define TRACE_MAGIC "GTRC"
+#define TRACE_MAGIC_LENGTH 4
+#define TRACE_VERSION 1
+/* Records are written out in blocks of about this size */
+#define TRACE_BLOCK 16384
+
+struct Field {
+    uint16_t offset;
+    uint8_t size;
+    bool isFloat;
+    bool isSigned;
+};
+
+#define FIELD(type, member) { \
+    offsetof(type, member), sizeof(((type *)0)->member), \
+    std::is_floating_point<decltype(((type *)0)->member)>::value, \
+    std::is_signed<decltype(((type *)0)->member)>::value }
+
+/* Anything touching these tables needs a new TRACE_VERSION */
+static const Field kLocationFields[] = {
+    FIELD(GpsLocation, flags),
+    FIELD(GpsLocation, latitude),
+    FIELD(GpsLocation, longitude),
+    FIELD(GpsLocation, altitude),
+    FIELD(GpsLocation, speed),
+    FIELD(GpsLocation, bearing),
+    FIELD(GpsLocation, accuracy),
+    FIELD(GpsLocation, timestamp),
+};
+
+static const Field kSvFields[] = {
+    FIELD(GnssSvInfo, svid),
+    FIELD(GnssSvInfo, constellation),
+    FIELD(GnssSvInfo, c_n0_dbhz),
+    FIELD(GnssSvInfo, elevation),
+    FIELD(GnssSvInfo, azimuth),
+    FIELD(GnssSvInfo, flags),
+};
+
+static const Field kClockFields[] = {
+    FIELD(GnssClock, flags),
+    FIELD(GnssClock, leap_second),
+    FIELD(GnssClock, time_ns),
+    FIELD(GnssClock, time_uncertainty_ns),
+    FIELD(GnssClock, full_bias_ns),
+    FIELD(GnssClock, bias_ns),
+    FIELD(GnssClock, bias_uncertainty_ns),
+    FIELD(GnssClock, drift_nsps),
+    FIELD(GnssClock, drift_uncertainty_nsps),
+    FIELD(GnssClock, hw_clock_discontinuity_count),
+};
+
+static const Field kMeasurementFields[] = {
+    FIELD(GnssMeasurement, flags),
+    FIELD(GnssMeasurement, svid),
+    FIELD(GnssMeasurement, constellation),
+    FIELD(GnssMeasurement, time_offset_ns),
+    FIELD(GnssMeasurement, state),
+    FIELD(GnssMeasurement, received_sv_time_in_ns),
+    FIELD(GnssMeasurement, received_sv_time_uncertainty_in_ns),
+    FIELD(GnssMeasurement, c_n0_dbhz),
+    FIELD(GnssMeasurement, pseudorange_rate_mps),
+    FIELD(GnssMeasurement, pseudorange_rate_uncertainty_mps),
+    FIELD(GnssMeasurement, accumulated_delta_range_state),
+    FIELD(GnssMeasurement, accumulated_delta_range_m),
+    FIELD(GnssMeasurement, accumulated_delta_range_uncertainty_m),
+    FIELD(GnssMeasurement, carrier_frequency_hz),
+    FIELD(GnssMeasurement, carrier_cycles),
+    FIELD(GnssMeasurement, carrier_phase),
+    FIELD(GnssMeasurement, carrier_phase_uncertainty),
+    FIELD(GnssMeasurement, multipath_indicator),
+    FIELD(GnssMeasurement, snr_db),
+};
+
+static const Field kNmeaFields[] = {
+    { 0, sizeof(GpsUtcTime), false, true },
+};
+
+#define COUNT(fields) (sizeof(fields) / sizeof((fields)[0]))
+
+static void putVarint(std::vector<uint8_t> *out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out->push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+static bool getVarint(const uint8_t **p, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Integers sign or zero extended, floats as their bits */
+static uint64_t load(const void *base, const Field& field)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(base) + field.offset;
+    uint64_t value = 0;
+
+    switch (field.size) {
+        case 1: {
+            uint8_t v;
+            memcpy(&v, p, sizeof(v));
+            value = field.isSigned ? static_cast<uint64_t>(static_cast<int8_t>(v)) : v;
+            break;
+        }
+        case 2: {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            value = field.isSigned ? static_cast<uint64_t>(static_cast<int16_t>(v)) : v;
+            break;
+        }
+        case 4: {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            value = field.isSigned && !field.isFloat ?
+                    static_cast<uint64_t>(static_cast<int32_t>(v)) : v;
+            break;
+        }
+        case 8:
+            memcpy(&value, p, sizeof(value));
+            break;
+    }
+    return value;
+}
+
+static void store(void *base, const Field& field, uint64_t value)
+{
+    uint8_t *p = static_cast<uint8_t *>(base) + field.offset;
+
+    switch (field.size) {
+        case 1: {
+            uint8_t v = static_cast<uint8_t>(value);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case 2: {
+            uint16_t v = static_cast<uint16_t>(value);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case 4: {
+            uint32_t v = static_cast<uint32_t>(value);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case 8:
+            memcpy(p, &value, sizeof(value));
+            break;
+    }
+}
+
+/* Encodes "current" against "previous", then makes "previous" a copy of it */
+static void encodeFields(const Field *fields, size_t count, const void *current, void *previous,
+        std::vector<uint8_t> *out)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t now = load(current, fields[i]);
+        uint64_t before = load(previous, fields[i]);
+
+        if (fields[i].isFloat) {
+            putVarint(out, now ^ before);
+        } else {
+            int64_t delta = static_cast<int64_t>(now - before);
+            putVarint(out, (static_cast<uint64_t>(delta) << 1) ^
+                    static_cast<uint64_t>(delta >> 63));
+        }
+        store(previous, fields[i], now);
+    }
+}
+
+/* Decodes onto "state", which holds the previous record */
+static bool decodeFields(const Field *fields, size_t count, const uint8_t **p,
+        const uint8_t *end, void *state)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t before = load(state, fields[i]);
+        uint64_t value;
+
+        if (!getVarint(p, end, &value)) {
+            return false;
+        }
+        if (fields[i].isFloat) {
+            store(state, fields[i], before ^ value);
+        } else {
+            store(state, fields[i], before + ((value >> 1) ^ (0 - (value & 1))));
+        }
+    }
+    return true;
+}
+
+GnssTraceWriter::GnssTraceWriter()
+    : mFd(-1),
+      mLastUs(0),
+      mRecordStart(0),
+      mRecords(0),
+      mBytes(0),
+      mNmeaTimestamp(0)
+{
+    memset(&mLocation, 0, sizeof(mLocation));
+    memset(&mSvStatus, 0, sizeof(mSvStatus));
+    memset(&mMeasurement, 0, sizeof(mMeasurement));
+}
+
+GnssTraceWriter::~GnssTraceWriter()
+{
+    close();
+}
+
+bool GnssTraceWriter::open(const char *path)
+{
+    close();
+
+    mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+    if (mFd < 0) {
+        return false;
+    }
+
+    mLastUs = 0;
+    mRecords = 0;
+    mBytes = 0;
+    mBuffer.clear();
+    mBuffer.reserve(TRACE_BLOCK * 2);
+    memset(&mLocation, 0, sizeof(mLocation));
+    memset(&mSvStatus, 0, sizeof(mSvStatus));
+    memset(&mMeasurement, 0, sizeof(mMeasurement));
+    mNmeaTimestamp = 0;
+
+    mBuffer.insert(mBuffer.end(), TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_LENGTH);
+    mBuffer.push_back(TRACE_VERSION);
+    mBytes = mBuffer.size();
+    return flush();
+}
+
+void GnssTraceWriter::close()
+{
+    if (mFd >= 0) {
+        flush();
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+bool GnssTraceWriter::flush()
+{
+    size_t written = 0;
+
+    if (mFd < 0) {
+        return false;
+    }
+
+    while (written < mBuffer.size()) {
+        ssize_t n = write(mFd, mBuffer.data() + written, mBuffer.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+
+    bool complete = written == mBuffer.size();
+    mBuffer.clear();
+    return complete;
+}
+
+void GnssTraceWriter::beginRecord(GnssTraceType type, int64_t boottimeNs)
+{
+    int64_t timeUs = boottimeNs / 1000;
+
+    mRecordStart = mBuffer.size();
+    mBuffer.push_back(type);
+    putVarint(&mBuffer, timeUs > mLastUs ? timeUs - mLastUs : 0);
+    if (timeUs > mLastUs) {
+        mLastUs = timeUs;
+    }
+    mPayload.clear();
+}
+
+void GnssTraceWriter::endRecord()
+{
+    putVarint(&mBuffer, mPayload.size());
+    mBuffer.insert(mBuffer.end(), mPayload.begin(), mPayload.end());
+
+    mBytes += mBuffer.size() - mRecordStart;
+    mRecords++;
+    if (mBuffer.size() >= TRACE_BLOCK) {
+        flush();
+    }
+}
+
+void GnssTraceWriter::writeLocation(int64_t boottimeNs, const GpsLocation& location)
+{
+    if (mFd < 0) {
+        return;
+    }
+
+    beginRecord(GNSS_TRACE_LOCATION, boottimeNs);
+    encodeFields(kLocationFields, COUNT(kLocationFields), &location, &mLocation, &mPayload);
+    endRecord();
+}
+
+void GnssTraceWriter::writeSvStatus(int64_t boottimeNs, const GnssSvStatus& status)
+{
+    size_t count = status.num_svs > 0 ? status.num_svs : 0;
+
+    if (mFd < 0) {
+        return;
+    }
+    if (count > GNSS_MAX_SVS) {
+        count = GNSS_MAX_SVS;
+    }
+
+    beginRecord(GNSS_TRACE_SV_STATUS, boottimeNs);
+    putVarint(&mPayload, count);
+    for (size_t i = 0; i < count; i++) {
+        encodeFields(kSvFields, COUNT(kSvFields), &status.gnss_sv_list[i],
+                &mSvStatus.gnss_sv_list[i], &mPayload);
+    }
+    endRecord();
+}
+
+void GnssTraceWriter::writeMeasurement(int64_t boottimeNs, const GnssData& data)
+{
+    size_t count = data.measurement_count;
+
+    if (mFd < 0) {
+        return;
+    }
+    if (count > GNSS_MAX_MEASUREMENT) {
+        count = GNSS_MAX_MEASUREMENT;
+    }
+
+    beginRecord(GNSS_TRACE_MEASUREMENT, boottimeNs);
+    encodeFields(kClockFields, COUNT(kClockFields), &data.clock, &mMeasurement.clock, &mPayload);
+    putVarint(&mPayload, count);
+    for (size_t i = 0; i < count; i++) {
+        encodeFields(kMeasurementFields, COUNT(kMeasurementFields), &data.measurements[i],
+                &mMeasurement.measurements[i], &mPayload);
+    }
+    endRecord();
+}
+
+void GnssTraceWriter::writeNmea(int64_t boottimeNs, GpsUtcTime timestamp, const char *nmea,
+        size_t length)
+{
+    if (mFd < 0 || nmea == NULL) {
+        return;
+    }
+
+    beginRecord(GNSS_TRACE_NMEA, boottimeNs);
+    encodeFields(kNmeaFields, COUNT(kNmeaFields), &timestamp, &mNmeaTimestamp, &mPayload);
+    mPayload.insert(mPayload.end(), nmea, nmea + length);
+    endRecord();
+}
+
+GnssTraceReader::GnssTraceReader()
+    : mOffset(0),
+      mTimeUs(0),
+      mTruncated(false),
+      mNmeaTimestamp(0)
+{
+    rewind();
+}
+
+bool GnssTraceReader::open(const char *path)
+{
+    std::vector<uint8_t> data;
+    struct stat st;
+    size_t length = 0;
+    int fd;
+
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    data.resize(st.st_size);
+    while (length < data.size()) {
+        ssize_t n = read(fd, data.data() + length, data.size() - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        length += n;
+    }
+    ::close(fd);
+
+    data.resize(length);
+    return open(std::move(data));
+}
+
+bool GnssTraceReader::open(std::vector<uint8_t> data)
+{
+    if (data.size() < TRACE_MAGIC_LENGTH + 1 ||
+            memcmp(data.data(), TRACE_MAGIC, TRACE_MAGIC_LENGTH) != 0 ||
+            data[TRACE_MAGIC_LENGTH] != TRACE_VERSION) {
+        return false;
+    }
+
+    mData = std::move(data);
+    rewind();
+    return true;
+}
+
+void GnssTraceReader::rewind()
+{
+    mOffset = TRACE_MAGIC_LENGTH + 1;
+    mTimeUs = 0;
+    mTruncated = false;
+
+    memset(&mLocation, 0, sizeof(mLocation));
+    memset(&mSvStatus, 0, sizeof(mSvStatus));
+    memset(&mMeasurement, 0, sizeof(mMeasurement));
+    mNmeaTimestamp = 0;
+    mNmea.clear();
+
+    mLocation.size = sizeof(mLocation);
+    mSvStatus.size = sizeof(mSvStatus);
+    mMeasurement.size = sizeof(mMeasurement);
+    mMeasurement.clock.size = sizeof(mMeasurement.clock);
+    for (auto& sv : mSvStatus.gnss_sv_list) {
+        sv.size = sizeof(sv);
+    }
+    for (auto& measurement : mMeasurement.measurements) {
+        measurement.size = sizeof(measurement);
+    }
+}
+
+int GnssTraceReader::next(int64_t *boottimeUs)
+{
+    const uint8_t *end = mData.data() + mData.size();
+
+    while (!mTruncated && mOffset < mData.size()) {
+        const uint8_t *p = mData.data() + mOffset;
+        uint8_t type = *p++;
+        uint64_t deltaUs, length, count;
+        bool ok = true;
+
+        if (!getVarint(&p, end, &deltaUs) || !getVarint(&p, end, &length) ||
+                length > static_cast<uint64_t>(end - p)) {
+            mTruncated = true;
+            break;
+        }
+
+        const uint8_t *payloadEnd = p + length;
+        mOffset = payloadEnd - mData.data();
+        mTimeUs += deltaUs;
+
+        switch (type) {
+            case GNSS_TRACE_LOCATION:
+                ok = decodeFields(kLocationFields, COUNT(kLocationFields), &p, payloadEnd,
+                        &mLocation);
+                break;
+
+            case GNSS_TRACE_SV_STATUS:
+                ok = getVarint(&p, payloadEnd, &count) && count <= GNSS_MAX_SVS;
+                for (size_t i = 0; ok && i < count; i++) {
+                    ok = decodeFields(kSvFields, COUNT(kSvFields), &p, payloadEnd,
+                            &mSvStatus.gnss_sv_list[i]);
+                }
+                mSvStatus.num_svs = ok ? count : 0;
+                break;
+
+            case GNSS_TRACE_MEASUREMENT:
+                ok = decodeFields(kClockFields, COUNT(kClockFields), &p, payloadEnd,
+                        &mMeasurement.clock) &&
+                        getVarint(&p, payloadEnd, &count) && count <= GNSS_MAX_MEASUREMENT;
+                for (size_t i = 0; ok && i < count; i++) {
+                    ok = decodeFields(kMeasurementFields, COUNT(kMeasurementFields), &p,
+                            payloadEnd, &mMeasurement.measurements[i]);
+                }
+                mMeasurement.measurement_count = ok ? count : 0;
+                break;
+
+            case GNSS_TRACE_NMEA:
+                ok = decodeFields(kNmeaFields, COUNT(kNmeaFields), &p, payloadEnd,
+                        &mNmeaTimestamp);
+                if (ok) {
+                    mNmea.assign(reinterpret_cast<const char *>(p), payloadEnd - p);
+                }
+                break;
+
+            default:
+                /* Written by a newer recorder */
+                continue;
+        }
+
+        if (!ok) {
+            mTruncated = true;
+            break;
+        }
+        if (boottimeUs != NULL) {
+            *boottimeUs = mTimeUs;
+        }
+        return type;
+    }
+
+    return 0;
+}
+
+} // namespace android
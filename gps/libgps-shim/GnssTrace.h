@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_GNSS_TRACE_H
+#define GPS_SHIM_GNSS_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Binary trace of what a gps.h HAL reported, for replay on the host.
+ *
+ *   file     "GTRC" <version: u8> <record>*
+ *   record   <type: u8> <time: varint> <length: varint> <payload: length bytes>
+ *
+ * "time" is microseconds of CLOCK_BOOTTIME since the previous record, the
+ * first record counting from 0. Readers skip types they do not know.
+ *
+ * Payloads are structs written field by field in declaration order, each
+ * field a varint against the same field of the previous record of that
+ * type: integers as the zigzag encoded difference, floats as the XOR of
+ * their bits, so that an unchanged field takes one byte and nothing is
+ * rounded. Array entries are compared with the entry at the same index,
+ * which vendors keep stable from epoch to epoch. The "size" members are
+ * not stored.
+ *
+ *   TYPE_LOCATION     GpsLocation
+ *   TYPE_SV_STATUS    <num_svs: varint> GnssSvInfo*
+ *   TYPE_MEASUREMENT  GnssClock <measurement_count: varint> GnssMeasurement*
+ *   TYPE_NMEA         <timestamp: GpsUtcTime field> <sentence: rest of payload>
+ */
+enum GnssTraceType : uint8_t {
+    GNSS_TRACE_LOCATION = 1,
+    GNSS_TRACE_SV_STATUS = 2,
+    GNSS_TRACE_MEASUREMENT = 3,
+    GNSS_TRACE_NMEA = 4,
+};
+
+/*
+ * Not thread safe. Records are buffered and written out in blocks; a
+ * record cut short by a crash is dropped by the reader.
+ */
+class GnssTraceWriter {
+public:
+    GnssTraceWriter();
+    ~GnssTraceWriter();
+
+    /* Truncates "path" and writes the file header. */
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return mFd >= 0; }
+
+    void writeLocation(int64_t boottimeNs, const GpsLocation& location);
+    void writeSvStatus(int64_t boottimeNs, const GnssSvStatus& status);
+    void writeMeasurement(int64_t boottimeNs, const GnssData& data);
+    void writeNmea(int64_t boottimeNs, GpsUtcTime timestamp, const char *nmea, size_t length);
+
+    bool flush();
+
+    uint64_t records() const { return mRecords; }
+    /* Encoded bytes, including what is still buffered */
+    uint64_t bytes() const { return mBytes; }
+
+private:
+    void beginRecord(GnssTraceType type, int64_t boottimeNs);
+    void endRecord();
+
+    int mFd;
+    int64_t mLastUs;
+    size_t mRecordStart;
+    std::vector<uint8_t> mBuffer;
+    std::vector<uint8_t> mPayload;
+    uint64_t mRecords;
+    uint64_t mBytes;
+
+    GpsLocation mLocation;
+    GnssSvStatus mSvStatus;
+    GnssData mMeasurement;
+    GpsUtcTime mNmeaTimestamp;
+};
+
+/*
+ * Not thread safe. Decodes in place: the record returned by next() is
+ * valid until the next call.
+ */
+class GnssTraceReader {
+public:
+    GnssTraceReader();
+
+    /* Reads the whole of "path", or takes an encoded trace already in memory. */
+    bool open(const char *path);
+    bool open(std::vector<uint8_t> data);
+
+    /* Back to the first record */
+    void rewind();
+
+    /*
+     * Decodes the next record and returns its type, or 0 at the end of the
+     * trace. "boottimeUs" is when it was recorded, in CLOCK_BOOTTIME.
+     */
+    int next(int64_t *boottimeUs);
+
+    const GpsLocation& location() const { return mLocation; }
+    const GnssSvStatus& svStatus() const { return mSvStatus; }
+    const GnssData& measurement() const { return mMeasurement; }
+    GpsUtcTime nmeaTimestamp() const { return mNmeaTimestamp; }
+    const std::string& nmea() const { return mNmea; }
+
+    /* Records cut short or not decodable, which end the trace */
+    bool truncated() const { return mTruncated; }
+
+private:
+    std::vector<uint8_t> mData;
+    size_t mOffset;
+    int64_t mTimeUs;
+    bool mTruncated;
+
+    GpsLocation mLocation;
+    GnssSvStatus mSvStatus;
+    GnssData mMeasurement;
+    GpsUtcTime mNmeaTimestamp;
+    std::string mNmea;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_GNSS_TRACE_H
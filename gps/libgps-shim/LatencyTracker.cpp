@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "LatencyTracker.h"
+
+namespace android {
+
+#define NS_PER_MS 1000000LL
+
+static const char *const kStageNames[LatencyTracker::STAGE_COUNT] = {
+    "chip", "shim", "framework", "total",
+};
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::clear()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mNegative = 0;
+    mMin = 0;
+    mMax = 0;
+    mSum = 0;
+}
+
+int LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns < (1u << kSubBits)) {
+        return static_cast<int>(ns);
+    }
+
+    int exponent = 63 - __builtin_clzll(ns);
+    int sub = (ns >> (exponent - kSubBits)) & ((1 << kSubBits) - 1);
+    return ((exponent - kSubBits + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::upperBound(int bucket)
+{
+    if (bucket < (1 << kSubBits)) {
+        return bucket;
+    }
+
+    int shift = (bucket >> kSubBits) - 1;
+    uint64_t lower = static_cast<uint64_t>((1 << kSubBits) + (bucket & ((1 << kSubBits) - 1)))
+            << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+    if (ns < 0) {
+        mNegative++;
+        ns = 0;
+    }
+
+    mBuckets[bucketOf(ns)]++;
+    if (mCount == 0 || ns < mMin) {
+        mMin = ns;
+    }
+    if (mCount == 0 || ns > mMax) {
+        mMax = ns;
+    }
+    mSum += ns;
+    mCount++;
+}
+
+int64_t LatencyHistogram::percentile(double percent) const
+{
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * mCount + 0.5);
+    uint64_t seen = 0;
+
+    if (mCount == 0) {
+        return 0;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (int i = 0; i < kBuckets; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            int64_t bound = upperBound(i);
+            return bound < mMax ? bound : mMax;
+        }
+    }
+    return mMax;
+}
+
+LatencyTracker::LatencyTracker(size_t maxPending)
+    : mPending(maxPending > 0 ? maxPending : 1),
+      mPendingHead(0),
+      mPendingSize(0),
+      mRecent(),
+      mRecentCount(0),
+      mUnmatched(0),
+      mForeignThread(0)
+{
+}
+
+void LatencyTracker::received(GpsUtcTime timestamp, int64_t realtimeNs, int64_t boottimeNs,
+        bool onHalThread)
+{
+    if (!onHalThread) {
+        mForeignThread++;
+    }
+
+    mHistograms[STAGE_CHIP].record(realtimeNs - timestamp * NS_PER_MS);
+
+    /* Full means the oldest was never dispatched */
+    if (mPendingSize == mPending.size()) {
+        mPendingHead = (mPendingHead + 1) % mPending.size();
+        mPendingSize--;
+        mUnmatched++;
+    }
+    mPending[(mPendingHead + mPendingSize) % mPending.size()] =
+            { timestamp, realtimeNs, boottimeNs };
+    mPendingSize++;
+}
+
+void LatencyTracker::delivered(GpsUtcTime timestamp, int64_t dispatchNs, int64_t returnNs)
+{
+    while (mPendingSize > 0) {
+        Pending p = mPending[mPendingHead];
+        mPendingHead = (mPendingHead + 1) % mPending.size();
+        mPendingSize--;
+
+        if (p.timestamp != timestamp) {
+            mUnmatched++;
+            continue;
+        }
+
+        int64_t returnRealtimeNs = p.realtimeNs + (returnNs - p.boottimeNs);
+        mHistograms[STAGE_SHIM].record(dispatchNs - p.boottimeNs);
+        mHistograms[STAGE_FRAMEWORK].record(returnNs - dispatchNs);
+        mHistograms[STAGE_TOTAL].record(returnRealtimeNs - timestamp * NS_PER_MS);
+
+        mRecent[mRecentCount % kRecent] = { timestamp, returnRealtimeNs };
+        mRecentCount++;
+        return;
+    }
+
+    /* Not seen on the way in, e.g. a fix from before a restart */
+    mUnmatched++;
+}
+
+static void append(char *buffer, size_t size, size_t *length, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    if (*length + 1 >= size) {
+        return;
+    }
+
+    va_start(args, format);
+    n = vsnprintf(buffer + *length, size - *length, format, args);
+    va_end(args);
+
+    if (n > 0) {
+        *length += static_cast<size_t>(n) < size - *length ? n : size - *length - 1;
+    }
+}
+
+static double toMs(int64_t ns)
+{
+    return ns / static_cast<double>(NS_PER_MS);
+}
+
+size_t LatencyTracker::dump(char *buffer, size_t size) const
+{
+    size_t length = 0;
+
+    if (buffer == NULL || size == 0) {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    append(buffer, size, &length, "GpsLocation latency (ms): count mean p50 p90 p99 max\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& h = mHistograms[i];
+        append(buffer, size, &length, "  %-9s %7" PRIu64 " %9.3f %9.3f %9.3f %9.3f %9.3f",
+                kStageNames[i], h.count(), toMs(h.mean()), toMs(h.percentile(50)),
+                toMs(h.percentile(90)), toMs(h.percentile(99)), toMs(h.max()));
+        if (h.negative() > 0) {
+            append(buffer, size, &length, " (%" PRIu64 " negative)", h.negative());
+        }
+        append(buffer, size, &length, "\n");
+    }
+    append(buffer, size, &length, "  unmatched %" PRIu64 ", off HAL threads %" PRIu64 "\n",
+            mUnmatched, mForeignThread);
+
+    size_t recent = mRecentCount < kRecent ? mRecentCount : kRecent;
+    append(buffer, size, &length, "Last delivered: fix time -> wall clock at delivery (ms)\n");
+    for (size_t i = 0; i < recent; i++) {
+        const Delivered& d = mRecent[(mRecentCount - recent + i) % kRecent];
+        append(buffer, size, &length, "  %" PRId64 " -> %" PRId64 "\n", d.timestamp,
+                d.realtimeNs / NS_PER_MS);
+    }
+
+    return length;
+}
+
+} // namespace android
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_LATENCY_TRACKER_H
+#define GPS_SHIM_LATENCY_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Log-linear histogram of nanosecond latencies: 8 buckets per power of
+ * two, so any percentile is off by at most 12.5%, in 2 KiB.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t ns);
+    void clear();
+
+    uint64_t count() const { return mCount; }
+    int64_t min() const { return mCount > 0 ? mMin : 0; }
+    int64_t max() const { return mCount > 0 ? mMax : 0; }
+    int64_t mean() const { return mCount > 0 ? static_cast<int64_t>(mSum / mCount) : 0; }
+    /* Values below zero, counted as zero; a clock stepped between two stamps */
+    uint64_t negative() const { return mNegative; }
+
+    /* Upper bound of the bucket holding the "percent" percentile. */
+    int64_t percentile(double percent) const;
+
+private:
+    static const int kSubBits = 3;
+    static const int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    static int bucketOf(uint64_t ns);
+    static uint64_t upperBound(int bucket);
+
+    uint32_t mBuckets[kBuckets];
+    uint64_t mCount;
+    uint64_t mNegative;
+    int64_t mMin;
+    int64_t mMax;
+    double mSum;                /* a clock off by months overflows int64 nanoseconds */
+};
+
+/*
+ * Where a GpsLocation spends its time between the chip and the framework:
+ *
+ *   chip       fix time (GpsUtcTime) to the vendor calling location_cb
+ *   shim       location_cb entry to dispatch to the framework, which
+ *              includes the time spent in a screen off batch
+ *   framework  the framework's location_cb, i.e. the hop into
+ *              system_server
+ *   total      fix time to the framework's location_cb returning
+ *
+ * A fix is matched from entry to dispatch by its GpsUtcTime. Fixes leave
+ * in the order they came in, so pending ones sit in a FIFO ring and a fix
+ * that never got dispatched is dropped once a later one is.
+ *
+ * Apps are out of reach of the HAL. The last delivered fixes are kept
+ * with their GpsUtcTime, which apps see as Location.getTime(), and the
+ * wall clock at delivery, so app side logs can be joined against them.
+ *
+ * Not thread safe.
+ */
+class LatencyTracker {
+public:
+    enum Stage {
+        STAGE_CHIP,
+        STAGE_SHIM,
+        STAGE_FRAMEWORK,
+        STAGE_TOTAL,
+        STAGE_COUNT,
+    };
+
+    explicit LatencyTracker(size_t maxPending);
+
+    /* The vendor called location_cb; "onHalThread" if from a create_thread_cb thread. */
+    void received(GpsUtcTime timestamp, int64_t realtimeNs, int64_t boottimeNs,
+            bool onHalThread);
+
+    /* The framework's location_cb was called at "dispatchNs" and returned at "returnNs". */
+    void delivered(GpsUtcTime timestamp, int64_t dispatchNs, int64_t returnNs);
+
+    const LatencyHistogram& histogram(Stage stage) const { return mHistograms[stage]; }
+    uint64_t unmatched() const { return mUnmatched; }
+    uint64_t foreignThread() const { return mForeignThread; }
+
+    /*
+     * Writes a human readable report into "buffer", always NUL terminated,
+     * and returns the length written, as GpsDebugInterface wants it.
+     */
+    size_t dump(char *buffer, size_t size) const;
+
+private:
+    struct Pending {
+        GpsUtcTime timestamp;
+        int64_t realtimeNs;     /* at entry */
+        int64_t boottimeNs;     /* at entry */
+    };
+
+    struct Delivered {
+        GpsUtcTime timestamp;
+        int64_t realtimeNs;     /* at return from the framework */
+    };
+
+    static const size_t kRecent = 8;
+
+    LatencyHistogram mHistograms[STAGE_COUNT];
+
+    std::vector<Pending> mPending;
+    size_t mPendingHead;
+    size_t mPendingSize;
+
+    Delivered mRecent[kRecent];
+    size_t mRecentCount;
+
+    uint64_t mUnmatched;
+    uint64_t mForeignThread;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_LATENCY_TRACKER_H
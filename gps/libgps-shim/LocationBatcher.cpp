@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "LocationBatcher.h"
+
+namespace android {
+
+static const int64_t kFullCircle = 3600000000LL;    /* 360 degrees in 1e-7 */
+
+static bool fits(int64_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+/* Longitudes wrap at the antimeridian; keep them in [-180, 180) */
+static int64_t wrapLongitude(int64_t value)
+{
+    value %= kFullCircle;
+    if (value >= kFullCircle / 2) {
+        value -= kFullCircle;
+    } else if (value < -kFullCircle / 2) {
+        value += kFullCircle;
+    }
+    return value;
+}
+
+LocationBatcher::LocationBatcher(size_t capacity)
+    : mRecords(capacity > 0 ? capacity : 1),
+      mHead(0),
+      mSize(0),
+      mBase(),
+      mLast(),
+      mEvicted(0)
+{
+}
+
+uint8_t LocationBatcher::quantizeAccuracy(float meters)
+{
+    if (!(meters > 0)) {
+        return 0;
+    }
+    if (meters < 64) {
+        long halves = lroundf(meters * 2);
+        return static_cast<uint8_t>(halves < 127 ? halves : 127);
+    }
+    long steps = lroundf((meters - 64) / 8);
+    return static_cast<uint8_t>(128 + (steps < 127 ? steps : 127));
+}
+
+float LocationBatcher::accuracyOf(uint8_t quantized)
+{
+    return quantized < 128 ? quantized / 2.0f : 64.0f + (quantized - 128) * 8.0f;
+}
+
+LocationBatcher::Absolute LocationBatcher::toAbsolute(const GpsLocation& fix)
+{
+    Absolute a;
+
+    a.latitude = llround(fix.latitude * 1e7);
+    a.longitude = wrapLongitude(llround(fix.longitude * 1e7));
+    a.altitude = llround(fix.altitude * 100);
+    a.timeMs = fix.timestamp;
+    return a;
+}
+
+bool LocationBatcher::delta(const Absolute& from, const Absolute& to, Record *out)
+{
+    int64_t latitude = to.latitude - from.latitude;
+    int64_t longitude = wrapLongitude(to.longitude - from.longitude);
+    int64_t altitude = to.altitude - from.altitude;
+    int64_t time = to.timeMs - from.timeMs;
+
+    if (!fits(latitude) || !fits(longitude) || !fits(altitude) || !fits(time)) {
+        return false;
+    }
+
+    out->latitude = static_cast<int32_t>(latitude);
+    out->longitude = static_cast<int32_t>(longitude);
+    out->altitude = static_cast<int32_t>(altitude);
+    out->time = static_cast<int32_t>(time);
+    return true;
+}
+
+void LocationBatcher::apply(Absolute *base, const Record& record)
+{
+    base->latitude += record.latitude;
+    base->longitude = wrapLongitude(base->longitude + record.longitude);
+    base->altitude += record.altitude;
+    base->timeMs += record.time;
+}
+
+void LocationBatcher::decode(const Absolute& absolute, const Record& record, GpsLocation *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->size = sizeof(*out);
+    out->flags = record.flags;
+    out->latitude = absolute.latitude / 1e7;
+    out->longitude = absolute.longitude / 1e7;
+    out->altitude = absolute.altitude / 100.0;
+    out->speed = record.speed / 100.0f;
+    out->bearing = record.bearing * (360.0f / 65536.0f);
+    out->accuracy = accuracyOf(record.accuracy);
+    out->timestamp = absolute.timeMs;
+}
+
+bool LocationBatcher::add(const GpsLocation& fix)
+{
+    size_t capacity = mRecords.size();
+    Absolute absolute = toAbsolute(fix);
+    Record record;
+
+    /* Only the time delta can realistically overflow, after a gap of 24 days */
+    if (mSize > 0 && !delta(mLast, absolute, &record)) {
+        return false;
+    }
+
+    if (mSize == capacity) {
+        /* The next record becomes the oldest, fold its deltas into the base */
+        mHead = (mHead + 1) % capacity;
+        mSize--;
+        mEvicted++;
+        if (mSize > 0) {
+            apply(&mBase, mRecords[mHead]);
+        }
+    }
+
+    if (mSize == 0) {
+        mBase = absolute;
+        delta(absolute, absolute, &record);
+    }
+    mLast = absolute;
+
+    float bearing = fmodf(fix.bearing, 360.0f);
+    if (bearing < 0) {
+        bearing += 360.0f;
+    }
+    long speed = lroundf(fix.speed * 100);
+
+    record.speed = static_cast<uint16_t>(speed < 0 ? 0 : speed > UINT16_MAX ? UINT16_MAX : speed);
+    record.bearing = static_cast<uint16_t>(lroundf(bearing * (65536.0f / 360.0f)) & 0xffff);
+    record.accuracy = quantizeAccuracy(fix.accuracy);
+    record.flags = static_cast<uint8_t>(fix.flags);
+
+    mRecords[(mHead + mSize) % capacity] = record;
+    mSize++;
+    return true;
+}
+
+void LocationBatcher::drain(std::vector<GpsLocation> *out)
+{
+    size_t capacity = mRecords.size();
+    Absolute absolute = mBase;
+
+    out->resize(mSize);
+    for (size_t i = 0; i < mSize; i++) {
+        const Record& record = mRecords[(mHead + i) % capacity];
+        if (i > 0) {
+            apply(&absolute, record);
+        }
+        decode(absolute, record, &(*out)[i]);
+    }
+
+    mHead = 0;
+    mSize = 0;
+}
+
+} // namespace android
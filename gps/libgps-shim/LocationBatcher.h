@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_LOCATION_BATCHER_H
+#define GPS_SHIM_LOCATION_BATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Ring of GpsLocation fixes held back while nobody is looking at them.
+ * Each fix is stored as int32 deltas against the one before it (1e-7
+ * degrees, centimetres, milliseconds) plus absolute speed, bearing and a
+ * quantized accuracy: 24 bytes instead of 64. The absolute values of the
+ * oldest fix are kept on the side, so evicting it when the ring is full
+ * just folds its successor's deltas in.
+ *
+ * Not thread safe.
+ */
+class LocationBatcher {
+public:
+    explicit LocationBatcher(size_t capacity);
+
+    /*
+     * Evicts the oldest fix if full. Returns false, storing nothing, if
+     * the fix is too far from the previous one for 32-bit deltas; drain()
+     * and add it again.
+     */
+    bool add(const GpsLocation& fix);
+
+    /* Decodes the stored fixes, oldest first, into "out" and empties the ring. */
+    void drain(std::vector<GpsLocation> *out);
+
+    size_t size() const { return mSize; }
+    size_t capacity() const { return mRecords.size(); }
+
+    /* Timestamp of the oldest stored fix, 0 when empty. */
+    GpsUtcTime oldestTimestamp() const { return mSize > 0 ? mBase.timeMs : 0; }
+
+    uint64_t evicted() const { return mEvicted; }
+
+    /* Bytes used by the ring itself. */
+    size_t footprint() const { return mRecords.size() * sizeof(Record); }
+
+    /* 0.5 m steps up to 64 m, 8 m steps up to 1080 m. */
+    static uint8_t quantizeAccuracy(float meters);
+    static float accuracyOf(uint8_t quantized);
+
+private:
+    struct Record {
+        int32_t latitude;       /* delta, 1e-7 degrees */
+        int32_t longitude;      /* delta, 1e-7 degrees */
+        int32_t altitude;       /* delta, centimetres */
+        int32_t time;           /* delta, milliseconds */
+        uint16_t speed;         /* cm/s */
+        uint16_t bearing;       /* 360/65536 degrees */
+        uint8_t accuracy;
+        uint8_t flags;
+    };
+
+    struct Absolute {
+        int64_t latitude;
+        int64_t longitude;
+        int64_t altitude;
+        int64_t timeMs;
+    };
+
+    static Absolute toAbsolute(const GpsLocation& fix);
+    static bool delta(const Absolute& from, const Absolute& to, Record *out);
+    static void apply(Absolute *base, const Record& record);
+    static void decode(const Absolute& absolute, const Record& record, GpsLocation *out);
+
+    std::vector<Record> mRecords;
+    size_t mHead;           /* index of the oldest record */
+    size_t mSize;
+    Absolute mBase;         /* absolute values of the oldest record */
+    Absolute mLast;         /* absolute values of the newest record */
+    uint64_t mEvicted;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_LOCATION_BATCHER_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "MeasurementRing.h"
+
+namespace android {
+
+MeasurementRing::MeasurementRing(size_t capacity, Policy policy)
+    : mCapacity(capacity > 0 ? capacity : 1),
+      mPolicy(policy),
+      mSlots(new Slot[mCapacity]),
+      mHead(0),
+      mTail(0),
+      mPushed(0),
+      mDelivered(0),
+      mDropped(0),
+      mOverwritten(0)
+{
+    for (size_t i = 0; i < mCapacity; i++) {
+        mSlots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+void MeasurementRing::copyEpoch(GnssData *dst, const GnssData& src)
+{
+    size_t max = GNSS_MAX_MEASUREMENT;
+    size_t count = src.measurement_count < max ? src.measurement_count : max;
+
+    dst->size = src.size;
+    dst->measurement_count = count;
+    memcpy(dst->measurements, src.measurements, count * sizeof(src.measurements[0]));
+    dst->clock = src.clock;
+}
+
+bool MeasurementRing::push(const GnssData& data, int64_t timeNs)
+{
+    uint64_t head = mHead.load(std::memory_order_relaxed);
+
+    mPushed.fetch_add(1, std::memory_order_relaxed);
+    if (mPolicy == KEEP_OLDEST && head - mTail.load(std::memory_order_acquire) >= mCapacity) {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot& slot = mSlots[head % mCapacity];
+    slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timeNs = timeNs;
+    copyEpoch(&slot.data, data);
+    slot.sequence.store(2 * head + 2, std::memory_order_release);
+
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+size_t MeasurementRing::pop(GnssData *out, size_t max, int64_t *timesNs)
+{
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+    uint64_t head = mHead.load(std::memory_order_acquire);
+    size_t n = 0;
+
+    while (n < max && tail < head) {
+        if (head - tail > mCapacity) {
+            mOverwritten.fetch_add(head - mCapacity - tail, std::memory_order_relaxed);
+            tail = head - mCapacity;
+        }
+
+        /* A completed epoch only changes its sequence by being overwritten */
+        Slot& slot = mSlots[tail % mCapacity];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence == 2 * tail + 2) {
+            copyEpoch(&out[n], slot.data);
+            if (timesNs != NULL) {
+                timesNs[n] = slot.timeNs;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                n++;
+            } else {
+                mOverwritten.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            mOverwritten.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        tail++;
+        head = mHead.load(std::memory_order_acquire);
+    }
+
+    mTail.store(tail, std::memory_order_release);
+    mDelivered.fetch_add(n, std::memory_order_relaxed);
+    return n;
+}
+
+size_t MeasurementRing::pending() const
+{
+    uint64_t tail = mTail.load(std::memory_order_acquire);
+    uint64_t head = mHead.load(std::memory_order_acquire);
+
+    return head - tail > mCapacity ? mCapacity : head - tail;
+}
+
+} // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_MEASUREMENT_RING_H
+#define GPS_SHIM_MEASUREMENT_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * Single producer, single consumer ring of GnssData epochs between the HAL
+ * callback and the thread that delivers them to the framework. Neither side
+ * takes a lock and push() never waits: when the ring is full the policy
+ * decides which epoch is lost.
+ *
+ * Every slot carries a sequence number (odd while being written) so that
+ * with KEEP_NEWEST the producer can overwrite a slot the consumer is
+ * copying; the consumer notices and counts the epoch as overrun.
+ */
+class MeasurementRing {
+public:
+    enum Policy {
+        KEEP_OLDEST,    /* drop incoming epochs while full */
+        KEEP_NEWEST,    /* overwrite the oldest epoch */
+    };
+
+    MeasurementRing(size_t capacity, Policy policy);
+
+    /*
+     * Producer side. "timeNs" travels with the epoch, e.g. when it arrived.
+     * Returns false if the epoch was dropped.
+     */
+    bool push(const GnssData& data, int64_t timeNs = 0);
+
+    /* Consumer side: copies up to "max" epochs, oldest first, and their times if asked. */
+    size_t pop(GnssData *out, size_t max, int64_t *timesNs = NULL);
+
+    /* Epochs waiting, as seen by the consumer. */
+    size_t pending() const;
+
+    size_t capacity() const { return mCapacity; }
+    Policy policy() const { return mPolicy; }
+
+    /* Epochs offered to push(), including dropped ones. */
+    uint64_t pushed() const { return mPushed.load(std::memory_order_relaxed); }
+    uint64_t delivered() const { return mDelivered.load(std::memory_order_relaxed); }
+
+    /* Epochs lost to a full ring, either dropped on push or overwritten. */
+    uint64_t overruns() const {
+        return mDropped.load(std::memory_order_relaxed) +
+                mOverwritten.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        int64_t timeNs;
+        GnssData data;
+    };
+
+    /* Copies the header, clock and the measurements actually in use. */
+    static void copyEpoch(GnssData *dst, const GnssData& src);
+
+    const size_t mCapacity;
+    const Policy mPolicy;
+    std::unique_ptr<Slot[]> mSlots;
+
+    alignas(64) std::atomic<uint64_t> mHead;    /* next epoch to write */
+    alignas(64) std::atomic<uint64_t> mTail;    /* next epoch to read */
+
+    std::atomic<uint64_t> mPushed;
+    std::atomic<uint64_t> mDelivered;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<uint64_t> mOverwritten;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_MEASUREMENT_RING_H
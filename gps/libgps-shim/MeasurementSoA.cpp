@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "MeasurementSoA.h"
+
+namespace android {
+
+typedef double f64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+/*
+ * Runs "predicate" over the first "count" entries of a column, one native
+ * vector at a time, and packs the lane results into a bitmask. Lanes are
+ * all ones or zero after a comparison, so AND-ing them with a per-lane bit
+ * and OR-ing into an accumulator builds the mask without leaving the
+ * vector registers; the lanes are only combined once at the end.
+ */
+template <typename Predicate>
+static inline uint64_t maskOf(const double *column, size_t count, Predicate predicate)
+{
+    const f64x2 *v = reinterpret_cast<const f64x2 *>(column);
+    u64x2 bit = { 1, 2 };
+    u64x2 acc = { 0, 0 };
+
+    for (size_t i = 0; i < (count + 1) / 2; i++) {
+        acc |= reinterpret_cast<u64x2>(predicate(v[i])) & bit;
+        bit <<= 2;
+    }
+    return acc[0] | acc[1];
+}
+
+/* As above for 32-bit columns; the lane bits only reach 32 lanes per pass. */
+template <typename Predicate>
+static inline uint64_t maskOf(const uint32_t *column, size_t count, Predicate predicate)
+{
+    const u32x4 *v = reinterpret_cast<const u32x4 *>(column);
+    uint64_t mask = 0;
+
+    for (size_t base = 0; base < count; base += 32) {
+        size_t end = count < base + 32 ? count : base + 32;
+        u32x4 bit = { 1, 2, 4, 8 };
+        u32x4 acc = { 0, 0, 0, 0 };
+
+        for (size_t i = base / 4; i < (end + 3) / 4; i++) {
+            acc |= reinterpret_cast<u32x4>(predicate(v[i])) & bit;
+            bit <<= 4;
+        }
+        mask |= static_cast<uint64_t>(acc[0] | acc[1] | acc[2] | acc[3]) << base;
+    }
+    return mask;
+}
+
+static inline uint64_t lowBits(size_t count)
+{
+    return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+}
+
+MeasurementSoA::MeasurementSoA()
+{
+    GnssData empty;
+
+    memset(&empty, 0, sizeof(empty));
+    load(empty);
+}
+
+void MeasurementSoA::load(const GnssData& data)
+{
+    size_t count = data.measurement_count < kCapacity ? data.measurement_count : kCapacity;
+
+    mCount = count;
+    mPresent = lowBits(count);
+    mHasSnr = 0;
+    mHasCarrierFrequency = 0;
+    mHasCarrierPhase = 0;
+    mUsedInFix = 0;
+    mClock = data.clock;
+
+    for (size_t i = 0; i < count; i++) {
+        const GnssMeasurement& m = data.measurements[i];
+
+        svid[i] = m.svid;
+        constellation[i] = m.constellation;
+        state[i] = m.state;
+        adrState[i] = m.accumulated_delta_range_state;
+        receivedSvTimeNs[i] = m.received_sv_time_in_ns;
+        receivedSvTimeUncertaintyNs[i] = m.received_sv_time_uncertainty_in_ns;
+        timeOffsetNs[i] = m.time_offset_ns;
+        cn0DbHz[i] = m.c_n0_dbhz;
+        pseudorangeRateMps[i] = m.pseudorange_rate_mps;
+        pseudorangeRateUncertaintyMps[i] = m.pseudorange_rate_uncertainty_mps;
+        adrM[i] = m.accumulated_delta_range_m;
+        adrUncertaintyM[i] = m.accumulated_delta_range_uncertainty_m;
+        carrierFrequencyHz[i] = m.carrier_frequency_hz;
+        snrDb[i] = m.snr_db;
+
+        mHasSnr |= static_cast<uint64_t>((m.flags & GNSS_MEASUREMENT_HAS_SNR) != 0) << i;
+        mHasCarrierFrequency |= static_cast<uint64_t>(
+                (m.flags & GNSS_MEASUREMENT_HAS_CARRIER_FREQUENCY) != 0) << i;
+        mHasCarrierPhase |= static_cast<uint64_t>(
+                (m.flags & GNSS_MEASUREMENT_HAS_CARRIER_PHASE) != 0) << i;
+    }
+
+    /* Zero the tails so that whole vectors can be read past count() */
+    size_t tail = kCapacity - count;
+    memset(svid + count, 0, tail * sizeof(svid[0]));
+    memset(constellation + count, 0, tail * sizeof(constellation[0]));
+    memset(state + count, 0, tail * sizeof(state[0]));
+    memset(adrState + count, 0, tail * sizeof(adrState[0]));
+    memset(receivedSvTimeNs + count, 0, tail * sizeof(receivedSvTimeNs[0]));
+    memset(receivedSvTimeUncertaintyNs + count, 0, tail * sizeof(receivedSvTimeUncertaintyNs[0]));
+    memset(timeOffsetNs + count, 0, tail * sizeof(timeOffsetNs[0]));
+    memset(cn0DbHz + count, 0, tail * sizeof(cn0DbHz[0]));
+    memset(pseudorangeRateMps + count, 0, tail * sizeof(pseudorangeRateMps[0]));
+    memset(pseudorangeRateUncertaintyMps + count, 0,
+            tail * sizeof(pseudorangeRateUncertaintyMps[0]));
+    memset(adrM + count, 0, tail * sizeof(adrM[0]));
+    memset(adrUncertaintyM + count, 0, tail * sizeof(adrUncertaintyM[0]));
+    memset(carrierFrequencyHz + count, 0, tail * sizeof(carrierFrequencyHz[0]));
+    memset(snrDb + count, 0, tail * sizeof(snrDb[0]));
+}
+
+void MeasurementSoA::markUsedInFix(const GnssSvStatus& status)
+{
+    int svs = status.num_svs < GNSS_MAX_SVS ? status.num_svs : GNSS_MAX_SVS;
+    alignas(16) uint32_t keys[kCapacity] = {};
+
+    /* (constellation, svid) folded into one 32-bit key per measurement */
+    for (size_t i = 0; i < mCount; i++) {
+        keys[i] = constellation[i] << 16 | static_cast<uint16_t>(svid[i]);
+    }
+
+    mUsedInFix = 0;
+    for (int n = 0; n < svs; n++) {
+        const GnssSvInfo& info = status.gnss_sv_list[n];
+        uint32_t key = static_cast<uint32_t>(info.constellation) << 16 |
+                static_cast<uint16_t>(info.svid);
+
+        if (info.flags & GNSS_SV_FLAGS_USED_IN_FIX) {
+            mUsedInFix |= maskOf(keys, mCount, [key](const u32x4& v) { return v == key; });
+        }
+    }
+
+    mUsedInFix &= mPresent;
+}
+
+uint64_t MeasurementSoA::cn0AtLeast(double dbHz) const
+{
+    return maskOf(cn0DbHz, mCount, [dbHz](const f64x2& v) { return v >= dbHz; }) & mPresent;
+}
+
+uint64_t MeasurementSoA::stateHas(uint32_t required) const
+{
+    return maskOf(state, mCount, [required](const u32x4& v) {
+        return (v & required) == required;
+    }) & mPresent;
+}
+
+uint64_t MeasurementSoA::adrUsable() const
+{
+    const uint32_t valid = GNSS_ADR_STATE_VALID;
+    const uint32_t bad = GNSS_ADR_STATE_RESET | GNSS_ADR_STATE_CYCLE_SLIP;
+
+    return maskOf(adrState, mCount, [valid, bad](const u32x4& v) {
+        return (v & (valid | bad)) == valid;
+    }) & mPresent;
+}
+
+uint64_t MeasurementSoA::constellationIs(GnssConstellationType type) const
+{
+    uint32_t wanted = type;
+
+    return maskOf(constellation, mCount, [wanted](const u32x4& v) {
+        return v == wanted;
+    }) & mPresent;
+}
+
+size_t MeasurementSoA::gather(uint64_t mask, const double *column, double *out)
+{
+    size_t n = 0;
+
+    for (; mask != 0; mask &= mask - 1) {
+        out[n++] = column[__builtin_ctzll(mask)];
+    }
+    return n;
+}
+
+} // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_MEASUREMENT_SOA_H
+#define GPS_SHIM_MEASUREMENT_SOA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * One GnssData epoch transposed into per-field columns, for positioning
+ * code that walks a single field across all satellites. GNSS_MAX_MEASUREMENT
+ * is 64, so every per-measurement predicate fits in a uint64_t with bit i
+ * standing for measurement i; filters return such masks and combine with
+ * plain & and |.
+ *
+ * Columns are 64 byte aligned and zero past count(). The filters work on
+ * 128-bit vectors through compiler vector extensions, which map to NEON on
+ * arm and SSE2 on the host, and only cover the first count() entries.
+ */
+class MeasurementSoA {
+public:
+    static const size_t kCapacity = 64;
+
+    MeasurementSoA();
+
+    void load(const GnssData& data);
+
+    /* Sets usedInFix() from the GNSS_SV_FLAGS_USED_IN_FIX bits of an SV report. */
+    void markUsedInFix(const GnssSvStatus& status);
+
+    size_t count() const { return mCount; }
+    const GnssClock& clock() const { return mClock; }
+
+    /* Bit i set for every loaded measurement. */
+    uint64_t present() const { return mPresent; }
+
+    /* Validity masks derived from GnssMeasurementFlags. */
+    uint64_t hasSnr() const { return mHasSnr; }
+    uint64_t hasCarrierFrequency() const { return mHasCarrierFrequency; }
+    uint64_t hasCarrierPhase() const { return mHasCarrierPhase; }
+    uint64_t usedInFix() const { return mUsedInFix; }
+
+    uint64_t cn0AtLeast(double dbHz) const;
+
+    /* Measurements whose state has every bit of "required". */
+    uint64_t stateHas(uint32_t required) const;
+
+    /* ADR marked valid and neither reset nor cycle slipped. */
+    uint64_t adrUsable() const;
+
+    uint64_t constellationIs(GnssConstellationType constellation) const;
+
+    /* Packs the entries of "column" selected by "mask"; returns how many. */
+    static size_t gather(uint64_t mask, const double *column, double *out);
+
+    alignas(64) int16_t svid[kCapacity];
+    alignas(64) uint32_t constellation[kCapacity];
+    alignas(64) uint32_t state[kCapacity];
+    alignas(64) uint32_t adrState[kCapacity];
+    alignas(64) int64_t receivedSvTimeNs[kCapacity];
+    alignas(64) int64_t receivedSvTimeUncertaintyNs[kCapacity];
+    alignas(64) double timeOffsetNs[kCapacity];
+    alignas(64) double cn0DbHz[kCapacity];
+    alignas(64) double pseudorangeRateMps[kCapacity];
+    alignas(64) double pseudorangeRateUncertaintyMps[kCapacity];
+    alignas(64) double adrM[kCapacity];
+    alignas(64) double adrUncertaintyM[kCapacity];
+    alignas(64) double carrierFrequencyHz[kCapacity];
+    alignas(64) double snrDb[kCapacity];
+
+private:
+    size_t mCount;
+    uint64_t mPresent;
+    uint64_t mHasSnr;
+    uint64_t mHasCarrierFrequency;
+    uint64_t mHasCarrierPhase;
+    uint64_t mUsedInFix;
+    GnssClock mClock;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_MEASUREMENT_SOA_H
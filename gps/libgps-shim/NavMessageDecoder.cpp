@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "NavMessageDecoder.h"
+
+namespace android {
+
+#define L1CA_SUBFRAME_BYTES 40
+#define TLM_PREAMBLE 0x8b
+#define ALMANAC_WEEK_PAGE_SVID 51
+
+/*
+ * IS-GPS-200 table 20-XIV as masks over a word laid out as D29* D30*
+ * d1..d24 D25..D30, MSB first: each parity bit is the parity of the word
+ * under its mask, one popcount instead of a dozen single bit XORs.
+ */
+static const uint32_t kParityMasks[6] = {
+    0xbb1f3480, 0x5d8f9a40, 0xaec7cd00, 0x5763e680, 0x6bb1f340, 0x8b7a89c0,
+};
+
+/* "count" bits of a 24-bit data word starting at d"first" (1-based, MSB first) */
+static inline uint32_t bits(uint32_t word, int first, int count)
+{
+    return (word >> (25 - first - count)) & ((1u << count) - 1);
+}
+
+static inline int32_t signExtend(uint32_t value, int count)
+{
+    return static_cast<int32_t>(value << (32 - count)) >> (32 - count);
+}
+
+/* Fields split as 8 MSBs at the end of one word and 24 LSBs in the next */
+static inline uint32_t bits32(const uint32_t *data, int word)
+{
+    return (bits(data[word], 17, 8) << 24) | data[word + 1];
+}
+
+NavMessageDecoder::NavMessageDecoder()
+    : mHaveEphemeris(0),
+      mHaveAlmanac(0),
+      mUpdatedSvid(0),
+      mAlmanacWeek(-1),
+      mSubframes(0),
+      mParityErrors(0)
+{
+    memset(mPending, 0, sizeof(mPending));
+    memset(mEphemeris, 0, sizeof(mEphemeris));
+    memset(mAlmanac, 0, sizeof(mAlmanac));
+}
+
+bool NavMessageDecoder::checkParity(const uint32_t *words, uint32_t *data)
+{
+    /* Word 10 ends in two zero bits by design, so word 1 starts with D29* = D30* = 0 */
+    uint32_t previous = 0;
+
+    for (int i = 0; i < 10; i++) {
+        uint32_t word = (previous << 30) | (words[i] & 0x3fffffff);
+        uint32_t parity = 0;
+
+        if (word & 0x40000000) {
+            word ^= 0x3fffffc0;
+        }
+        for (int k = 0; k < 6; k++) {
+            parity = (parity << 1) | __builtin_parity(word & kParityMasks[k]);
+        }
+        if (parity != (word & 0x3f)) {
+            return false;
+        }
+
+        data[i] = (word >> 6) & 0xffffff;
+        previous = words[i] & 0x3;
+    }
+
+    return true;
+}
+
+NavMessageDecoder::Result NavMessageDecoder::feed(const GnssNavigationMessage& message)
+{
+    if (message.type != GNSS_NAVIGATION_MESSAGE_TYPE_GNSS_L1CA || message.data == NULL) {
+        return RESULT_IGNORED;
+    }
+
+    return feedSubframe(message.svid, message.data, message.data_length);
+}
+
+NavMessageDecoder::Result NavMessageDecoder::feedSubframe(int svid, const uint8_t *data,
+        size_t length)
+{
+    uint32_t words[10];
+    uint32_t decoded[10];
+    int subframe;
+
+    if (svid < 1 || svid > LNAV_MAX_SVID || length < L1CA_SUBFRAME_BYTES) {
+        return RESULT_IGNORED;
+    }
+
+    for (int i = 0; i < 10; i++) {
+        const uint8_t *p = data + i * 4;
+        words[i] = (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    /* A receiver locked 180 degrees out of phase hands over every bit inverted */
+    if (((words[0] >> 22) & 0xff) == (~TLM_PREAMBLE & 0xff)) {
+        for (int i = 0; i < 10; i++) {
+            words[i] = ~words[i];
+        }
+    }
+
+    if (!checkParity(words, decoded) || bits(decoded[0], 1, 8) != TLM_PREAMBLE) {
+        mParityErrors++;
+        return RESULT_PARITY_ERROR;
+    }
+    mSubframes++;
+
+    subframe = bits(decoded[1], 20, 3);
+    if (subframe >= 1 && subframe <= 3) {
+        Subframes& pending = mPending[svid - 1];
+        memcpy(pending.words[subframe - 1], decoded, sizeof(decoded));
+        pending.present |= 1 << (subframe - 1);
+        return decodeEphemeris(svid);
+    }
+    if (subframe == 4 || subframe == 5) {
+        return decodeAlmanac(decoded);
+    }
+
+    return RESULT_IGNORED;
+}
+
+NavMessageDecoder::Result NavMessageDecoder::decodeEphemeris(int svid)
+{
+    const Subframes& pending = mPending[svid - 1];
+    const uint32_t *sf1 = pending.words[0];
+    const uint32_t *sf2 = pending.words[1];
+    const uint32_t *sf3 = pending.words[2];
+    LnavEphemeris eph;
+
+    if (pending.present != 0x7) {
+        return RESULT_SUBFRAME;
+    }
+
+    /* A new issue may be half way in: wait until all three agree */
+    uint16_t iodc = (bits(sf1[2], 23, 2) << 8) | bits(sf1[7], 1, 8);
+    uint8_t iode = bits(sf2[2], 1, 8);
+    if (iode != bits(sf3[9], 1, 8) || iode != (iodc & 0xff)) {
+        return RESULT_SUBFRAME;
+    }
+
+    memset(&eph, 0, sizeof(eph));
+    eph.svid = svid;
+    eph.iode = iode;
+    eph.iodc = iodc;
+
+    eph.week = bits(sf1[2], 1, 10);
+    eph.uraIndex = bits(sf1[2], 13, 4);
+    eph.health = bits(sf1[2], 17, 6);
+    eph.tgd = signExtend(bits(sf1[6], 17, 8), 8);
+    eph.toc = bits(sf1[7], 9, 16);
+    eph.af2 = signExtend(bits(sf1[8], 1, 8), 8);
+    eph.af1 = signExtend(bits(sf1[8], 9, 16), 16);
+    eph.af0 = signExtend(bits(sf1[9], 1, 22), 22);
+
+    eph.crs = signExtend(bits(sf2[2], 9, 16), 16);
+    eph.deltaN = signExtend(bits(sf2[3], 1, 16), 16);
+    eph.m0 = static_cast<int32_t>(bits32(sf2, 3));
+    eph.cuc = signExtend(bits(sf2[5], 1, 16), 16);
+    eph.e = bits32(sf2, 5);
+    eph.cus = signExtend(bits(sf2[7], 1, 16), 16);
+    eph.sqrtA = bits32(sf2, 7);
+    eph.toe = bits(sf2[9], 1, 16);
+    eph.fitInterval = bits(sf2[9], 17, 1);
+
+    eph.cic = signExtend(bits(sf3[2], 1, 16), 16);
+    eph.omega0 = static_cast<int32_t>(bits32(sf3, 2));
+    eph.cis = signExtend(bits(sf3[4], 1, 16), 16);
+    eph.i0 = static_cast<int32_t>(bits32(sf3, 4));
+    eph.crc = signExtend(bits(sf3[6], 1, 16), 16);
+    eph.omega = static_cast<int32_t>(bits32(sf3, 6));
+    eph.omegaDot = signExtend(sf3[8], 24);
+    eph.idot = signExtend(bits(sf3[9], 9, 14), 14);
+
+    uint32_t bit = 1u << (svid - 1);
+    if ((mHaveEphemeris & bit) != 0 && memcmp(&mEphemeris[svid - 1], &eph, sizeof(eph)) == 0) {
+        return RESULT_SUBFRAME;
+    }
+    mEphemeris[svid - 1] = eph;
+    mHaveEphemeris |= bit;
+    mUpdatedSvid = svid;
+    return RESULT_EPHEMERIS;
+}
+
+NavMessageDecoder::Result NavMessageDecoder::decodeAlmanac(const uint32_t *data)
+{
+    int svid = bits(data[2], 3, 6);
+    LnavAlmanac alm;
+
+    if (svid == ALMANAC_WEEK_PAGE_SVID) {
+        mAlmanacWeek = bits(data[2], 17, 8);
+        return RESULT_IGNORED;
+    }
+    /* Other page ids carry ionosphere, UTC, health and spare data */
+    if (svid < 1 || svid > LNAV_MAX_SVID) {
+        return RESULT_IGNORED;
+    }
+
+    memset(&alm, 0, sizeof(alm));
+    alm.svid = svid;
+    alm.e = bits(data[2], 9, 16);
+    alm.toa = bits(data[3], 1, 8);
+    alm.deltaI = signExtend(bits(data[3], 9, 16), 16);
+    alm.omegaDot = signExtend(bits(data[4], 1, 16), 16);
+    alm.health = bits(data[4], 17, 8);
+    alm.sqrtA = data[5];
+    alm.omega0 = signExtend(data[6], 24);
+    alm.omega = signExtend(data[7], 24);
+    alm.m0 = signExtend(data[8], 24);
+    alm.af0 = signExtend((bits(data[9], 1, 8) << 3) | bits(data[9], 20, 3), 11);
+    alm.af1 = signExtend(bits(data[9], 9, 11), 11);
+
+    uint32_t bit = 1u << (svid - 1);
+    if ((mHaveAlmanac & bit) != 0 && memcmp(&mAlmanac[svid - 1], &alm, sizeof(alm)) == 0) {
+        return RESULT_SUBFRAME;
+    }
+    mAlmanac[svid - 1] = alm;
+    mHaveAlmanac |= bit;
+    mUpdatedSvid = svid;
+    return RESULT_ALMANAC;
+}
+
+const LnavEphemeris *NavMessageDecoder::ephemeris(int svid) const
+{
+    if (svid < 1 || svid > LNAV_MAX_SVID || (mHaveEphemeris & (1u << (svid - 1))) == 0) {
+        return NULL;
+    }
+    return &mEphemeris[svid - 1];
+}
+
+const LnavAlmanac *NavMessageDecoder::almanac(int svid) const
+{
+    if (svid < 1 || svid > LNAV_MAX_SVID || (mHaveAlmanac & (1u << (svid - 1))) == 0) {
+        return NULL;
+    }
+    return &mAlmanac[svid - 1];
+}
+
+} // namespace android
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_NAV_MESSAGE_DECODER_H
+#define GPS_SHIM_NAV_MESSAGE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+#define LNAV_MAX_SVID 32
+
+/*
+ * GPS L1 C/A (LNAV) ephemeris as broadcast in subframes 1-3 (IS-GPS-200
+ * 20.3.3.3). Fields keep their broadcast integer encoding, so the struct
+ * stays small and round-trips exactly; the comment on each field gives
+ * its scale factor.
+ */
+struct LnavEphemeris {
+    uint8_t svid;
+    uint8_t iode;
+    uint8_t uraIndex;
+    uint8_t health;
+    uint16_t iodc;
+    uint16_t week;              /* modulo 1024 */
+    uint16_t toc;               /* 2^4 s */
+    uint16_t toe;               /* 2^4 s */
+    int8_t tgd;                 /* 2^-31 s */
+    int8_t af2;                 /* 2^-55 s/s^2 */
+    uint8_t fitInterval;
+    uint8_t reserved;
+    int16_t af1;                /* 2^-43 s/s */
+    int16_t crs;                /* 2^-5 m */
+    int32_t af0;                /* 2^-31 s, 22 bits */
+    int16_t deltaN;             /* 2^-43 semicircles/s */
+    int16_t cuc;                /* 2^-29 rad */
+    int32_t m0;                 /* 2^-31 semicircles */
+    uint32_t e;                 /* 2^-33 */
+    int16_t cus;                /* 2^-29 rad */
+    int16_t cic;                /* 2^-29 rad */
+    uint32_t sqrtA;             /* 2^-19 m^1/2 */
+    int32_t omega0;             /* 2^-31 semicircles */
+    int16_t cis;                /* 2^-29 rad */
+    int16_t crc;                /* 2^-5 m */
+    int32_t i0;                 /* 2^-31 semicircles */
+    int32_t omega;              /* 2^-31 semicircles */
+    int32_t omegaDot;           /* 2^-43 semicircles/s, 24 bits */
+    int16_t idot;               /* 2^-43 semicircles/s, 14 bits */
+    uint16_t reserved2;
+};
+
+/* Almanac page from subframe 4 or 5 (IS-GPS-200 20.3.3.5.1.2). */
+struct LnavAlmanac {
+    uint8_t svid;
+    uint8_t health;
+    uint8_t toa;                /* 2^12 s */
+    uint8_t reserved;
+    uint16_t e;                 /* 2^-21 */
+    int16_t deltaI;             /* 2^-19 semicircles */
+    int16_t omegaDot;           /* 2^-38 semicircles/s */
+    int16_t af0;                /* 2^-20 s, 11 bits */
+    int16_t af1;                /* 2^-38 s/s, 11 bits */
+    uint16_t reserved2;
+    uint32_t sqrtA;             /* 2^-11 m^1/2, 24 bits */
+    int32_t omega0;             /* 2^-23 semicircles, 24 bits */
+    int32_t omega;              /* 2^-23 semicircles, 24 bits */
+    int32_t m0;                 /* 2^-23 semicircles, 24 bits */
+};
+
+/*
+ * Streaming decoder for the subframes delivered through
+ * gnss_navigation_message_callback(). Subframes are parity checked
+ * whatever the chip claims in "status", assembled per SV, and turned
+ * into an LnavEphemeris once subframes 1-3 with matching IODC/IODE have
+ * been seen. Other message types are ignored.
+ *
+ * Not thread safe.
+ */
+class NavMessageDecoder {
+public:
+    enum Result {
+        RESULT_IGNORED,         /* not GPS L1 C/A, or a page without orbit data */
+        RESULT_PARITY_ERROR,
+        RESULT_SUBFRAME,        /* kept, ephemeris still incomplete or unchanged */
+        RESULT_EPHEMERIS,       /* ephemeris(svid) was updated */
+        RESULT_ALMANAC,         /* almanac(svid) was updated */
+    };
+
+    NavMessageDecoder();
+
+    Result feed(const GnssNavigationMessage& message);
+
+    /* Decodes the 40 byte L1 C/A subframe layout of gps.h; "svid" is the transmitter. */
+    Result feedSubframe(int svid, const uint8_t *data, size_t length);
+
+    /* NULL until one has been decoded; an almanac's svid is the SV it describes. */
+    const LnavEphemeris *ephemeris(int svid) const;
+    const LnavAlmanac *almanac(int svid) const;
+
+    /* The SV the last RESULT_EPHEMERIS or RESULT_ALMANAC was about. */
+    int updatedSvid() const { return mUpdatedSvid; }
+
+    /* Almanac reference week (modulo 256) from subframe 5 page 25, -1 if not seen. */
+    int almanacWeek() const { return mAlmanacWeek; }
+
+    uint64_t subframes() const { return mSubframes; }
+    uint64_t parityErrors() const { return mParityErrors; }
+
+    /*
+     * Checks the parity of ten 30-bit words, right aligned in "words", and
+     * stores their 24 data bits with the D30* inversion removed. Returns
+     * false on the first bad word.
+     */
+    static bool checkParity(const uint32_t *words, uint32_t *data);
+
+private:
+    struct Subframes {
+        uint32_t words[3][10];  /* data bits of subframes 1-3 */
+        uint8_t present;        /* bit n-1 set when subframe n is held */
+    };
+
+    Result decodeEphemeris(int svid);
+    Result decodeAlmanac(const uint32_t *data);
+
+    Subframes mPending[LNAV_MAX_SVID];
+    LnavEphemeris mEphemeris[LNAV_MAX_SVID];
+    LnavAlmanac mAlmanac[LNAV_MAX_SVID];
+    uint32_t mHaveEphemeris;
+    uint32_t mHaveAlmanac;
+    int mUpdatedSvid;
+    int mAlmanacWeek;
+    uint64_t mSubframes;
+    uint64_t mParityErrors;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_NAV_MESSAGE_DECODER_H
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "SvStatusTable.h"
+
+namespace android {
+
+SvStatusTable::SvStatusTable(float cn0ThresholdDbHz, float angleThresholdDegrees)
+    : mCn0Threshold(cn0ThresholdDbHz),
+      mAngleThreshold(angleThresholdDegrees),
+      mGeneration(0)
+{
+    size_t maxSvs = GNSS_MAX_SVS;
+
+    mSvs.reserve(maxSvs);
+    mReported.reserve(maxSvs);
+    mNextSvs.reserve(maxSvs);
+    mNextReported.reserve(maxSvs);
+}
+
+uint32_t SvStatusTable::keyOf(const Sv& sv)
+{
+    return (static_cast<uint32_t>(sv.constellation) << 16) | static_cast<uint16_t>(sv.svid);
+}
+
+static float angleDelta(float a, float b)
+{
+    float d = fabsf(a - b);
+
+    /* Azimuth wraps at 360 */
+    return d > 180.0f ? 360.0f - d : d;
+}
+
+size_t SvStatusTable::update(const GnssSvStatus& status, std::vector<Change> *out)
+{
+    const uint8_t flagMask = GNSS_SV_FLAGS_USED_IN_FIX | GNSS_SV_FLAGS_HAS_EPHEMERIS_DATA |
+            GNSS_SV_FLAGS_HAS_ALMANAC_DATA;
+    size_t maxSvs = GNSS_MAX_SVS;
+    size_t count = status.num_svs > 0 ? status.num_svs : 0;
+    size_t changes = 0;
+
+    if (count > maxSvs) {
+        count = maxSvs;
+    }
+
+    mNextSvs.clear();
+    for (size_t i = 0; i < count; i++) {
+        const GnssSvInfo& info = status.gnss_sv_list[i];
+        Sv sv = { info.svid, info.constellation, info.flags, info.c_n0_dbhz, info.elevation,
+                info.azimuth };
+
+        /* Insertion sort: vendors keep their order from epoch to epoch, so this is linear */
+        uint32_t key = keyOf(sv);
+        size_t j = mNextSvs.size();
+        while (j > 0 && keyOf(mNextSvs[j - 1]) > key) {
+            j--;
+        }
+        if (j > 0 && keyOf(mNextSvs[j - 1]) == key) {
+            /* Reported twice: the last one wins */
+            mNextSvs[j - 1] = sv;
+            continue;
+        }
+        mNextSvs.insert(mNextSvs.begin() + j, sv);
+    }
+
+    auto report = [&](const Sv& sv, uint8_t what) {
+        changes++;
+        if (out != NULL) {
+            out->push_back({ sv, what });
+        }
+    };
+
+    /* Merge the new report with the previous one, both sorted by key */
+    mNextReported.clear();
+    size_t o = 0;
+    for (size_t n = 0; n < mNextSvs.size(); n++) {
+        const Sv& sv = mNextSvs[n];
+        uint32_t key = keyOf(sv);
+
+        while (o < mSvs.size() && keyOf(mSvs[o]) < key) {
+            report(mSvs[o++], CHANGE_DISAPPEARED);
+        }
+
+        if (o >= mSvs.size() || keyOf(mSvs[o]) != key) {
+            report(sv, CHANGE_APPEARED);
+            mNextReported.push_back({ sv.cn0DbHz, sv.elevation, sv.azimuth });
+            continue;
+        }
+
+        const Sv& old = mSvs[o];
+        Reported reported = mReported[o++];
+        uint8_t what = 0;
+        uint8_t flipped = (sv.flags ^ old.flags) & flagMask;
+
+        if (flipped & GNSS_SV_FLAGS_USED_IN_FIX) {
+            what |= CHANGE_USED_IN_FIX;
+        }
+        if (flipped & GNSS_SV_FLAGS_HAS_EPHEMERIS_DATA) {
+            what |= CHANGE_EPHEMERIS;
+        }
+        if (flipped & GNSS_SV_FLAGS_HAS_ALMANAC_DATA) {
+            what |= CHANGE_ALMANAC;
+        }
+        if (fabsf(sv.cn0DbHz - reported.cn0DbHz) >= mCn0Threshold) {
+            what |= CHANGE_CN0;
+            reported.cn0DbHz = sv.cn0DbHz;
+        }
+        if (angleDelta(sv.elevation, reported.elevation) >= mAngleThreshold ||
+                angleDelta(sv.azimuth, reported.azimuth) >= mAngleThreshold) {
+            what |= CHANGE_POSITION;
+            reported.elevation = sv.elevation;
+            reported.azimuth = sv.azimuth;
+        }
+
+        if (what != 0) {
+            report(sv, what);
+        }
+        mNextReported.push_back(reported);
+    }
+    while (o < mSvs.size()) {
+        report(mSvs[o++], CHANGE_DISAPPEARED);
+    }
+
+    mSvs.swap(mNextSvs);
+    mReported.swap(mNextReported);
+    if (changes > 0) {
+        mGeneration++;
+    }
+    return changes;
+}
+
+} // namespace android
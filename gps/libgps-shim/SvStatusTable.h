@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GPS_SHIM_SV_STATUS_TABLE_H
+#define GPS_SHIM_SV_STATUS_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <hardware/gps.h>
+
+namespace android {
+
+/*
+ * The SVs of the latest gnss_sv_status_callback() report, kept sorted by
+ * (constellation, svid), and what changed since the previous report.
+ *
+ * C/N0 and sky position are compared with the value last reported as a
+ * change, not with the previous epoch, so noise below the threshold never
+ * shows up while a slow drift still does. Appearing and disappearing SVs
+ * and flips of the used in fix, ephemeris and almanac flags are always
+ * changes.
+ *
+ * Not thread safe.
+ */
+class SvStatusTable {
+public:
+    enum ChangeFlags : uint8_t {
+        CHANGE_APPEARED = 1 << 0,
+        CHANGE_DISAPPEARED = 1 << 1,
+        CHANGE_CN0 = 1 << 2,
+        CHANGE_USED_IN_FIX = 1 << 3,
+        CHANGE_EPHEMERIS = 1 << 4,
+        CHANGE_ALMANAC = 1 << 5,
+        CHANGE_POSITION = 1 << 6,      /* elevation or azimuth */
+    };
+
+    /* 16 bytes against 32 for a GnssSvInfo */
+    struct Sv {
+        int16_t svid;
+        uint8_t constellation;  /* GnssConstellationType */
+        uint8_t flags;          /* GnssSvFlags */
+        float cn0DbHz;
+        float elevation;
+        float azimuth;
+    };
+
+    struct Change {
+        Sv sv;                  /* last known values for CHANGE_DISAPPEARED */
+        uint8_t what;           /* ChangeFlags */
+    };
+
+    SvStatusTable(float cn0ThresholdDbHz, float angleThresholdDegrees);
+
+    /* Appends the changes to "out", which may be NULL, and returns how many there were. */
+    size_t update(const GnssSvStatus& status, std::vector<Change> *out);
+
+    /* The latest values of every SV, sorted; valid until the next update(). */
+    const std::vector<Sv>& svs() const { return mSvs; }
+
+    /* Bumped by every update() that had changes. */
+    uint64_t generation() const { return mGeneration; }
+
+private:
+    /* Values as of the last reported change, parallel to mSvs */
+    struct Reported {
+        float cn0DbHz;
+        float elevation;
+        float azimuth;
+    };
+
+    static uint32_t keyOf(const Sv& sv);
+
+    float mCn0Threshold;
+    float mAngleThreshold;
+    uint64_t mGeneration;
+
+    std::vector<Sv> mSvs;
+    std::vector<Reported> mReported;
+    std::vector<Sv> mNextSvs;
+    std::vector<Reported> mNextReported;
+};
+
+} // namespace android
+
+#endif // GPS_SHIM_SV_STATUS_TABLE_H
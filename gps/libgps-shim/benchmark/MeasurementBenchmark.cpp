@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "MeasurementSoA.h"
+
+/*
+ * Per-epoch work over GnssData as the HAL delivers it and over the
+ * transposed MeasurementSoA columns: a single filter and sum, and eight
+ * passes of a reweighted clock drift estimate over the selected
+ * satellites. 40 measurements per epoch, cycling over 256 distinct epochs
+ * so that neither layout runs from a hot L1.
+ */
+
+using namespace android;
+
+static const size_t kEpochs = 256;
+static const size_t kMeasurements = 40;
+static const double kMinCn0 = 25.0;
+static const uint32_t kRequiredState =
+        GNSS_MEASUREMENT_STATE_CODE_LOCK | GNSS_MEASUREMENT_STATE_TOW_DECODED;
+static const int kIterations = 8;
+
+static std::vector<GnssData> makeEpochs()
+{
+    std::vector<GnssData> epochs(kEpochs);
+
+    srand(7870);
+    for (GnssData& data : epochs) {
+        memset(&data, 0, sizeof(data));
+        data.size = sizeof(data);
+        data.measurement_count = kMeasurements;
+        for (size_t i = 0; i < kMeasurements; i++) {
+            GnssMeasurement& m = data.measurements[i];
+
+            m.size = sizeof(m);
+            m.svid = static_cast<int16_t>(1 + i % 32);
+            m.constellation = static_cast<GnssConstellationType>(1 + i % 6);
+            m.state = rand() % 4 ? kRequiredState : GNSS_MEASUREMENT_STATE_CODE_LOCK;
+            m.accumulated_delta_range_state = rand() % 8 ? GNSS_ADR_STATE_VALID :
+                    GNSS_ADR_STATE_VALID | GNSS_ADR_STATE_CYCLE_SLIP;
+            m.c_n0_dbhz = 15.0 + rand() % 3000 / 100.0;
+            m.pseudorange_rate_mps = -800.0 + rand() % 160000 / 100.0;
+            m.pseudorange_rate_uncertainty_mps = 0.05 + rand() % 100 / 100.0;
+            m.accumulated_delta_range_m = rand() % 1000000 / 10.0;
+        }
+    }
+    return epochs;
+}
+
+static bool selectedAoS(const GnssMeasurement& m)
+{
+    return m.c_n0_dbhz >= kMinCn0 && (m.state & kRequiredState) == kRequiredState &&
+            (m.accumulated_delta_range_state &
+             (GNSS_ADR_STATE_VALID | GNSS_ADR_STATE_RESET | GNSS_ADR_STATE_CYCLE_SLIP)) ==
+            GNSS_ADR_STATE_VALID;
+}
+
+static uint64_t selectedSoA(const MeasurementSoA& soa)
+{
+    return soa.cn0AtLeast(kMinCn0) & soa.stateHas(kRequiredState) & soa.adrUsable();
+}
+
+/* One Cauchy-reweighted step towards the common pseudorange rate bias */
+static inline double driftStep(const double *rate, const double *sigma, size_t n, double drift)
+{
+    double num = 0, den = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        double r = rate[i] - drift;
+        double w = 1.0 / (sigma[i] * sigma[i] + 0.01 * r * r);
+        num += w * r;
+        den += w;
+    }
+    return den > 0 ? drift + num / den : drift;
+}
+
+static void BM_FilterSumAoS(benchmark::State& state)
+{
+    std::vector<GnssData> epochs = makeEpochs();
+    size_t e = 0;
+
+    for (auto _ : state) {
+        const GnssData& data = epochs[e++ % kEpochs];
+        double sum = 0;
+
+        for (size_t i = 0; i < data.measurement_count; i++) {
+            if (selectedAoS(data.measurements[i])) {
+                sum += data.measurements[i].pseudorange_rate_mps;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilterSumAoS);
+
+static void BM_FilterSumSoA(benchmark::State& state)
+{
+    std::vector<GnssData> epochs = makeEpochs();
+    std::vector<MeasurementSoA> soas(kEpochs);
+    size_t e = 0;
+
+    for (size_t i = 0; i < kEpochs; i++) {
+        soas[i].load(epochs[i]);
+    }
+    for (auto _ : state) {
+        const MeasurementSoA& soa = soas[e++ % kEpochs];
+        double sum = 0;
+
+        for (uint64_t mask = selectedSoA(soa); mask; mask &= mask - 1) {
+            sum += soa.pseudorangeRateMps[__builtin_ctzll(mask)];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilterSumSoA);
+
+static void BM_DriftAoS(benchmark::State& state)
+{
+    std::vector<GnssData> epochs = makeEpochs();
+    size_t e = 0;
+
+    for (auto _ : state) {
+        const GnssData& data = epochs[e++ % kEpochs];
+        double drift = 0;
+
+        for (int k = 0; k < kIterations; k++) {
+            double num = 0, den = 0;
+
+            for (size_t i = 0; i < data.measurement_count; i++) {
+                const GnssMeasurement& m = data.measurements[i];
+
+                if (!selectedAoS(m)) {
+                    continue;
+                }
+                double sigma = m.pseudorange_rate_uncertainty_mps;
+                double r = m.pseudorange_rate_mps - drift;
+                double w = 1.0 / (sigma * sigma + 0.01 * r * r);
+                num += w * r;
+                den += w;
+            }
+            drift = den > 0 ? drift + num / den : drift;
+        }
+        benchmark::DoNotOptimize(drift);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DriftAoS);
+
+static void BM_DriftSoA(benchmark::State& state)
+{
+    std::vector<GnssData> epochs = makeEpochs();
+    std::vector<MeasurementSoA> soas(kEpochs);
+    size_t e = 0;
+
+    for (size_t i = 0; i < kEpochs; i++) {
+        soas[i].load(epochs[i]);
+    }
+    for (auto _ : state) {
+        const MeasurementSoA& soa = soas[e++ % kEpochs];
+        uint64_t mask = selectedSoA(soa);
+        double rate[MeasurementSoA::kCapacity], sigma[MeasurementSoA::kCapacity];
+        size_t n = MeasurementSoA::gather(mask, soa.pseudorangeRateMps, rate);
+        double drift = 0;
+
+        MeasurementSoA::gather(mask, soa.pseudorangeRateUncertaintyMps, sigma);
+        for (int k = 0; k < kIterations; k++) {
+            drift = driftStep(rate, sigma, n, drift);
+        }
+        benchmark::DoNotOptimize(drift);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DriftSoA);
+
+/* The transpose itself, paid once per epoch before any of the above */
+static void BM_Load(benchmark::State& state)
+{
+    std::vector<GnssData> epochs = makeEpochs();
+    MeasurementSoA soa;
+    size_t e = 0;
+
+    for (auto _ : state) {
+        soa.load(epochs[e++ % kEpochs]);
+        benchmark::DoNotOptimize(soa.present());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Load);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "NavMessageDecoder.h"
+
+/*
+ * Cost of one GPS L1 C/A subframe: the parity check of its ten words
+ * through the popcount masks, next to the bit by bit equations of
+ * IS-GPS-200 20.3.5, and the whole feedSubframe() path. Cycles over 256
+ * random subframes with valid parity.
+ */
+
+using namespace android;
+
+static const size_t kSubframes = 256;
+
+/* Data bits covered by D25..D30 (IS-GPS-200 table 20-XIV), 0 terminated */
+static const int kParityBits[6][16] = {
+    { 1, 2, 3, 5, 6, 10, 11, 12, 13, 14, 17, 18, 20, 23, 0 },
+    { 2, 3, 4, 6, 7, 11, 12, 13, 14, 15, 18, 19, 21, 24, 0 },
+    { 1, 3, 4, 5, 7, 8, 12, 13, 14, 15, 16, 19, 20, 22, 0 },
+    { 2, 4, 5, 6, 8, 9, 13, 14, 15, 16, 17, 20, 21, 23, 0 },
+    { 1, 3, 5, 6, 7, 9, 10, 14, 15, 16, 17, 18, 21, 22, 24, 0 },
+    { 3, 5, 6, 8, 9, 10, 11, 13, 15, 19, 22, 23, 24, 0 },
+};
+
+static const bool kParityFromD30[6] = { false, true, false, true, true, false };
+
+static void parityOf(const int *d, int d29, int d30, int *parity)
+{
+    for (int j = 0; j < 6; j++) {
+        int value = kParityFromD30[j] ? d30 : d29;
+        for (int t = 0; kParityBits[j][t] != 0; t++) {
+            value ^= d[kParityBits[j][t]];
+        }
+        parity[j] = value;
+    }
+}
+
+/* TLM and HOW for subframes 1-5, random data words; word 10 may end in any parity */
+static std::vector<uint32_t> makeSubframes()
+{
+    std::vector<uint32_t> words(kSubframes * 10);
+
+    srand(7870);
+    for (size_t s = 0; s < kSubframes; s++) {
+        int d29 = 0, d30 = 0;
+
+        for (int i = 0; i < 10; i++) {
+            uint32_t data = (static_cast<uint32_t>(rand()) << 8 ^ rand()) & 0xffffff;
+            uint32_t word = 0;
+            int d[25], parity[6];
+
+            if (i == 0) {
+                data = (0x8bu << 16) | (data & 0xffff);
+            } else if (i == 1) {
+                data = (data & ~0x1cu) | ((1 + s % 5) << 2);
+            }
+            for (int k = 1; k <= 24; k++) {
+                d[k] = (data >> (24 - k)) & 1;
+                word = (word << 1) | (d[k] ^ d30);
+            }
+            parityOf(d, d29, d30, parity);
+            for (int j = 0; j < 6; j++) {
+                word = (word << 1) | parity[j];
+            }
+            words[s * 10 + i] = word;
+            d29 = parity[4];
+            d30 = parity[5];
+        }
+    }
+    return words;
+}
+
+static void BM_CheckParity(benchmark::State& state)
+{
+    std::vector<uint32_t> words = makeSubframes();
+    uint32_t data[10];
+    size_t s = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(NavMessageDecoder::checkParity(&words[s++ % kSubframes * 10],
+                data));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CheckParity);
+
+/* The usual transcription of the parity equations, for comparison */
+static void BM_CheckParityBitwise(benchmark::State& state)
+{
+    std::vector<uint32_t> words = makeSubframes();
+    uint32_t data[10];
+    size_t s = 0;
+
+    for (auto _ : state) {
+        const uint32_t *w = &words[s++ % kSubframes * 10];
+        int d29 = 0, d30 = 0;
+        bool ok = true;
+
+        for (int i = 0; i < 10 && ok; i++) {
+            int d[25], parity[6];
+
+            data[i] = 0;
+            for (int k = 1; k <= 24; k++) {
+                d[k] = ((w[i] >> (30 - k)) & 1) ^ d30;
+                data[i] = (data[i] << 1) | d[k];
+            }
+            parityOf(d, d29, d30, parity);
+            for (int j = 0; j < 6; j++) {
+                ok = ok && parity[j] == static_cast<int>((w[i] >> (5 - j)) & 1);
+            }
+            d29 = (w[i] >> 1) & 1;
+            d30 = w[i] & 1;
+        }
+        benchmark::DoNotOptimize(ok);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CheckParityBitwise);
+
+static void BM_FeedSubframe(benchmark::State& state)
+{
+    std::vector<uint32_t> words = makeSubframes();
+    std::vector<uint8_t> bytes(words.size() * 4);
+    NavMessageDecoder decoder;
+    size_t s = 0;
+
+    for (size_t i = 0; i < words.size(); i++) {
+        bytes[4 * i] = words[i] >> 24;
+        bytes[4 * i + 1] = words[i] >> 16;
+        bytes[4 * i + 2] = words[i] >> 8;
+        bytes[4 * i + 3] = words[i];
+    }
+    for (auto _ : state) {
+        size_t n = s++ % kSubframes;
+        benchmark::DoNotOptimize(decoder.feedSubframe(1 + n % LNAV_MAX_SVID, &bytes[n * 40], 40));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FeedSubframe);
+
+BENCHMARK_MAIN();
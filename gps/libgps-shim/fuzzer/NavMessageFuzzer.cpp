@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "NavMessageDecoder.h"
+
+/*
+ * Feeds arbitrary subframes to NavMessageDecoder as they would arrive
+ * through gnss_navigation_message_callback(), and checks it against a bit
+ * by bit transcription of IS-GPS-200 20.3.5:
+ *  - the mask based parity check agrees with the reference on the raw
+ *    input words and on the encoded ones, and so do the data bits it
+ *    returns;
+ *  - an ephemeris built from the input, encoded by the reference and
+ *    fed in either polarity, decodes to exactly the same struct;
+ *  - flipping any one of its 300 bits gets the subframe rejected.
+ *
+ * Input layout: byte 0 picks the polarity and byte 1 and 2 the bit to
+ * corrupt; the first 40 bytes after them are also fed as a raw subframe,
+ * and everything after the header supplies the ephemeris fields.
+ */
+
+using namespace android;
+
+/* Data bits covered by D25..D30 (IS-GPS-200 table 20-XIV), 0 terminated */
+static const int kParityBits[6][16] = {
+    { 1, 2, 3, 5, 6, 10, 11, 12, 13, 14, 17, 18, 20, 23, 0 },
+    { 2, 3, 4, 6, 7, 11, 12, 13, 14, 15, 18, 19, 21, 24, 0 },
+    { 1, 3, 4, 5, 7, 8, 12, 13, 14, 15, 16, 19, 20, 22, 0 },
+    { 2, 4, 5, 6, 8, 9, 13, 14, 15, 16, 17, 20, 21, 23, 0 },
+    { 1, 3, 5, 6, 7, 9, 10, 14, 15, 16, 17, 18, 21, 22, 24, 0 },
+    { 3, 5, 6, 8, 9, 10, 11, 13, 15, 19, 22, 23, 24, 0 },
+};
+
+/* Whether D25..D30 start from D29* (false) or D30* (true) */
+static const bool kParityFromD30[6] = { false, true, false, true, true, false };
+
+static void referenceParity(const int *d, int d29, int d30, int *parity)
+{
+    for (int j = 0; j < 6; j++) {
+        int value = kParityFromD30[j] ? d30 : d29;
+        for (int t = 0; kParityBits[j][t] != 0; t++) {
+            value ^= d[kParityBits[j][t]];
+        }
+        parity[j] = value;
+    }
+}
+
+/* Ten 24-bit source words to ten 30-bit transmitted words */
+static void referenceEncode(const uint32_t *data, uint32_t *words)
+{
+    int d29 = 0, d30 = 0;
+
+    for (int i = 0; i < 10; i++) {
+        int d[25], parity[6];
+        uint32_t word = 0;
+
+        for (int k = 1; k <= 24; k++) {
+            d[k] = (data[i] >> (24 - k)) & 1;
+        }
+        referenceParity(d, d29, d30, parity);
+        for (int k = 1; k <= 24; k++) {
+            word = (word << 1) | (d[k] ^ d30);
+        }
+        for (int j = 0; j < 6; j++) {
+            word = (word << 1) | parity[j];
+        }
+        words[i] = word;
+        d29 = parity[4];
+        d30 = parity[5];
+    }
+}
+
+static bool referenceCheck(const uint32_t *words, uint32_t *data)
+{
+    int d29 = 0, d30 = 0;
+
+    for (int i = 0; i < 10; i++) {
+        int d[25], parity[6];
+
+        data[i] = 0;
+        for (int k = 1; k <= 24; k++) {
+            d[k] = ((words[i] >> (30 - k)) & 1) ^ d30;
+            data[i] = (data[i] << 1) | d[k];
+        }
+        referenceParity(d, d29, d30, parity);
+        for (int j = 0; j < 6; j++) {
+            if (parity[j] != static_cast<int>((words[i] >> (5 - j)) & 1)) {
+                return false;
+            }
+        }
+        d29 = (words[i] >> 1) & 1;
+        d30 = words[i] & 1;
+    }
+    return true;
+}
+
+/* Stores "count" bits of "value" at d"first" of a 24-bit data word */
+static void put(uint32_t *data, int word, int first, int count, uint32_t value)
+{
+    uint32_t mask = count == 32 ? ~0u : (1u << count) - 1;
+
+    data[word] |= (value & mask) << (25 - first - count);
+}
+
+/* Picks the two non-information bits of word 10 so that it ends in D29 = D30 = 0 */
+static void solveWord10(uint32_t *data)
+{
+    uint32_t words[10];
+
+    for (uint32_t t = 0; t < 4; t++) {
+        data[9] = (data[9] & ~3u) | t;
+        referenceEncode(data, words);
+        if ((words[9] & 3) == 0) {
+            return;
+        }
+    }
+    abort();
+}
+
+static void startSubframe(uint32_t *data, int subframe)
+{
+    memset(data, 0, 10 * sizeof(*data));
+    put(data, 0, 1, 8, 0x8b);
+    put(data, 1, 1, 17, 100 + subframe);
+    put(data, 1, 20, 3, subframe);
+}
+
+class FieldReader {
+public:
+    FieldReader(const uint8_t *data, size_t size) : mData(data), mSize(size) {}
+
+    uint32_t next(int count)
+    {
+        uint32_t value = 0;
+
+        for (int i = 0; i < 4; i++) {
+            value = (value << 8) | (mSize > 0 ? *mData++ : 0);
+            mSize -= mSize > 0 ? 1 : 0;
+        }
+        return count == 32 ? value : value & ((1u << count) - 1);
+    }
+
+private:
+    const uint8_t *mData;
+    size_t mSize;
+};
+
+static int32_t signExtend(uint32_t value, int count)
+{
+    return static_cast<int32_t>(value << (32 - count)) >> (32 - count);
+}
+
+static void makeEphemeris(FieldReader *in, int svid, LnavEphemeris *x)
+{
+    memset(x, 0, sizeof(*x));
+    x->svid = svid;
+    x->week = in->next(10);
+    x->uraIndex = in->next(4);
+    x->health = in->next(6);
+    x->iodc = in->next(10);
+    x->iode = x->iodc & 0xff;
+    x->tgd = static_cast<int8_t>(in->next(8));
+    x->toc = in->next(16);
+    x->af2 = static_cast<int8_t>(in->next(8));
+    x->af1 = static_cast<int16_t>(in->next(16));
+    x->af0 = signExtend(in->next(22), 22);
+    x->crs = static_cast<int16_t>(in->next(16));
+    x->deltaN = static_cast<int16_t>(in->next(16));
+    x->m0 = in->next(32);
+    x->cuc = static_cast<int16_t>(in->next(16));
+    x->e = in->next(32);
+    x->cus = static_cast<int16_t>(in->next(16));
+    x->sqrtA = in->next(32);
+    x->toe = in->next(16);
+    x->fitInterval = in->next(1);
+    x->cic = static_cast<int16_t>(in->next(16));
+    x->omega0 = in->next(32);
+    x->cis = static_cast<int16_t>(in->next(16));
+    x->i0 = in->next(32);
+    x->crc = static_cast<int16_t>(in->next(16));
+    x->omega = in->next(32);
+    x->omegaDot = signExtend(in->next(24), 24);
+    x->idot = signExtend(in->next(14), 14);
+}
+
+/* IS-GPS-200 figure 20-1, subframes 1-3 */
+static void encodeEphemeris(const LnavEphemeris& x, uint32_t data[3][10])
+{
+    uint32_t *a = data[0], *b = data[1], *c = data[2];
+
+    startSubframe(a, 1);
+    put(a, 2, 1, 10, x.week);
+    put(a, 2, 13, 4, x.uraIndex);
+    put(a, 2, 17, 6, x.health);
+    put(a, 2, 23, 2, x.iodc >> 8);
+    put(a, 6, 17, 8, static_cast<uint8_t>(x.tgd));
+    put(a, 7, 1, 8, x.iodc);
+    put(a, 7, 9, 16, x.toc);
+    put(a, 8, 1, 8, static_cast<uint8_t>(x.af2));
+    put(a, 8, 9, 16, static_cast<uint16_t>(x.af1));
+    put(a, 9, 1, 22, static_cast<uint32_t>(x.af0));
+
+    startSubframe(b, 2);
+    put(b, 2, 1, 8, x.iode);
+    put(b, 2, 9, 16, static_cast<uint16_t>(x.crs));
+    put(b, 3, 1, 16, static_cast<uint16_t>(x.deltaN));
+    put(b, 3, 17, 8, static_cast<uint32_t>(x.m0) >> 24);
+    put(b, 4, 1, 24, x.m0);
+    put(b, 5, 1, 16, static_cast<uint16_t>(x.cuc));
+    put(b, 5, 17, 8, x.e >> 24);
+    put(b, 6, 1, 24, x.e);
+    put(b, 7, 1, 16, static_cast<uint16_t>(x.cus));
+    put(b, 7, 17, 8, x.sqrtA >> 24);
+    put(b, 8, 1, 24, x.sqrtA);
+    put(b, 9, 1, 16, x.toe);
+    put(b, 9, 17, 1, x.fitInterval);
+
+    startSubframe(c, 3);
+    put(c, 2, 1, 16, static_cast<uint16_t>(x.cic));
+    put(c, 2, 17, 8, static_cast<uint32_t>(x.omega0) >> 24);
+    put(c, 3, 1, 24, x.omega0);
+    put(c, 4, 1, 16, static_cast<uint16_t>(x.cis));
+    put(c, 4, 17, 8, static_cast<uint32_t>(x.i0) >> 24);
+    put(c, 5, 1, 24, x.i0);
+    put(c, 6, 1, 16, static_cast<uint16_t>(x.crc));
+    put(c, 6, 17, 8, static_cast<uint32_t>(x.omega) >> 24);
+    put(c, 7, 1, 24, x.omega);
+    put(c, 8, 1, 24, static_cast<uint32_t>(x.omegaDot));
+    put(c, 9, 1, 8, x.iode);
+    put(c, 9, 9, 14, static_cast<uint32_t>(x.idot));
+}
+
+static void toBytes(const uint32_t *words, bool inverted, uint8_t *bytes)
+{
+    for (int i = 0; i < 10; i++) {
+        uint32_t word = inverted ? ~words[i] & 0x3fffffff : words[i];
+        bytes[4 * i] = word >> 24;
+        bytes[4 * i + 1] = word >> 16;
+        bytes[4 * i + 2] = word >> 8;
+        bytes[4 * i + 3] = word;
+    }
+}
+
+static void checkRawParity(const uint8_t *bytes)
+{
+    uint32_t words[10], expected[10], actual[10];
+
+    for (int i = 0; i < 10; i++) {
+        const uint8_t *p = bytes + i * 4;
+        words[i] = ((static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]) &
+                0x3fffffff;
+    }
+
+    bool ok = referenceCheck(words, expected);
+    if (NavMessageDecoder::checkParity(words, actual) != ok ||
+            (ok && memcmp(expected, actual, sizeof(expected)) != 0)) {
+        abort();
+    }
+}
+
+static void checkRoundTrip(FieldReader *in, bool inverted, int corruptBit)
+{
+    NavMessageDecoder decoder;
+    LnavEphemeris expected;
+    uint32_t data[3][10];
+    const int svid = 7;
+
+    makeEphemeris(in, svid, &expected);
+    encodeEphemeris(expected, data);
+
+    for (int sf = 0; sf < 3; sf++) {
+        uint32_t words[10];
+        uint8_t bytes[40], corrupt[40];
+        int word = corruptBit / 30, bit = corruptBit % 30;
+
+        solveWord10(data[sf]);
+        referenceEncode(data[sf], words);
+        toBytes(words, inverted, bytes);
+
+        memcpy(corrupt, bytes, sizeof(corrupt));
+        corrupt[4 * word + 3 - bit / 8] ^= 1 << (bit % 8);
+        checkRawParity(bytes);
+        checkRawParity(corrupt);
+        if (decoder.feedSubframe(svid, corrupt, sizeof(corrupt)) !=
+                NavMessageDecoder::RESULT_PARITY_ERROR) {
+            abort();
+        }
+
+        NavMessageDecoder::Result result = decoder.feedSubframe(svid, bytes, sizeof(bytes));
+        if (result != (sf < 2 ? NavMessageDecoder::RESULT_SUBFRAME :
+                NavMessageDecoder::RESULT_EPHEMERIS)) {
+            abort();
+        }
+    }
+
+    const LnavEphemeris *actual = decoder.ephemeris(svid);
+    if (actual == NULL || memcmp(actual, &expected, sizeof(expected)) != 0) {
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 3) {
+        return 0;
+    }
+
+    const uint8_t *body = data + 3;
+    size_t bodyLen = size - 3;
+
+    if (bodyLen >= 40) {
+        NavMessageDecoder decoder;
+        GnssNavigationMessage message;
+
+        checkRawParity(body);
+
+        memset(&message, 0, sizeof(message));
+        message.size = sizeof(message);
+        message.type = GNSS_NAVIGATION_MESSAGE_TYPE_GNSS_L1CA;
+        message.svid = 1 + data[0] % LNAV_MAX_SVID;
+        message.data_length = bodyLen;
+        message.data = const_cast<uint8_t *>(body);
+        decoder.feed(message);
+    }
+
+    FieldReader in(body, bodyLen);
+    checkRoundTrip(&in, data[0] & 1, ((data[1] << 8) | data[2]) % 300);
+    return 0;
+}
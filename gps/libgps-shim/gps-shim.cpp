@@ -0,0 +1,1421 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "gps-shim"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <cutils/properties.h>
+#include <hardware/gps.h>
+#include <log/log.h>
+
+#include "AssistCache.h"
+#include "GeofenceEngine.h"
+#include "GnssTrace.h"
+#include "LatencyTracker.h"
+#include "LocationBatcher.h"
+#include "MeasurementRing.h"
+#include "NavMessageDecoder.h"
+#include "SvStatusTable.h"
+
+#ifndef GPS_SHIM_TARGET
+#if defined(__LP64__)
+#define GPS_SHIM_TARGET "/vendor/lib64/hw/gps.vendor.so"
+#else
+#define GPS_SHIM_TARGET "/vendor/lib/hw/gps.vendor.so"
+#endif
+#endif
+
+/* Raw measurement epochs handed to the framework per wakeup, 1 disables batching */
+#define MEAS_BATCH_PROP "persist.vendor.gps.meas_batch"
+#define MEAS_BATCH_DEFAULT 1
+/* Longest an epoch waits for its batch to fill */
+#define MEAS_FLUSH_MS_PROP "persist.vendor.gps.meas_flush_ms"
+#define MEAS_FLUSH_MS_DEFAULT 5000
+#define MEAS_RING_PROP "persist.vendor.gps.meas_ring"
+#define MEAS_RING_DEFAULT 16
+/* Overwrite the oldest epoch instead of dropping new ones when the ring is full */
+#define MEAS_KEEP_NEWEST_PROP "persist.vendor.gps.meas_keep_newest"
+
+/* Fixes held back while the screen is off before they are flushed, 0 disables batching */
+#define BATCH_SIZE_PROP "persist.vendor.gps.batch_size"
+#define BATCH_SIZE_DEFAULT 0
+#define BATCH_INTERVAL_MS_PROP "persist.vendor.gps.batch_interval_ms"
+#define BATCH_INTERVAL_MS_DEFAULT 60000
+/* An hour of 1 Hz fixes, 84 KiB */
+#define BATCH_CAPACITY 3600
+#define BACKLIGHT_PATH "/sys/class/backlight/panel/brightness"
+/* The backlight attribute cannot be polled for changes, it is read this often instead */
+#define BACKLIGHT_CHECK_MS 1000
+
+/* Take over geofences the chip has no slots left for */
+#define GEOFENCE_FALLBACK_PROP "persist.vendor.gps.geofence_fallback"
+#define GEOFENCE_HYSTERESIS_M 10.0
+#define GEOFENCE_DWELL_MS 3000
+
+/* Last fix and decoded navigation data, handed back to the chip at init */
+#define ASSIST_CACHE_PROP "persist.vendor.gps.assist_cache"
+#define ASSIST_CACHE_PATH "/data/vendor/gps/assist.bin"
+/* Written out on stop, on new navigation data, and this often while navigating */
+#define ASSIST_SYNC_INTERVAL_MS (10 * 60 * 1000)
+/* Assume the device mostly stayed put: the cached fix loses 1 m/s of accuracy */
+#define ASSIST_POSITION_DRIFT_MPS 1.0
+#define ASSIST_MAX_POSITION_UNCERTAINTY_M 200000.0
+#define ASSIST_TIME_UNCERTAINTY_MS 2000
+/* Broadcast ephemeris is fit for 4 hours */
+#define ASSIST_EPHEMERIS_MAX_AGE_MS (4 * 60 * 60 * 1000LL)
+
+/* Skip SV status epochs that change nothing beyond the thresholds below */
+#define SV_CHANGES_ONLY_PROP "persist.vendor.gps.sv_changes_only"
+#define SV_CN0_THRESHOLD_DBHZ 2.0f
+#define SV_ANGLE_THRESHOLD_DEG 1.0f
+/* Latest values are still forwarded this often */
+#define SV_KEEPALIVE_MS 5000
+
+/* Fixes tracked between location_cb and the framework when nothing batches them */
+#define LATENCY_PENDING 16
+
+/* Record what the vendor reports, for gps-replay; rewritten on every init */
+#define TRACE_PROP "persist.vendor.gps.trace"
+#define TRACE_PATH "/data/vendor/gps/trace.gtr"
+/* Location, SV and NMEA records waiting for the trace thread */
+#define TRACE_QUEUE 64
+/* Longer NMEA callbacks are not traced */
+#define TRACE_NMEA_MAX 512
+
+using namespace android;
+
+static const GpsInterface *sVendorInterface;
+static GpsInterface sShimInterface;
+static struct gps_device_t *sVendorDevice;
+static struct gps_device_t sShimDevice;
+
+static GpsCallbacks sFrameworkCallbacks;
+static GpsCallbacks sShimCallbacks;
+
+static std::mutex sBatchLock;
+static std::unique_ptr<LocationBatcher> sBatcher;
+static size_t sBatchSize;
+static int64_t sBatchIntervalMs = BATCH_INTERVAL_MS_DEFAULT;
+static int sBacklightFd = -1;
+static uint64_t sBatchedFixes;
+static uint64_t sBatchFlushes;
+/* CLOCK_BOOTTIME of the first fix in the current batch */
+static int64_t sBatchStartedMs;
+/* Keeps a drained batch and the fixes after it in order */
+static std::mutex sDeliverLock;
+/* Flushes the batch once it is due, even if no further fix arrives */
+static std::atomic<bool> sBatchRunning;
+static sem_t sBatchWakeup;
+static sem_t sBatchExited;
+
+/* Whether the framework currently holds the wakelock on the vendor HAL's behalf */
+static std::mutex sWakelockLock;
+static bool sWakelockHeld;
+
+/*
+ * Geofences the vendor turned down with GPS_GEOFENCE_ERROR_TOO_MANY_GEOFENCES
+ * are evaluated here instead, against the fixes passing through
+ * onLocation(), so they are only watched while the GPS is running.
+ */
+struct PendingGeofence {
+    double latitude;
+    double longitude;
+    double radiusMeters;
+    int lastTransition;
+    int monitorTransitions;
+    int responsivenessMs;
+    int unknownTimerMs;
+};
+
+static const GpsGeofencingInterface *sVendorGeofencing;
+static GpsGeofencingInterface sShimGeofencing;
+static GpsGeofenceCallbacks sFrameworkGeofenceCallbacks;
+static GpsGeofenceCallbacks sShimGeofenceCallbacks;
+
+static std::mutex sGeofenceLock;
+static std::unique_ptr<GeofenceEngine> sGeofences;
+/* Adds waiting for the vendor's verdict, by id */
+static std::map<int32_t, PendingGeofence> sPendingGeofences;
+
+static const GpsMeasurementInterface *sVendorMeasurement;
+static GpsMeasurementInterface sShimMeasurement;
+static GpsMeasurementCallbacks sFrameworkMeasurementCallbacks;
+static GpsMeasurementCallbacks sShimMeasurementCallbacks;
+
+static std::unique_ptr<MeasurementRing> sMeasRing;
+static size_t sMeasBatch = MEAS_BATCH_DEFAULT;
+static int sMeasFlushMs = MEAS_FLUSH_MS_DEFAULT;
+static std::atomic<bool> sMeasRunning;
+/* Posted by the HAL callback when the consumer has something to do */
+static sem_t sMeasWakeup;
+static sem_t sMeasExited;
+
+static std::mutex sAssistLock;
+static AssistCache sAssistCache;
+static int64_t sAssistSyncedMs;
+
+static const GpsNavigationMessageInterface *sVendorNavigation;
+static GpsNavigationMessageInterface sShimNavigation;
+static GpsNavigationMessageCallbacks sFrameworkNavigationCallbacks;
+static GpsNavigationMessageCallbacks sShimNavigationCallbacks;
+
+/* Outlives close(), what was decoded stays valid for the next start */
+static std::mutex sNavLock;
+static NavMessageDecoder sNavDecoder;
+
+static std::mutex sSvLock;
+static SvStatusTable sSvTable(SV_CN0_THRESHOLD_DBHZ, SV_ANGLE_THRESHOLD_DEG);
+static bool sSvChangesOnly;
+static int64_t sSvForwardedMs;
+static uint64_t sSvEpochs;
+static uint64_t sSvSkipped;
+
+static std::mutex sTraceLock;
+static GnssTraceWriter sTrace;
+/* Checked first, so that callbacks never touch the trace queue while nothing is traced */
+static std::atomic<bool> sTracing;
+
+/*
+ * A copy of what a HAL callback reported. The callback only fills a slot;
+ * the trace thread encodes and writes it.
+ */
+struct TraceEvent {
+    GnssTraceType type;
+    int64_t boottimeNs;
+    GpsUtcTime nmeaTimestamp;
+    size_t nmeaLength;
+    union {
+        GpsLocation location;
+        GnssSvStatus svStatus;
+        char nmea[TRACE_NMEA_MAX];
+    };
+};
+
+static std::mutex sTraceQueueLock;
+static std::unique_ptr<TraceEvent[]> sTraceQueue;
+static size_t sTraceHead;
+static size_t sTraceCount;
+static uint64_t sTraceDropped;
+static std::atomic<bool> sTraceFlushPending;
+static sem_t sTraceWakeup;
+static sem_t sTraceExited;
+
+static std::mutex sLatencyLock;
+static std::unique_ptr<LatencyTracker> sLatency;
+
+static const GpsDebugInterface *sVendorDebug;
+static GpsDebugInterface sShimDebug;
+
+/* Set on the threads the vendor asked the framework for */
+static thread_local bool sOnHalThread;
+
+struct HalThread {
+    void (*start)(void *);
+    void *arg;
+};
+
+static int64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t clockMs(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void addMs(struct timespec *ts, int ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/*
+ * Runs on the HAL's thread: never blocks, sem_post is the only syscall.
+ * When tracing, the arrival time rides along in the ring and the consumer
+ * writes the trace.
+ */
+static void onGnssMeasurement(GnssData *data)
+{
+    MeasurementRing *ring = sMeasRing.get();
+
+    if (data == NULL || ring == NULL) {
+        return;
+    }
+
+    ring->push(*data, sTracing.load(std::memory_order_relaxed) ? clockNs(CLOCK_BOOTTIME) : 0);
+
+    /* Wake the consumer on the first epoch, to arm the flush timer, and when the batch is full */
+    size_t pending = ring->pending();
+    if (pending == 1 || pending == sMeasBatch) {
+        sem_post(&sMeasWakeup);
+    }
+}
+
+/* Returns a free slot with sTraceQueueLock held, or NULL if the queue is full. */
+static TraceEvent *traceSlot(std::unique_lock<std::mutex>& lock, GnssTraceType type)
+{
+    lock = std::unique_lock<std::mutex>(sTraceQueueLock);
+    if (sTraceQueue == NULL) {
+        /* Tracing stopped since the caller looked */
+        return NULL;
+    }
+    if (sTraceCount == TRACE_QUEUE) {
+        sTraceDropped++;
+        return NULL;
+    }
+
+    TraceEvent *event = &sTraceQueue[(sTraceHead + sTraceCount) % TRACE_QUEUE];
+    event->type = type;
+    event->boottimeNs = clockNs(CLOCK_BOOTTIME);
+    return event;
+}
+
+/* Called with sTraceQueueLock held through "lock", which it releases */
+static void tracePosted(std::unique_lock<std::mutex>& lock)
+{
+    bool wake = sTraceCount++ == 0;
+
+    lock.unlock();
+    if (wake) {
+        sem_post(&sTraceWakeup);
+    }
+}
+
+static void traceLocation(const GpsLocation& location)
+{
+    std::unique_lock<std::mutex> lock;
+    TraceEvent *event = traceSlot(lock, GNSS_TRACE_LOCATION);
+
+    if (event != NULL) {
+        event->location = location;
+        tracePosted(lock);
+    }
+}
+
+static void traceSvStatus(const GnssSvStatus& status)
+{
+    std::unique_lock<std::mutex> lock;
+    TraceEvent *event = traceSlot(lock, GNSS_TRACE_SV_STATUS);
+
+    if (event != NULL) {
+        event->svStatus = status;
+        tracePosted(lock);
+    }
+}
+
+static void traceNmea(GpsUtcTime timestamp, const char *nmea, size_t length)
+{
+    std::unique_lock<std::mutex> lock;
+
+    if (length > TRACE_NMEA_MAX) {
+        std::lock_guard<std::mutex> dropLock(sTraceQueueLock);
+        sTraceDropped++;
+        return;
+    }
+
+    TraceEvent *event = traceSlot(lock, GNSS_TRACE_NMEA);
+    if (event != NULL) {
+        event->nmeaTimestamp = timestamp;
+        event->nmeaLength = length;
+        memcpy(event->nmea, nmea, length);
+        tracePosted(lock);
+    }
+}
+
+static void writeTraceEvent(const TraceEvent& event)
+{
+    std::lock_guard<std::mutex> lock(sTraceLock);
+
+    switch (event.type) {
+        case GNSS_TRACE_LOCATION:
+            sTrace.writeLocation(event.boottimeNs, event.location);
+            break;
+        case GNSS_TRACE_SV_STATUS:
+            sTrace.writeSvStatus(event.boottimeNs, event.svStatus);
+            break;
+        case GNSS_TRACE_NMEA:
+            sTrace.writeNmea(event.boottimeNs, event.nmeaTimestamp, event.nmea,
+                    event.nmeaLength);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Writes what the location, SV and NMEA callbacks queued, one record at a
+ * time so that the callbacks are never held up by the encoder or by a
+ * write to storage. Measurements are traced by their own consumer.
+ */
+static void traceLoop(void *arg __unused)
+{
+    std::unique_ptr<TraceEvent> event(new TraceEvent());
+    bool running = true;
+
+    while (running) {
+        sem_wait(&sTraceWakeup);
+        running = sTracing.load();
+
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(sTraceQueueLock);
+                if (sTraceCount == 0) {
+                    break;
+                }
+                *event = sTraceQueue[sTraceHead];
+                sTraceHead = (sTraceHead + 1) % TRACE_QUEUE;
+                sTraceCount--;
+            }
+            writeTraceEvent(*event);
+        }
+
+        if (sTraceFlushPending.exchange(false)) {
+            std::lock_guard<std::mutex> lock(sTraceLock);
+            sTrace.flush();
+        }
+    }
+
+    sem_post(&sTraceExited);
+}
+
+static void deliverMeasurements(GnssData *batch, int64_t *timesNs)
+{
+    MeasurementRing *ring = sMeasRing.get();
+    gnss_measurement_callback cb = sFrameworkMeasurementCallbacks.gnss_measurement_callback;
+    size_t count;
+
+    while ((count = ring->pop(batch, sMeasBatch, timesNs)) > 0) {
+        if (sTracing.load()) {
+            std::lock_guard<std::mutex> lock(sTraceLock);
+            for (size_t i = 0; i < count; i++) {
+                /* Stamped before tracing started */
+                if (timesNs[i] != 0) {
+                    sTrace.writeMeasurement(timesNs[i], batch[i]);
+                }
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (cb != NULL) {
+                cb(&batch[i]);
+            }
+        }
+    }
+}
+
+static void measurementLoop(void *arg __unused)
+{
+    std::unique_ptr<GnssData[]> batch(new GnssData[sMeasBatch]);
+    std::unique_ptr<int64_t[]> timesNs(new int64_t[sMeasBatch]);
+    MeasurementRing *ring = sMeasRing.get();
+    uint64_t reportedOverruns = 0;
+
+    while (sMeasRunning.load()) {
+        if (ring->pending() == 0) {
+            sem_wait(&sMeasWakeup);
+        } else if (ring->pending() < sMeasBatch) {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            addMs(&deadline, sMeasFlushMs);
+            while (sMeasRunning.load() && ring->pending() < sMeasBatch &&
+                    sem_timedwait(&sMeasWakeup, &deadline) == 0) {
+            }
+        }
+
+        if (ring->pending() > 0) {
+            deliverMeasurements(batch.get(), timesNs.get());
+        }
+
+        if (ring->overruns() != reportedOverruns) {
+            ALOGW("%s: %" PRIu64 " measurement epochs lost to a full ring", __func__,
+                    ring->overruns() - reportedOverruns);
+            reportedOverruns = ring->overruns();
+        }
+    }
+
+    /* Whatever is left still belongs to the framework */
+    deliverMeasurements(batch.get(), timesNs.get());
+    sem_post(&sMeasExited);
+}
+
+static int initMeasurementShim(GpsMeasurementCallbacks *callbacks)
+{
+    int batch, ring, ret;
+    bool keepNewest;
+
+    if (callbacks == NULL || sFrameworkCallbacks.create_thread_cb == NULL) {
+        return sVendorMeasurement->init(callbacks);
+    }
+
+    batch = property_get_int32(MEAS_BATCH_PROP, MEAS_BATCH_DEFAULT);
+    ring = property_get_int32(MEAS_RING_PROP, MEAS_RING_DEFAULT);
+    sMeasFlushMs = property_get_int32(MEAS_FLUSH_MS_PROP, MEAS_FLUSH_MS_DEFAULT);
+    keepNewest = property_get_bool(MEAS_KEEP_NEWEST_PROP, true);
+
+    sMeasBatch = batch > 0 ? batch : 1;
+    if (ring < static_cast<int>(sMeasBatch)) {
+        ring = sMeasBatch;
+    }
+    if (sMeasFlushMs <= 0) {
+        sMeasFlushMs = MEAS_FLUSH_MS_DEFAULT;
+    }
+
+    memset(&sFrameworkMeasurementCallbacks, 0, sizeof(sFrameworkMeasurementCallbacks));
+    memcpy(&sFrameworkMeasurementCallbacks, callbacks,
+            callbacks->size < sizeof(sFrameworkMeasurementCallbacks) ?
+                    callbacks->size : sizeof(sFrameworkMeasurementCallbacks));
+
+    /* The legacy GpsData callback stays direct, only GnssData goes through the ring */
+    sShimMeasurementCallbacks = sFrameworkMeasurementCallbacks;
+    sShimMeasurementCallbacks.size = sizeof(sShimMeasurementCallbacks);
+    if (sFrameworkMeasurementCallbacks.gnss_measurement_callback == NULL) {
+        return sVendorMeasurement->init(callbacks);
+    }
+    sShimMeasurementCallbacks.gnss_measurement_callback = onGnssMeasurement;
+
+    sMeasRing.reset(new MeasurementRing(ring, keepNewest ?
+            MeasurementRing::KEEP_NEWEST : MeasurementRing::KEEP_OLDEST));
+    sem_init(&sMeasWakeup, 0, 0);
+    sem_init(&sMeasExited, 0, 0);
+    sMeasRunning.store(true);
+    sFrameworkCallbacks.create_thread_cb("gps-shim-meas", measurementLoop, NULL);
+
+    ret = sVendorMeasurement->init(&sShimMeasurementCallbacks);
+    if (ret != GPS_MEASUREMENT_OPERATION_SUCCESS) {
+        sMeasRunning.store(false);
+        sem_post(&sMeasWakeup);
+        sem_wait(&sMeasExited);
+        sMeasRing.reset();
+    }
+
+    ALOGI("%s: batching %zu epochs, ring of %d, %s", __func__, sMeasBatch, ring,
+            keepNewest ? "keep newest" : "keep oldest");
+    return ret;
+}
+
+static void closeMeasurementShim()
+{
+    sVendorMeasurement->close();
+
+    if (sMeasRing != NULL) {
+        sMeasRunning.store(false);
+        sem_post(&sMeasWakeup);
+        sem_wait(&sMeasExited);
+
+        ALOGI("%s: %" PRIu64 " epochs, %" PRIu64 " delivered, %" PRIu64 " lost", __func__,
+                sMeasRing->pushed(), sMeasRing->delivered(), sMeasRing->overruns());
+        sMeasRing.reset();
+        sem_destroy(&sMeasWakeup);
+        sem_destroy(&sMeasExited);
+    }
+}
+
+static void onNavigationMessage(GnssNavigationMessage *message)
+{
+    if (message != NULL) {
+        std::lock_guard<std::mutex> lock(sNavLock);
+        NavMessageDecoder::Result result = sNavDecoder.feed(*message);
+
+        if (result == NavMessageDecoder::RESULT_EPHEMERIS) {
+            const LnavEphemeris *eph = sNavDecoder.ephemeris(sNavDecoder.updatedSvid());
+            ALOGV("%s: G%02d ephemeris IODE %u toe %u", __func__, eph->svid, eph->iode,
+                    eph->toe << 4);
+
+            std::lock_guard<std::mutex> assistLock(sAssistLock);
+            sAssistCache.putRecord(GNSS_CONSTELLATION_GPS, AssistCache::KIND_EPHEMERIS,
+                    eph->svid, eph, sizeof(*eph), clockMs(CLOCK_REALTIME));
+            sAssistCache.sync();
+        } else if (result == NavMessageDecoder::RESULT_ALMANAC) {
+            const LnavAlmanac *alm = sNavDecoder.almanac(sNavDecoder.updatedSvid());
+
+            std::lock_guard<std::mutex> assistLock(sAssistLock);
+            sAssistCache.putRecord(GNSS_CONSTELLATION_GPS, AssistCache::KIND_ALMANAC,
+                    alm->svid, alm, sizeof(*alm), clockMs(CLOCK_REALTIME));
+        }
+    }
+
+    if (sFrameworkNavigationCallbacks.gnss_navigation_message_callback != NULL) {
+        sFrameworkNavigationCallbacks.gnss_navigation_message_callback(message);
+    }
+}
+
+static int initNavigationShim(GpsNavigationMessageCallbacks *callbacks)
+{
+    if (callbacks == NULL) {
+        return sVendorNavigation->init(callbacks);
+    }
+
+    memset(&sFrameworkNavigationCallbacks, 0, sizeof(sFrameworkNavigationCallbacks));
+    memcpy(&sFrameworkNavigationCallbacks, callbacks,
+            callbacks->size < sizeof(sFrameworkNavigationCallbacks) ?
+                    callbacks->size : sizeof(sFrameworkNavigationCallbacks));
+
+    /* Only GnssNavigationMessage carries the constellation, leave the legacy callback alone */
+    sShimNavigationCallbacks = sFrameworkNavigationCallbacks;
+    sShimNavigationCallbacks.size = sizeof(sShimNavigationCallbacks);
+    if (sFrameworkNavigationCallbacks.gnss_navigation_message_callback != NULL) {
+        sShimNavigationCallbacks.gnss_navigation_message_callback = onNavigationMessage;
+    }
+
+    return sVendorNavigation->init(&sShimNavigationCallbacks);
+}
+
+static void closeNavigationShim()
+{
+    sVendorNavigation->close();
+
+    std::lock_guard<std::mutex> lock(sNavLock);
+    ALOGI("%s: %" PRIu64 " subframes decoded, %" PRIu64 " parity errors", __func__,
+            sNavDecoder.subframes(), sNavDecoder.parityErrors());
+}
+
+static void onGeofenceAdd(int32_t geofenceId, int32_t status)
+{
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        auto pending = sPendingGeofences.find(geofenceId);
+
+        if (pending != sPendingGeofences.end()) {
+            const PendingGeofence& p = pending->second;
+            if (status == GPS_GEOFENCE_ERROR_TOO_MANY_GEOFENCES && sGeofences != NULL) {
+                status = sGeofences->add(geofenceId, p.latitude, p.longitude, p.radiusMeters,
+                        p.lastTransition, p.monitorTransitions, p.responsivenessMs,
+                        p.unknownTimerMs);
+                ALOGD("%s: geofence %d kept in software (%zu total): %d", __func__,
+                        geofenceId, sGeofences->size(), status);
+            }
+            sPendingGeofences.erase(pending);
+        }
+    }
+
+    if (sFrameworkGeofenceCallbacks.geofence_add_callback != NULL) {
+        sFrameworkGeofenceCallbacks.geofence_add_callback(geofenceId, status);
+    }
+}
+
+static void initGeofenceShim(GpsGeofenceCallbacks *callbacks)
+{
+    if (callbacks == NULL || !property_get_bool(GEOFENCE_FALLBACK_PROP, true)) {
+        sVendorGeofencing->init(callbacks);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        sFrameworkGeofenceCallbacks = *callbacks;
+        if (sGeofences == NULL) {
+            sGeofences.reset(new GeofenceEngine(GEOFENCE_HYSTERESIS_M, GEOFENCE_DWELL_MS));
+        }
+    }
+
+    sShimGeofenceCallbacks = *callbacks;
+    sShimGeofenceCallbacks.geofence_add_callback = onGeofenceAdd;
+    sVendorGeofencing->init(&sShimGeofenceCallbacks);
+}
+
+static void addGeofenceAreaShim(int32_t geofenceId, double latitude, double longitude,
+        double radiusMeters, int lastTransition, int monitorTransitions,
+        int notificationResponsivenessMs, int unknownTimerMs)
+{
+    bool exists = false;
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        if (sGeofences != NULL) {
+            exists = sGeofences->contains(geofenceId);
+            sPendingGeofences[geofenceId] = { latitude, longitude, radiusMeters,
+                    lastTransition, monitorTransitions, notificationResponsivenessMs,
+                    unknownTimerMs };
+        }
+    }
+
+    /* The vendor would happily add a second one */
+    if (exists) {
+        onGeofenceAdd(geofenceId, GPS_GEOFENCE_ERROR_ID_EXISTS);
+        return;
+    }
+
+    sVendorGeofencing->add_geofence_area(geofenceId, latitude, longitude, radiusMeters,
+            lastTransition, monitorTransitions, notificationResponsivenessMs, unknownTimerMs);
+}
+
+static void pauseGeofenceShim(int32_t geofenceId)
+{
+    int32_t status;
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        if (sGeofences == NULL || !sGeofences->contains(geofenceId)) {
+            status = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+        } else {
+            status = sGeofences->pause(geofenceId);
+        }
+    }
+
+    if (status == GPS_GEOFENCE_ERROR_ID_UNKNOWN) {
+        sVendorGeofencing->pause_geofence(geofenceId);
+    } else if (sFrameworkGeofenceCallbacks.geofence_pause_callback != NULL) {
+        sFrameworkGeofenceCallbacks.geofence_pause_callback(geofenceId, status);
+    }
+}
+
+static void resumeGeofenceShim(int32_t geofenceId, int monitorTransitions)
+{
+    int32_t status;
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        if (sGeofences == NULL || !sGeofences->contains(geofenceId)) {
+            status = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+        } else {
+            status = sGeofences->resume(geofenceId, monitorTransitions);
+        }
+    }
+
+    if (status == GPS_GEOFENCE_ERROR_ID_UNKNOWN) {
+        sVendorGeofencing->resume_geofence(geofenceId, monitorTransitions);
+    } else if (sFrameworkGeofenceCallbacks.geofence_resume_callback != NULL) {
+        sFrameworkGeofenceCallbacks.geofence_resume_callback(geofenceId, status);
+    }
+}
+
+static void removeGeofenceAreaShim(int32_t geofenceId)
+{
+    int32_t status;
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        if (sGeofences == NULL) {
+            status = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+        } else {
+            sPendingGeofences.erase(geofenceId);
+            status = sGeofences->remove(geofenceId);
+        }
+    }
+
+    if (status == GPS_GEOFENCE_ERROR_ID_UNKNOWN) {
+        sVendorGeofencing->remove_geofence_area(geofenceId);
+    } else if (sFrameworkGeofenceCallbacks.geofence_remove_callback != NULL) {
+        sFrameworkGeofenceCallbacks.geofence_remove_callback(geofenceId, status);
+    }
+}
+
+static void evaluateGeofences(GpsLocation *location)
+{
+    std::vector<GeofenceEngine::Transition> transitions;
+
+    {
+        std::lock_guard<std::mutex> lock(sGeofenceLock);
+        if (sGeofences == NULL || sGeofences->size() == 0) {
+            return;
+        }
+        sGeofences->evaluate(*location, &transitions);
+    }
+
+    if (sFrameworkGeofenceCallbacks.geofence_transition_callback == NULL) {
+        return;
+    }
+    for (const auto& t : transitions) {
+        sFrameworkGeofenceCallbacks.geofence_transition_callback(t.id, location, t.transition,
+                location->timestamp);
+    }
+}
+
+static void acquireWakelockShim()
+{
+    std::lock_guard<std::mutex> lock(sWakelockLock);
+
+    if (!sWakelockHeld && sFrameworkCallbacks.acquire_wakelock_cb != NULL) {
+        sWakelockHeld = true;
+        sFrameworkCallbacks.acquire_wakelock_cb();
+    }
+}
+
+/* Also called early for batched fixes; the vendor's own release then finds nothing held */
+static void releaseWakelockShim()
+{
+    std::lock_guard<std::mutex> lock(sWakelockLock);
+
+    if (sWakelockHeld && sFrameworkCallbacks.release_wakelock_cb != NULL) {
+        sWakelockHeld = false;
+        sFrameworkCallbacks.release_wakelock_cb();
+    }
+}
+
+/* Unknown counts as on, so that nothing is held back by mistake */
+static bool screenOn()
+{
+    char value[16];
+    ssize_t len;
+
+    if (sBacklightFd < 0) {
+        return true;
+    }
+
+    len = pread(sBacklightFd, value, sizeof(value) - 1, 0);
+    if (len <= 0) {
+        return true;
+    }
+    value[len] = '\0';
+    return atoi(value) > 0;
+}
+
+static void halThreadMain(void *arg)
+{
+    HalThread thread = *static_cast<HalThread *>(arg);
+
+    delete static_cast<HalThread *>(arg);
+    sOnHalThread = true;
+    thread.start(thread.arg);
+}
+
+static pthread_t createThreadShim(const char *name, void (*start)(void *), void *arg)
+{
+    HalThread *thread = new HalThread { start, arg };
+    pthread_t tid = sFrameworkCallbacks.create_thread_cb(name, halThreadMain, thread);
+
+    if (tid == 0) {
+        delete thread;
+    }
+    return tid;
+}
+
+static void deliverLocation(GpsLocation *location)
+{
+    int64_t dispatchNs = clockNs(CLOCK_BOOTTIME);
+
+    sFrameworkCallbacks.location_cb(location);
+
+    if (location != NULL) {
+        int64_t returnNs = clockNs(CLOCK_BOOTTIME);
+        std::lock_guard<std::mutex> lock(sLatencyLock);
+        if (sLatency != NULL) {
+            sLatency->delivered(location->timestamp, dispatchNs, returnNs);
+        }
+    }
+}
+
+/* Callers hold sDeliverLock */
+static void flushBatchLocked()
+{
+    std::vector<GpsLocation> fixes;
+
+    {
+        std::lock_guard<std::mutex> lock(sBatchLock);
+        if (sBatcher == NULL || sBatcher->size() == 0) {
+            return;
+        }
+        sBatcher->drain(&fixes);
+        sBatchFlushes++;
+    }
+
+    for (auto& fix : fixes) {
+        deliverLocation(&fix);
+    }
+}
+
+static void flushBatch()
+{
+    std::lock_guard<std::mutex> lock(sDeliverLock);
+    flushBatchLocked();
+}
+
+/*
+ * Sleeps until the batch started by onLocation() has been held for
+ * sBatchIntervalMs and flushes it, so that the last fixes before the chip
+ * goes quiet are not held until the next start. While a batch is held the
+ * backlight is checked every BACKLIGHT_CHECK_MS, and the batch goes out as
+ * soon as the screen is back on. Waits on CLOCK_REALTIME like the
+ * measurement consumer, which does not wake a suspended AP: the flush then
+ * happens on the next wakeup, which is what batching is for.
+ */
+static void batchLoop(void *arg __unused)
+{
+    while (sBatchRunning.load()) {
+        int64_t dueMs;
+
+        {
+            std::lock_guard<std::mutex> lock(sBatchLock);
+            dueMs = sBatcher->size() > 0 ? sBatchStartedMs + sBatchIntervalMs : 0;
+        }
+
+        if (dueMs == 0) {
+            sem_wait(&sBatchWakeup);
+            continue;
+        }
+
+        int64_t remainingMs = dueMs - clockMs(CLOCK_BOOTTIME);
+        if (remainingMs > 0 && !screenOn()) {
+            struct timespec deadline;
+            int64_t waitMs = remainingMs < BACKLIGHT_CHECK_MS ? remainingMs : BACKLIGHT_CHECK_MS;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            addMs(&deadline, static_cast<int>(waitMs));
+            /* Anything posted means the batch changed, look again */
+            if (sem_timedwait(&sBatchWakeup, &deadline) == 0 || errno != ETIMEDOUT ||
+                    (waitMs < remainingMs && !screenOn())) {
+                continue;
+            }
+        }
+
+        bool acquired = false;
+        {
+            std::lock_guard<std::mutex> lock(sWakelockLock);
+            if (!sWakelockHeld && sFrameworkCallbacks.acquire_wakelock_cb != NULL) {
+                sWakelockHeld = acquired = true;
+                sFrameworkCallbacks.acquire_wakelock_cb();
+            }
+        }
+        flushBatch();
+        if (acquired) {
+            releaseWakelockShim();
+        }
+    }
+
+    sem_post(&sBatchExited);
+}
+
+static void onLocation(GpsLocation *location)
+{
+    bool batched;
+    bool first = false;
+    bool flush = false;
+
+    if (location != NULL) {
+        int64_t realtimeNs = clockNs(CLOCK_REALTIME);
+        int64_t boottimeNs = clockNs(CLOCK_BOOTTIME);
+        {
+            std::lock_guard<std::mutex> lock(sLatencyLock);
+            if (sLatency != NULL) {
+                sLatency->received(location->timestamp, realtimeNs, boottimeNs, sOnHalThread);
+            }
+        }
+
+        if (sTracing.load()) {
+            traceLocation(*location);
+        }
+    }
+
+    if (location != NULL) {
+        evaluateGeofences(location);
+
+        std::lock_guard<std::mutex> lock(sAssistLock);
+        sAssistCache.putPosition(*location);
+        if (location->timestamp - sAssistSyncedMs >= ASSIST_SYNC_INTERVAL_MS) {
+            sAssistCache.sync();
+            sAssistSyncedMs = location->timestamp;
+        }
+    }
+
+    if (sBatcher == NULL || location == NULL || screenOn()) {
+        std::lock_guard<std::mutex> lock(sDeliverLock);
+        flushBatchLocked();
+        deliverLocation(location);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sBatchLock);
+        batched = sBatcher->add(*location);
+        if (batched) {
+            sBatchedFixes++;
+            first = sBatcher->size() == 1;
+            if (first) {
+                sBatchStartedMs = clockMs(CLOCK_BOOTTIME);
+            }
+            flush = sBatcher->size() >= sBatchSize ||
+                    location->timestamp - sBatcher->oldestTimestamp() >= sBatchIntervalMs;
+        }
+    }
+
+    if (!batched) {
+        /* Too far from the batch to encode, which is overdue anyway */
+        std::lock_guard<std::mutex> lock(sDeliverLock);
+        flushBatchLocked();
+        deliverLocation(location);
+        return;
+    }
+
+    if (flush) {
+        flushBatch();
+    } else {
+        if (first && sBatchRunning.load()) {
+            sem_post(&sBatchWakeup);
+        }
+        /* Nothing to deliver, let the AP sleep until the next fix or the deadline */
+        releaseWakelockShim();
+    }
+}
+
+/*
+ * The framework replaces its whole SV list on every callback, so an epoch
+ * is forwarded as is or not at all.
+ */
+static void onSvStatus(GnssSvStatus *status)
+{
+    if (status != NULL && sTracing.load()) {
+        traceSvStatus(*status);
+    }
+
+    if (status != NULL && sSvChangesOnly) {
+        std::lock_guard<std::mutex> lock(sSvLock);
+        int64_t now = clockMs(CLOCK_BOOTTIME);
+
+        sSvEpochs++;
+        if (sSvTable.update(*status, NULL) == 0 && now - sSvForwardedMs < SV_KEEPALIVE_MS) {
+            sSvSkipped++;
+            return;
+        }
+        sSvForwardedMs = now;
+    }
+
+    sFrameworkCallbacks.gnss_sv_status_cb(status);
+}
+
+static void onNmea(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    if (nmea != NULL && length > 0 && sTracing.load()) {
+        traceNmea(timestamp, nmea, length);
+    }
+
+    sFrameworkCallbacks.nmea_cb(timestamp, nmea, length);
+}
+
+static int startShim()
+{
+    {
+        /* Whoever starts navigating gets the sky right away */
+        std::lock_guard<std::mutex> lock(sSvLock);
+        sSvForwardedMs = INT64_MIN / 2;
+    }
+
+    return sVendorInterface->start();
+}
+
+static int stopShim()
+{
+    int ret = sVendorInterface->stop();
+
+    /* Whoever stopped navigating still gets what was recorded */
+    flushBatch();
+
+    /* The trace thread writes out what is queued, then flushes */
+    if (sTracing.load()) {
+        sTraceFlushPending.store(true);
+        sem_post(&sTraceWakeup);
+    }
+
+    std::lock_guard<std::mutex> lock(sAssistLock);
+    sAssistCache.sync();
+    return ret;
+}
+
+static void deleteAidingDataShim(GpsAidingData flags)
+{
+    {
+        std::lock_guard<std::mutex> lock(sAssistLock);
+        sAssistCache.clear(flags);
+        sAssistCache.sync();
+    }
+
+    sVendorInterface->delete_aiding_data(flags);
+}
+
+/*
+ * gps.h can only take a position and the time; ephemeris and almanac stay
+ * in the cache, ready for a chip specific injection path.
+ */
+static void injectAssistance()
+{
+    AssistCache::Position position;
+    int64_t now = clockMs(CLOCK_REALTIME);
+    bool havePosition;
+    size_t ephemerides;
+
+    {
+        std::lock_guard<std::mutex> lock(sAssistLock);
+        if (!sAssistCache.open(ASSIST_CACHE_PATH)) {
+            ALOGW("%s: cannot open %s: %s", __func__, ASSIST_CACHE_PATH, strerror(errno));
+            return;
+        }
+        havePosition = sAssistCache.position(&position);
+        ephemerides = sAssistCache.countFresh(GNSS_CONSTELLATION_GPS,
+                AssistCache::KIND_EPHEMERIS, now, ASSIST_EPHEMERIS_MAX_AGE_MS);
+    }
+
+    /* A clock behind the last fix has been reset, trust neither */
+    if (!havePosition || now < position.utcMs) {
+        ALOGI("%s: nothing to inject, %zu fresh ephemerides", __func__, ephemerides);
+        return;
+    }
+
+    double uncertainty = position.accuracy +
+            (now - position.utcMs) / 1000.0 * ASSIST_POSITION_DRIFT_MPS;
+    sVendorInterface->inject_time(now, clockMs(CLOCK_BOOTTIME), ASSIST_TIME_UNCERTAINTY_MS);
+    if (uncertainty <= ASSIST_MAX_POSITION_UNCERTAINTY_M) {
+        sVendorInterface->inject_location(position.latitude, position.longitude, uncertainty);
+    }
+
+    ALOGI("%s: fix from %" PRId64 " s ago, +/- %.0f m, %zu fresh ephemerides", __func__,
+            (now - position.utcMs) / 1000, uncertainty, ephemerides);
+}
+
+static void cleanupShim()
+{
+    sVendorInterface->cleanup();
+
+    if (sTracing.load()) {
+        /* The trace thread drains the queue before it exits */
+        sTracing.store(false);
+        sem_post(&sTraceWakeup);
+        sem_wait(&sTraceExited);
+        sem_destroy(&sTraceWakeup);
+        sem_destroy(&sTraceExited);
+
+        std::lock_guard<std::mutex> lock(sTraceLock);
+        ALOGI("%s: traced %" PRIu64 " records in %" PRIu64 " bytes, %" PRIu64 " dropped",
+                __func__, sTrace.records(), sTrace.bytes(), sTraceDropped);
+        sTrace.close();
+
+        std::lock_guard<std::mutex> queueLock(sTraceQueueLock);
+        sTraceQueue.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sLatencyLock);
+        if (sLatency != NULL) {
+            const LatencyHistogram& total = sLatency->histogram(LatencyTracker::STAGE_TOTAL);
+            ALOGI("%s: %" PRIu64 " fixes delivered, %.1f ms median, %.1f ms p99 from the chip",
+                    __func__, total.count(), total.percentile(50) / 1e6,
+                    total.percentile(99) / 1e6);
+            sLatency.reset();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sSvLock);
+        if (sSvEpochs > 0) {
+            ALOGI("%s: %" PRIu64 " of %" PRIu64 " SV status epochs unchanged", __func__,
+                    sSvSkipped, sSvEpochs);
+        }
+    }
+
+    if (sBatchRunning.load()) {
+        sBatchRunning.store(false);
+        sem_post(&sBatchWakeup);
+        sem_wait(&sBatchExited);
+        sem_destroy(&sBatchWakeup);
+        sem_destroy(&sBatchExited);
+    }
+
+    std::lock_guard<std::mutex> lock(sBatchLock);
+    if (sBatcher != NULL) {
+        ALOGI("%s: %" PRIu64 " fixes batched, %" PRIu64 " flushes, %" PRIu64 " evicted",
+                __func__, sBatchedFixes, sBatchFlushes, sBatcher->evicted());
+        sBatcher.reset();
+    }
+    if (sBacklightFd >= 0) {
+        close(sBacklightFd);
+        sBacklightFd = -1;
+    }
+}
+
+static int initShim(GpsCallbacks *callbacks)
+{
+    size_t size;
+    int batchSize;
+
+    if (callbacks == NULL) {
+        return sVendorInterface->init(callbacks);
+    }
+
+    size = callbacks->size < sizeof(sFrameworkCallbacks) ?
+            callbacks->size : sizeof(sFrameworkCallbacks);
+    memset(&sFrameworkCallbacks, 0, sizeof(sFrameworkCallbacks));
+    memcpy(&sFrameworkCallbacks, callbacks, size);
+    memcpy(&sShimCallbacks, callbacks, size);
+
+    /* Always seen, the software geofences need every fix */
+    if (sFrameworkCallbacks.location_cb != NULL) {
+        sShimCallbacks.location_cb = onLocation;
+    }
+
+    if (sFrameworkCallbacks.create_thread_cb != NULL) {
+        sShimCallbacks.create_thread_cb = createThreadShim;
+    }
+
+    if (property_get_bool(TRACE_PROP, false)) {
+        std::lock_guard<std::mutex> lock(sTraceLock);
+        if (sFrameworkCallbacks.create_thread_cb == NULL) {
+            ALOGW("%s: no create_thread_cb, not tracing", __func__);
+        } else if (sTrace.open(TRACE_PATH)) {
+            sTraceQueue.reset(new TraceEvent[TRACE_QUEUE]);
+            sTraceHead = sTraceCount = 0;
+            sTraceDropped = 0;
+            sTraceFlushPending.store(false);
+            sem_init(&sTraceWakeup, 0, 0);
+            sem_init(&sTraceExited, 0, 0);
+            sTracing.store(true);
+            if (sFrameworkCallbacks.create_thread_cb("gps-shim-trace", traceLoop, NULL) == 0) {
+                ALOGW("%s: cannot start the trace thread, not tracing", __func__);
+                sTracing.store(false);
+                sem_destroy(&sTraceWakeup);
+                sem_destroy(&sTraceExited);
+                sTrace.close();
+                sTraceQueue.reset();
+            } else {
+                ALOGI("%s: tracing to %s", __func__, TRACE_PATH);
+            }
+        } else {
+            ALOGW("%s: cannot open %s: %s", __func__, TRACE_PATH, strerror(errno));
+        }
+    }
+
+    sSvChangesOnly = property_get_bool(SV_CHANGES_ONLY_PROP, true);
+    if (sFrameworkCallbacks.gnss_sv_status_cb != NULL && (sSvChangesOnly || sTracing.load())) {
+        sShimCallbacks.gnss_sv_status_cb = onSvStatus;
+    }
+
+    if (sFrameworkCallbacks.nmea_cb != NULL && sTracing.load()) {
+        sShimCallbacks.nmea_cb = onNmea;
+    }
+
+    batchSize = property_get_int32(BATCH_SIZE_PROP, BATCH_SIZE_DEFAULT);
+    sBatchIntervalMs = property_get_int32(BATCH_INTERVAL_MS_PROP, BATCH_INTERVAL_MS_DEFAULT);
+    if (batchSize > 0 && sFrameworkCallbacks.location_cb != NULL) {
+        sBatchSize = batchSize < BATCH_CAPACITY ? batchSize : BATCH_CAPACITY;
+        sBatcher.reset(new LocationBatcher(BATCH_CAPACITY));
+        sBacklightFd = open(BACKLIGHT_PATH, O_RDONLY | O_CLOEXEC);
+        if (sBacklightFd < 0) {
+            ALOGW("%s: cannot read %s, fixes will not be batched", __func__, BACKLIGHT_PATH);
+        }
+
+        sShimCallbacks.acquire_wakelock_cb = acquireWakelockShim;
+        sShimCallbacks.release_wakelock_cb = releaseWakelockShim;
+
+        if (sFrameworkCallbacks.create_thread_cb != NULL) {
+            sem_init(&sBatchWakeup, 0, 0);
+            sem_init(&sBatchExited, 0, 0);
+            sBatchRunning.store(true);
+            if (sFrameworkCallbacks.create_thread_cb("gps-shim-batch", batchLoop, NULL) == 0) {
+                ALOGW("%s: cannot start the batch thread, batches only flush on the next fix",
+                        __func__);
+                sBatchRunning.store(false);
+                sem_destroy(&sBatchWakeup);
+                sem_destroy(&sBatchExited);
+            }
+        } else {
+            ALOGW("%s: no create_thread_cb, batches only flush on the next fix", __func__);
+        }
+        ALOGI("%s: batching up to %zu fixes or %" PRId64 " ms with the screen off", __func__,
+                sBatchSize, sBatchIntervalMs);
+    }
+
+    if (sFrameworkCallbacks.location_cb != NULL) {
+        std::lock_guard<std::mutex> lock(sLatencyLock);
+        sLatency.reset(new LatencyTracker(sBatcher != NULL ? BATCH_CAPACITY : LATENCY_PENDING));
+    }
+
+    int ret = sVendorInterface->init(&sShimCallbacks);
+    if (ret == 0 && property_get_bool(ASSIST_CACHE_PROP, true)) {
+        injectAssistance();
+    }
+    return ret;
+}
+
+/* Whatever the vendor reports, followed by the latency histograms */
+static size_t getInternalStateShim(char *buffer, size_t bufferSize)
+{
+    size_t length = 0;
+
+    if (buffer == NULL || bufferSize == 0) {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    if (sVendorDebug != NULL && sVendorDebug->get_internal_state != NULL) {
+        length = sVendorDebug->get_internal_state(buffer, bufferSize);
+        if (length >= bufferSize) {
+            length = bufferSize - 1;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sLatencyLock);
+    if (sLatency != NULL) {
+        length += sLatency->dump(buffer + length, bufferSize - length);
+    }
+    return length;
+}
+
+static const void *getExtensionShim(const char *name)
+{
+    const void *extension = sVendorInterface->get_extension(name);
+
+    /* Offered even when the vendor has none */
+    if (name != NULL && strcmp(name, GPS_DEBUG_INTERFACE) == 0) {
+        sVendorDebug = static_cast<const GpsDebugInterface *>(extension);
+        sShimDebug.size = sizeof(sShimDebug);
+        sShimDebug.get_internal_state = getInternalStateShim;
+        return &sShimDebug;
+    }
+
+    if (extension == NULL || name == NULL) {
+        return extension;
+    }
+
+    if (strcmp(name, GPS_MEASUREMENT_INTERFACE) == 0) {
+        sVendorMeasurement = static_cast<const GpsMeasurementInterface *>(extension);
+        sShimMeasurement = *sVendorMeasurement;
+        sShimMeasurement.size = sizeof(sShimMeasurement);
+        sShimMeasurement.init = initMeasurementShim;
+        sShimMeasurement.close = closeMeasurementShim;
+        return &sShimMeasurement;
+    }
+
+    if (strcmp(name, GPS_NAVIGATION_MESSAGE_INTERFACE) == 0) {
+        sVendorNavigation = static_cast<const GpsNavigationMessageInterface *>(extension);
+        sShimNavigation = *sVendorNavigation;
+        sShimNavigation.size = sizeof(sShimNavigation);
+        sShimNavigation.init = initNavigationShim;
+        sShimNavigation.close = closeNavigationShim;
+        return &sShimNavigation;
+    }
+
+    if (strcmp(name, GPS_GEOFENCING_INTERFACE) == 0) {
+        sVendorGeofencing = static_cast<const GpsGeofencingInterface *>(extension);
+        sShimGeofencing = *sVendorGeofencing;
+        sShimGeofencing.size = sizeof(sShimGeofencing);
+        sShimGeofencing.init = initGeofenceShim;
+        sShimGeofencing.add_geofence_area = addGeofenceAreaShim;
+        sShimGeofencing.pause_geofence = pauseGeofenceShim;
+        sShimGeofencing.resume_geofence = resumeGeofenceShim;
+        sShimGeofencing.remove_geofence_area = removeGeofenceAreaShim;
+        return &sShimGeofencing;
+    }
+
+    return extension;
+}
+
+static const GpsInterface *getGpsInterfaceShim(struct gps_device_t *dev __unused)
+{
+    return &sShimInterface;
+}
+
+static int closeShim(struct hw_device_t *device __unused)
+{
+    return sVendorDevice->common.close(&sVendorDevice->common);
+}
+
+static int openShim(const struct hw_module_t *module, const char *id,
+        struct hw_device_t **device)
+{
+    const struct hw_module_t *vendorModule;
+    struct hw_device_t *vendorDevice;
+    void *handle;
+    int ret;
+
+    handle = dlopen(GPS_SHIM_TARGET, RTLD_NOW);
+    if (handle == NULL) {
+        ALOGE("%s: failed to load %s: %s", __func__, GPS_SHIM_TARGET, dlerror());
+        return -EINVAL;
+    }
+
+    vendorModule = static_cast<const struct hw_module_t *>(
+            dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR));
+    if (vendorModule == NULL || vendorModule->methods == NULL) {
+        ALOGE("%s: %s is not a HAL module", __func__, GPS_SHIM_TARGET);
+        dlclose(handle);
+        return -EINVAL;
+    }
+
+    ret = vendorModule->methods->open(vendorModule, id, &vendorDevice);
+    if (ret != 0) {
+        ALOGE("%s: %s failed to open: %d", __func__, GPS_SHIM_TARGET, ret);
+        return ret;
+    }
+
+    sVendorDevice = reinterpret_cast<struct gps_device_t *>(vendorDevice);
+    sVendorInterface = sVendorDevice->get_gps_interface(sVendorDevice);
+    if (sVendorInterface == NULL) {
+        ALOGE("%s: %s has no GpsInterface", __func__, GPS_SHIM_TARGET);
+        vendorDevice->close(vendorDevice);
+        return -EINVAL;
+    }
+
+    memset(&sShimInterface, 0, sizeof(sShimInterface));
+    memcpy(&sShimInterface, sVendorInterface,
+            sVendorInterface->size < sizeof(sShimInterface) ?
+                    sVendorInterface->size : sizeof(sShimInterface));
+    sShimInterface.init = initShim;
+    sShimInterface.start = startShim;
+    sShimInterface.stop = stopShim;
+    sShimInterface.cleanup = cleanupShim;
+    sShimInterface.delete_aiding_data = deleteAidingDataShim;
+    if (sVendorInterface->get_extension != NULL) {
+        sShimInterface.get_extension = getExtensionShim;
+    }
+
+    sShimDevice = *sVendorDevice;
+    sShimDevice.common.module = const_cast<struct hw_module_t *>(module);
+    sShimDevice.common.close = closeShim;
+    sShimDevice.get_gps_interface = getGpsInterfaceShim;
+
+    ALOGI("%s: wrapping %s", __func__, GPS_SHIM_TARGET);
+    *device = &sShimDevice.common;
+    return 0;
+}
+
+static struct hw_module_methods_t sShimModuleMethods = {
+    .open = openShim,
+};
+
+struct hw_module_t HAL_MODULE_INFO_SYM = {
+    .tag = HARDWARE_MODULE_TAG,
+    .module_api_version = 1,
+    .hal_api_version = HARDWARE_HAL_API_VERSION,
+    .id = GPS_HARDWARE_MODULE_ID,
+    .name = "GPS HAL shim",
+    .author = "The LineageOS Project",
+    .methods = &sShimModuleMethods,
+};
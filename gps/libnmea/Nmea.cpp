@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+
+#include <nmea/Nmea.h>
+
+namespace android {
+namespace nmea {
+
+static const double kPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+};
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline char charField(std::string_view field)
+{
+    return field.empty() ? 0 : field[0];
+}
+
+/* Exactly "count" digits at "p". */
+static bool digits(const char *p, size_t count, int *out)
+{
+    int value = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!isDigit(p[i])) {
+            return false;
+        }
+        value = value * 10 + (p[i] - '0');
+    }
+    *out = value;
+    return true;
+}
+
+bool parseDecimal(std::string_view field, double *out)
+{
+    uint64_t mantissa = 0;
+    size_t i = 0, significant = 0, fraction = 0;
+    bool negative = false, point = false, any = false;
+
+    if (field.empty()) {
+        *out = NAN;
+        return true;
+    }
+
+    if (field[0] == '-' || field[0] == '+') {
+        negative = field[0] == '-';
+        i++;
+    }
+
+    for (; i < field.size(); i++) {
+        char c = field[i];
+        if (c == '.' && !point) {
+            point = true;
+        } else if (isDigit(c)) {
+            any = true;
+            /* Digits past the 18th only matter before the point */
+            if (significant < 18 && fraction < 18) {
+                mantissa = mantissa * 10 + (c - '0');
+                if (mantissa != 0) {
+                    significant++;
+                }
+                if (point) {
+                    fraction++;
+                }
+            } else if (!point) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (!any) {
+        return false;
+    }
+
+    double value = static_cast<double>(mantissa) / kPow10[fraction];
+    *out = negative ? -value : value;
+    return true;
+}
+
+bool parseInteger(std::string_view field, int *out)
+{
+    size_t i = 0;
+    bool negative = false;
+    int value = 0;
+
+    if (field.empty()) {
+        *out = -1;
+        return true;
+    }
+
+    if (field[0] == '-' || field[0] == '+') {
+        negative = field[0] == '-';
+        i++;
+    }
+    if (i == field.size() || field.size() - i > 9) {
+        return false;
+    }
+
+    for (; i < field.size(); i++) {
+        if (!isDigit(field[i])) {
+            return false;
+        }
+        value = value * 10 + (field[i] - '0');
+    }
+
+    *out = negative ? -value : value;
+    return true;
+}
+
+bool parseTime(std::string_view field, int32_t *out)
+{
+    int hour, minute, second, millis = 0;
+
+    if (field.empty()) {
+        *out = -1;
+        return true;
+    }
+
+    if (field.size() < 6 || !digits(field.data(), 2, &hour) ||
+            !digits(field.data() + 2, 2, &minute) || !digits(field.data() + 4, 2, &second) ||
+            hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    if (field.size() > 6) {
+        int scale = 100;
+
+        if (field[6] != '.') {
+            return false;
+        }
+        for (size_t i = 7; i < field.size(); i++) {
+            if (!isDigit(field[i])) {
+                return false;
+            }
+            millis += (field[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    *out = ((hour * 60 + minute) * 60 + second) * 1000 + millis;
+    return true;
+}
+
+bool parseDate(std::string_view field, int *day, int *month, int *year)
+{
+    if (field.empty()) {
+        *day = *month = *year = -1;
+        return true;
+    }
+
+    if (field.size() != 6 || !digits(field.data(), 2, day) ||
+            !digits(field.data() + 2, 2, month) || !digits(field.data() + 4, 2, year) ||
+            *day < 1 || *day > 31 || *month < 1 || *month > 12) {
+        return false;
+    }
+
+    *year += *year >= 80 ? 1900 : 2000;
+    return true;
+}
+
+bool parseCoordinate(std::string_view value, std::string_view hemisphere, double *out)
+{
+    double raw, degrees, minutes;
+
+    if (value.empty()) {
+        *out = NAN;
+        return true;
+    }
+
+    if (!parseDecimal(value, &raw) || raw < 0 || hemisphere.size() != 1) {
+        return false;
+    }
+
+    degrees = floor(raw / 100);
+    minutes = raw - degrees * 100;
+    if (minutes >= 60) {
+        return false;
+    }
+
+    degrees += minutes / 60;
+    switch (hemisphere[0]) {
+        case 'N':
+        case 'E':
+            *out = degrees;
+            return true;
+        case 'S':
+        case 'W':
+            *out = -degrees;
+            return true;
+        default:
+            return false;
+    }
+}
+
+int64_t toUtcTime(int year, int month, int day, int32_t timeMs)
+{
+    if (year < 0 || month < 1 || day < 1 || timeMs < 0) {
+        return -1;
+    }
+
+    /* Days since 1970-01-01 in the proleptic Gregorian calendar */
+    int y = month <= 2 ? year - 1 : year;
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+
+    return days * 86400000LL + timeMs;
+}
+
+bool decodeGga(const Sentence& s, Gga *out)
+{
+    return s.type() == SENTENCE_GGA &&
+            parseTime(s.field(0), &out->timeMs) &&
+            parseCoordinate(s.field(1), s.field(2), &out->latitude) &&
+            parseCoordinate(s.field(3), s.field(4), &out->longitude) &&
+            parseInteger(s.field(5), &out->quality) &&
+            parseInteger(s.field(6), &out->satellites) &&
+            parseDecimal(s.field(7), &out->hdop) &&
+            parseDecimal(s.field(8), &out->altitude) &&
+            parseDecimal(s.field(10), &out->geoidSeparation);
+}
+
+bool decodeRmc(const Sentence& s, Rmc *out)
+{
+    double variation;
+
+    if (s.type() != SENTENCE_RMC ||
+            !parseTime(s.field(0), &out->timeMs) ||
+            !parseCoordinate(s.field(2), s.field(3), &out->latitude) ||
+            !parseCoordinate(s.field(4), s.field(5), &out->longitude) ||
+            !parseDecimal(s.field(6), &out->speedKnots) ||
+            !parseDecimal(s.field(7), &out->course) ||
+            !parseDate(s.field(8), &out->day, &out->month, &out->year) ||
+            !parseDecimal(s.field(9), &variation)) {
+        return false;
+    }
+
+    out->valid = charField(s.field(1)) == 'A';
+    out->magneticVariation = charField(s.field(10)) == 'W' ? -variation : variation;
+    out->mode = charField(s.field(11));
+    return true;
+}
+
+bool decodeGsa(const Sentence& s, Gsa *out)
+{
+    if (s.type() != SENTENCE_GSA ||
+            !parseInteger(s.field(1), &out->fixType) ||
+            !parseDecimal(s.field(14), &out->pdop) ||
+            !parseDecimal(s.field(15), &out->hdop) ||
+            !parseDecimal(s.field(16), &out->vdop) ||
+            !parseInteger(s.field(17), &out->systemId)) {
+        return false;
+    }
+
+    out->selection = charField(s.field(0));
+    out->svidCount = 0;
+    for (size_t i = 2; i < 14; i++) {
+        int svid;
+        if (!parseInteger(s.field(i), &svid)) {
+            return false;
+        }
+        if (svid >= 0) {
+            out->svids[out->svidCount++] = svid;
+        }
+    }
+    return true;
+}
+
+bool decodeGsv(const Sentence& s, Gsv *out)
+{
+    size_t groups;
+
+    if (s.type() != SENTENCE_GSV || s.fieldCount() < 3 ||
+            !parseInteger(s.field(0), &out->messageCount) ||
+            !parseInteger(s.field(1), &out->messageNumber) ||
+            !parseInteger(s.field(2), &out->satellitesInView)) {
+        return false;
+    }
+
+    /* A trailing field after whole satellite groups is the NMEA 4.1 signal id */
+    groups = (s.fieldCount() - 3) / 4;
+    out->signalId = -1;
+    if ((s.fieldCount() - 3) % 4 == 1 && !parseInteger(s.field(s.fieldCount() - 1), &out->signalId)) {
+        return false;
+    }
+    if (groups > 4) {
+        return false;
+    }
+
+    out->satelliteCount = 0;
+    for (size_t g = 0; g < groups; g++) {
+        GsvSatellite *sat = &out->satellites[out->satelliteCount];
+        size_t base = 3 + g * 4;
+
+        if (!parseInteger(s.field(base), &sat->svid) ||
+                !parseInteger(s.field(base + 1), &sat->elevation) ||
+                !parseInteger(s.field(base + 2), &sat->azimuth) ||
+                !parseInteger(s.field(base + 3), &sat->snr)) {
+            return false;
+        }
+        if (sat->svid >= 0) {
+            out->satelliteCount++;
+        }
+    }
+    return true;
+}
+
+bool decodeGns(const Sentence& s, Gns *out)
+{
+    if (s.type() != SENTENCE_GNS ||
+            !parseTime(s.field(0), &out->timeMs) ||
+            !parseCoordinate(s.field(1), s.field(2), &out->latitude) ||
+            !parseCoordinate(s.field(3), s.field(4), &out->longitude) ||
+            !parseInteger(s.field(6), &out->satellites) ||
+            !parseDecimal(s.field(7), &out->hdop) ||
+            !parseDecimal(s.field(8), &out->altitude) ||
+            !parseDecimal(s.field(9), &out->geoidSeparation)) {
+        return false;
+    }
+
+    out->mode = s.field(5);
+    out->navStatus = charField(s.field(12));
+    return true;
+}
+
+} // namespace nmea
+} // namespace android
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include <nmea/Sentence.h>
+
+namespace android {
+namespace nmea {
+
+static const uint64_t kOnes = 0x0101010101010101ULL;
+static const uint64_t kLow7 = 0x7f7f7f7f7f7f7f7fULL;
+static const uint64_t kHigh = 0x8080808080808080ULL;
+
+static inline uint64_t loadLe64(const char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/* 0x80 in every byte of "word" equal to "c", 0 elsewhere; no false positives. */
+static inline uint64_t matchBytes(uint64_t word, char c)
+{
+    uint64_t x = word ^ (kOnes * static_cast<uint8_t>(c));
+
+    return ~(((x & kLow7) + kLow7) | x | kLow7);
+}
+
+static inline uint8_t foldXor(uint64_t acc)
+{
+    acc ^= acc >> 32;
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    return static_cast<uint8_t>(acc);
+}
+
+uint8_t checksum(const char *data, size_t length)
+{
+    uint64_t acc = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        acc ^= loadLe64(data + i);
+    }
+    for (; i < length; i++) {
+        acc ^= static_cast<uint8_t>(data[i]);
+    }
+
+    return foldXor(acc);
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static SentenceType typeOf(std::string_view formatter)
+{
+    static const struct {
+        const char *name;
+        SentenceType type;
+    } kTypes[] = {
+        { "GGA", SENTENCE_GGA },
+        { "GNS", SENTENCE_GNS },
+        { "GSA", SENTENCE_GSA },
+        { "GSV", SENTENCE_GSV },
+        { "RMC", SENTENCE_RMC },
+    };
+
+    if (formatter.size() != 3) {
+        return SENTENCE_UNKNOWN;
+    }
+    for (const auto& t : kTypes) {
+        if (formatter == t.name) {
+            return t.type;
+        }
+    }
+    return SENTENCE_UNKNOWN;
+}
+
+Sentence::Sentence()
+    : mType(SENTENCE_UNKNOWN),
+      mCount(0)
+{
+}
+
+bool Sentence::parse(const char *data, size_t length)
+{
+    size_t start = 0, star = 0, i = 0;
+    bool found = false;
+    uint64_t acc = 0;
+    const char *body;
+    int hi, lo;
+
+    mType = SENTENCE_UNKNOWN;
+    mAddress = std::string_view();
+    mTalker = std::string_view();
+    mFormatter = std::string_view();
+    mCount = 0;
+
+    while (length > 0 && (data[length - 1] == '\r' || data[length - 1] == '\n' ||
+            data[length - 1] == '\0')) {
+        length--;
+    }
+    if (length < 4 || (data[0] != '$' && data[0] != '!')) {
+        return false;
+    }
+
+    body = data + 1;
+    length -= 1;
+
+    /* Word at a time up to the '*', the scalar loop handles the tail */
+    while (!found && i + 8 <= length) {
+        uint64_t word = loadLe64(body + i);
+        uint64_t commas = matchBytes(word, ',');
+        uint64_t stars = matchBytes(word, '*');
+
+        if (stars != 0) {
+            int bits = __builtin_ctzll(stars) & ~7;
+            uint64_t before = bits == 0 ? 0 : ~0ULL >> (64 - bits);
+
+            word &= before;
+            commas &= before;
+            star = i + bits / 8;
+            found = true;
+        }
+        acc ^= word;
+
+        for (; commas != 0; commas &= commas - 1) {
+            size_t pos = i + __builtin_ctzll(commas) / 8;
+            if (!addField(std::string_view(body + start, pos - start))) {
+                mCount = 0;
+                return false;
+            }
+            start = pos + 1;
+        }
+        if (!found) {
+            i += 8;
+        }
+    }
+
+    for (; !found && i < length; i++) {
+        if (body[i] == '*') {
+            star = i;
+            found = true;
+        } else {
+            acc ^= static_cast<uint8_t>(body[i]);
+            if (body[i] == ',') {
+                if (!addField(std::string_view(body + start, i - start))) {
+                    mCount = 0;
+                    return false;
+                }
+                start = i + 1;
+            }
+        }
+    }
+
+    hi = found && star + 3 == length ? hexValue(body[star + 1]) : -1;
+    lo = found && star + 3 == length ? hexValue(body[star + 2]) : -1;
+    if (hi < 0 || lo < 0 || foldXor(acc) != (hi << 4 | lo) ||
+            !addField(std::string_view(body + start, star - start))) {
+        mCount = 0;
+        return false;
+    }
+
+    /* The address is talker plus formatter, or 'P' plus a maker code */
+    if (mAddress.size() < 2) {
+        mCount = 0;
+        return false;
+    }
+    if (mAddress[0] == 'P') {
+        mFormatter = mAddress.substr(1);
+    } else {
+        mTalker = mAddress.substr(0, 2);
+        mFormatter = mAddress.substr(2);
+        mType = typeOf(mFormatter);
+    }
+    return true;
+}
+
+bool Sentence::addField(std::string_view field)
+{
+    if (mAddress.data() == NULL) {
+        mAddress = field;
+        return true;
+    }
+    if (mCount == kMaxFields) {
+        return false;
+    }
+    mFields[mCount++] = field;
+    return true;
+}
+
+} // namespace nmea
+} // namespace android
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <nmea/Nmea.h>
+#include <nmea/Sentence.h>
+
+/*
+ * Parsing cost of the sentences a GPS HAL hands to gps_nmea_callback: one
+ * epoch of a multi-constellation receiver, GGA on its own, and GGA through
+ * the sscanf() parsing this library replaces.
+ */
+
+using namespace android::nmea;
+
+static std::string withChecksum(const char *body)
+{
+    char sentence[128];
+
+    snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum(body, strlen(body)));
+    return sentence;
+}
+
+static const char kGga[] = "GPGGA,123519.00,4807.0381,N,01134.5668,E,1,12,0.9,519.4,M,47.0,M,,";
+
+/* GGA, RMC, GSA, three GSV and GNS, as sent once per fix */
+static std::vector<std::string> epoch()
+{
+    static const char *kBodies[] = {
+        kGga,
+        "GPRMC,123519.00,A,4807.0381,N,01134.5668,E,0.8,84.4,150620,3.1,E,A",
+        "GNGSA,A,3,02,04,06,08,10,12,14,16,18,20,,,1.6,0.9,1.3,1",
+        "GPGSV,3,1,12,02,45,083,44,04,31,211,40,06,12,320,33,08,67,145,47,1",
+        "GPGSV,3,2,12,10,22,040,38,12,08,275,29,14,55,190,45,16,71,012,48,1",
+        "GPGSV,3,3,12,18,36,102,41,20,15,233,35,22,,,,24,05,300,,1",
+        "GNGNS,123519.00,4807.0381,N,01134.5668,E,AAN,16,0.9,519.4,47.0,,,V",
+    };
+    std::vector<std::string> sentences;
+
+    for (const char *body : kBodies) {
+        sentences.push_back(withChecksum(body));
+    }
+    return sentences;
+}
+
+static bool decode(const Sentence& sentence)
+{
+    switch (sentence.type()) {
+        case SENTENCE_GGA: {
+            Gga gga;
+            return decodeGga(sentence, &gga);
+        }
+        case SENTENCE_RMC: {
+            Rmc rmc;
+            return decodeRmc(sentence, &rmc);
+        }
+        case SENTENCE_GSA: {
+            Gsa gsa;
+            return decodeGsa(sentence, &gsa);
+        }
+        case SENTENCE_GSV: {
+            Gsv gsv;
+            return decodeGsv(sentence, &gsv);
+        }
+        case SENTENCE_GNS: {
+            Gns gns;
+            return decodeGns(sentence, &gns);
+        }
+        default:
+            return false;
+    }
+}
+
+static void BM_ParseEpoch(benchmark::State& state)
+{
+    std::vector<std::string> sentences = epoch();
+    Sentence sentence;
+
+    for (auto _ : state) {
+        for (const std::string& s : sentences) {
+            bool ok = sentence.parse(s.data(), s.size()) && decode(sentence);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * sentences.size());
+}
+BENCHMARK(BM_ParseEpoch);
+
+static void BM_SplitEpoch(benchmark::State& state)
+{
+    std::vector<std::string> sentences = epoch();
+    Sentence sentence;
+
+    for (auto _ : state) {
+        for (const std::string& s : sentences) {
+            benchmark::DoNotOptimize(sentence.parse(s.data(), s.size()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * sentences.size());
+}
+BENCHMARK(BM_SplitEpoch);
+
+static void BM_ParseGga(benchmark::State& state)
+{
+    std::string s = withChecksum(kGga);
+    Sentence sentence;
+    Gga gga;
+
+    for (auto _ : state) {
+        bool ok = sentence.parse(s.data(), s.size()) && decodeGga(sentence, &gga);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(gga);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseGga);
+
+/* The checksum loop and sscanf() a HAL wrapper would otherwise use */
+static void BM_SscanfGga(benchmark::State& state)
+{
+    std::string s = withChecksum(kGga);
+
+    for (auto _ : state) {
+        const char *star = strchr(s.c_str(), '*');
+        uint8_t sum = 0;
+        unsigned expected = 0;
+        double time, latitude, longitude, hdop, altitude, separation;
+        char ns, ew;
+        int quality, satellites;
+
+        for (const char *p = s.c_str() + 1; p < star; p++) {
+            sum ^= *p;
+        }
+        bool ok = sscanf(star + 1, "%2x", &expected) == 1 && expected == sum &&
+                sscanf(s.c_str(), "$GPGGA,%lf,%lf,%c,%lf,%c,%d,%d,%lf,%lf,M,%lf,M", &time,
+                        &latitude, &ns, &longitude, &ew, &quality, &satellites, &hdop,
+                        &altitude, &separation) == 10;
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(latitude);
+        benchmark::DoNotOptimize(separation);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SscanfGga);
+
+BENCHMARK_MAIN();
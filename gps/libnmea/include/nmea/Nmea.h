@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NMEA_NMEA_H
+#define NMEA_NMEA_H
+
+#include <stdint.h>
+
+#include <nmea/Sentence.h>
+
+/*
+ * Decoders for the sentences GNSS chips report through gps_nmea_callback.
+ * Empty fields decode to NaN for real values and -1 for integers; a
+ * malformed non-empty field fails the whole sentence. Nothing here uses
+ * strtod or the locale.
+ */
+
+namespace android {
+namespace nmea {
+
+/* hhmmss[.sss] as milliseconds since midnight, -1 if empty. */
+bool parseTime(std::string_view field, int32_t *out);
+
+/* ddmmyy; years 80-99 are 1980-1999, 00-79 are 2000-2079. */
+bool parseDate(std::string_view field, int *day, int *month, int *year);
+
+/* [d]ddmm.mmmm plus N/S/E/W into signed degrees. */
+bool parseCoordinate(std::string_view value, std::string_view hemisphere, double *out);
+
+bool parseDecimal(std::string_view field, double *out);
+bool parseInteger(std::string_view field, int *out);
+
+/* Milliseconds since the epoch, the GpsUtcTime of a fix, or -1. */
+int64_t toUtcTime(int year, int month, int day, int32_t timeMs);
+
+struct Gga {
+    int32_t timeMs;
+    double latitude;
+    double longitude;
+    int quality;                /* 0 = no fix, 1 = GPS, 2 = DGPS, ... */
+    int satellites;
+    double hdop;
+    double altitude;            /* metres above mean sea level */
+    double geoidSeparation;
+};
+
+struct Rmc {
+    int32_t timeMs;
+    bool valid;                 /* status 'A' */
+    double latitude;
+    double longitude;
+    double speedKnots;
+    double course;              /* degrees true */
+    int day;
+    int month;
+    int year;
+    double magneticVariation;   /* east positive */
+    char mode;                  /* NMEA 2.3 mode indicator, 0 if absent */
+};
+
+struct Gsa {
+    char selection;             /* 'M'anual or 'A'utomatic */
+    int fixType;                /* 1 = none, 2 = 2D, 3 = 3D */
+    int svids[12];
+    int svidCount;
+    double pdop;
+    double hdop;
+    double vdop;
+    int systemId;               /* NMEA 4.1, -1 if absent */
+};
+
+struct GsvSatellite {
+    int svid;
+    int elevation;
+    int azimuth;
+    int snr;                    /* dB-Hz, -1 when not tracking */
+};
+
+struct Gsv {
+    int messageCount;
+    int messageNumber;
+    int satellitesInView;
+    GsvSatellite satellites[4];
+    int satelliteCount;
+    int signalId;               /* NMEA 4.1, -1 if absent */
+};
+
+struct Gns {
+    int32_t timeMs;
+    double latitude;
+    double longitude;
+    std::string_view mode;      /* one character per constellation */
+    int satellites;
+    double hdop;
+    double altitude;
+    double geoidSeparation;
+    char navStatus;             /* NMEA 4.1, 0 if absent */
+};
+
+bool decodeGga(const Sentence& sentence, Gga *out);
+bool decodeRmc(const Sentence& sentence, Rmc *out);
+bool decodeGsa(const Sentence& sentence, Gsa *out);
+bool decodeGsv(const Sentence& sentence, Gsv *out);
+bool decodeGns(const Sentence& sentence, Gns *out);
+
+} // namespace nmea
+} // namespace android
+
+#endif // NMEA_NMEA_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NMEA_SENTENCE_H
+#define NMEA_SENTENCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+/*
+ * Allocation free NMEA 0183 framing for the sentences handed out by
+ * gps_nmea_callback. Fields are views into the caller's buffer, which has
+ * to outlive the Sentence.
+ */
+
+namespace android {
+namespace nmea {
+
+enum SentenceType {
+    SENTENCE_UNKNOWN,
+    SENTENCE_GGA,
+    SENTENCE_GNS,
+    SENTENCE_GSA,
+    SENTENCE_GSV,
+    SENTENCE_RMC,
+};
+
+/* Enough for GSV (4 satellites plus signal id) and NMEA 4.1 GSA. */
+static const size_t kMaxFields = 32;
+
+/*
+ * XOR of "length" bytes, the NMEA checksum of everything between '$' and
+ * '*'. Eight bytes are folded per step.
+ */
+uint8_t checksum(const char *data, size_t length);
+
+class Sentence {
+public:
+    Sentence();
+
+    /*
+     * Parses "$<address>,<field>,...*<hh>", optionally followed by any mix
+     * of CR, LF and NUL as some HALs include them in "length". Returns
+     * false on bad framing, a checksum mismatch or too many fields.
+     *
+     * The delimiter search and the checksum share a single pass over the
+     * sentence, eight bytes at a time.
+     */
+    bool parse(const char *data, size_t length);
+    bool parse(std::string_view sentence) { return parse(sentence.data(), sentence.size()); }
+
+    /* "GP", "GL", "GN", ...; empty for proprietary sentences. */
+    std::string_view talker() const { return mTalker; }
+    std::string_view formatter() const { return mFormatter; }
+    SentenceType type() const { return mType; }
+
+    /* Data fields, not counting the address field. */
+    size_t fieldCount() const { return mCount; }
+
+    /* Out of range fields read as empty, like trailing empty fields. */
+    std::string_view field(size_t index) const {
+        return index < mCount ? mFields[index] : std::string_view();
+    }
+
+private:
+    bool addField(std::string_view field);
+
+    std::string_view mAddress;
+    std::string_view mTalker;
+    std::string_view mFormatter;
+    SentenceType mType;
+    size_t mCount;
+    std::string_view mFields[kMaxFields];
+};
+
+} // namespace nmea
+} // namespace android
+
+#endif // NMEA_SENTENCE_H
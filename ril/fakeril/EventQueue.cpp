@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+
+#include <chrono>
+
+#include "EventQueue.h"
+
+namespace android {
+
+int64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+EventQueue::EventQueue()
+    : mSeq(0),
+      mStopping(false),
+      mThread(&EventQueue::loop, this)
+{
+}
+
+EventQueue::~EventQueue()
+{
+    stop();
+}
+
+void EventQueue::postAt(int64_t whenNs, std::function<void()> fn)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mEvents.push(Event{whenNs, mSeq++, std::move(fn)});
+    mCond.notify_one();
+}
+
+void EventQueue::postDelayed(int64_t delayNs, std::function<void()> fn)
+{
+    postAt(monotonicNs() + delayNs, std::move(fn));
+}
+
+void EventQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+        mCond.notify_one();
+    }
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void EventQueue::loop()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+
+    for (;;) {
+        if (mEvents.empty()) {
+            if (mStopping) {
+                return;
+            }
+            mCond.wait(lock);
+            continue;
+        }
+
+        int64_t now = monotonicNs();
+        int64_t when = mEvents.top().whenNs;
+        if (when > now) {
+            if (mStopping) {
+                return;
+            }
+            mCond.wait_for(lock, std::chrono::nanoseconds(when - now));
+            continue;
+        }
+
+        std::function<void()> fn = std::move(const_cast<Event&>(mEvents.top()).fn);
+        mEvents.pop();
+
+        lock.unlock();
+        fn();
+        lock.lock();
+    }
+}
+
+} // namespace android
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKERIL_EVENT_QUEUE_H
+#define FAKERIL_EVENT_QUEUE_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+int64_t monotonicNs();
+
+/*
+ * Single worker thread running callbacks at absolute monotonic times.
+ * Callbacks due at the same time run in the order they were posted, which
+ * keeps replays deterministic.
+ */
+class EventQueue {
+public:
+    EventQueue();
+    ~EventQueue();
+
+    void postAt(int64_t whenNs, std::function<void()> fn);
+    void postDelayed(int64_t delayNs, std::function<void()> fn);
+
+    /* Runs everything already due, then stops the worker. */
+    void stop();
+
+private:
+    struct Event {
+        int64_t whenNs;
+        uint64_t seq;
+        std::function<void()> fn;
+    };
+
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.whenNs != b.whenNs ? a.whenNs > b.whenNs : a.seq > b.seq;
+        }
+    };
+
+    void loop();
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::priority_queue<Event, std::vector<Event>, Later> mEvents;
+    uint64_t mSeq;
+    bool mStopping;
+    std::thread mThread;
+};
+
+} // namespace android
+
+#endif // FAKERIL_EVENT_QUEUE_H
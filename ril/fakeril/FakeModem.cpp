@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "fakeril"
+
+#include <log/log.h>
+
+#include "FakeModem.h"
+
+namespace android {
+
+FakeModem::FakeModem(const struct RIL_Env *env,
+        std::vector<std::unique_ptr<TraceRecord>> trace, double speed)
+    : mEnv(env),
+      mTrace(std::move(trace)),
+      mSpeed(speed > 0 ? speed : 1.0)
+{
+    for (const auto& record : mTrace) {
+        if (record->type == TraceRecord::REQUEST) {
+            mResponses[record->id].push_back(record.get());
+        }
+    }
+}
+
+FakeModem::~FakeModem()
+{
+    mQueue.stop();
+}
+
+void FakeModem::start()
+{
+    int64_t base = monotonicNs();
+
+    for (const auto& record : mTrace) {
+        if (record->type != TraceRecord::UNSOLICITED) {
+            continue;
+        }
+
+        TraceRecord *urc = record.get();
+        int64_t when = base + static_cast<int64_t>(urc->timeUs * 1000 / mSpeed);
+        mQueue.postAt(when, [this, urc]() {
+#if defined(ANDROID_MULTI_SIM)
+            mEnv->OnUnsolicitedResponse(urc->id, urc->response.data(), urc->response.size(),
+                    RIL_SOCKET_1);
+#else
+            mEnv->OnUnsolicitedResponse(urc->id, urc->response.data(), urc->response.size());
+#endif
+        });
+    }
+}
+
+void FakeModem::complete(RIL_Token t, RIL_Errno e, void *response, size_t responselen)
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mPending.find(t);
+        if (it == mPending.end()) {
+            /* already completed by onCancel */
+            return;
+        }
+        mPending.erase(it);
+    }
+
+    mEnv->OnRequestComplete(t, e, response, responselen);
+}
+
+void FakeModem::onRequest(int request, void *data __unused, size_t datalen __unused,
+        RIL_Token t)
+{
+    TraceRecord *record = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPending.insert(t);
+
+        auto it = mResponses.find(request);
+        if (it != mResponses.end()) {
+            size_t& cursor = mCursors[request];
+            record = it->second[cursor];
+            cursor = (cursor + 1) % it->second.size();
+        }
+    }
+
+    if (record == NULL) {
+        mQueue.postDelayed(0, [this, t]() {
+            complete(t, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
+        });
+        return;
+    }
+
+    mQueue.postDelayed(static_cast<int64_t>(record->latencyUs * 1000 / mSpeed), [this, t, record]() {
+        complete(t, static_cast<RIL_Errno>(record->error), record->response.data(),
+                record->response.size());
+    });
+}
+
+int FakeModem::supports(int request)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mResponses.count(request) ? 1 : 0;
+}
+
+void FakeModem::onCancel(RIL_Token t)
+{
+    mQueue.postDelayed(0, [this, t]() {
+        complete(t, RIL_E_CANCELLED, NULL, 0);
+    });
+}
+
+} // namespace android
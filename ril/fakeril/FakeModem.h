@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKERIL_FAKE_MODEM_H
+#define FAKERIL_FAKE_MODEM_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <telephony/ril.h>
+
+#include "EventQueue.h"
+#include "Trace.h"
+
+namespace android {
+
+/*
+ * Vendor RIL stand-in that answers requests from a recorded trace.
+ *
+ * Each request id is answered with the recorded responses for that id in
+ * order, wrapping around when the recording runs out, after the recorded
+ * modem latency divided by "speed". Recorded unsolicited responses are
+ * emitted at their recorded times once start() is called.
+ */
+class FakeModem {
+public:
+    FakeModem(const struct RIL_Env *env, std::vector<std::unique_ptr<TraceRecord>> trace,
+            double speed);
+    ~FakeModem();
+
+    void start();
+
+    void onRequest(int request, void *data, size_t datalen, RIL_Token t);
+    int supports(int request);
+    void onCancel(RIL_Token t);
+
+private:
+    void complete(RIL_Token t, RIL_Errno e, void *response, size_t responselen);
+
+    const struct RIL_Env *mEnv;
+    std::vector<std::unique_ptr<TraceRecord>> mTrace;
+    double mSpeed;
+
+    std::mutex mLock;
+    std::map<int, std::vector<TraceRecord *>> mResponses;
+    std::map<int, size_t> mCursors;
+    /* A multiset: nothing stops a client from reusing a token it has in flight */
+    std::multiset<RIL_Token> mPending;
+
+    EventQueue mQueue;
+};
+
+} // namespace android
+
+#endif // FAKERIL_FAKE_MODEM_H
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "fakeril"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <log/log.h>
+
+#include "Trace.h"
+
+namespace android {
+
+static std::vector<std::string> split(const std::string& text, char sep)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+
+    for (;;) {
+        size_t end = text.find(sep, start);
+        parts.push_back(text.substr(start, end - start));
+        if (end == std::string::npos) {
+            return parts;
+        }
+        start = end + 1;
+    }
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool Payload::parse(const std::string& text)
+{
+    mBytes.clear();
+    mStrings.clear();
+    mPointers.clear();
+    mData = nullptr;
+    mSize = 0;
+
+    if (text == "-") {
+        return true;
+    }
+
+    if (text.size() < 2 || text[1] != ':') {
+        return false;
+    }
+
+    const std::string body = text.substr(2);
+
+    switch (text[0]) {
+        case 'x':
+            if (body.size() % 2 != 0) {
+                return false;
+            }
+            for (size_t i = 0; i < body.size(); i += 2) {
+                int hi = hexValue(body[i]);
+                int lo = hexValue(body[i + 1]);
+                if (hi < 0 || lo < 0) {
+                    return false;
+                }
+                mBytes.push_back(static_cast<uint8_t>(hi << 4 | lo));
+            }
+            mData = mBytes.data();
+            mSize = mBytes.size();
+            return true;
+        case 'i':
+            for (const std::string& value : split(body, ',')) {
+                char *end;
+                int v = static_cast<int>(strtol(value.c_str(), &end, 0));
+                if (value.empty() || *end != '\0') {
+                    return false;
+                }
+                const uint8_t *p = reinterpret_cast<const uint8_t *>(&v);
+                mBytes.insert(mBytes.end(), p, p + sizeof(v));
+            }
+            mData = mBytes.data();
+            mSize = mBytes.size();
+            return true;
+        case 's':
+            for (const std::string& value : split(body, '|')) {
+                if (value == "-") {
+                    mPointers.push_back(nullptr);
+                    continue;
+                }
+                mStrings.emplace_back(new std::string(value));
+                mPointers.push_back(&(*mStrings.back())[0]);
+            }
+            mData = mPointers.data();
+            mSize = mPointers.size() * sizeof(char *);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool parseRecord(const std::string& line, TraceRecord& record)
+{
+    std::istringstream in(line);
+    std::string type, request, response;
+
+    if (!(in >> type >> record.timeUs >> record.id)) {
+        return false;
+    }
+
+    if (type == "req") {
+        record.type = TraceRecord::REQUEST;
+        if (!(in >> record.latencyUs >> record.error >> request >> response)) {
+            return false;
+        }
+    } else if (type == "urc") {
+        record.type = TraceRecord::UNSOLICITED;
+        record.latencyUs = 0;
+        record.error = 0;
+        request = "-";
+        if (!(in >> response)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    return record.request.parse(request) && record.response.parse(response);
+}
+
+bool loadTrace(const char *path, std::vector<std::unique_ptr<TraceRecord>>& out)
+{
+    std::ifstream file(path);
+    std::string line;
+    int lineno = 0;
+
+    if (!file) {
+        ALOGE("%s: cannot open %s", __func__, path);
+        return false;
+    }
+
+    while (std::getline(file, line)) {
+        lineno++;
+
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        std::unique_ptr<TraceRecord> record(new TraceRecord());
+        if (!parseRecord(line, *record)) {
+            ALOGE("%s: %s:%d: malformed record", __func__, path, lineno);
+            return false;
+        }
+        out.push_back(std::move(record));
+    }
+
+    return true;
+}
+
+} // namespace android
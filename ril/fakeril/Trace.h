@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKERIL_TRACE_H
+#define FAKERIL_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+
+/*
+ * Request or response body in the layout the RIL interface expects.
+ *
+ * Encodings used in trace files:
+ *   -               no data (NULL, 0)
+ *   x:0a1b2c        raw bytes, for pointer-free structs
+ *   i:1,2,3         int array
+ *   s:foo|bar|-     char * array, "-" stands for a NULL entry
+ */
+class Payload {
+public:
+    Payload() = default;
+    Payload(const Payload&) = delete;
+    Payload& operator=(const Payload&) = delete;
+
+    bool parse(const std::string& text);
+
+    void *data() { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    std::vector<uint8_t> mBytes;
+    std::vector<std::unique_ptr<std::string>> mStrings;
+    std::vector<char *> mPointers;
+    void *mData = nullptr;
+    size_t mSize = 0;
+};
+
+/*
+ * One line of a recorded RIL session.
+ *
+ *   req <time_us> <request> <latency_us> <errno> <request payload> <response payload>
+ *   urc <time_us> <unsol> <payload>
+ *
+ * "time_us" is relative to the start of the recording, "latency_us" is the
+ * time the modem took to complete the request. Lines starting with '#' are
+ * comments.
+ */
+struct TraceRecord {
+    enum Type {
+        REQUEST,
+        UNSOLICITED,
+    };
+
+    Type type;
+    int64_t timeUs;
+    int id;
+    int64_t latencyUs;
+    int error;
+    Payload request;
+    Payload response;
+};
+
+/* Returns false and logs the offending line if "path" cannot be parsed. */
+bool loadTrace(const char *path, std::vector<std::unique_ptr<TraceRecord>>& out);
+
+} // namespace android
+
+#endif // FAKERIL_TRACE_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "fakeril"
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <log/log.h>
+
+#include <telephony/ril.h>
+
+#include "FakeModem.h"
+
+/*
+ * RIL_Init entry point for the fake modem, so it can be loaded by rild, the
+ * secril shim or ril-replay like a vendor RIL. Arguments:
+ *   -t <trace>  recorded session to answer from (required)
+ *   -s <speed>  replay speed factor, 1 replays with the recorded latencies
+ */
+
+using namespace android;
+
+static FakeModem *sModem;
+
+#if defined(ANDROID_MULTI_SIM)
+static void onRequest(int request, void *data, size_t datalen, RIL_Token t,
+        RIL_SOCKET_ID socket_id __unused)
+#else
+static void onRequest(int request, void *data, size_t datalen, RIL_Token t)
+#endif
+{
+    sModem->onRequest(request, data, datalen, t);
+}
+
+#if defined(ANDROID_MULTI_SIM)
+static RIL_RadioState onStateRequest(RIL_SOCKET_ID socket_id __unused)
+#else
+static RIL_RadioState onStateRequest()
+#endif
+{
+    return RADIO_STATE_ON;
+}
+
+static int supports(int requestCode)
+{
+    return sModem->supports(requestCode);
+}
+
+static void onCancel(RIL_Token t)
+{
+    sModem->onCancel(t);
+}
+
+static const char *getVersion(void)
+{
+    return "fakeril 1.0";
+}
+
+static const RIL_RadioFunctions sFunctions = {
+    RIL_VERSION,
+    onRequest,
+    onStateRequest,
+    supports,
+    onCancel,
+    getVersion,
+};
+
+const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
+{
+    std::vector<std::unique_ptr<TraceRecord>> trace;
+    const char *tracePath = NULL;
+    double speed = 1.0;
+    int opt;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                tracePath = optarg;
+                break;
+            case 's':
+                speed = atof(optarg);
+                break;
+            default:
+                ALOGE("%s: unknown argument", __func__);
+                return NULL;
+        }
+    }
+
+    if (tracePath == NULL || !loadTrace(tracePath, trace)) {
+        ALOGE("%s: a valid trace is required (-t <path>)", __func__);
+        return NULL;
+    }
+
+    delete sModem;
+    sModem = new FakeModem(env, std::move(trace), speed);
+    sModem->start();
+
+    return &sFunctions;
+}
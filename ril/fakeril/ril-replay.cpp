@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ril-replay drives a vendor RIL, normally the secril shim on top of the
+ * fake modem, with the requests of a recorded trace and reports the end to
+ * end latency seen from the libril side of the RIL_Env interface.
+ *
+ * usage: ril-replay [-l <vendor ril>] [-s <speed>] [-n <window>] [-r <repeat>] <trace>
+ *
+ *   -l  library exporting RIL_Init (default libsecril-fake-shim.so);
+ *       use libfakeril.so to measure the fake modem on its own
+ *   -s  replay speed factor, applied to request pacing and modem latency
+ *   -n  keep up to <window> requests in flight instead of following the
+ *       recorded request times, to measure throughput
+ *   -r  replay the request list <repeat> times
+ *
+ * ril-replay stands in for libril: it calls RIL_Init and onRequest itself
+ * and counts completions and URCs in its own RIL_Env. Nothing goes through
+ * the rild socket, parcel marshalling or libril's dispatch and wakelock
+ * handling, so the numbers cover the shim and the fake modem only, and do
+ * not show what the framework sees on a device. Requests libril answers
+ * on its own, such as SET_UNSOLICITED_RESPONSE_FILTER on RIL version 12,
+ * reach the shim here but never do on a device.
+ */
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <telephony/ril.h>
+
+#include "EventQueue.h"
+#include "RequestStats.h"
+#include "Trace.h"
+
+using namespace android;
+
+struct Outstanding {
+    const TraceRecord *record;
+    int64_t startNs;
+};
+
+static double sSpeed = 1.0;
+
+static std::mutex sLock;
+static std::condition_variable sCond;
+static size_t sInFlight;
+static std::map<int, LatencyHistogram> sEndToEnd;
+static std::map<int, LatencyHistogram> sOverhead;
+static std::map<int, uint64_t> sErrors;
+static std::atomic<uint64_t> sUnsolicited;
+
+static EventQueue *sTimers;
+
+static void onRequestComplete(RIL_Token t, RIL_Errno e, void *response __unused,
+        size_t responselen __unused)
+{
+    Outstanding *outstanding = static_cast<Outstanding *>(t);
+    int64_t elapsedUs = (monotonicNs() - outstanding->startNs) / 1000;
+    int64_t modemUs = static_cast<int64_t>(outstanding->record->latencyUs / sSpeed);
+    int request = outstanding->record->id;
+
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        sEndToEnd[request].record(elapsedUs);
+        sOverhead[request].record(elapsedUs > modemUs ? elapsedUs - modemUs : 0);
+        if (e != RIL_E_SUCCESS) {
+            sErrors[e]++;
+        }
+        sInFlight--;
+        sCond.notify_all();
+    }
+
+    delete outstanding;
+}
+
+#if defined(ANDROID_MULTI_SIM)
+static void onUnsolicitedResponse(int unsolResponse __unused, const void *data __unused,
+        size_t datalen __unused, RIL_SOCKET_ID socket_id __unused)
+#else
+static void onUnsolicitedResponse(int unsolResponse __unused, const void *data __unused,
+        size_t datalen __unused)
+#endif
+{
+    sUnsolicited++;
+}
+
+static void requestTimedCallback(RIL_TimedCallback callback, void *param,
+        const struct timeval *relativeTime)
+{
+    int64_t delayNs = 0;
+
+    if (relativeTime != NULL) {
+        delayNs = static_cast<int64_t>(relativeTime->tv_sec) * 1000000000LL +
+                static_cast<int64_t>(relativeTime->tv_usec) * 1000LL;
+    }
+
+    sTimers->postDelayed(delayNs, [callback, param]() { callback(param); });
+}
+
+static void onRequestAck(RIL_Token t __unused)
+{
+}
+
+static const struct RIL_Env sEnv = {
+    onRequestComplete,
+    onUnsolicitedResponse,
+    requestTimedCallback,
+    onRequestAck,
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-l <vendor ril>] [-s <speed>] [-n <window>] [-r <repeat>] "
+            "<trace>\n", argv0);
+    fprintf(stderr, "Calls the RIL directly, without libril: socket, parcel and dispatch "
+            "costs are not measured.\n");
+}
+
+static void printHistograms(const char *title, const std::map<int, LatencyHistogram>& stats)
+{
+    printf("%s (us):\n", title);
+    printf("  %7s %8s %10s %10s %10s %10s\n", "request", "count", "mean", "p50", "p99", "max");
+
+    for (const auto& it : stats) {
+        const LatencyHistogram& h = it.second;
+        printf("  %7d %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+                it.first, h.count(), h.mean(), h.percentile(50), h.percentile(99), h.max());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *library = "libsecril-fake-shim.so";
+    size_t window = 0;
+    int repeat = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:s:n:r:")) != -1) {
+        switch (opt) {
+            case 'l':
+                library = optarg;
+                break;
+            case 's':
+                sSpeed = atof(optarg);
+                break;
+            case 'n':
+                window = static_cast<size_t>(atoi(optarg));
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || sSpeed <= 0 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *tracePath = argv[optind];
+    std::vector<std::unique_ptr<TraceRecord>> trace;
+    if (!loadTrace(tracePath, trace)) {
+        return 1;
+    }
+
+    std::vector<const TraceRecord *> requests;
+    int64_t lastUnsolicitedUs = 0;
+    for (const auto& record : trace) {
+        if (record->type == TraceRecord::REQUEST) {
+            requests.push_back(record.get());
+        } else if (record->timeUs > lastUnsolicitedUs) {
+            lastUnsolicitedUs = record->timeUs;
+        }
+    }
+
+    void *handle = dlopen(library, RTLD_NOW);
+    if (handle == NULL) {
+        fprintf(stderr, "cannot load %s: %s\n", library, dlerror());
+        return 1;
+    }
+
+    auto rilInit = reinterpret_cast<const RIL_RadioFunctions *(*)(
+            const struct RIL_Env *, int, char **)>(dlsym(handle, "RIL_Init"));
+    if (rilInit == NULL) {
+        fprintf(stderr, "%s has no RIL_Init\n", library);
+        return 1;
+    }
+
+    sTimers = new EventQueue();
+
+    char speedArg[32];
+    snprintf(speedArg, sizeof(speedArg), "%f", sSpeed);
+    char *rilArgv[] = {
+        argv[0], const_cast<char *>("-t"), const_cast<char *>(tracePath),
+        const_cast<char *>("-s"), speedArg, NULL,
+    };
+
+    const RIL_RadioFunctions *funcs = rilInit(&sEnv, 5, rilArgv);
+    if (funcs == NULL) {
+        fprintf(stderr, "RIL_Init failed\n");
+        return 1;
+    }
+
+    int64_t start = monotonicNs();
+    uint64_t sent = 0;
+
+    for (int pass = 0; pass < repeat; pass++) {
+        int64_t passStart = monotonicNs();
+
+        for (const TraceRecord *record : requests) {
+            if (window > 0) {
+                std::unique_lock<std::mutex> lock(sLock);
+                sCond.wait(lock, [window]() { return sInFlight < window; });
+            } else {
+                int64_t due = passStart + static_cast<int64_t>(record->timeUs * 1000 / sSpeed);
+                int64_t now = monotonicNs();
+                if (due > now) {
+                    usleep(static_cast<useconds_t>((due - now) / 1000));
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(sLock);
+                sInFlight++;
+            }
+
+            Outstanding *outstanding = new Outstanding{record, monotonicNs()};
+            TraceRecord *mutableRecord = const_cast<TraceRecord *>(record);
+#if defined(ANDROID_MULTI_SIM)
+            funcs->onRequest(record->id, mutableRecord->request.data(),
+                    mutableRecord->request.size(), outstanding, RIL_SOCKET_1);
+#else
+            funcs->onRequest(record->id, mutableRecord->request.data(),
+                    mutableRecord->request.size(), outstanding);
+#endif
+            sent++;
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(sLock);
+        sCond.wait(lock, []() { return sInFlight == 0; });
+    }
+
+    int64_t unsolicitedEnd = start + static_cast<int64_t>(lastUnsolicitedUs * 1000 / sSpeed);
+    int64_t now = monotonicNs();
+    if (unsolicitedEnd > now) {
+        usleep(static_cast<useconds_t>((unsolicitedEnd - now) / 1000));
+    }
+
+    double seconds = (monotonicNs() - start) / 1e9;
+
+    printf("library: %s\n", library);
+    printf("requests: %" PRIu64 " in %.3f s (%.1f req/s), unsolicited: %" PRIu64 "\n",
+            sent, seconds, seconds > 0 ? sent / seconds : 0.0, sUnsolicited.load());
+    for (const auto& it : sErrors) {
+        printf("errno %d: %" PRIu64 "\n", it.first, it.second);
+    }
+    printHistograms("End to end latency", sEndToEnd);
+    printHistograms("Dispatch overhead over modem latency", sOverhead);
+
+    /* The vendor RIL keeps threads and timers alive; skip global teardown */
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ril-sched-sim replays a synthetic dual-SIM workload against a modem
+ * model in virtual time, once with every request dispatched in arrival
+ * order and once through the shim's RequestScheduler, and reports the
+ * latency each priority lane sees.
+ *
+ * usage: ril-sched-sim [-d <seconds>] [-c <channels>] [-b <budget>] [-S <seed>]
+ *
+ *   -d  simulated time (default 600)
+ *   -c  commands the modem works on at once, the rest queue in order (default 2)
+ *   -b  scheduler budget for data and bulk requests (default 4)
+ *   -S  random seed
+ *
+ * Both subscriptions share the modem, as RIL_SUBSCRIPTION_1 and
+ * RIL_SUBSCRIPTION_2 do on a single tss310; each request carries its
+ * subscription as the socket id.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include <telephony/ril.h>
+#include <telephony/ril_msim.h>
+
+#include "RequestScheduler.h"
+#include "RequestStats.h"
+
+using namespace android;
+
+#define NS_PER_MS 1000000LL
+
+/* Same bound as the shim's SCHED_STARVATION_NS */
+#define STARVATION_MS 10000
+
+struct Stream {
+    RIL_SubscriptionType sub;
+    int request;
+    int64_t meanIntervalMs;     /* Poisson arrivals */
+    int64_t serviceMs;          /* modem time, +-20% */
+    int burst;                  /* requests issued back to back per arrival */
+};
+
+/* A call-heavy subscription next to one that polls, scans and loads its phonebook */
+static const Stream kStreams[] = {
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_SIGNAL_STRENGTH, 1000, 40, 1 },
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_GET_CELL_INFO_LIST, 2000, 250, 1 },
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_QUERY_AVAILABLE_NETWORKS, 90000, 12000, 1 },
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO, 30000, 80, 40 },
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_DATA_CALL_LIST, 5000, 80, 1 },
+    { RIL_SUBSCRIPTION_1, RIL_REQUEST_SMS_ACKNOWLEDGE, 20000, 100, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_SIGNAL_STRENGTH, 1000, 40, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_DIAL, 8000, 300, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_HANGUP, 8000, 150, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_GET_CURRENT_CALLS, 3000, 60, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_SMS_ACKNOWLEDGE, 5000, 100, 1 },
+    { RIL_SUBSCRIPTION_2, RIL_REQUEST_DATA_CALL_LIST, 4000, 80, 1 },
+};
+
+#define STREAM_COUNT (sizeof(kStreams) / sizeof(kStreams[0]))
+
+struct Request {
+    const Stream *stream;
+    int64_t arrivalNs;
+    int64_t serviceNs;
+};
+
+struct Event {
+    int64_t when;
+    uint64_t seq;
+    int stream;                 /* arrival of this stream, -1 otherwise */
+    Request *done;              /* modem completion */
+
+    bool operator>(const Event& other) const {
+        return when != other.when ? when > other.when : seq > other.seq;
+    }
+};
+
+class Simulation {
+public:
+    Simulation(size_t channels, size_t budget, uint64_t seed)
+        : mScheduler(budget, STARVATION_MS * NS_PER_MS),
+          mChannels(channels),
+          mBusy(0),
+          mSeq(0),
+          mRandom(seed) {}
+
+    void run(int64_t durationNs) {
+        for (size_t i = 0; i < STREAM_COUNT; i++) {
+            post(interval(kStreams[i].meanIntervalMs), static_cast<int>(i), NULL);
+        }
+
+        while (!mEvents.empty()) {
+            Event event = mEvents.top();
+            mEvents.pop();
+
+            if (event.done != NULL) {
+                onModemDone(event.when, event.done);
+            } else if (event.stream < 0) {
+                release(event.when);
+            } else if (event.when < durationNs) {
+                onArrival(event.when, &kStreams[event.stream]);
+                post(event.when + interval(kStreams[event.stream].meanIntervalMs),
+                        event.stream, NULL);
+            }
+        }
+    }
+
+    const std::map<int, LatencyHistogram>& lanes() const { return mLanes; }
+    const RequestScheduler& scheduler() const { return mScheduler; }
+
+private:
+    double uniform() {
+        mRandom = mRandom * 6364136223846793005ULL + 1442695040888963407ULL;
+        return ((mRandom >> 11) + 0.5) / 9007199254740992.0;
+    }
+
+    int64_t interval(int64_t meanMs) {
+        return static_cast<int64_t>(-log(uniform()) * meanMs * NS_PER_MS);
+    }
+
+    void post(int64_t when, int stream, Request *done) {
+        mEvents.push(Event{when, mSeq++, stream, done});
+    }
+
+    void onArrival(int64_t now, const Stream *stream) {
+        for (int i = 0; i < stream->burst; i++) {
+            Request *request = new Request();
+            request->stream = stream;
+            request->arrivalNs = now;
+            request->serviceNs = static_cast<int64_t>(
+                    stream->serviceMs * NS_PER_MS * (0.8 + 0.4 * uniform()));
+
+            int fileid = 0x4F3A;
+            bool flat = stream->request == RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO;
+            if (mScheduler.submit(stream->request, flat ? &fileid : NULL,
+                    flat ? sizeof(fileid) : 0, request, stream->sub, now)) {
+                toModem(now, request);
+            } else {
+                /* Starvation check, like the shim's timed callback */
+                post(now + mScheduler.starvationNs(), -1, NULL);
+            }
+        }
+    }
+
+    void toModem(int64_t now, Request *request) {
+        if (mBusy < mChannels) {
+            mBusy++;
+            post(now + request->serviceNs, -1, request);
+        } else {
+            mModemQueue.push_back(request);
+        }
+    }
+
+    void onModemDone(int64_t now, Request *request) {
+        RequestScheduler::Lane lane = RequestScheduler::laneOf(request->stream->request);
+
+        mLanes[lane].record((now - request->arrivalNs) / 1000);
+
+        mBusy--;
+        if (!mModemQueue.empty()) {
+            Request *queued = mModemQueue.front();
+            mModemQueue.pop_front();
+            mBusy++;
+            post(now + queued->serviceNs, -1, queued);
+        }
+
+        if (mScheduler.complete(request)) {
+            release(now);
+        }
+
+        delete request;
+    }
+
+    void release(int64_t now) {
+        std::unique_ptr<RequestScheduler::Held> held;
+
+        while ((held = mScheduler.next(now)) != nullptr) {
+            toModem(now, static_cast<Request *>(held->token));
+        }
+    }
+
+    RequestScheduler mScheduler;
+    size_t mChannels;
+    size_t mBusy;
+    uint64_t mSeq;
+    uint64_t mRandom;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> mEvents;
+    std::deque<Request *> mModemQueue;
+    std::map<int, LatencyHistogram> mLanes;
+};
+
+static void printLanes(const char *title, const Simulation& simulation)
+{
+    printf("%s (ms):\n", title);
+    printf("  %-6s %8s %10s %10s %10s %10s\n", "lane", "count", "mean", "p50", "p99", "max");
+
+    for (const auto& it : simulation.lanes()) {
+        const LatencyHistogram& h = it.second;
+        printf("  %-6s %8" PRIu64 " %10.1f %10.1f %10.1f %10.1f\n",
+                RequestScheduler::laneName(static_cast<RequestScheduler::Lane>(it.first)),
+                h.count(), h.mean() / 1000.0, h.percentile(50) / 1000.0,
+                h.percentile(99) / 1000.0, h.max() / 1000.0);
+    }
+}
+
+static void printHeld(const Simulation& simulation)
+{
+    printf("Held in the shim:\n");
+    printf("  %-6s %8s %10s %10s\n", "lane", "held", "starved", "max wait");
+
+    for (int lane = 0; lane < RequestScheduler::LANE_COUNT; lane++) {
+        RequestScheduler::Lane l = static_cast<RequestScheduler::Lane>(lane);
+        RequestScheduler::LaneStats stats = simulation.scheduler().stats(l);
+
+        printf("  %-6s %8" PRIu64 " %10" PRIu64 " %10.1f\n", RequestScheduler::laneName(l),
+                stats.held, stats.starved, stats.maxWaitNs / static_cast<double>(NS_PER_MS));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int64_t durationSec = 600;
+    size_t channels = 2;
+    size_t budget = 4;
+    uint64_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:c:b:S:")) != -1) {
+        switch (opt) {
+            case 'd':
+                durationSec = atoll(optarg);
+                break;
+            case 'c':
+                channels = static_cast<size_t>(atoi(optarg));
+                break;
+            case 'b':
+                budget = static_cast<size_t>(atoi(optarg));
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d <seconds>] [-c <channels>] [-b <budget>] "
+                        "[-S <seed>]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (durationSec <= 0 || channels == 0) {
+        fprintf(stderr, "duration and channels must be positive\n");
+        return 1;
+    }
+
+    printf("%" PRId64 " s simulated, %zu modem channel(s), budget %zu\n",
+            durationSec, channels, budget);
+
+    Simulation fifo(channels, 0, seed);
+    fifo.run(durationSec * 1000 * NS_PER_MS);
+    printLanes("Arrival order", fifo);
+
+    Simulation lanes(channels, budget, seed);
+    lanes.run(durationSec * 1000 * NS_PER_MS);
+    printLanes("Priority lanes", lanes);
+    printHeld(lanes);
+
+    return 0;
+}
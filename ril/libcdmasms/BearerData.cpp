@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <cdmasms/BearerData.h>
+#include <cdmasms/Septets.h>
+
+namespace android {
+namespace cdmasms {
+
+/* Reads MSB first bit fields, the bit order used throughout C.S0015. */
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t length)
+        : mData(data), mBits(length * 8), mPos(0) {}
+
+    bool read(int bits, uint32_t *out) {
+        uint32_t value = 0;
+
+        if (mPos + bits > mBits) {
+            return false;
+        }
+        for (int i = 0; i < bits; i++, mPos++) {
+            value = (value << 1) | ((mData[mPos >> 3] >> (7 - (mPos & 7))) & 1);
+        }
+        *out = value;
+        return true;
+    }
+
+    size_t position() const { return mPos; }
+    size_t remaining() const { return mBits - mPos; }
+
+private:
+    const uint8_t *mData;
+    size_t mBits;
+    size_t mPos;
+};
+
+static void writeBits(uint8_t *data, size_t *pos, int bits, uint32_t value)
+{
+    for (int i = bits - 1; i >= 0; i--, (*pos)++) {
+        uint8_t mask = static_cast<uint8_t>(0x80 >> (*pos & 7));
+        if ((value >> i) & 1) {
+            data[*pos >> 3] |= mask;
+        } else {
+            data[*pos >> 3] &= static_cast<uint8_t>(~mask);
+        }
+    }
+}
+
+/* Re-aligns "count" bytes starting "bitOffset" bits into "src"; reads past "srcLen" as 0. */
+static void extractBytes(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        uint8_t *out)
+{
+    size_t byte = bitOffset >> 3;
+    unsigned shift = bitOffset & 7;
+
+    if (shift == 0) {
+        memcpy(out, src + byte, count);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        unsigned hi = src[byte + i];
+        unsigned lo = byte + i + 1 < srcLen ? src[byte + i + 1] : 0;
+        out[i] = static_cast<uint8_t>((hi << shift) | (lo >> (8 - shift)));
+    }
+}
+
+BearerDataReader::BearerDataReader(const uint8_t *data, size_t length)
+    : mData(data),
+      mLength(length),
+      mPos(0),
+      mTruncated(false)
+{
+}
+
+BearerDataReader::BearerDataReader(const RIL_CDMA_SMS_Message& message)
+    : BearerDataReader(message.aBearerData,
+            message.uBearerDataLen < 0 ? 0 :
+            message.uBearerDataLen > RIL_CDMA_SMS_BEARER_DATA_MAX ?
+                    RIL_CDMA_SMS_BEARER_DATA_MAX : message.uBearerDataLen)
+{
+}
+
+bool BearerDataReader::next(Subparameter *out)
+{
+    if (mPos >= mLength) {
+        return false;
+    }
+
+    if (mPos + 2 > mLength || mPos + 2 + mData[mPos + 1] > mLength) {
+        mTruncated = true;
+        mPos = mLength;
+        return false;
+    }
+
+    out->id = mData[mPos];
+    out->length = mData[mPos + 1];
+    out->data = mData + mPos + 2;
+    mPos += 2 + out->length;
+    return true;
+}
+
+bool BearerDataReader::find(uint8_t id, Subparameter *out) const
+{
+    BearerDataReader reader(mData, mLength);
+    Subparameter param;
+
+    while (reader.next(&param)) {
+        if (param.id == id) {
+            *out = param;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool decodeMessageIdentifier(const Subparameter& param, MessageIdentifier *out)
+{
+    BitReader reader(param.data, param.length);
+    uint32_t type, id, header;
+
+    if (param.id != SUBPARAM_MESSAGE_IDENTIFIER ||
+            !reader.read(4, &type) || !reader.read(16, &id) || !reader.read(1, &header)) {
+        return false;
+    }
+
+    out->messageType = static_cast<uint8_t>(type);
+    out->messageId = static_cast<uint16_t>(id);
+    out->headerIndicator = header != 0;
+    return true;
+}
+
+int UserData::bitsPerField() const
+{
+    switch (encoding) {
+        case ENCODING_7BIT_ASCII:
+        case ENCODING_IA5:
+        case ENCODING_GSM_7BIT_DEFAULT:
+            return 7;
+        case ENCODING_OCTET:
+        case ENCODING_SHIFT_JIS:
+        case ENCODING_KOREAN:
+        case ENCODING_LATIN_HEBREW:
+        case ENCODING_LATIN:
+            return 8;
+        case ENCODING_UNICODE_16:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool decodeUserData(const Subparameter& param, UserData *out)
+{
+    BitReader reader(param.data, param.length);
+    uint32_t encoding, messageType = 0, numFields;
+
+    if (param.id != SUBPARAM_USER_DATA || !reader.read(5, &encoding)) {
+        return false;
+    }
+
+    if (encoding == ENCODING_IS91_EXTENDED_PROTOCOL || encoding == ENCODING_GSM_DCS) {
+        if (!reader.read(8, &messageType)) {
+            return false;
+        }
+    }
+
+    if (!reader.read(8, &numFields)) {
+        return false;
+    }
+
+    out->encoding = static_cast<uint8_t>(encoding);
+    out->messageType = static_cast<uint8_t>(messageType);
+    out->numFields = static_cast<uint8_t>(numFields);
+    out->data = param.data;
+    out->dataLength = param.length;
+    out->bitOffset = reader.position();
+
+    int bits = out->bitsPerField();
+    return bits == 0 || static_cast<size_t>(bits) * numFields <= reader.remaining();
+}
+
+size_t UserData::unpack(uint8_t *out, size_t outLen) const
+{
+    size_t count = numFields < outLen ? numFields : outLen;
+
+    switch (encoding) {
+        case ENCODING_7BIT_ASCII:
+        case ENCODING_IA5:
+            return unpackAscii7(data, dataLength, bitOffset, count, out);
+        case ENCODING_GSM_7BIT_DEFAULT: {
+            /* GSM septets are packed LSB first into bytes that start at bitOffset */
+            uint8_t payload[RIL_CDMA_SMS_BEARER_DATA_MAX];
+            size_t payloadLen = (count * 7 + 7) / 8;
+
+            if (bitOffset + payloadLen * 8 > dataLength * 8) {
+                payloadLen = (dataLength * 8 - bitOffset + 7) / 8;
+            }
+            extractBytes(data, dataLength, bitOffset, payloadLen, payload);
+            return unpackGsm7(payload, payloadLen, 0, count, out);
+        }
+        case ENCODING_OCTET:
+        case ENCODING_SHIFT_JIS:
+        case ENCODING_KOREAN:
+        case ENCODING_LATIN_HEBREW:
+        case ENCODING_LATIN:
+            if (bitOffset + count * 8 > dataLength * 8) {
+                count = (dataLength * 8 - bitOffset) / 8;
+            }
+            extractBytes(data, dataLength, bitOffset, count, out);
+            return count;
+        default:
+            return 0;
+    }
+}
+
+size_t UserData::unpackUnicode(uint16_t *out, size_t outLen) const
+{
+    BitReader reader(data, dataLength);
+    size_t count = numFields < outLen ? numFields : outLen;
+    uint32_t value;
+    size_t n;
+
+    if (encoding != ENCODING_UNICODE_16) {
+        return 0;
+    }
+
+    for (size_t skipped = 0; skipped < bitOffset; skipped += 8) {
+        reader.read(bitOffset - skipped < 8 ? bitOffset - skipped : 8, &value);
+    }
+
+    for (n = 0; n < count && reader.read(16, &value); n++) {
+        out[n] = static_cast<uint16_t>(value);
+    }
+
+    return n;
+}
+
+static bool bcdToInt(uint8_t bcd, int *out)
+{
+    int hi = bcd >> 4, lo = bcd & 0x0f;
+
+    if (hi > 9 || lo > 9) {
+        return false;
+    }
+    *out = hi * 10 + lo;
+    return true;
+}
+
+bool decodeTimestamp(const Subparameter& param, Timestamp *out)
+{
+    int year;
+
+    if (param.length < 6 ||
+            (param.id != SUBPARAM_MESSAGE_CENTER_TIME_STAMP &&
+             param.id != SUBPARAM_VALIDITY_PERIOD_ABSOLUTE &&
+             param.id != SUBPARAM_DEFERRED_DELIVERY_TIME_ABSOLUTE)) {
+        return false;
+    }
+
+    if (!bcdToInt(param.data[0], &year) || !bcdToInt(param.data[1], &out->month) ||
+            !bcdToInt(param.data[2], &out->day) || !bcdToInt(param.data[3], &out->hour) ||
+            !bcdToInt(param.data[4], &out->minute) || !bcdToInt(param.data[5], &out->second)) {
+        return false;
+    }
+
+    /* C.S0015-B 4.5.4: 96-99 are 1996-1999, 00-95 are 2000-2095 */
+    out->year = year >= 96 ? 1900 + year : 2000 + year;
+    return true;
+}
+
+BearerDataWriter::BearerDataWriter(uint8_t *buffer, size_t capacity)
+    : mBuffer(buffer),
+      mCapacity(capacity),
+      mLength(0),
+      mMessage(NULL)
+{
+}
+
+BearerDataWriter::BearerDataWriter(RIL_CDMA_SMS_Message *message)
+    : BearerDataWriter(message->aBearerData, RIL_CDMA_SMS_BEARER_DATA_MAX)
+{
+    mMessage = message;
+}
+
+uint8_t *BearerDataWriter::beginSubparameter(uint8_t id, uint8_t length)
+{
+    if (mLength + 2 + length > mCapacity) {
+        return NULL;
+    }
+
+    uint8_t *body = mBuffer + mLength + 2;
+    mBuffer[mLength] = id;
+    mBuffer[mLength + 1] = length;
+    memset(body, 0, length);
+    mLength += 2 + length;
+    return body;
+}
+
+bool BearerDataWriter::appendMessageIdentifier(const MessageIdentifier& id)
+{
+    uint8_t *body = beginSubparameter(SUBPARAM_MESSAGE_IDENTIFIER, 3);
+    size_t pos = 0;
+
+    if (body == NULL) {
+        return false;
+    }
+
+    writeBits(body, &pos, 4, id.messageType);
+    writeBits(body, &pos, 16, id.messageId);
+    writeBits(body, &pos, 1, id.headerIndicator ? 1 : 0);
+    return true;
+}
+
+static uint8_t intToBcd(int value)
+{
+    return static_cast<uint8_t>(((value / 10) % 10) << 4 | (value % 10));
+}
+
+bool BearerDataWriter::appendTimestamp(const Timestamp& timestamp)
+{
+    uint8_t *body = beginSubparameter(SUBPARAM_MESSAGE_CENTER_TIME_STAMP, 6);
+
+    if (body == NULL) {
+        return false;
+    }
+
+    body[0] = intToBcd(timestamp.year % 100);
+    body[1] = intToBcd(timestamp.month);
+    body[2] = intToBcd(timestamp.day);
+    body[3] = intToBcd(timestamp.hour);
+    body[4] = intToBcd(timestamp.minute);
+    body[5] = intToBcd(timestamp.second);
+    return true;
+}
+
+bool BearerDataWriter::appendAscii7(const char *text, size_t length)
+{
+    size_t bits = 5 + 8 + length * 7;
+    uint8_t *body;
+    size_t pos = 0;
+
+    if (length > 0xff || (bits + 7) / 8 > 0xff) {
+        return false;
+    }
+
+    body = beginSubparameter(SUBPARAM_USER_DATA, static_cast<uint8_t>((bits + 7) / 8));
+    if (body == NULL) {
+        return false;
+    }
+
+    writeBits(body, &pos, 5, ENCODING_7BIT_ASCII);
+    writeBits(body, &pos, 8, static_cast<uint32_t>(length));
+    packAscii7(reinterpret_cast<const uint8_t *>(text), length, body, (bits + 7) / 8, pos);
+    return true;
+}
+
+void BearerDataWriter::finish()
+{
+    if (mMessage != NULL) {
+        mMessage->uBearerDataLen = static_cast<int>(mLength);
+    }
+}
+
+size_t packDtmf(const uint8_t *digits, size_t count, uint8_t *out, size_t outLen)
+{
+    size_t bytes = (count + 1) / 2;
+
+    if (bytes > outLen) {
+        return 0;
+    }
+
+    for (size_t i = 0; i + 1 < count; i += 2) {
+        out[i / 2] = static_cast<uint8_t>((digits[i] & 0x0f) << 4 | (digits[i + 1] & 0x0f));
+    }
+    if (count & 1) {
+        out[count / 2] = static_cast<uint8_t>((digits[count - 1] & 0x0f) << 4);
+    }
+
+    return bytes;
+}
+
+size_t unpackDtmf(const uint8_t *packed, size_t count, uint8_t *digits, size_t digitsLen)
+{
+    if (count > digitsLen) {
+        count = digitsLen;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t byte = packed[i / 2];
+        digits[i] = (i & 1) ? (byte & 0x0f) : (byte >> 4);
+    }
+
+    return count;
+}
+
+int dtmfToAscii(uint8_t digit)
+{
+    if (digit >= 1 && digit <= 9) {
+        return '0' + digit;
+    }
+
+    switch (digit) {
+        case 10: return '0';
+        case 11: return '*';
+        case 12: return '#';
+        default: return -1;
+    }
+}
+
+int asciiToDtmf(char c)
+{
+    if (c >= '1' && c <= '9') {
+        return c - '0';
+    }
+
+    switch (c) {
+        case '0': return 10;
+        case '*': return 11;
+        case '#': return 12;
+        default: return -1;
+    }
+}
+
+int addressToString(const RIL_CDMA_SMS_Address& address, char *out, size_t outLen)
+{
+    size_t count = address.number_of_digits;
+
+    if (count > RIL_CDMA_SMS_ADDRESS_MAX || count + 1 > outLen) {
+        return -1;
+    }
+
+    if (address.digit_mode != RIL_CDMA_SMS_DIGIT_MODE_4_BIT) {
+        memcpy(out, address.digits, count);
+        out[count] = '\0';
+        return static_cast<int>(count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        int c = dtmfToAscii(address.digits[i]);
+        if (c < 0) {
+            return -1;
+        }
+        out[i] = static_cast<char>(c);
+    }
+    out[count] = '\0';
+    return static_cast<int>(count);
+}
+
+bool stringToAddress(const char *number, RIL_CDMA_SMS_Address *address)
+{
+    size_t count = strlen(number);
+
+    if (count > RIL_CDMA_SMS_ADDRESS_MAX) {
+        return false;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->digit_mode = RIL_CDMA_SMS_DIGIT_MODE_4_BIT;
+
+    for (size_t i = 0; i < count; i++) {
+        int digit = asciiToDtmf(number[i]);
+        if (digit < 0) {
+            return false;
+        }
+        address->digits[i] = static_cast<unsigned char>(digit);
+    }
+
+    address->number_of_digits = static_cast<unsigned char>(count);
+    return true;
+}
+
+} // namespace cdmasms
+} // namespace android
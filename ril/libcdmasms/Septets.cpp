@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <cdmasms/Septets.h>
+
+namespace android {
+namespace cdmasms {
+
+/*
+ * Eight 64-bit lanes: with NEON or SSE2 the compiler lowers the shift and
+ * mask below to four 128-bit operations, one lane per character.
+ */
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+typedef uint8_t u8x8 __attribute__((vector_size(8)));
+
+static const u64x8 kMsbShifts = { 57, 50, 43, 36, 29, 22, 15, 8 };
+static const u64x8 kLsbShifts = { 0, 7, 14, 21, 28, 35, 42, 49 };
+
+static inline uint64_t loadLe64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t loadBe64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void spread7(uint64_t word, const u64x8& shifts, uint8_t *out)
+{
+    u64x8 lanes = (u64x8){} + word;
+    u8x8 chars = __builtin_convertvector((lanes >> shifts) & 0x7f, u8x8);
+
+    memcpy(out, &chars, sizeof(chars));
+}
+
+size_t unpackAscii7(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        uint8_t *out)
+{
+    size_t pos = bitOffset;
+    size_t n = 0;
+
+    /* 8 characters need 56 bits, plus at most 7 bits of misalignment */
+    while (n + 8 <= count && (pos >> 3) + 8 <= srcLen) {
+        spread7(loadBe64(src + (pos >> 3)) << (pos & 7), kMsbShifts, out + n);
+        pos += 56;
+        n += 8;
+    }
+
+    for (; n < count && pos + 7 <= srcLen * 8; n++, pos += 7) {
+        unsigned c = 0;
+        for (int k = 0; k < 7; k++) {
+            size_t bit = pos + k;
+            c = (c << 1) | ((src[bit >> 3] >> (7 - (bit & 7))) & 1);
+        }
+        out[n] = static_cast<uint8_t>(c);
+    }
+
+    return n;
+}
+
+size_t unpackGsm7(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        uint8_t *out)
+{
+    size_t pos = bitOffset;
+    size_t n = 0;
+
+    while (n + 8 <= count && (pos >> 3) + 8 <= srcLen) {
+        spread7(loadLe64(src + (pos >> 3)) >> (pos & 7), kLsbShifts, out + n);
+        pos += 56;
+        n += 8;
+    }
+
+    for (; n < count && pos + 7 <= srcLen * 8; n++, pos += 7) {
+        unsigned c = 0;
+        for (int k = 0; k < 7; k++) {
+            size_t bit = pos + k;
+            c |= ((src[bit >> 3] >> (bit & 7)) & 1u) << k;
+        }
+        out[n] = static_cast<uint8_t>(c);
+    }
+
+    return n;
+}
+
+size_t packAscii7(const uint8_t *chars, size_t count, uint8_t *out, size_t outLen,
+        size_t bitOffset)
+{
+    size_t pos = bitOffset;
+
+    if (bitOffset + count * 7 > outLen * 8) {
+        return 0;
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        for (int k = 6; k >= 0; k--, pos++) {
+            uint8_t mask = static_cast<uint8_t>(0x80 >> (pos & 7));
+            if ((chars[n] >> k) & 1) {
+                out[pos >> 3] |= mask;
+            } else {
+                out[pos >> 3] &= static_cast<uint8_t>(~mask);
+            }
+        }
+    }
+
+    return count * 7;
+}
+
+} // namespace cdmasms
+} // namespace android
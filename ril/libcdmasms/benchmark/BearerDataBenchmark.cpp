@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cdmasms/BearerData.h>
+#include <cdmasms/Septets.h>
+
+/*
+ * Decoding cost of an incoming CDMA SMS: a deliver with message id,
+ * timestamp and 160 characters of 7-bit text, as a full message and for
+ * the unpacking step alone, next to the bit by bit loop it replaces.
+ */
+
+using namespace android::cdmasms;
+
+static const char kText[] =
+        "The quick brown fox jumps over the lazy dog while the modem keeps the relay "
+        "link up for the next message in the burst, 0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ ok.";
+
+static_assert(sizeof(kText) - 1 == 160, "one full 7-bit SMS");
+
+static void buildMessage(RIL_CDMA_SMS_Message *message)
+{
+    MessageIdentifier id = { 1, 0x1234, false };
+    Timestamp timestamp = { 2020, 6, 15, 12, 30, 45 };
+
+    memset(message, 0, sizeof(*message));
+    BearerDataWriter writer(message);
+    writer.appendMessageIdentifier(id);
+    writer.appendAscii7(kText, sizeof(kText) - 1);
+    writer.appendTimestamp(timestamp);
+    writer.finish();
+}
+
+static void BM_DecodeDeliver(benchmark::State& state)
+{
+    RIL_CDMA_SMS_Message message;
+    uint8_t chars[256];
+
+    buildMessage(&message);
+    for (auto _ : state) {
+        BearerDataReader reader(message);
+        Subparameter param;
+        MessageIdentifier id;
+        UserData userData;
+        Timestamp timestamp;
+        size_t n = 0;
+
+        while (reader.next(&param)) {
+            switch (param.id) {
+                case SUBPARAM_MESSAGE_IDENTIFIER:
+                    decodeMessageIdentifier(param, &id);
+                    break;
+                case SUBPARAM_USER_DATA:
+                    if (decodeUserData(param, &userData)) {
+                        n = userData.unpack(chars, sizeof(chars));
+                    }
+                    break;
+                case SUBPARAM_MESSAGE_CENTER_TIME_STAMP:
+                    decodeTimestamp(param, &timestamp);
+                    break;
+            }
+        }
+        benchmark::DoNotOptimize(n);
+        benchmark::DoNotOptimize(chars);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeDeliver);
+
+/* 160 characters packed MSB first after the 13 bit user data header */
+static void packedText(uint8_t *buffer, size_t size)
+{
+    memset(buffer, 0, size);
+    packAscii7(reinterpret_cast<const uint8_t *>(kText), sizeof(kText) - 1, buffer, size, 13);
+}
+
+static void BM_UnpackAscii7(benchmark::State& state)
+{
+    uint8_t packed[160], chars[160];
+
+    packedText(packed, sizeof(packed));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpackAscii7(packed, sizeof(packed), 13, 160, chars));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 160);
+}
+BENCHMARK(BM_UnpackAscii7);
+
+static void BM_UnpackGsm7(benchmark::State& state)
+{
+    uint8_t packed[160], chars[160];
+
+    packedText(packed, sizeof(packed));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(unpackGsm7(packed, sizeof(packed), 0, 160, chars));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 160);
+}
+BENCHMARK(BM_UnpackGsm7);
+
+/* The usual bit at a time loop, for comparison */
+static void BM_UnpackAscii7Scalar(benchmark::State& state)
+{
+    uint8_t packed[160], chars[160];
+
+    packedText(packed, sizeof(packed));
+    for (auto _ : state) {
+        size_t pos = 13;
+        for (size_t n = 0; n < 160; n++) {
+            unsigned c = 0;
+            for (int k = 0; k < 7; k++, pos++) {
+                c = (c << 1) | ((packed[pos >> 3] >> (7 - (pos & 7))) & 1);
+            }
+            chars[n] = static_cast<uint8_t>(c);
+        }
+        benchmark::DoNotOptimize(chars);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 160);
+}
+BENCHMARK(BM_UnpackAscii7Scalar);
+
+static void BM_EncodeDeliver(benchmark::State& state)
+{
+    RIL_CDMA_SMS_Message message;
+
+    for (auto _ : state) {
+        buildMessage(&message);
+        benchmark::DoNotOptimize(message.uBearerDataLen);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeDeliver);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cdmasms/BearerData.h>
+#include <cdmasms/Septets.h>
+
+/*
+ * Feeds arbitrary bytes to the bearer data decoders as they would arrive
+ * in RIL_UNSOL_RESPONSE_CDMA_NEW_SMS, and cross-checks the vector 7-bit
+ * unpacking against a bit by bit reference.
+ *
+ * Input layout: byte 0 picks a bit offset and byte 1 a character count for
+ * the direct unpack checks; everything else is the bearer data, and also
+ * the source buffer of those checks.
+ */
+
+using namespace android::cdmasms;
+
+static size_t referenceUnpack(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        bool msbFirst, uint8_t *out)
+{
+    size_t n;
+
+    for (n = 0; n < count && bitOffset + (n + 1) * 7 <= srcLen * 8; n++) {
+        unsigned c = 0;
+        for (int k = 0; k < 7; k++) {
+            size_t bit = bitOffset + n * 7 + k;
+            unsigned value = msbFirst ? (src[bit >> 3] >> (7 - (bit & 7))) & 1 :
+                    (src[bit >> 3] >> (bit & 7)) & 1;
+            c |= msbFirst ? value << (6 - k) : value << k;
+        }
+        out[n] = static_cast<uint8_t>(c);
+    }
+
+    return n;
+}
+
+static void checkUnpack(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count)
+{
+    uint8_t expected[256], actual[256];
+
+    for (int msbFirst = 0; msbFirst <= 1; msbFirst++) {
+        size_t n = referenceUnpack(src, srcLen, bitOffset, count, msbFirst, expected);
+        size_t m = msbFirst ? unpackAscii7(src, srcLen, bitOffset, count, actual) :
+                unpackGsm7(src, srcLen, bitOffset, count, actual);
+
+        if (n != m || memcmp(expected, actual, n) != 0) {
+            abort();
+        }
+    }
+}
+
+static void decodeAll(const RIL_CDMA_SMS_Message& message)
+{
+    BearerDataReader reader(message);
+    Subparameter param;
+
+    while (reader.next(&param)) {
+        MessageIdentifier id;
+        UserData userData;
+        Timestamp timestamp;
+        uint8_t chars[256];
+        uint16_t units[256];
+
+        decodeMessageIdentifier(param, &id);
+        decodeTimestamp(param, &timestamp);
+        if (decodeUserData(param, &userData)) {
+            userData.unpack(chars, sizeof(chars));
+            userData.unpackUnicode(units, sizeof(units) / sizeof(units[0]));
+        }
+    }
+
+    reader.find(SUBPARAM_USER_DATA, &param);
+}
+
+/* Whatever 7-bit text the input holds must survive the writer and reader. */
+static void checkRoundTrip(const uint8_t *data, size_t size)
+{
+    RIL_CDMA_SMS_Message message;
+    char text[200];
+    size_t length = size < sizeof(text) ? size : sizeof(text);
+
+    for (size_t i = 0; i < length; i++) {
+        text[i] = static_cast<char>(data[i] & 0x7f);
+    }
+
+    memset(&message, 0, sizeof(message));
+    BearerDataWriter writer(&message);
+    if (!writer.appendAscii7(text, length)) {
+        return;
+    }
+    writer.finish();
+
+    BearerDataReader reader(message);
+    Subparameter param;
+    UserData userData;
+    uint8_t chars[256];
+
+    if (!reader.find(SUBPARAM_USER_DATA, &param) || !decodeUserData(param, &userData) ||
+            userData.unpack(chars, sizeof(chars)) != length ||
+            memcmp(chars, text, length) != 0) {
+        abort();
+    }
+}
+
+static void checkAddress(const uint8_t *data, size_t size)
+{
+    RIL_CDMA_SMS_Address address;
+    char number[RIL_CDMA_SMS_ADDRESS_MAX + 1];
+    uint8_t digits[RIL_CDMA_SMS_ADDRESS_MAX * 2];
+
+    memset(&address, 0, sizeof(address));
+    address.digit_mode = (size > 0 && (data[0] & 1)) ? RIL_CDMA_SMS_DIGIT_MODE_8_BIT :
+            RIL_CDMA_SMS_DIGIT_MODE_4_BIT;
+    address.number_of_digits = static_cast<unsigned char>(size > 1 ? data[1] : 0);
+    if (size > 2) {
+        size_t n = size - 2 < RIL_CDMA_SMS_ADDRESS_MAX ? size - 2 : RIL_CDMA_SMS_ADDRESS_MAX;
+        memcpy(address.digits, data + 2, n);
+    }
+    addressToString(address, number, sizeof(number));
+
+    unpackDtmf(data, size * 2, digits, sizeof(digits));
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    RIL_CDMA_SMS_Message message;
+
+    if (size < 2) {
+        return 0;
+    }
+
+    const uint8_t *body = data + 2;
+    size_t bodyLen = size - 2;
+
+    memset(&message, 0, sizeof(message));
+    message.uBearerDataLen = static_cast<int>(
+            bodyLen < RIL_CDMA_SMS_BEARER_DATA_MAX ? bodyLen : RIL_CDMA_SMS_BEARER_DATA_MAX);
+    memcpy(message.aBearerData, body, message.uBearerDataLen);
+
+    decodeAll(message);
+    checkUnpack(body, bodyLen, data[0], data[1]);
+    checkRoundTrip(body, bodyLen);
+    checkAddress(data, size);
+    return 0;
+}
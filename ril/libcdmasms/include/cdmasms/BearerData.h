@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CDMASMS_BEARER_DATA_H
+#define CDMASMS_BEARER_DATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <telephony/ril_cdma_sms.h>
+
+/*
+ * Allocation free codec for the bearer data carried in
+ * RIL_CDMA_SMS_Message.aBearerData (3GPP2 C.S0015-B 4.5). Decoding only
+ * produces views into the caller's buffer; anything that has to be
+ * expanded goes into caller provided storage.
+ */
+
+namespace android {
+namespace cdmasms {
+
+enum SubparameterId {
+    SUBPARAM_MESSAGE_IDENTIFIER = 0x00,
+    SUBPARAM_USER_DATA = 0x01,
+    SUBPARAM_USER_RESPONSE_CODE = 0x02,
+    SUBPARAM_MESSAGE_CENTER_TIME_STAMP = 0x03,
+    SUBPARAM_VALIDITY_PERIOD_ABSOLUTE = 0x04,
+    SUBPARAM_VALIDITY_PERIOD_RELATIVE = 0x05,
+    SUBPARAM_DEFERRED_DELIVERY_TIME_ABSOLUTE = 0x06,
+    SUBPARAM_DEFERRED_DELIVERY_TIME_RELATIVE = 0x07,
+    SUBPARAM_PRIORITY_INDICATOR = 0x08,
+    SUBPARAM_PRIVACY_INDICATOR = 0x09,
+    SUBPARAM_REPLY_OPTION = 0x0A,
+    SUBPARAM_NUMBER_OF_MESSAGES = 0x0B,
+    SUBPARAM_ALERT_ON_MESSAGE_DELIVERY = 0x0C,
+    SUBPARAM_LANGUAGE_INDICATOR = 0x0D,
+    SUBPARAM_CALLBACK_NUMBER = 0x0E,
+    SUBPARAM_MESSAGE_DISPLAY_MODE = 0x0F,
+    SUBPARAM_MESSAGE_DEPOSIT_INDEX = 0x11,
+    SUBPARAM_SERVICE_CATEGORY_PROGRAM_DATA = 0x12,
+    SUBPARAM_SERVICE_CATEGORY_PROGRAM_RESULTS = 0x13,
+    SUBPARAM_MESSAGE_STATUS = 0x14,
+};
+
+/* C.S0015-B table 9.1-1 (TSB-58) */
+enum UserDataEncoding {
+    ENCODING_OCTET = 0x00,
+    ENCODING_IS91_EXTENDED_PROTOCOL = 0x01,
+    ENCODING_7BIT_ASCII = 0x02,
+    ENCODING_IA5 = 0x03,
+    ENCODING_UNICODE_16 = 0x04,
+    ENCODING_SHIFT_JIS = 0x05,
+    ENCODING_KOREAN = 0x06,
+    ENCODING_LATIN_HEBREW = 0x07,
+    ENCODING_LATIN = 0x08,
+    ENCODING_GSM_7BIT_DEFAULT = 0x09,
+    ENCODING_GSM_DCS = 0x0A,
+};
+
+/* A subparameter as it sits in the bearer data buffer. */
+struct Subparameter {
+    uint8_t id;
+    uint8_t length;
+    const uint8_t *data;
+};
+
+/* Walks the subparameters of a bearer data buffer. */
+class BearerDataReader {
+public:
+    BearerDataReader(const uint8_t *data, size_t length);
+    explicit BearerDataReader(const RIL_CDMA_SMS_Message& message);
+
+    /* Returns false at the end of the buffer or on a truncated subparameter. */
+    bool next(Subparameter *out);
+
+    /* Looks "id" up from the start of the buffer. */
+    bool find(uint8_t id, Subparameter *out) const;
+
+    bool truncated() const { return mTruncated; }
+
+private:
+    const uint8_t *mData;
+    size_t mLength;
+    size_t mPos;
+    bool mTruncated;
+};
+
+struct MessageIdentifier {
+    uint8_t messageType;    /* C.S0015-B table 4.5.1-1, 1 = deliver, 2 = submit, ... */
+    uint16_t messageId;
+    bool headerIndicator;   /* user data starts with a UDH */
+};
+
+struct Timestamp {
+    int year;               /* four digits */
+    int month;
+    int day;
+    int hour;
+    int minute;
+    int second;
+};
+
+/* View over the characters of a User Data subparameter. */
+struct UserData {
+    uint8_t encoding;
+    uint8_t messageType;    /* only meaningful for IS-91 and GSM DCS encodings */
+    uint8_t numFields;
+    const uint8_t *data;    /* subparameter body */
+    size_t dataLength;
+    size_t bitOffset;       /* first character bit within "data" */
+
+    /* Bits per character for fixed width encodings, 0 otherwise. */
+    int bitsPerField() const;
+
+    /*
+     * Unpacks 7 and 8 bit encodings into "out", one character per byte.
+     * Returns the number of characters written, or 0 for other encodings.
+     */
+    size_t unpack(uint8_t *out, size_t outLen) const;
+
+    /* Unpacks ENCODING_UNICODE_16 into host order UTF-16 units. */
+    size_t unpackUnicode(uint16_t *out, size_t outLen) const;
+};
+
+bool decodeMessageIdentifier(const Subparameter& param, MessageIdentifier *out);
+bool decodeUserData(const Subparameter& param, UserData *out);
+bool decodeTimestamp(const Subparameter& param, Timestamp *out);
+
+/*
+ * Builds bearer data into a fixed buffer, typically
+ * RIL_CDMA_SMS_Message.aBearerData. Every append returns false and leaves
+ * the buffer unchanged if the subparameter does not fit.
+ */
+class BearerDataWriter {
+public:
+    BearerDataWriter(uint8_t *buffer, size_t capacity);
+    explicit BearerDataWriter(RIL_CDMA_SMS_Message *message);
+
+    bool appendMessageIdentifier(const MessageIdentifier& id);
+    bool appendTimestamp(const Timestamp& timestamp);
+    bool appendAscii7(const char *text, size_t length);
+
+    size_t length() const { return mLength; }
+
+    /* Stores the written length into the message given at construction. */
+    void finish();
+
+private:
+    uint8_t *beginSubparameter(uint8_t id, uint8_t length);
+
+    uint8_t *mBuffer;
+    size_t mCapacity;
+    size_t mLength;
+    RIL_CDMA_SMS_Message *mMessage;
+};
+
+/*
+ * DTMF digits (C.S0005 table 2.7.1.3.2.4-4: 1-9, 10 = '0', 11 = '*',
+ * 12 = '#') are stored one per byte in RIL_CDMA_SMS_Address; over the air
+ * and in compact storage they take one nibble each, high nibble first.
+ */
+size_t packDtmf(const uint8_t *digits, size_t count, uint8_t *out, size_t outLen);
+size_t unpackDtmf(const uint8_t *packed, size_t count, uint8_t *digits, size_t digitsLen);
+
+int dtmfToAscii(uint8_t digit);
+int asciiToDtmf(char c);
+
+/*
+ * Converts the digits of an address to a NUL terminated string; 8-bit mode
+ * digits are already ASCII. Returns the string length, or -1 on bad DTMF
+ * digits or if the address does not fit in "out".
+ */
+int addressToString(const RIL_CDMA_SMS_Address& address, char *out, size_t outLen);
+
+/* Fills a 4-bit mode address from a dial string; returns false on bad digits. */
+bool stringToAddress(const char *number, RIL_CDMA_SMS_Address *address);
+
+} // namespace cdmasms
+} // namespace android
+
+#endif // CDMASMS_BEARER_DATA_H
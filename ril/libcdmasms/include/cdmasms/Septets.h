@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CDMASMS_SEPTETS_H
+#define CDMASMS_SEPTETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace cdmasms {
+
+/*
+ * 7-bit character unpacking. Both functions read "count" characters
+ * starting "bitOffset" bits into "src" (of "srcLen" bytes) and store one
+ * character per byte in "out". They return the number of characters
+ * unpacked, which is less than "count" if "src" runs out.
+ *
+ * Eight characters are extracted per step with vector shifts; the scalar
+ * loop only handles the tail of the buffer.
+ */
+
+/* Characters packed MSB first, as CDMA 7-bit ASCII/IA5 user data (C.S0015 4.5.2). */
+size_t unpackAscii7(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        uint8_t *out);
+
+/* Septets packed LSB first, as GSM 7-bit default alphabet (TS 23.038 6.1.2.1). */
+size_t unpackGsm7(const uint8_t *src, size_t srcLen, size_t bitOffset, size_t count,
+        uint8_t *out);
+
+/* MSB first packing, the inverse of unpackAscii7. Returns the number of bits written. */
+size_t packAscii7(const uint8_t *chars, size_t count, uint8_t *out, size_t outLen,
+        size_t bitOffset);
+
+} // namespace cdmasms
+} // namespace android
+
+#endif // CDMASMS_SEPTETS_H
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ActivityAccountant.h"
+#include "RequestScheduler.h"
+
+namespace android {
+
+const uint64_t ActivityAccountant::URC_WEIGHT_US;
+const uint32_t ActivityAccountant::BUSY_PERMILLE;
+const uint32_t ActivityAccountant::QUIET_PERMILLE;
+
+static const char *const kFeatureNames[ActivityAccountant::FEATURE_COUNT] = {
+    "call", "sms", "data", "network", "sim", "other", "background",
+};
+
+ActivityAccountant::ActivityAccountant(int64_t minIntervalNs, int64_t maxIntervalNs)
+    : mMinIntervalNs(minIntervalNs),
+      mMaxIntervalNs(maxIntervalNs > minIntervalNs ? maxIntervalNs : minIntervalNs),
+      mIntervalNs(minIntervalNs),
+      mHaveSample(false),
+      mLastNs(0),
+      mSleepMs(0),
+      mSamples(0),
+      mCounterResets(0)
+{
+    memset(&mLast, 0, sizeof(mLast));
+    memset(mWindowWeightUs, 0, sizeof(mWindowWeightUs));
+    memset(mWindowEvents, 0, sizeof(mWindowEvents));
+    memset(mUsage, 0, sizeof(mUsage));
+}
+
+ActivityAccountant::Feature ActivityAccountant::featureOf(int requestOrUnsol)
+{
+    switch (requestOrUnsol) {
+        case RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED:
+        case RIL_UNSOL_CALL_RING:
+        case RIL_UNSOL_RINGBACK_TONE:
+        case RIL_UNSOL_SRVCC_STATE_NOTIFY:
+        case RIL_UNSOL_SUPP_SVC_NOTIFICATION:
+        case RIL_UNSOL_ON_SS:
+        case RIL_UNSOL_ON_USSD:
+        case RIL_UNSOL_ON_USSD_REQUEST:
+        case RIL_UNSOL_CDMA_CALL_WAITING:
+        case RIL_REQUEST_SET_CALL_FORWARD:
+        case RIL_REQUEST_QUERY_CALL_FORWARD_STATUS:
+        case RIL_REQUEST_SEND_USSD:
+            return FEATURE_CALL;
+
+        case RIL_UNSOL_RESPONSE_NEW_SMS:
+        case RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT:
+        case RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM:
+        case RIL_UNSOL_RESPONSE_CDMA_NEW_SMS:
+        case RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS:
+        case RIL_UNSOL_RESPONSE_NEW_CB_MSG:
+            return FEATURE_SMS;
+
+        case RIL_UNSOL_DATA_CALL_LIST_CHANGED:
+        case RIL_UNSOL_LCEDATA_RECV:
+        case RIL_UNSOL_PCO_DATA:
+        case RIL_UNSOL_KEEPALIVE_STATUS:
+        case RIL_REQUEST_ALLOW_DATA:
+            return FEATURE_DATA;
+
+        case RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED:
+        case RIL_UNSOL_NITZ_TIME_RECEIVED:
+        case RIL_UNSOL_SIGNAL_STRENGTH:
+        case RIL_UNSOL_RESTRICTED_STATE_CHANGED:
+        case RIL_UNSOL_VOICE_RADIO_TECH_CHANGED:
+        case RIL_UNSOL_CELL_INFO_LIST:
+        case RIL_UNSOL_RESPONSE_IMS_NETWORK_STATE_CHANGED:
+        case RIL_UNSOL_NETWORK_SCAN_RESULT:
+        case RIL_REQUEST_SIGNAL_STRENGTH:
+        case RIL_REQUEST_VOICE_REGISTRATION_STATE:
+        case RIL_REQUEST_DATA_REGISTRATION_STATE:
+        case RIL_REQUEST_OPERATOR:
+        case RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE:
+        case RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC:
+        case RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL:
+        case RIL_REQUEST_QUERY_AVAILABLE_NETWORKS:
+        case RIL_REQUEST_START_NETWORK_SCAN:
+        case RIL_REQUEST_STOP_NETWORK_SCAN:
+        case RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE:
+        case RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE:
+        case RIL_REQUEST_GET_NEIGHBORING_CELL_IDS:
+        case RIL_REQUEST_GET_CELL_INFO_LIST:
+        case RIL_REQUEST_SET_UNSOL_CELL_INFO_LIST_RATE:
+        case RIL_REQUEST_SET_BAND_MODE:
+        case RIL_REQUEST_VOICE_RADIO_TECH:
+        case RIL_REQUEST_RADIO_POWER:
+            return FEATURE_NETWORK;
+
+        case RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED:
+        case RIL_UNSOL_SIM_REFRESH:
+        case RIL_UNSOL_STK_SESSION_END:
+        case RIL_UNSOL_STK_PROACTIVE_COMMAND:
+        case RIL_UNSOL_STK_EVENT_NOTIFY:
+        case RIL_UNSOL_STK_CALL_SETUP:
+        case RIL_UNSOL_SIM_SMS_STORAGE_FULL:
+        case RIL_UNSOL_PB_INIT_COMPLETE:
+        case RIL_REQUEST_GET_SIM_STATUS:
+        case RIL_REQUEST_ENTER_SIM_PIN:
+        case RIL_REQUEST_ENTER_SIM_PUK:
+        case RIL_REQUEST_CHANGE_SIM_PIN:
+        case RIL_REQUEST_GET_IMSI:
+        case RIL_REQUEST_SIM_IO:
+        case RIL_REQUEST_QUERY_FACILITY_LOCK:
+        case RIL_REQUEST_SET_FACILITY_LOCK:
+        case RIL_REQUEST_STK_GET_PROFILE:
+        case RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND:
+        case RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE:
+        case RIL_REQUEST_ISIM_AUTHENTICATION:
+        case RIL_REQUEST_SIM_AUTHENTICATION:
+        case RIL_REQUEST_SIM_OPEN_CHANNEL:
+        case RIL_REQUEST_SIM_CLOSE_CHANNEL:
+        case RIL_REQUEST_SIM_TRANSMIT_APDU_BASIC:
+        case RIL_REQUEST_SIM_TRANSMIT_APDU_CHANNEL:
+        case RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO:
+        case RIL_REQUEST_GET_PHONEBOOK_ENTRY:
+        case RIL_REQUEST_ACCESS_PHONEBOOK_ENTRY:
+            return FEATURE_SIM;
+    }
+
+    if (requestOrUnsol >= RIL_UNSOL_RESPONSE_BASE) {
+        return FEATURE_OTHER;
+    }
+
+    switch (RequestScheduler::laneOf(requestOrUnsol)) {
+        case RequestScheduler::LANE_CALL:
+            return FEATURE_CALL;
+        case RequestScheduler::LANE_SMS:
+            return FEATURE_SMS;
+        case RequestScheduler::LANE_DATA:
+            return FEATURE_DATA;
+        default:
+            return FEATURE_OTHER;
+    }
+}
+
+const char *ActivityAccountant::featureName(Feature feature)
+{
+    return feature >= 0 && feature < FEATURE_COUNT ? kFeatureNames[feature] : "?";
+}
+
+void ActivityAccountant::onRequest(int request, uint64_t serviceUs)
+{
+    Feature feature = featureOf(request);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    /* Count every request, even one that completed instantly */
+    mWindowWeightUs[feature] += serviceUs > 0 ? serviceUs : 1;
+    mWindowEvents[feature]++;
+}
+
+void ActivityAccountant::onUnsolicited(int unsol)
+{
+    Feature feature = featureOf(unsol);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mWindowWeightUs[feature] += URC_WEIGHT_US;
+    mWindowEvents[feature]++;
+}
+
+/* Counter delta, taking a counter that went backwards as restarted from zero */
+static uint64_t counterDelta(uint32_t now, uint32_t last, bool *reset)
+{
+    if (now < last) {
+        *reset = true;
+        return now;
+    }
+    return now - last;
+}
+
+/* Shares "total" out by "weights"; rounding remainders go to the heaviest feature. */
+static void apportion(uint64_t total, const uint64_t *weights, uint64_t weightSum,
+        int heaviest, uint64_t *out)
+{
+    uint64_t given = 0;
+
+    for (int f = 0; f < ActivityAccountant::FEATURE_COUNT; f++) {
+        uint64_t share = weightSum ? static_cast<uint64_t>(
+                static_cast<double>(total) * weights[f] / weightSum) : 0;
+        out[f] = share;
+        given += share;
+    }
+    out[heaviest] += total - given;
+}
+
+int64_t ActivityAccountant::onSample(const RIL_ActivityStatsInfo& info, int64_t nowNs)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (!mHaveSample) {
+        /* The first sample only sets the reference point */
+        mHaveSample = true;
+        mLast = info;
+        mLastNs = nowNs;
+        memset(mWindowWeightUs, 0, sizeof(mWindowWeightUs));
+        memset(mWindowEvents, 0, sizeof(mWindowEvents));
+        return mIntervalNs;
+    }
+
+    bool reset = false;
+    uint64_t idle = counterDelta(info.idle_mode_time_ms, mLast.idle_mode_time_ms, &reset);
+    uint64_t rx = counterDelta(info.rx_mode_time_ms, mLast.rx_mode_time_ms, &reset);
+    uint64_t tx[RIL_NUM_TX_POWER_LEVELS];
+    uint64_t txTotal = 0;
+    for (int level = 0; level < RIL_NUM_TX_POWER_LEVELS; level++) {
+        tx[level] = counterDelta(info.tx_mode_time_ms[level], mLast.tx_mode_time_ms[level],
+                &reset);
+        txTotal += tx[level];
+    }
+    mSleepMs += counterDelta(info.sleep_mode_time_ms, mLast.sleep_mode_time_ms, &reset);
+    if (reset) {
+        mCounterResets++;
+    }
+
+    uint64_t weights[FEATURE_COUNT];
+    uint64_t weightSum = 0;
+    int heaviest = FEATURE_BACKGROUND;
+    memcpy(weights, mWindowWeightUs, sizeof(weights));
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        weightSum += weights[f];
+        if (weights[f] > weights[heaviest]) {
+            heaviest = f;
+        }
+    }
+    if (weightSum == 0) {
+        weights[FEATURE_BACKGROUND] = weightSum = 1;
+    }
+
+    uint64_t shares[FEATURE_COUNT];
+    apportion(idle, weights, weightSum, heaviest, shares);
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        mUsage[f].idleMs += shares[f];
+    }
+    apportion(rx, weights, weightSum, heaviest, shares);
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        mUsage[f].rxMs += shares[f];
+    }
+    for (int level = 0; level < RIL_NUM_TX_POWER_LEVELS; level++) {
+        apportion(tx[level], weights, weightSum, heaviest, shares);
+        for (int f = 0; f < FEATURE_COUNT; f++) {
+            mUsage[f].txMs[level] += shares[f];
+        }
+    }
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        mUsage[f].events += mWindowEvents[f];
+    }
+
+    /* Busy share of the wall clock window decides the next interval */
+    int64_t windowMs = (nowNs - mLastNs) / 1000000;
+    uint64_t busyPermille = windowMs > 0 ? (rx + txTotal) * 1000 / windowMs : 0;
+    if (busyPermille > BUSY_PERMILLE) {
+        mIntervalNs /= 2;
+    } else if (busyPermille < QUIET_PERMILLE) {
+        mIntervalNs *= 2;
+    }
+    if (mIntervalNs < mMinIntervalNs) {
+        mIntervalNs = mMinIntervalNs;
+    } else if (mIntervalNs > mMaxIntervalNs) {
+        mIntervalNs = mMaxIntervalNs;
+    }
+
+    mLast = info;
+    mLastNs = nowNs;
+    mSamples++;
+    memset(mWindowWeightUs, 0, sizeof(mWindowWeightUs));
+    memset(mWindowEvents, 0, sizeof(mWindowEvents));
+    return mIntervalNs;
+}
+
+int64_t ActivityAccountant::intervalNs() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mIntervalNs;
+}
+
+void ActivityAccountant::dump(int fd) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    dprintf(fd, "\nModem activity by feature (ms, %" PRIu64 " samples, %" PRIu64 " resets, "
+            "sleep %" PRIu64 ", next sample in %" PRId64 " s):\n", mSamples, mCounterResets,
+            mSleepMs, mIntervalNs / 1000000000);
+    dprintf(fd, "  %-10s %8s %10s %10s", "feature", "events", "idle", "rx");
+    for (int level = 0; level < RIL_NUM_TX_POWER_LEVELS; level++) {
+        char name[8];
+        snprintf(name, sizeof(name), "tx%d", level);
+        dprintf(fd, " %9s", name);
+    }
+    dprintf(fd, "\n");
+
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        const Usage& usage = mUsage[f];
+        dprintf(fd, "  %-10s %8" PRIu64 " %10" PRIu64 " %10" PRIu64, kFeatureNames[f],
+                usage.events, usage.idleMs, usage.rxMs);
+        for (int level = 0; level < RIL_NUM_TX_POWER_LEVELS; level++) {
+            dprintf(fd, " %9" PRIu64, usage.txMs[level]);
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+} // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_ACTIVITY_ACCOUNTANT_H
+#define SECRIL_SHIM_ACTIVITY_ACCOUNTANT_H
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Splits the modem's cumulative RIL_ActivityStatsInfo counters between the
+ * radio features that kept it busy.
+ *
+ * Between two samples every request and URC is weighed: a request by the
+ * time the modem took to complete it, a URC by a fixed URC_WEIGHT_US. The
+ * idle, RX and per power level TX time the counters advanced by is then
+ * shared out in proportion to those weights. A window without any traffic
+ * is booked as background (paging, cell reselection, measurements).
+ *
+ * The poll interval adapts to the load: it halves while the radio is busy
+ * for more than BUSY_PERMILLE of the window and doubles while it is busy
+ * for less than QUIET_PERMILLE, within [minIntervalNs, maxIntervalNs].
+ */
+class ActivityAccountant {
+public:
+    enum Feature {
+        FEATURE_CALL,
+        FEATURE_SMS,
+        FEATURE_DATA,
+        FEATURE_NETWORK,
+        FEATURE_SIM,
+        FEATURE_OTHER,
+        FEATURE_BACKGROUND,
+        FEATURE_COUNT,
+    };
+
+    static const uint64_t URC_WEIGHT_US = 5000;
+    static const uint32_t BUSY_PERMILLE = 100;
+    static const uint32_t QUIET_PERMILLE = 10;
+
+    ActivityAccountant(int64_t minIntervalNs, int64_t maxIntervalNs);
+
+    static Feature featureOf(int requestOrUnsol);
+    static const char *featureName(Feature feature);
+
+    void onRequest(int request, uint64_t serviceUs);
+    void onUnsolicited(int unsol);
+
+    /* Folds a cumulative sample in. Returns the delay until the next sample. */
+    int64_t onSample(const RIL_ActivityStatsInfo& info, int64_t nowNs);
+
+    int64_t intervalNs() const;
+
+    /* Writes the per feature report to "fd". */
+    void dump(int fd) const;
+
+private:
+    struct Usage {
+        uint64_t events;
+        uint64_t idleMs;
+        uint64_t rxMs;
+        uint64_t txMs[RIL_NUM_TX_POWER_LEVELS];
+    };
+
+    mutable std::mutex mLock;
+    int64_t mMinIntervalNs;
+    int64_t mMaxIntervalNs;
+    int64_t mIntervalNs;
+    bool mHaveSample;
+    RIL_ActivityStatsInfo mLast;
+    int64_t mLastNs;
+    uint64_t mWindowWeightUs[FEATURE_COUNT];
+    uint64_t mWindowEvents[FEATURE_COUNT];
+    Usage mUsage[FEATURE_COUNT];
+    uint64_t mSleepMs;
+    uint64_t mSamples;
+    uint64_t mCounterResets;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_ACTIVITY_ACCOUNTANT_H
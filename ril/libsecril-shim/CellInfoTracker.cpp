@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CellInfoTracker.h"
+
+namespace android {
+
+/* TS 27.007 8.5 "not known or not detectable" */
+static const int ASU_UNKNOWN = 99;
+
+bool CellKey::operator==(const CellKey& other) const
+{
+    return type == other.type && memcmp(id, other.id, sizeof(id)) == 0;
+}
+
+size_t CellKeyHash::operator()(const CellKey& key) const
+{
+    /* FNV-1a over the identity fields */
+    uint64_t hash = 1469598103934665603ULL;
+    hash = (hash ^ static_cast<uint32_t>(key.type)) * 1099511628211ULL;
+    for (int value : key.id) {
+        hash = (hash ^ static_cast<uint32_t>(value)) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+CellKey CellInfoTracker::keyOf(const RIL_CellInfo_v12& cell)
+{
+    CellKey key;
+
+    memset(&key, 0, sizeof(key));
+    key.type = cell.cellInfoType;
+
+    switch (cell.cellInfoType) {
+        case RIL_CELL_INFO_TYPE_GSM: {
+            const RIL_CellIdentityGsm_v12& id = cell.CellInfo.gsm.cellIdentityGsm;
+            key.id[0] = id.mcc;
+            key.id[1] = id.mnc;
+            key.id[2] = id.lac;
+            key.id[3] = id.cid;
+            key.id[4] = id.arfcn;
+            break;
+        }
+        case RIL_CELL_INFO_TYPE_WCDMA: {
+            const RIL_CellIdentityWcdma_v12& id = cell.CellInfo.wcdma.cellIdentityWcdma;
+            key.id[0] = id.mcc;
+            key.id[1] = id.mnc;
+            key.id[2] = id.lac;
+            key.id[3] = id.cid;
+            key.id[4] = id.psc;
+            key.id[5] = id.uarfcn;
+            break;
+        }
+        case RIL_CELL_INFO_TYPE_LTE: {
+            const RIL_CellIdentityLte_v12& id = cell.CellInfo.lte.cellIdentityLte;
+            key.id[0] = id.mcc;
+            key.id[1] = id.mnc;
+            key.id[2] = id.ci;
+            key.id[3] = id.pci;
+            key.id[4] = id.tac;
+            key.id[5] = id.earfcn;
+            break;
+        }
+        case RIL_CELL_INFO_TYPE_CDMA: {
+            const RIL_CellIdentityCdma& id = cell.CellInfo.cdma.cellIdentityCdma;
+            key.id[0] = id.networkId;
+            key.id[1] = id.systemId;
+            key.id[2] = id.basestationId;
+            break;
+        }
+        case RIL_CELL_INFO_TYPE_TD_SCDMA: {
+            const RIL_CellIdentityTdscdma& id = cell.CellInfo.tdscdma.cellIdentityTdscdma;
+            key.id[0] = id.mcc;
+            key.id[1] = id.mnc;
+            key.id[2] = id.lac;
+            key.id[3] = id.cid;
+            key.id[4] = id.cpid;
+            break;
+        }
+        default:
+            break;
+    }
+
+    return key;
+}
+
+/*
+ * Returns true if two readings of a signal field differ by at least
+ * "thresholdDb". "tenthsPerUnit" converts one unit of the field into tenths
+ * of a dB (ASU steps are 2 dB, most fields are whole dB, SNRs are 0.1 dB).
+ * A reading that becomes valid or invalid always counts as a change.
+ */
+static bool signalMoved(int a, int b, int invalid, int tenthsPerUnit, int thresholdDb)
+{
+    if (a == b) {
+        return false;
+    }
+    if (a == invalid || b == invalid) {
+        return true;
+    }
+
+    long delta = labs(static_cast<long>(a) - static_cast<long>(b)) * tenthsPerUnit;
+    return delta >= static_cast<long>(thresholdDb) * 10;
+}
+
+bool CellInfoTracker::significantlyDifferent(const RIL_CellInfo_v12& a,
+        const RIL_CellInfo_v12& b) const
+{
+    const int th = mThresholdDb;
+
+    if (a.registered != b.registered) {
+        return true;
+    }
+
+    switch (a.cellInfoType) {
+        case RIL_CELL_INFO_TYPE_GSM: {
+            const RIL_GSM_SignalStrength_v12& sa = a.CellInfo.gsm.signalStrengthGsm;
+            const RIL_GSM_SignalStrength_v12& sb = b.CellInfo.gsm.signalStrengthGsm;
+            return a.CellInfo.gsm.cellIdentityGsm.bsic != b.CellInfo.gsm.cellIdentityGsm.bsic ||
+                    signalMoved(sa.signalStrength, sb.signalStrength, ASU_UNKNOWN, 20, th);
+        }
+        case RIL_CELL_INFO_TYPE_WCDMA: {
+            const RIL_SignalStrengthWcdma& sa = a.CellInfo.wcdma.signalStrengthWcdma;
+            const RIL_SignalStrengthWcdma& sb = b.CellInfo.wcdma.signalStrengthWcdma;
+            return signalMoved(sa.signalStrength, sb.signalStrength, ASU_UNKNOWN, 20, th);
+        }
+        case RIL_CELL_INFO_TYPE_LTE: {
+            const RIL_LTE_SignalStrength_v8& sa = a.CellInfo.lte.signalStrengthLte;
+            const RIL_LTE_SignalStrength_v8& sb = b.CellInfo.lte.signalStrengthLte;
+            return signalMoved(sa.signalStrength, sb.signalStrength, ASU_UNKNOWN, 20, th) ||
+                    signalMoved(sa.rsrp, sb.rsrp, INT_MAX, 10, th) ||
+                    signalMoved(sa.rsrq, sb.rsrq, INT_MAX, 10, th) ||
+                    signalMoved(sa.rssnr, sb.rssnr, INT_MAX, 1, th);
+        }
+        case RIL_CELL_INFO_TYPE_CDMA: {
+            const RIL_CellInfoCdma& ca = a.CellInfo.cdma;
+            const RIL_CellInfoCdma& cb = b.CellInfo.cdma;
+            return signalMoved(ca.signalStrengthCdma.dbm, cb.signalStrengthCdma.dbm,
+                            INT_MAX, 10, th) ||
+                    signalMoved(ca.signalStrengthCdma.ecio, cb.signalStrengthCdma.ecio,
+                            INT_MAX, 1, th) ||
+                    signalMoved(ca.signalStrengthEvdo.dbm, cb.signalStrengthEvdo.dbm,
+                            INT_MAX, 10, th) ||
+                    signalMoved(ca.signalStrengthEvdo.ecio, cb.signalStrengthEvdo.ecio,
+                            INT_MAX, 1, th);
+        }
+        case RIL_CELL_INFO_TYPE_TD_SCDMA: {
+            return signalMoved(a.CellInfo.tdscdma.signalStrengthTdscdma.rscp,
+                    b.CellInfo.tdscdma.signalStrengthTdscdma.rscp, INT_MAX, 10, th);
+        }
+        default:
+            return memcmp(&a.CellInfo, &b.CellInfo, sizeof(a.CellInfo)) != 0;
+    }
+}
+
+CellInfoTracker::CellInfoTracker(int thresholdDb)
+    : mThresholdDb(thresholdDb < 0 ? 0 : thresholdDb),
+      mGeneration(0)
+{
+}
+
+void CellInfoTracker::setThresholdDb(int thresholdDb)
+{
+    mThresholdDb = thresholdDb < 0 ? 0 : thresholdDb;
+}
+
+size_t CellInfoTracker::update(const RIL_CellInfo_v12 *cells, size_t count,
+        std::vector<Change>& changes)
+{
+    size_t before = changes.size();
+
+    mGeneration++;
+
+    for (size_t i = 0; i < count; i++) {
+        const RIL_CellInfo_v12& cell = cells[i];
+        CellKey key = keyOf(cell);
+
+        auto it = mCells.find(key);
+        if (it == mCells.end()) {
+            mCells.emplace(key, Entry{cell, mGeneration});
+            changes.push_back(Change{CELL_ADDED, key, cell});
+            continue;
+        }
+
+        Entry& entry = it->second;
+        if (entry.generation == mGeneration) {
+            /* duplicate report of the same cell in one list */
+            continue;
+        }
+        entry.generation = mGeneration;
+
+        if (significantlyDifferent(entry.cell, cell)) {
+            entry.cell = cell;
+            changes.push_back(Change{CELL_CHANGED, key, cell});
+        }
+    }
+
+    for (auto it = mCells.begin(); it != mCells.end();) {
+        if (it->second.generation != mGeneration) {
+            changes.push_back(Change{CELL_REMOVED, it->first, it->second.cell});
+            it = mCells.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return changes.size() - before;
+}
+
+void CellInfoTracker::rebase(const RIL_CellInfo_v12 *cells, size_t count)
+{
+    mCells.clear();
+    mGeneration++;
+
+    for (size_t i = 0; i < count; i++) {
+        mCells[keyOf(cells[i])] = Entry{cells[i], mGeneration};
+    }
+}
+
+void CellInfoTracker::snapshot(std::vector<RIL_CellInfo_v12>& out) const
+{
+    out.clear();
+    out.reserve(mCells.size());
+
+    for (const auto& it : mCells) {
+        out.push_back(it.second.cell);
+    }
+}
+
+void CellInfoTracker::clear()
+{
+    mCells.clear();
+}
+
+} // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_CELL_INFO_TRACKER_H
+#define SECRIL_SHIM_CELL_INFO_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Identity of a cell, independent of its signal fields. Two reports of the
+ * same cell in consecutive polls map to the same key. The channel is part of
+ * the identity where the PCI or PSC is, since those repeat across carriers.
+ */
+struct CellKey {
+    int type;
+    int id[6];
+
+    bool operator==(const CellKey& other) const;
+};
+
+struct CellKeyHash {
+    size_t operator()(const CellKey& key) const;
+};
+
+/*
+ * Keeps the last reported RIL_CellInfo_v12 list and reduces every new list
+ * to the cells that were added, removed or changed since then. A cell only
+ * counts as changed when its registration flips or one of its signal fields
+ * moves by at least the configured threshold in dB. A cell that moves to
+ * another channel is reported as removed and added.
+ */
+class CellInfoTracker {
+public:
+    enum ChangeKind {
+        CELL_ADDED,
+        CELL_REMOVED,
+        CELL_CHANGED,
+    };
+
+    struct Change {
+        ChangeKind kind;
+        CellKey key;
+        RIL_CellInfo_v12 cell; /* new value, or last known value if removed */
+    };
+
+    /* A negative threshold counts as 0: every change is reported. */
+    explicit CellInfoTracker(int thresholdDb);
+
+    void setThresholdDb(int thresholdDb);
+    int thresholdDb() const { return mThresholdDb; }
+
+    /*
+     * Diffs "cells" against the tracked state and appends the differences to
+     * "changes". The tracked state only follows reported changes, so signal
+     * drift below the threshold cannot accumulate unnoticed.
+     * Returns the number of changes appended.
+     */
+    size_t update(const RIL_CellInfo_v12 *cells, size_t count,
+            std::vector<Change>& changes);
+
+    /* Replaces the tracked state with "cells" without computing a diff. */
+    void rebase(const RIL_CellInfo_v12 *cells, size_t count);
+
+    /* Full snapshot of the tracked cells, for consumers that need one. */
+    void snapshot(std::vector<RIL_CellInfo_v12>& out) const;
+
+    size_t size() const { return mCells.size(); }
+    void clear();
+
+    static CellKey keyOf(const RIL_CellInfo_v12& cell);
+
+private:
+    struct Entry {
+        RIL_CellInfo_v12 cell;
+        uint32_t generation;
+    };
+
+    bool significantlyDifferent(const RIL_CellInfo_v12& a,
+            const RIL_CellInfo_v12& b) const;
+
+    int mThresholdDb;
+    uint32_t mGeneration;
+    std::unordered_map<CellKey, Entry, CellKeyHash> mCells;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_CELL_INFO_TRACKER_H
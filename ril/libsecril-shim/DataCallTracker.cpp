@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "DataCallTracker.h"
+
+namespace android {
+
+/*
+ * Interned strings are never released one by one; once this many have
+ * accumulated, the table is rebuilt from the baseline.
+ */
+static const size_t MAX_INTERNED_STRINGS = 1024;
+
+/* Id of the empty string and of NULL, which the framework treats alike */
+static const uint32_t EMPTY_ID = 0;
+
+bool DataCallTracker::Call::operator==(const Call& other) const
+{
+    /* The retry hint is only meaningful for a failed call */
+    if (status != 0 && suggestedRetryTime != other.suggestedRetryTime) {
+        return false;
+    }
+
+    return status == other.status && active == other.active && mtu == other.mtu &&
+            type == other.type && ifname == other.ifname &&
+            addresses == other.addresses && dnses == other.dnses &&
+            gateways == other.gateways && pcscf == other.pcscf;
+}
+
+DataCallTracker::DataCallTracker()
+    : mReportDormancy(true)
+{
+    clear();
+}
+
+uint32_t DataCallTracker::intern(const char *text, size_t length)
+{
+    if (length == 0) {
+        return EMPTY_ID;
+    }
+
+    mScratch.assign(text, length);
+    auto it = mIds.find(mScratch);
+    if (it != mIds.end()) {
+        return it->second;
+    }
+
+    uint32_t id = static_cast<uint32_t>(mStrings.size());
+    mStrings.push_back(mScratch);
+    mIds.emplace(mScratch, id);
+    return id;
+}
+
+void DataCallTracker::tokenize(const char *list, bool sorted, std::vector<uint32_t> *out)
+{
+    out->clear();
+    if (list == NULL) {
+        return;
+    }
+
+    const char *p = list;
+    while (*p != '\0') {
+        while (*p == ' ') {
+            p++;
+        }
+        const char *start = p;
+        while (*p != '\0' && *p != ' ') {
+            p++;
+        }
+        if (p > start) {
+            out->push_back(intern(start, p - start));
+        }
+    }
+
+    if (sorted) {
+        std::sort(out->begin(), out->end());
+    }
+}
+
+void DataCallTracker::parse(const RIL_Data_Call_Response_v11& in, Call *out)
+{
+    out->status = in.status;
+    out->suggestedRetryTime = in.suggestedRetryTime;
+    out->active = in.active;
+    out->mtu = in.mtu > 0 ? in.mtu : 0;
+    out->type = in.type != NULL ? intern(in.type, strlen(in.type)) : EMPTY_ID;
+    out->ifname = in.ifname != NULL ? intern(in.ifname, strlen(in.ifname)) : EMPTY_ID;
+    tokenize(in.addresses, true, &out->addresses);
+    tokenize(in.dnses, false, &out->dnses);
+    tokenize(in.gateways, true, &out->gateways);
+    tokenize(in.pcscf, false, &out->pcscf);
+}
+
+size_t DataCallTracker::update(const RIL_Data_Call_Response_v11 *calls, size_t count,
+        std::vector<Change>& changes)
+{
+    size_t before = changes.size();
+    std::map<int, Call> next;
+    Call call;
+
+    for (size_t i = 0; i < count; i++) {
+        parse(calls[i], &call);
+
+        auto it = mCalls.find(calls[i].cid);
+        if (it == mCalls.end()) {
+            changes.push_back(Change{CALL_ADDED, calls[i].cid});
+        } else if (it->second != call) {
+            int active = call.active;
+            call.active = it->second.active;
+            if (mReportDormancy || it->second != call) {
+                call.active = active;
+                changes.push_back(Change{CALL_CHANGED, calls[i].cid});
+            }
+        }
+        next[calls[i].cid] = call;
+    }
+
+    for (const auto& entry : mCalls) {
+        if (next.find(entry.first) == next.end()) {
+            changes.push_back(Change{CALL_REMOVED, entry.first});
+        }
+    }
+
+    mCalls.swap(next);
+    compactIfNeeded();
+    return changes.size() - before;
+}
+
+void DataCallTracker::rebase(const RIL_Data_Call_Response_v11 *calls, size_t count)
+{
+    mCalls.clear();
+    for (size_t i = 0; i < count; i++) {
+        parse(calls[i], &mCalls[calls[i].cid]);
+    }
+    compactIfNeeded();
+}
+
+void DataCallTracker::upsert(const RIL_Data_Call_Response_v11& call)
+{
+    /* A failed setup leaves no call behind */
+    if (call.status != 0) {
+        return;
+    }
+
+    parse(call, &mCalls[call.cid]);
+    compactIfNeeded();
+}
+
+void DataCallTracker::onDeactivateRequest(RIL_Token t, const void *data, size_t datalen)
+{
+    const char **strings = static_cast<const char **>(const_cast<void *>(data));
+
+    /* "cid", "reason" */
+    if (data == NULL || datalen < sizeof(char *) || strings[0] == NULL) {
+        return;
+    }
+
+    mDeactivating[t] = atoi(strings[0]);
+}
+
+void DataCallTracker::onDeactivateComplete(RIL_Token t, RIL_Errno e)
+{
+    auto it = mDeactivating.find(t);
+    if (it == mDeactivating.end()) {
+        return;
+    }
+
+    if (e == RIL_E_SUCCESS) {
+        mCalls.erase(it->second);
+    }
+    mDeactivating.erase(it);
+}
+
+void DataCallTracker::compactIfNeeded()
+{
+    if (mStrings.size() < MAX_INTERNED_STRINGS) {
+        return;
+    }
+
+    std::vector<std::string> strings;
+    strings.swap(mStrings);
+    mIds.clear();
+    mStrings.push_back(std::string());
+    mIds.emplace(std::string(), EMPTY_ID);
+
+    auto remap = [&](uint32_t id) {
+        return intern(strings[id].data(), strings[id].size());
+    };
+    auto remapList = [&](std::vector<uint32_t>& ids, bool sorted) {
+        for (uint32_t& id : ids) {
+            id = remap(id);
+        }
+        if (sorted) {
+            std::sort(ids.begin(), ids.end());
+        }
+    };
+
+    for (auto& entry : mCalls) {
+        Call& call = entry.second;
+        call.type = remap(call.type);
+        call.ifname = remap(call.ifname);
+        remapList(call.addresses, true);
+        remapList(call.dnses, false);
+        remapList(call.gateways, true);
+        remapList(call.pcscf, false);
+    }
+}
+
+void DataCallTracker::clear()
+{
+    mCalls.clear();
+    mDeactivating.clear();
+    mIds.clear();
+    mStrings.assign(1, std::string());
+    mIds.emplace(std::string(), EMPTY_ID);
+}
+
+} // namespace android
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_DATA_CALL_TRACKER_H
+#define SECRIL_SHIM_DATA_CALL_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Keeps the data call list the framework last saw in a pre-parsed form:
+ * every string is interned, and the space separated address, DNS, gateway
+ * and P-CSCF lists are split into interned tokens. Comparing two reports of
+ * a call then takes integer compares only, and formatting differences such
+ * as extra spaces or reordered addresses do not count as changes.
+ *
+ * Not thread safe; callers serialize access.
+ */
+class DataCallTracker {
+public:
+    enum ChangeKind {
+        CALL_ADDED,
+        CALL_REMOVED,
+        CALL_CHANGED,
+    };
+
+    struct Change {
+        ChangeKind kind;
+        int cid;
+    };
+
+    DataCallTracker();
+
+    /*
+     * Diffs "calls" against the list the framework last saw, appends the
+     * differences to "changes" and makes "calls" the new baseline, on the
+     * assumption that the caller forwards any list with changes.
+     * Returns the number of changes appended.
+     */
+    size_t update(const RIL_Data_Call_Response_v11 *calls, size_t count,
+            std::vector<Change>& changes);
+
+    /*
+     * With dormancy reports off (RIL_UR_DATA_CALL_DORMANCY_CHANGED clear),
+     * a call whose only change is "active" does not count as changed and
+     * keeps the value the framework last saw.
+     */
+    void setReportDormancy(bool report) { mReportDormancy = report; }
+
+    /* Replaces the baseline with "calls", e.g. a DATA_CALL_LIST response. */
+    void rebase(const RIL_Data_Call_Response_v11 *calls, size_t count);
+
+    /* The framework saw "call" alone, as the response to a setup. */
+    void upsert(const RIL_Data_Call_Response_v11& call);
+
+    /* DEACTIVATE_DATA_CALL: the call is gone once the request succeeds. */
+    void onDeactivateRequest(RIL_Token t, const void *data, size_t datalen);
+    void onDeactivateComplete(RIL_Token t, RIL_Errno e);
+
+    size_t size() const { return mCalls.size(); }
+    size_t internedStrings() const { return mStrings.size(); }
+    void clear();
+
+private:
+    struct Call {
+        int status;
+        int suggestedRetryTime;
+        int active;
+        int mtu;
+        uint32_t type;
+        uint32_t ifname;
+        std::vector<uint32_t> addresses;    /* sorted, order is not meaningful */
+        std::vector<uint32_t> dnses;        /* in priority order */
+        std::vector<uint32_t> gateways;     /* sorted */
+        std::vector<uint32_t> pcscf;        /* in priority order */
+
+        bool operator==(const Call& other) const;
+        bool operator!=(const Call& other) const { return !(*this == other); }
+    };
+
+    uint32_t intern(const char *text, size_t length);
+    void tokenize(const char *list, bool sorted, std::vector<uint32_t> *out);
+    void parse(const RIL_Data_Call_Response_v11& in, Call *out);
+    void compactIfNeeded();
+
+    std::map<int, Call> mCalls;
+    std::map<RIL_Token, int> mDeactivating;
+    bool mReportDormancy;
+    std::unordered_map<std::string, uint32_t> mIds;
+    std::vector<std::string> mStrings;
+    std::string mScratch;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_DATA_CALL_TRACKER_H
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DataProfileCache.h"
+
+namespace android {
+
+bool DataProfileCache::Profile::operator==(const Profile& other) const
+{
+    return profileId == other.profileId && apn == other.apn && protocol == other.protocol &&
+            authType == other.authType && hasUser == other.hasUser && user == other.user &&
+            hasPassword == other.hasPassword && password == other.password &&
+            type == other.type && maxConnsTime == other.maxConnsTime &&
+            maxConns == other.maxConns && waitTime == other.waitTime &&
+            enabled == other.enabled;
+}
+
+DataProfileCache::ProfileSet::ProfileSet(const std::vector<Profile>& profiles)
+    : mProfiles(profiles),
+      mInfos(profiles.size())
+{
+    for (size_t i = 0; i < mProfiles.size(); i++) {
+        Profile& profile = mProfiles[i];
+        RIL_DataProfileInfo& info = mInfos[i];
+
+        info.profileId = profile.profileId;
+        info.apn = &profile.apn[0];
+        info.protocol = &profile.protocol[0];
+        info.authType = profile.authType;
+        info.user = profile.hasUser ? &profile.user[0] : NULL;
+        info.password = profile.hasPassword ? &profile.password[0] : NULL;
+        info.type = profile.type;
+        info.maxConnsTime = profile.maxConnsTime;
+        info.maxConns = profile.maxConns;
+        info.waitTime = profile.waitTime;
+        info.enabled = profile.enabled;
+        mPointers.push_back(&info);
+    }
+}
+
+DataProfileCache::DataProfileCache()
+    : mProfilesInModem(false)
+{
+}
+
+bool DataProfileCache::parseProfiles(const void *data, size_t datalen, std::vector<Profile> *out)
+{
+    const RIL_DataProfileInfo * const *infos = static_cast<const RIL_DataProfileInfo * const *>(data);
+    size_t count = datalen / sizeof(RIL_DataProfileInfo *);
+
+    if (data == NULL || count == 0 || datalen % sizeof(RIL_DataProfileInfo *) != 0) {
+        return false;
+    }
+
+    out->clear();
+    for (size_t i = 0; i < count; i++) {
+        const RIL_DataProfileInfo *info = infos[i];
+        Profile profile;
+
+        if (info == NULL) {
+            return false;
+        }
+
+        profile.profileId = info->profileId;
+        profile.apn = info->apn != NULL ? info->apn : "";
+        profile.protocol = info->protocol != NULL ? info->protocol : "";
+        profile.authType = info->authType;
+        profile.hasUser = info->user != NULL;
+        profile.user = info->user != NULL ? info->user : "";
+        profile.hasPassword = info->password != NULL;
+        profile.password = info->password != NULL ? info->password : "";
+        profile.type = info->type;
+        profile.maxConnsTime = info->maxConnsTime;
+        profile.maxConns = info->maxConns;
+        profile.waitTime = info->waitTime;
+        profile.enabled = info->enabled;
+        out->push_back(profile);
+    }
+
+    return true;
+}
+
+bool DataProfileCache::onSetProfiles(RIL_Token t, const void *data, size_t datalen)
+{
+    std::vector<Profile> profiles;
+
+    if (!parseProfiles(data, datalen, &profiles)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mProfilesInModem && profiles == mProfiles) {
+        return true;
+    }
+
+    mProfiles = profiles;
+    mProfilesInModem = false;
+    mProfileRequests[t] = std::move(profiles);
+    return false;
+}
+
+void DataProfileCache::invalidateProfiles()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mProfilesInModem = false;
+    /* Pushes still in flight went to a radio that is going away */
+    mProfileRequests.clear();
+}
+
+void DataProfileCache::forgetProfiles()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mProfiles.clear();
+    mProfilesInModem = false;
+    mProfileRequests.clear();
+}
+
+bool DataProfileCache::profilesToPush(RIL_Token t, std::vector<Profile> *out)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mProfiles.empty() || mProfilesInModem || !mProfileRequests.empty()) {
+        return false;
+    }
+
+    *out = mProfiles;
+    mProfileRequests[t] = mProfiles;
+    return true;
+}
+
+bool DataProfileCache::onComplete(RIL_Token t, RIL_Errno e)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto profiles = mProfileRequests.find(t);
+    if (profiles == mProfileRequests.end()) {
+        return false;
+    }
+
+    /* A later set may have replaced the list while this one was in flight */
+    if (e == RIL_E_SUCCESS && profiles->second == mProfiles) {
+        mProfilesInModem = true;
+    }
+    mProfileRequests.erase(profiles);
+    return true;
+}
+
+} // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_DATA_PROFILE_CACHE_H
+#define SECRIL_SHIM_DATA_PROFILE_CACHE_H
+
+#include <stddef.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Takes RIL_REQUEST_SET_DATA_PROFILE off the data bring-up path after the
+ * modem restarts its radio, e.g. across an airplane mode toggle: the data
+ * profiles the framework last set are pushed to the modem as soon as the
+ * SIM is ready, before the framework gets there, and the framework's own
+ * identical request is answered without a round trip. SETUP_DATA_CALL
+ * itself is left to the framework and the modem.
+ *
+ * The profiles belong to the card they were set for and are forgotten as
+ * soon as that card goes away, so they are never pushed for another SIM.
+ */
+class DataProfileCache {
+public:
+    struct Profile {
+        int profileId;
+        std::string apn;
+        std::string protocol;
+        int authType;
+        bool hasUser;
+        std::string user;
+        bool hasPassword;
+        std::string password;
+        int type;
+        int maxConnsTime;
+        int maxConns;
+        int waitTime;
+        int enabled;
+
+        bool operator==(const Profile& other) const;
+    };
+
+    /* RIL_DataProfileInfo ** view of a profile list, owning its strings */
+    class ProfileSet {
+    public:
+        explicit ProfileSet(const std::vector<Profile>& profiles);
+
+        void *data() { return mPointers.data(); }
+        size_t size() const { return mPointers.size() * sizeof(RIL_DataProfileInfo *); }
+
+    private:
+        std::vector<Profile> mProfiles;
+        std::vector<RIL_DataProfileInfo> mInfos;
+        std::vector<RIL_DataProfileInfo *> mPointers;
+    };
+
+    DataProfileCache();
+
+    /*
+     * Called for the framework's RIL_REQUEST_SET_DATA_PROFILE. Returns true
+     * if the modem already holds exactly these profiles, in which case the
+     * request can be completed right away.
+     */
+    bool onSetProfiles(RIL_Token t, const void *data, size_t datalen);
+
+    /* The modem lost its profiles (radio off or unavailable). */
+    void invalidateProfiles();
+
+    /* The card was removed or swapped; its profiles must not be pushed again. */
+    void forgetProfiles();
+
+    /*
+     * Fills "out" if there are remembered profiles the modem does not hold;
+     * the caller dispatches them as request "t".
+     */
+    bool profilesToPush(RIL_Token t, std::vector<Profile> *out);
+
+    /*
+     * Accounts for a RIL_REQUEST_SET_DATA_PROFILE completion. Returns true
+     * if it was tracked here.
+     */
+    bool onComplete(RIL_Token t, RIL_Errno e);
+
+private:
+    static bool parseProfiles(const void *data, size_t datalen, std::vector<Profile> *out);
+
+    mutable std::mutex mLock;
+    std::vector<Profile> mProfiles;
+    bool mProfilesInModem;
+    std::unordered_map<RIL_Token, std::vector<Profile>> mProfileRequests;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_DATA_PROFILE_CACHE_H
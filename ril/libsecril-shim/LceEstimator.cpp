@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "LceEstimator.h"
+
+namespace android {
+
+LceEstimator::LceEstimator(int64_t timeConstantNs)
+    : mHead(0),
+      mTail(0),
+      mOverruns(0),
+      mTimeConstantNs(timeConstantNs > 0 ? timeConstantNs : 1)
+{
+    reset();
+}
+
+bool LceEstimator::push(const RIL_LceDataInfo& info, int64_t nowNs)
+{
+    size_t head = mHead.load(std::memory_order_relaxed);
+
+    if (head - mTail.load(std::memory_order_acquire) >= RING_SIZE) {
+        mOverruns.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Sample& slot = mRing[head & (RING_SIZE - 1)];
+    slot.timeNs = nowNs;
+    slot.kbps = info.last_hop_capacity_kbps;
+    slot.confidence = info.confidence_level > 100 ? 100 : info.confidence_level;
+    slot.suspended = info.lce_suspended;
+
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+size_t LceEstimator::drain()
+{
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    size_t head = mHead.load(std::memory_order_acquire);
+    size_t count = head - tail;
+
+    for (; tail != head; tail++) {
+        fold(mRing[tail & (RING_SIZE - 1)]);
+        mTail.store(tail + 1, std::memory_order_release);
+    }
+
+    return count;
+}
+
+void LceEstimator::fold(const Sample& sample)
+{
+    mEstimate.lastKbps = sample.kbps;
+    mEstimate.suspended = sample.suspended != 0;
+
+    /* A suspension notice carries no usable capacity */
+    if (sample.suspended) {
+        mEstimate.updatedNs = sample.timeNs;
+        return;
+    }
+
+    if (mEstimate.samples == 0) {
+        mKbps = sample.kbps;
+        mConfidence = sample.confidence;
+    } else {
+        int64_t dt = sample.timeNs - mEstimate.updatedNs;
+        double alpha = dt > 0 ? 1.0 - exp(-static_cast<double>(dt) / mTimeConstantNs) : 0.0;
+
+        mConfidence += alpha * (sample.confidence - mConfidence);
+        mKbps += alpha * (sample.confidence / 100.0) * (sample.kbps - mKbps);
+    }
+
+    mEstimate.kbps = static_cast<uint32_t>(mKbps + 0.5);
+    mEstimate.confidence = static_cast<uint8_t>(mConfidence + 0.5);
+    mEstimate.updatedNs = sample.timeNs;
+    mEstimate.samples++;
+}
+
+void LceEstimator::reset()
+{
+    memset(&mEstimate, 0, sizeof(mEstimate));
+    mKbps = 0;
+    mConfidence = 0;
+}
+
+} // namespace android
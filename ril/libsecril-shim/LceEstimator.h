@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_LCE_ESTIMATOR_H
+#define SECRIL_SHIM_LCE_ESTIMATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+struct LceEstimate {
+    uint32_t kbps;          /* smoothed last-hop capacity */
+    uint32_t lastKbps;      /* most recent report as received */
+    uint8_t confidence;     /* smoothed, 0-100 */
+    bool suspended;         /* the modem said reports stop for now */
+    int64_t updatedNs;      /* CLOCK_MONOTONIC of the most recent report */
+    uint32_t samples;       /* reports folded in since the last reset */
+};
+
+/*
+ * Smooths RIL_UNSOL_LCEDATA_RECV reports into a capacity estimate.
+ *
+ * Reports are pushed from the thread the vendor RIL delivers URCs on and
+ * drained on the libril event loop, through a single producer, single
+ * consumer ring that needs no lock. Draining applies an exponentially
+ * weighted average whose weight grows with the time since the previous
+ * report (time constant "timeConstantNs") and with the confidence the
+ * modem attached to the report, so a low confidence outlier barely moves
+ * the estimate.
+ */
+class LceEstimator {
+public:
+    explicit LceEstimator(int64_t timeConstantNs);
+
+    /* Producer side. Returns false if the ring is full and the report was dropped. */
+    bool push(const RIL_LceDataInfo& info, int64_t nowNs);
+
+    /* Consumer side. Folds every queued report in; returns how many there were. */
+    size_t drain();
+
+    /* Consumer side: forgets the estimate, e.g. when the radio goes off. */
+    void reset();
+
+    const LceEstimate& estimate() const { return mEstimate; }
+    uint64_t overruns() const { return mOverruns.load(std::memory_order_relaxed); }
+
+private:
+    struct Sample {
+        int64_t timeNs;
+        uint32_t kbps;
+        uint8_t confidence;
+        uint8_t suspended;
+    };
+
+    static const size_t RING_SIZE = 64;     /* power of two */
+
+    void fold(const Sample& sample);
+
+    Sample mRing[RING_SIZE];
+    std::atomic<size_t> mHead;      /* next slot to write, owned by the producer */
+    std::atomic<size_t> mTail;      /* next slot to read, owned by the consumer */
+    std::atomic<uint64_t> mOverruns;
+
+    int64_t mTimeConstantNs;
+    double mKbps;
+    double mConfidence;
+    LceEstimate mEstimate;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_LCE_ESTIMATOR_H
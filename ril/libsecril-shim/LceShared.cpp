@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "LceShared.h"
+
+namespace android {
+
+/* Give up on a reader that keeps racing the writer */
+static const int MAX_READ_ATTEMPTS = 8;
+
+static_assert(sizeof(LceSharedState) == 9 * sizeof(uint32_t),
+        "LceSharedState is a file format");
+
+static void initState(LceSharedState *state)
+{
+    state->magic = LceSharedState::MAGIC;
+    state->size = sizeof(LceSharedState);
+    state->sequence.store(0, std::memory_order_relaxed);
+    state->kbps.store(0, std::memory_order_relaxed);
+    state->lastKbps.store(0, std::memory_order_relaxed);
+    state->flags.store(0, std::memory_order_relaxed);
+    state->samples.store(0, std::memory_order_relaxed);
+    state->updatedNsLow.store(0, std::memory_order_relaxed);
+    state->updatedNsHigh.store(0, std::memory_order_relaxed);
+}
+
+static bool readState(const LceSharedState *state, LceEstimate *out)
+{
+    if (state == NULL || state->magic != LceSharedState::MAGIC ||
+            state->size != sizeof(LceSharedState)) {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        uint32_t begin = state->sequence.load(std::memory_order_acquire);
+        if (begin & 1) {
+            continue;
+        }
+
+        uint32_t flags = state->flags.load(std::memory_order_relaxed);
+        out->kbps = state->kbps.load(std::memory_order_relaxed);
+        out->lastKbps = state->lastKbps.load(std::memory_order_relaxed);
+        out->confidence = static_cast<uint8_t>(flags & 0xff);
+        out->suspended = (flags & 0x100) != 0;
+        out->samples = state->samples.load(std::memory_order_relaxed);
+        out->updatedNs = static_cast<int64_t>(
+                static_cast<uint64_t>(state->updatedNsHigh.load(std::memory_order_relaxed)) << 32 |
+                state->updatedNsLow.load(std::memory_order_relaxed));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (state->sequence.load(std::memory_order_relaxed) == begin) {
+            return begin != 0;
+        }
+    }
+
+    return false;
+}
+
+LcePublisher::LcePublisher()
+    : mState(&mFallback)
+{
+    initState(&mFallback);
+}
+
+LcePublisher::~LcePublisher()
+{
+    if (mState != &mFallback) {
+        munmap(mState, sizeof(LceSharedState));
+    }
+}
+
+bool LcePublisher::open(const char *path)
+{
+    int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    /* Readers run as other users, whatever umask rild was started with */
+    void *map = MAP_FAILED;
+    if (fchmod(fd, 0644) == 0 && ftruncate(fd, sizeof(LceSharedState)) == 0) {
+        map = mmap(NULL, sizeof(LceSharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    /* Whatever a previous instance left there is stale */
+    LceSharedState *state = static_cast<LceSharedState *>(map);
+    initState(state);
+    if (mState != &mFallback) {
+        munmap(mState, sizeof(LceSharedState));
+    }
+    mState = state;
+    return true;
+}
+
+void LcePublisher::publish(const LceEstimate& estimate)
+{
+    uint32_t sequence = mState->sequence.load(std::memory_order_relaxed);
+    uint64_t updatedNs = static_cast<uint64_t>(estimate.updatedNs);
+
+    mState->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    mState->kbps.store(estimate.kbps, std::memory_order_relaxed);
+    mState->lastKbps.store(estimate.lastKbps, std::memory_order_relaxed);
+    mState->flags.store(estimate.confidence | (estimate.suspended ? 0x100 : 0),
+            std::memory_order_relaxed);
+    mState->samples.store(estimate.samples, std::memory_order_relaxed);
+    mState->updatedNsLow.store(static_cast<uint32_t>(updatedNs), std::memory_order_relaxed);
+    mState->updatedNsHigh.store(static_cast<uint32_t>(updatedNs >> 32),
+            std::memory_order_relaxed);
+
+    mState->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool LcePublisher::read(LceEstimate *out) const
+{
+    return readState(mState, out);
+}
+
+LceReader::LceReader()
+    : mState(NULL)
+{
+}
+
+LceReader::~LceReader()
+{
+    if (mState != NULL) {
+        munmap(const_cast<LceSharedState *>(mState), sizeof(LceSharedState));
+    }
+}
+
+bool LceReader::open(const char *path)
+{
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    void *map = mmap(NULL, sizeof(LceSharedState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    if (mState != NULL) {
+        munmap(const_cast<LceSharedState *>(mState), sizeof(LceSharedState));
+    }
+    mState = static_cast<const LceSharedState *>(map);
+    return true;
+}
+
+bool LceReader::openSlot(int slot)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "%s-%d", LCE_SHARED_PATH, slot);
+    return open(path);
+}
+
+bool LceReader::read(LceEstimate *out) const
+{
+    return readState(mState, out);
+}
+
+} // namespace android
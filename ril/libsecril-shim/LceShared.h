@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_LCE_SHARED_H
+#define SECRIL_SHIM_LCE_SHARED_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "LceEstimator.h"
+
+/*
+ * One file per RIL slot, "<LCE_SHARED_PATH>-<slot>". The directory is
+ * world-searchable and labelled radio_lce_vendor_data_file, which vendor
+ * domains with the radio_lce_client attribute may map.
+ */
+#define LCE_SHARED_PATH "/data/vendor/radio_lce/lce"
+
+namespace android {
+
+/*
+ * Layout of the LCE estimate file. The shim maps it read-write and is the
+ * only writer; any process allowed to read the file maps it read-only and
+ * gets the current estimate with a handful of loads, without a binder call
+ * or a modem request. Updates are published under a sequence lock: the
+ * sequence is odd while a write is in progress.
+ */
+struct LceSharedState {
+    static const uint32_t MAGIC = 0x3145434c;     /* "LCE1" */
+
+    uint32_t magic;
+    uint32_t size;
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> kbps;
+    std::atomic<uint32_t> lastKbps;
+    std::atomic<uint32_t> flags;        /* confidence in bits 0-7, suspended in bit 8 */
+    std::atomic<uint32_t> samples;
+    std::atomic<uint32_t> updatedNsLow;
+    std::atomic<uint32_t> updatedNsHigh;
+};
+
+/* Owns the writable mapping. Falls back to private memory if the file cannot be mapped. */
+class LcePublisher {
+public:
+    LcePublisher();
+    ~LcePublisher();
+
+    bool open(const char *path);
+    void publish(const LceEstimate& estimate);
+
+    /* Same read as LceReader, for requests answered inside the shim. */
+    bool read(LceEstimate *out) const;
+
+private:
+    LceSharedState *mState;
+    LceSharedState mFallback;
+};
+
+class LceReader {
+public:
+    LceReader();
+    ~LceReader();
+
+    bool open(const char *path);
+
+    /* Opens the file rild publishes for RIL slot "slot". */
+    bool openSlot(int slot);
+
+    /* Returns false until a first estimate has been published. */
+    bool read(LceEstimate *out) const;
+
+private:
+    const LceSharedState *mState;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_LCE_SHARED_H
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "NetworkScanStreamer.h"
+
+namespace android {
+
+NetworkScanStreamer::NetworkScanStreamer()
+    : mActive(false),
+      mSocketId(0),
+      mNextScan(0),
+      mInFlight(false),
+      mCellsForwarded(0),
+      mDuplicates(0)
+{
+}
+
+void NetworkScanStreamer::split(const RIL_RadioAccessSpecifier& specifier,
+        std::vector<RIL_RadioAccessSpecifier>& out)
+{
+    uint32_t bands = specifier.bands_length > MAX_BANDS ? MAX_BANDS : specifier.bands_length;
+
+    /* Channels are not tied to a band, so a specifier naming any stays whole */
+    if (bands <= 1 || specifier.channels_length > 0) {
+        out.push_back(specifier);
+        return;
+    }
+
+    for (uint32_t i = 0; i < bands; i++) {
+        RIL_RadioAccessSpecifier one;
+
+        memset(&one, 0, sizeof(one));
+        one.radio_access_network = specifier.radio_access_network;
+        one.bands_length = 1;
+        /* The band enums share the union's layout */
+        one.bands.eutran_bands[0] = specifier.bands.eutran_bands[i];
+        out.push_back(one);
+    }
+}
+
+bool NetworkScanStreamer::start(const void *data, size_t datalen, int socketId)
+{
+    const RIL_NetworkScanRequest *request = static_cast<const RIL_NetworkScanRequest *>(data);
+    std::vector<RIL_RadioAccessSpecifier> scans;
+
+    if (request == NULL || datalen < sizeof(*request) || request->type != RIL_ONE_SHOT ||
+            request->specifiers_length > MAX_RADIO_ACCESS_NETWORKS) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < request->specifiers_length; i++) {
+        split(request->specifiers[i], scans);
+    }
+    if (scans.size() < 2) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mActive) {
+        return false;
+    }
+
+    mActive = true;
+    mSocketId = socketId;
+    mScans.swap(scans);
+    mNextScan = 0;
+    mInFlight = false;
+    mSeen.clear();
+    return true;
+}
+
+bool NetworkScanStreamer::nextScan(RIL_NetworkScanRequest *out)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (!mActive || mInFlight || mNextScan >= mScans.size()) {
+        return false;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->type = RIL_ONE_SHOT;
+    out->specifiers_length = 1;
+    out->specifiers[0] = mScans[mNextScan++];
+    mInFlight = true;
+    return true;
+}
+
+NetworkScanStreamer::Outcome NetworkScanStreamer::onResult(const void *data, size_t datalen,
+        std::vector<RIL_CellInfo_v12>& fresh, RIL_Errno *error)
+{
+    const RIL_NetworkScanResult *result = static_cast<const RIL_NetworkScanResult *>(data);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mActive) {
+        return OUTCOME_IGNORED;
+    }
+    if (!mInFlight || result == NULL || datalen < sizeof(*result)) {
+        return OUTCOME_DROPPED;
+    }
+
+    for (uint32_t i = 0; i < result->network_infos_length && result->network_infos != NULL;
+            i++) {
+        const RIL_CellInfo_v12& cell = result->network_infos[i];
+        CellKey key = CellInfoTracker::keyOf(cell);
+        bool registered = cell.registered != 0;
+
+        auto it = mSeen.find(key);
+        if (it != mSeen.end() && it->second == registered) {
+            mDuplicates++;
+            continue;
+        }
+        mSeen[key] = registered;
+        fresh.push_back(cell);
+    }
+    mCellsForwarded += fresh.size();
+
+    *error = result->error;
+    if (result->error != RIL_E_SUCCESS) {
+        mActive = false;
+        mInFlight = false;
+        return OUTCOME_FAILED;
+    }
+    if (result->status != COMPLETE) {
+        return OUTCOME_PARTIAL;
+    }
+
+    mInFlight = false;
+    if (mNextScan < mScans.size()) {
+        return OUTCOME_NEXT;
+    }
+    mActive = false;
+    return OUTCOME_DONE;
+}
+
+void NetworkScanStreamer::onScanFailed()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mActive = false;
+    mInFlight = false;
+}
+
+bool NetworkScanStreamer::cancel()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    bool inFlight = mActive && mInFlight;
+
+    mActive = false;
+    mInFlight = false;
+    return inFlight;
+}
+
+bool NetworkScanStreamer::active() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mActive;
+}
+
+int NetworkScanStreamer::socketId() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mSocketId;
+}
+
+uint64_t NetworkScanStreamer::cellsForwarded() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mCellsForwarded;
+}
+
+uint64_t NetworkScanStreamer::duplicatesDropped() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mDuplicates;
+}
+
+} // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_NETWORK_SCAN_STREAMER_H
+#define SECRIL_SHIM_NETWORK_SCAN_STREAMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <telephony/ril.h>
+
+#include "CellInfoTracker.h"
+
+namespace android {
+
+/*
+ * Turns a RIL_REQUEST_START_NETWORK_SCAN the modem would answer with one
+ * result at the very end into a stream of partial results.
+ *
+ * The request is split into one-shot sub-scans, one per band of every
+ * radio access network (or per network when it names channels or nothing
+ * at all), which are handed to the modem one after another. Each sub-scan
+ * result is reduced to the cells not reported earlier in the session, by
+ * cell identity, and goes to the framework as a PARTIAL result; the last
+ * sub-scan ends the session with COMPLETE. A cancelled session never
+ * issues another sub-scan.
+ *
+ * Only one-shot scans are streamed. The framework ends a scan on its first
+ * COMPLETE, so a periodic scan has no end the shim could report and is
+ * left to the modem as is.
+ */
+class NetworkScanStreamer {
+public:
+    enum Outcome {
+        OUTCOME_IGNORED,    /* not part of a session, pass the URC on */
+        OUTCOME_DROPPED,    /* belongs to a sub-scan that no longer matters */
+        OUTCOME_PARTIAL,    /* emit PARTIAL, the current sub-scan goes on */
+        OUTCOME_NEXT,       /* emit PARTIAL, then start the next sub-scan */
+        OUTCOME_DONE,       /* emit COMPLETE, the session is over */
+        OUTCOME_FAILED,     /* emit COMPLETE with the error, the session is over */
+    };
+
+    NetworkScanStreamer();
+
+    /*
+     * Opens a session for "request". Returns false, leaving the request to
+     * the modem as is, if it is periodic, does not split into at least two
+     * sub-scans or a session is already open.
+     */
+    bool start(const void *data, size_t datalen, int socketId);
+
+    /* Next sub-scan to hand to the modem. Returns false if there is none. */
+    bool nextScan(RIL_NetworkScanRequest *out);
+
+    /*
+     * Folds a modem result in and stores the cells the framework has not
+     * seen in "fresh".
+     */
+    Outcome onResult(const void *data, size_t datalen, std::vector<RIL_CellInfo_v12>& fresh,
+            RIL_Errno *error);
+
+    /* The modem refused a sub-scan the shim issued: ends the session. */
+    void onScanFailed();
+
+    /* Returns true if a sub-scan was running in the modem. */
+    bool cancel();
+
+    bool active() const;
+    int socketId() const;
+
+    uint64_t cellsForwarded() const;
+    uint64_t duplicatesDropped() const;
+
+private:
+    static void split(const RIL_RadioAccessSpecifier& specifier,
+            std::vector<RIL_RadioAccessSpecifier>& out);
+
+    mutable std::mutex mLock;
+    bool mActive;
+    int mSocketId;
+    std::vector<RIL_RadioAccessSpecifier> mScans;
+    size_t mNextScan;
+    bool mInFlight;
+    std::unordered_map<CellKey, bool, CellKeyHash> mSeen;   /* cell -> registered */
+    uint64_t mCellsForwarded;
+    uint64_t mDuplicates;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_NETWORK_SCAN_STREAMER_H
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "PhonebookLoader.h"
+
+namespace android {
+
+PhonebookLoader::PhonebookLoader(size_t depth)
+    : mDepth(depth),
+      mGeneration(0),
+      mHits(0)
+{
+}
+
+void PhonebookLoader::configure(size_t depth)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mDepth = depth;
+}
+
+uint64_t PhonebookLoader::keyOf(int fileid, int index)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(fileid)) << 32 |
+            static_cast<uint32_t>(index);
+}
+
+PhonebookLoader::FileState& PhonebookLoader::fileLocked(int fileid)
+{
+    auto it = mFiles.find(fileid);
+
+    if (it == mFiles.end()) {
+        FileState state = {};
+        state.end = -1;
+        state.used = -1;
+        it = mFiles.emplace(fileid, state).first;
+    }
+
+    return it->second;
+}
+
+void PhonebookLoader::onStorageInfoRequest(RIL_Token t, const void *data, size_t datalen)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mDepth == 0 || data == NULL || datalen < sizeof(int)) {
+        return;
+    }
+
+    mStorageRequests[t] = *static_cast<const int *>(data);
+}
+
+void PhonebookLoader::copyEntry(const SecPhonebookEntry& entry, Entry *out)
+{
+    out->entry = entry;
+
+    for (int i = 0; i < PB_NUM_ALPHA; i++) {
+        if (entry.alphaTags[i] != NULL) {
+            out->text[i] = entry.alphaTags[i];
+            out->entry.alphaTags[i] = &out->text[i][0];
+        }
+    }
+
+    for (int i = 0; i < PB_NUM_NUMBER; i++) {
+        if (entry.numbers[i] != NULL) {
+            out->text[PB_NUM_ALPHA + i] = entry.numbers[i];
+            out->entry.numbers[i] = &out->text[PB_NUM_ALPHA + i][0];
+        }
+    }
+}
+
+PhonebookLoader::Lookup PhonebookLoader::lookup(const void *data, size_t datalen, RIL_Token t,
+        int socketId, Entry *out)
+{
+    const SecPhonebookEntryRequest *request = static_cast<const SecPhonebookEntryRequest *>(data);
+    PhonebookStore::Record record;
+
+    if (request == NULL || datalen != sizeof(SecPhonebookEntryRequest)) {
+        return LOOKUP_MISS;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mDepth == 0) {
+        return LOOKUP_MISS;
+    }
+
+    if (mStore.find(request->fileid, request->index, &record)) {
+        copyEntry(record.entry, out);
+        mHits++;
+        return LOOKUP_HIT;
+    }
+
+    uint64_t key = keyOf(request->fileid, request->index);
+    auto inFlight = mInFlight.find(key);
+    if (inFlight != mInFlight.end()) {
+        mOutstanding[inFlight->second]->waiters.push_back(t);
+        mHits++;
+        return LOOKUP_PARKED;
+    }
+
+    /* Prefetches reuse the command and PIN2 of the framework's own requests */
+    FileState& file = fileLocked(request->fileid);
+    file.command = request->command;
+    file.hasPin2 = request->pin2 != NULL;
+    file.pin2 = request->pin2 != NULL ? request->pin2 : "";
+    file.socketId = socketId;
+    file.started = true;
+    if (file.cursor <= request->index) {
+        file.cursor = request->index + 1;
+    }
+
+    std::unique_ptr<Outstanding> outstanding(new Outstanding());
+    outstanding->fileid = request->fileid;
+    outstanding->index = request->index;
+    outstanding->generation = mGeneration;
+    outstanding->prefetch = false;
+    mOutstanding[t] = std::move(outstanding);
+    mInFlight[key] = t;
+    return LOOKUP_MISS;
+}
+
+bool PhonebookLoader::nextFetch(Fetch *out)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mDepth == 0) {
+        return false;
+    }
+
+    for (auto& it : mFiles) {
+        int fileid = it.first;
+        FileState& file = it.second;
+
+        if (!file.started || file.stopped || file.end < 0 || file.inFlight >= mDepth ||
+                (file.used >= 0 && file.found >= file.used)) {
+            continue;
+        }
+
+        while (file.cursor <= file.end) {
+            int index = file.cursor++;
+            uint64_t key = keyOf(fileid, index);
+            PhonebookStore::Record record;
+
+            if (mInFlight.count(key) != 0 || mStore.find(fileid, index, &record)) {
+                continue;
+            }
+
+            std::unique_ptr<Outstanding> outstanding(new Outstanding());
+            outstanding->fileid = fileid;
+            outstanding->index = index;
+            outstanding->generation = mGeneration;
+            outstanding->prefetch = true;
+
+            /* The bookkeeping entry doubles as the token: unique while in flight */
+            RIL_Token token = outstanding.get();
+            mOutstanding[token] = std::move(outstanding);
+            mInFlight[key] = token;
+            file.inFlight++;
+
+            out->token = token;
+            out->socketId = file.socketId;
+            out->command = file.command;
+            out->fileid = fileid;
+            out->index = index;
+            out->hasPin2 = file.hasPin2;
+            out->pin2 = file.pin2;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PhonebookLoader::onEntry(Outstanding& outstanding, RIL_Errno e, const void *response,
+        size_t responselen)
+{
+    const SecPhonebookEntry *entry = static_cast<const SecPhonebookEntry *>(response);
+    auto it = mFiles.find(outstanding.fileid);
+
+    if (it == mFiles.end() || outstanding.generation != mGeneration) {
+        /* Cleared while in flight, the answer may predate a change */
+        return;
+    }
+
+    FileState& file = it->second;
+
+    if (e != RIL_E_SUCCESS || entry == NULL || responselen != sizeof(SecPhonebookEntry)) {
+        /* Leave the rest of this file to the framework's own requests */
+        if (outstanding.prefetch) {
+            file.stopped = true;
+        }
+        return;
+    }
+
+    mStore.put(outstanding.fileid, outstanding.index, *entry);
+    if (!PhonebookStore::isEmpty(*entry)) {
+        file.found++;
+    }
+
+    /* Empty records up to nextIndex do not need to be fetched */
+    if (entry->nextIndex > outstanding.index) {
+        if (entry->nextIndex > file.cursor) {
+            file.cursor = entry->nextIndex;
+        }
+    } else if (file.end < 0 || outstanding.index < file.end) {
+        file.end = outstanding.index;
+    }
+}
+
+PhonebookLoader::Completion PhonebookLoader::onComplete(RIL_Token t, RIL_Errno e,
+        const void *response, size_t responselen, std::vector<RIL_Token>& waiters)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto storage = mStorageRequests.find(t);
+    if (storage != mStorageRequests.end()) {
+        const int *info = static_cast<const int *>(response);
+        int fileid = storage->second;
+
+        mStorageRequests.erase(storage);
+        if (e == RIL_E_SUCCESS && info != NULL && responselen >= 3 * sizeof(int) &&
+                info[0] > 0) {
+            FileState& file = fileLocked(fileid);
+            file.end = info[2] + info[0] - 1;
+            file.used = info[1];
+            if (file.cursor < info[2]) {
+                file.cursor = info[2];
+            }
+        }
+        return COMPLETION_FORWARD;
+    }
+
+    auto it = mOutstanding.find(t);
+    if (it == mOutstanding.end()) {
+        return COMPLETION_UNTRACKED;
+    }
+
+    std::unique_ptr<Outstanding> outstanding = std::move(it->second);
+    mOutstanding.erase(it);
+
+    uint64_t key = keyOf(outstanding->fileid, outstanding->index);
+    auto inFlight = mInFlight.find(key);
+    if (inFlight != mInFlight.end() && inFlight->second == t) {
+        mInFlight.erase(inFlight);
+    }
+
+    if (outstanding->prefetch && outstanding->generation == mGeneration) {
+        auto file = mFiles.find(outstanding->fileid);
+        if (file != mFiles.end() && file->second.inFlight > 0) {
+            file->second.inFlight--;
+        }
+    }
+
+    onEntry(*outstanding, e, response, responselen);
+    waiters.insert(waiters.end(), outstanding->waiters.begin(), outstanding->waiters.end());
+
+    return outstanding->prefetch ? COMPLETION_CONSUMED : COMPLETION_FORWARD;
+}
+
+void PhonebookLoader::clear()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mStore.clear();
+    mFiles.clear();
+    mInFlight.clear();
+    mGeneration++;
+}
+
+size_t PhonebookLoader::size() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStore.size();
+}
+
+uint64_t PhonebookLoader::hits() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mHits;
+}
+
+} // namespace android
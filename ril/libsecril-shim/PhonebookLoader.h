@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_PHONEBOOK_LOADER_H
+#define SECRIL_SHIM_PHONEBOOK_LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <telephony/ril.h>
+
+#include "PhonebookStore.h"
+
+namespace android {
+
+/*
+ * Pipelines the USIM phonebook load. The framework walks the phonebook
+ * one RIL_REQUEST_GET_PHONEBOOK_ENTRY at a time, following nextIndex.
+ * Once it has asked for the storage info of a file and for its first entry,
+ * the loader keeps up to "depth" entry requests of its own in flight ahead
+ * of it and stores the answers in a PhonebookStore. Framework requests are
+ * then answered from the store, or parked until the prefetch of the same
+ * entry returns.
+ */
+class PhonebookLoader {
+public:
+    enum Lookup {
+        LOOKUP_MISS,        /* dispatch the request to the modem */
+        LOOKUP_HIT,         /* complete the request with "out" */
+        LOOKUP_PARKED,      /* the request is completed with a prefetch */
+    };
+
+    enum Completion {
+        COMPLETION_UNTRACKED,
+        COMPLETION_FORWARD, /* a framework request, pass the response on */
+        COMPLETION_CONSUMED, /* a prefetch, do not hand it to libril */
+    };
+
+    /* Owned copy of a stored entry */
+    struct Entry {
+        SecPhonebookEntry entry;
+        std::string text[PB_NUM_ALPHA + PB_NUM_NUMBER];
+    };
+
+    /* A prefetch to dispatch; "token" is owned by the loader. */
+    struct Fetch {
+        RIL_Token token;
+        int socketId;
+        int command;
+        int fileid;
+        int index;
+        bool hasPin2;
+        std::string pin2;
+    };
+
+    explicit PhonebookLoader(size_t depth);
+
+    /* Prefetching is off with a depth of 0. */
+    void configure(size_t depth);
+
+    void onStorageInfoRequest(RIL_Token t, const void *data, size_t datalen);
+
+    Lookup lookup(const void *data, size_t datalen, RIL_Token t, int socketId, Entry *out);
+
+    /* Pops the next prefetch if the pipeline has room. */
+    bool nextFetch(Fetch *out);
+
+    /*
+     * Accounts for a storage info or entry response. Framework requests
+     * that were parked on it are appended to "waiters" and must be
+     * completed with the same response.
+     */
+    Completion onComplete(RIL_Token t, RIL_Errno e, const void *response, size_t responselen,
+            std::vector<RIL_Token>& waiters);
+
+    /* Forgets every stored entry; prefetches in flight are still consumed. */
+    void clear();
+
+    size_t size() const;
+    uint64_t hits() const;
+
+private:
+    struct FileState {
+        int command;
+        bool hasPin2;
+        std::string pin2;
+        int socketId;
+        int cursor;
+        int end;            /* last index, -1 until the storage info is known */
+        int used;           /* non-empty records, -1 until known */
+        int found;
+        size_t inFlight;
+        bool started;
+        bool stopped;
+    };
+
+    struct Outstanding {
+        int fileid;
+        int index;
+        uint64_t generation;
+        bool prefetch;
+        std::vector<RIL_Token> waiters;
+    };
+
+    static uint64_t keyOf(int fileid, int index);
+    FileState& fileLocked(int fileid);
+    static void copyEntry(const SecPhonebookEntry& entry, Entry *out);
+    void onEntry(Outstanding& outstanding, RIL_Errno e, const void *response,
+            size_t responselen);
+
+    mutable std::mutex mLock;
+    size_t mDepth;
+    uint64_t mGeneration;
+    uint64_t mHits;
+    PhonebookStore mStore;
+    std::unordered_map<int, FileState> mFiles;
+    std::unordered_map<RIL_Token, int> mStorageRequests;
+    std::unordered_map<RIL_Token, std::unique_ptr<Outstanding>> mOutstanding;
+    std::unordered_map<uint64_t, RIL_Token> mInFlight;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_PHONEBOOK_LOADER_H
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "PhonebookStore.h"
+
+namespace android {
+
+const uint32_t PhonebookStore::NO_TEXT;
+
+PhonebookStore::Iterator::Iterator(const PhonebookStore *store, int fileid)
+    : mStore(store),
+      mFileid(fileid),
+      mRow(0)
+{
+}
+
+bool PhonebookStore::Iterator::next(Record *out)
+{
+    while (mRow < mStore->size()) {
+        size_t row = mRow++;
+        if (mFileid < 0 || mStore->mFileid[row] == mFileid) {
+            mStore->fill(row, out);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+PhonebookStore::Iterator PhonebookStore::iterate(int fileid) const
+{
+    return Iterator(this, fileid);
+}
+
+uint64_t PhonebookStore::keyOf(int fileid, int index)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(fileid)) << 32 |
+            static_cast<uint32_t>(index);
+}
+
+uint32_t PhonebookStore::addText(const char *text)
+{
+    if (text == NULL) {
+        return NO_TEXT;
+    }
+
+    /* libril marshals these as C strings, so that is all there is to keep */
+    size_t length = strlen(text);
+    uint32_t offset = static_cast<uint32_t>(mText.size());
+
+    mText.insert(mText.end(), text, text + length + 1);
+    return offset;
+}
+
+bool PhonebookStore::isEmpty(const SecPhonebookEntry& entry)
+{
+    for (int i = 0; i < PB_NUM_ALPHA; i++) {
+        if (entry.alphaTags[i] != NULL && entry.alphaTags[i][0] != '\0') {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < PB_NUM_NUMBER; i++) {
+        if (entry.numbers[i] != NULL && entry.numbers[i][0] != '\0') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void PhonebookStore::put(int fileid, int index, const SecPhonebookEntry& entry)
+{
+    uint64_t key = keyOf(fileid, index);
+    auto it = mRows.find(key);
+    size_t row;
+
+    if (it != mRows.end()) {
+        /* Rewritten records leave their old text behind until clear() */
+        row = it->second;
+    } else {
+        row = mFileid.size();
+        mRows[key] = static_cast<uint32_t>(row);
+
+        mFileid.push_back(fileid);
+        mIndex.push_back(index);
+        mRecordIndex.push_back(0);
+        mNextIndex.push_back(0);
+        for (int i = 0; i < PB_NUM_ALPHA; i++) {
+            mAlphaLength[i].push_back(0);
+            mAlphaType[i].push_back(0);
+            mAlphaText[i].push_back(NO_TEXT);
+        }
+        for (int i = 0; i < PB_NUM_NUMBER; i++) {
+            mNumberLength[i].push_back(0);
+            mNumberType[i].push_back(0);
+            mNumberText[i].push_back(NO_TEXT);
+        }
+    }
+
+    mRecordIndex[row] = entry.recordIndex;
+    mNextIndex[row] = entry.nextIndex;
+    for (int i = 0; i < PB_NUM_ALPHA; i++) {
+        mAlphaLength[i][row] = entry.lengthAlphas[i];
+        mAlphaType[i][row] = entry.dataTypeAlphas[i];
+        mAlphaText[i][row] = addText(entry.alphaTags[i]);
+    }
+    for (int i = 0; i < PB_NUM_NUMBER; i++) {
+        mNumberLength[i][row] = entry.lengthNumbers[i];
+        mNumberType[i][row] = entry.dataTypeNumbers[i];
+        mNumberText[i][row] = addText(entry.numbers[i]);
+    }
+}
+
+void PhonebookStore::fill(size_t row, Record *out) const
+{
+    char *text = const_cast<char *>(mText.data());
+
+    out->fileid = mFileid[row];
+    out->index = mIndex[row];
+    out->entry.recordIndex = mRecordIndex[row];
+    out->entry.nextIndex = mNextIndex[row];
+
+    for (int i = 0; i < PB_NUM_ALPHA; i++) {
+        uint32_t offset = mAlphaText[i][row];
+        out->entry.lengthAlphas[i] = mAlphaLength[i][row];
+        out->entry.dataTypeAlphas[i] = mAlphaType[i][row];
+        out->entry.alphaTags[i] = offset == NO_TEXT ? NULL : text + offset;
+    }
+
+    for (int i = 0; i < PB_NUM_NUMBER; i++) {
+        uint32_t offset = mNumberText[i][row];
+        out->entry.lengthNumbers[i] = mNumberLength[i][row];
+        out->entry.dataTypeNumbers[i] = mNumberType[i][row];
+        out->entry.numbers[i] = offset == NO_TEXT ? NULL : text + offset;
+    }
+}
+
+bool PhonebookStore::find(int fileid, int index, Record *out) const
+{
+    auto it = mRows.find(keyOf(fileid, index));
+
+    if (it == mRows.end()) {
+        return false;
+    }
+
+    fill(it->second, out);
+    return true;
+}
+
+size_t PhonebookStore::used(int fileid) const
+{
+    Iterator it = iterate(fileid);
+    Record record;
+    size_t count = 0;
+
+    while (it.next(&record)) {
+        if (!isEmpty(record.entry)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void PhonebookStore::clear()
+{
+    mFileid.clear();
+    mIndex.clear();
+    mRecordIndex.clear();
+    mNextIndex.clear();
+    for (int i = 0; i < PB_NUM_ALPHA; i++) {
+        mAlphaLength[i].clear();
+        mAlphaType[i].clear();
+        mAlphaText[i].clear();
+    }
+    for (int i = 0; i < PB_NUM_NUMBER; i++) {
+        mNumberLength[i].clear();
+        mNumberType[i].clear();
+        mNumberText[i].clear();
+    }
+    mText.clear();
+    mRows.clear();
+}
+
+} // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_PHONEBOOK_STORE_H
+#define SECRIL_SHIM_PHONEBOOK_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+/*
+ * Payloads of the Samsung USIM phonebook requests, as laid out by the
+ * vendor RIL. RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO takes the fileid as
+ * int[1] and answers int[] { total, used, first index, ... }.
+ */
+#define PB_NUM_ALPHA 4
+#define PB_NUM_NUMBER 5
+
+struct SecPhonebookEntryRequest {
+    int command;
+    int fileid;
+    int index;
+    char *pin2;
+};
+
+struct SecPhonebookEntry {
+    int lengthAlphas[PB_NUM_ALPHA];
+    int dataTypeAlphas[PB_NUM_ALPHA];
+    char *alphaTags[PB_NUM_ALPHA];
+    int lengthNumbers[PB_NUM_NUMBER];
+    int dataTypeNumbers[PB_NUM_NUMBER];
+    char *numbers[PB_NUM_NUMBER];
+    int recordIndex;
+    int nextIndex;
+};
+
+/*
+ * Column store of phonebook entries, keyed by the (fileid, index) they were
+ * requested with. Every field lives in its own column and all strings share
+ * one text buffer, so a 500 record phonebook takes a handful of allocations.
+ */
+class PhonebookStore {
+public:
+    /* View of one stored entry, valid until the store is modified. */
+    struct Record {
+        int fileid;
+        int index;
+        SecPhonebookEntry entry;
+    };
+
+    class Iterator {
+    public:
+        /* Fills "out" with the next record in insertion order. */
+        bool next(Record *out);
+
+    private:
+        friend class PhonebookStore;
+        Iterator(const PhonebookStore *store, int fileid);
+
+        const PhonebookStore *mStore;
+        int mFileid;
+        size_t mRow;
+    };
+
+    /* Iterates the records of "fileid", or of every file if "fileid" is -1. */
+    Iterator iterate(int fileid = -1) const;
+
+    void put(int fileid, int index, const SecPhonebookEntry& entry);
+    bool find(int fileid, int index, Record *out) const;
+
+    /* Number of stored entries of "fileid" that carry a name or a number. */
+    size_t used(int fileid) const;
+
+    size_t size() const { return mFileid.size(); }
+    size_t textBytes() const { return mText.size(); }
+    void clear();
+
+    static bool isEmpty(const SecPhonebookEntry& entry);
+
+private:
+    static const uint32_t NO_TEXT = UINT32_MAX;
+
+    static uint64_t keyOf(int fileid, int index);
+    uint32_t addText(const char *text);
+    void fill(size_t row, Record *out) const;
+
+    std::vector<int> mFileid;
+    std::vector<int> mIndex;
+    std::vector<int> mRecordIndex;
+    std::vector<int> mNextIndex;
+    std::vector<int> mAlphaLength[PB_NUM_ALPHA];
+    std::vector<int> mAlphaType[PB_NUM_ALPHA];
+    std::vector<uint32_t> mAlphaText[PB_NUM_ALPHA];
+    std::vector<int> mNumberLength[PB_NUM_NUMBER];
+    std::vector<int> mNumberType[PB_NUM_NUMBER];
+    std::vector<uint32_t> mNumberText[PB_NUM_NUMBER];
+    std::vector<char> mText;
+    std::unordered_map<uint64_t, uint32_t> mRows;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_PHONEBOOK_STORE_H
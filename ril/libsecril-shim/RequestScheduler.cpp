@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "RequestScheduler.h"
+
+namespace android {
+
+RequestScheduler::RequestScheduler(size_t maxOutstanding, int64_t starvationNs)
+    : mMaxOutstanding(maxOutstanding),
+      mStarvationNs(starvationNs),
+      mHeldCount(0)
+{
+    memset(mNextSocket, 0, sizeof(mNextSocket));
+    memset(mStats, 0, sizeof(mStats));
+    memset(mLaneOutstanding, 0, sizeof(mLaneOutstanding));
+}
+
+bool RequestScheduler::hasRoomLocked(Lane lane) const
+{
+    size_t budget = mMaxOutstanding;
+
+    if (lane == LANE_LONG) {
+        budget = kLongBudget;
+    }
+    return mMaxOutstanding == 0 || mLaneOutstanding[lane] < budget;
+}
+
+void RequestScheduler::trackLocked(RIL_Token t, Lane lane)
+{
+    if (mMaxOutstanding > 0) {
+        mOutstanding[t] = lane;
+        mLaneOutstanding[lane]++;
+    }
+}
+
+void RequestScheduler::configure(size_t maxOutstanding, int64_t starvationNs)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mMaxOutstanding = maxOutstanding;
+    mStarvationNs = starvationNs;
+}
+
+RequestScheduler::Lane RequestScheduler::classify(int request, Payload *payload)
+{
+    *payload = PAYLOAD_OPAQUE;
+
+    switch (request) {
+        case RIL_REQUEST_GET_CURRENT_CALLS:
+        case RIL_REQUEST_DIAL:
+        case RIL_REQUEST_HANGUP:
+        case RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND:
+        case RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND:
+        case RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE:
+        case RIL_REQUEST_CONFERENCE:
+        case RIL_REQUEST_UDUB:
+        case RIL_REQUEST_LAST_CALL_FAIL_CAUSE:
+        case RIL_REQUEST_DTMF:
+        case RIL_REQUEST_ANSWER:
+        case RIL_REQUEST_DTMF_START:
+        case RIL_REQUEST_DTMF_STOP:
+        case RIL_REQUEST_SEPARATE_CONNECTION:
+        case RIL_REQUEST_SET_MUTE:
+        case RIL_REQUEST_GET_MUTE:
+        case RIL_REQUEST_EXPLICIT_CALL_TRANSFER:
+        case RIL_REQUEST_CDMA_FLASH:
+        case RIL_REQUEST_CDMA_BURST_DTMF:
+        case RIL_REQUEST_DIAL_EMERGENCY_CALL:
+        case RIL_REQUEST_HANGUP_VT:
+        case RIL_REQUEST_HOLD:
+            return LANE_CALL;
+
+        case RIL_REQUEST_SEND_SMS:
+        case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
+        case RIL_REQUEST_SMS_ACKNOWLEDGE:
+        case RIL_REQUEST_CDMA_SEND_SMS:
+        case RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE:
+        case RIL_REQUEST_CDMA_SMS_ACKNOWLEDGE:
+        case RIL_REQUEST_ACKNOWLEDGE_INCOMING_GSM_SMS_WITH_PDU:
+        case RIL_REQUEST_IMS_SEND_SMS:
+        case RIL_REQUEST_REPORT_SMS_MEMORY_STATUS:
+            return LANE_SMS;
+
+        case RIL_REQUEST_SETUP_DATA_CALL:
+        case RIL_REQUEST_DEACTIVATE_DATA_CALL:
+            /* Gate the data path: never held, see submit() */
+            return LANE_DATA;
+        case RIL_REQUEST_DATA_CALL_LIST:
+        case RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE:
+        case RIL_REQUEST_STOP_LCE:
+        case RIL_REQUEST_PULL_LCEDATA:
+            *payload = PAYLOAD_VOID;
+            return LANE_DATA;
+        case RIL_REQUEST_START_LCE:
+            *payload = PAYLOAD_FLAT;
+            return LANE_DATA;
+        case RIL_REQUEST_SET_INITIAL_ATTACH_APN:
+        case RIL_REQUEST_SET_DATA_PROFILE:
+            return LANE_DATA;
+
+        case RIL_REQUEST_SIGNAL_STRENGTH:
+        case RIL_REQUEST_VOICE_REGISTRATION_STATE:
+        case RIL_REQUEST_DATA_REGISTRATION_STATE:
+        case RIL_REQUEST_OPERATOR:
+        case RIL_REQUEST_GET_IMEI:
+        case RIL_REQUEST_GET_IMEISV:
+        case RIL_REQUEST_GET_CLIR:
+        case RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE:
+        case RIL_REQUEST_BASEBAND_VERSION:
+        case RIL_REQUEST_QUERY_CLIP:
+        case RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE:
+        case RIL_REQUEST_GET_NEIGHBORING_CELL_IDS:
+        case RIL_REQUEST_QUERY_TTY_MODE:
+        case RIL_REQUEST_GSM_GET_BROADCAST_SMS_CONFIG:
+        case RIL_REQUEST_CDMA_SUBSCRIPTION:
+        case RIL_REQUEST_DEVICE_IDENTITY:
+        case RIL_REQUEST_GET_SMSC_ADDRESS:
+        case RIL_REQUEST_GET_CELL_INFO_LIST:
+        case RIL_REQUEST_GET_HARDWARE_CONFIG:
+        case RIL_REQUEST_GET_RADIO_CAPABILITY:
+        case RIL_REQUEST_GET_ACTIVITY_INFO:
+        case RIL_REQUEST_USIM_PB_CAPA:
+            *payload = PAYLOAD_VOID;
+            return LANE_BULK;
+        case RIL_REQUEST_QUERY_CALL_WAITING:
+        case RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO:
+            *payload = PAYLOAD_FLAT;
+            return LANE_BULK;
+        case RIL_REQUEST_QUERY_FACILITY_LOCK:
+            *payload = PAYLOAD_STRINGS;
+            return LANE_BULK;
+        case RIL_REQUEST_SIM_IO:
+        case RIL_REQUEST_QUERY_CALL_FORWARD_STATUS:
+        case RIL_REQUEST_GET_PHONEBOOK_ENTRY:
+            return LANE_BULK;
+
+        case RIL_REQUEST_QUERY_AVAILABLE_NETWORKS:
+            *payload = PAYLOAD_VOID;
+            return LANE_LONG;
+
+        default:
+            return LANE_NONE;
+    }
+}
+
+RequestScheduler::Lane RequestScheduler::laneOf(int request)
+{
+    Payload payload;
+    return classify(request, &payload);
+}
+
+const char *RequestScheduler::laneName(Lane lane)
+{
+    switch (lane) {
+        case LANE_CALL: return "call";
+        case LANE_SMS: return "sms";
+        case LANE_DATA: return "data";
+        case LANE_BULK: return "bulk";
+        case LANE_LONG: return "long";
+        default: return "none";
+    }
+}
+
+bool RequestScheduler::copyPayload(Payload payload, const void *data, size_t datalen,
+        Held *held)
+{
+    /* libril frees the request data once onRequest returns, keep a copy */
+    switch (payload) {
+        case PAYLOAD_VOID:
+            held->mData = NULL;
+            held->mSize = 0;
+            return data == NULL || datalen == 0;
+        case PAYLOAD_FLAT:
+            if (data == NULL) {
+                return datalen == 0;
+            }
+            held->mBytes.assign(static_cast<const uint8_t *>(data),
+                    static_cast<const uint8_t *>(data) + datalen);
+            held->mData = held->mBytes.data();
+            held->mSize = datalen;
+            return true;
+        case PAYLOAD_STRINGS: {
+            const char * const *strings = static_cast<const char * const *>(data);
+            size_t count = datalen / sizeof(char *);
+
+            if (data == NULL || count == 0 || datalen % sizeof(char *) != 0) {
+                return false;
+            }
+
+            held->mStrings.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                held->mStrings.emplace_back(strings[i] ? strings[i] : "");
+            }
+            for (size_t i = 0; i < count; i++) {
+                held->mPointers.push_back(strings[i] ? &held->mStrings[i][0] : NULL);
+            }
+            held->mData = held->mPointers.data();
+            held->mSize = datalen;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool RequestScheduler::submit(int request, const void *data, size_t datalen, RIL_Token t,
+        int socketId, int64_t nowNs)
+{
+    Payload payload;
+    Lane lane = classify(request, &payload);
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (lane == LANE_NONE) {
+        return true;
+    }
+
+    /* Default and IMS bring-up go to the modem together, outside the budget */
+    bool urgent = request == RIL_REQUEST_SETUP_DATA_CALL ||
+            request == RIL_REQUEST_DEACTIVATE_DATA_CALL;
+
+    if (lane == LANE_CALL || lane == LANE_SMS || urgent || mMaxOutstanding == 0) {
+        mStats[lane].dispatched++;
+        return true;
+    }
+
+    if (mHeld[lane].empty() && hasRoomLocked(lane)) {
+        trackLocked(t, lane);
+        mStats[lane].dispatched++;
+        return true;
+    }
+
+    std::unique_ptr<Held> held(new Held());
+    if (!copyPayload(payload, data, datalen, held.get())) {
+        /* Unknown layout, cannot defer it: let it use the budget anyway */
+        trackLocked(t, lane);
+        mStats[lane].dispatched++;
+        return true;
+    }
+
+    held->request = request;
+    held->token = t;
+    held->socketId = socketId;
+    held->lane = lane;
+    held->queuedNs = nowNs;
+
+    mHeld[lane][socketId].push_back(std::move(held));
+    mHeldCount++;
+    mStats[lane].held++;
+    return false;
+}
+
+bool RequestScheduler::complete(RIL_Token t)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mOutstanding.find(t);
+    if (it == mOutstanding.end()) {
+        return false;
+    }
+
+    mLaneOutstanding[it->second]--;
+    mOutstanding.erase(it);
+    return mHeldCount > 0;
+}
+
+bool RequestScheduler::popLocked(Lane lane, int64_t nowNs, bool starvedOnly,
+        std::unique_ptr<Held> *out)
+{
+    auto& sockets = mHeld[lane];
+    auto it = sockets.end();
+
+    if (sockets.empty()) {
+        return false;
+    }
+
+    if (starvedOnly) {
+        /* The socket whose oldest request has waited longest, if it waited long enough */
+        for (auto s = sockets.begin(); s != sockets.end(); ++s) {
+            if (it == sockets.end() ||
+                    s->second.front()->queuedNs < it->second.front()->queuedNs) {
+                it = s;
+            }
+        }
+        if (nowNs - it->second.front()->queuedNs < mStarvationNs) {
+            return false;
+        }
+        mStats[lane].starved++;
+    } else {
+        /* Round robin: the first socket at or after the one due next */
+        it = sockets.lower_bound(mNextSocket[lane]);
+        if (it == sockets.end()) {
+            it = sockets.begin();
+        }
+    }
+
+    *out = std::move(it->second.front());
+    it->second.pop_front();
+    mNextSocket[lane] = it->first + 1;
+    if (it->second.empty()) {
+        sockets.erase(it);
+    }
+
+    int64_t waitNs = nowNs - (*out)->queuedNs;
+    if (waitNs > mStats[lane].maxWaitNs) {
+        mStats[lane].maxWaitNs = waitNs;
+    }
+    mStats[lane].dispatched++;
+    mHeldCount--;
+    return true;
+}
+
+std::unique_ptr<RequestScheduler::Held> RequestScheduler::next(int64_t nowNs)
+{
+    static const Lane kHeldLanes[] = { LANE_DATA, LANE_BULK, LANE_LONG };
+    std::unique_ptr<Held> held;
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for (Lane lane : kHeldLanes) {
+        if (hasRoomLocked(lane) && popLocked(lane, nowNs, false, &held)) {
+            trackLocked(held->token, lane);
+            return held;
+        }
+    }
+
+    /* Over the budget: the modem queues it, but it no longer waits here */
+    for (Lane lane : kHeldLanes) {
+        if (popLocked(lane, nowNs, true, &held)) {
+            trackLocked(held->token, lane);
+            return held;
+        }
+    }
+
+    return held;
+}
+
+int64_t RequestScheduler::starvationNs() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStarvationNs;
+}
+
+RequestScheduler::LaneStats RequestScheduler::stats(Lane lane) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats[lane];
+}
+
+size_t RequestScheduler::heldCount() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mHeldCount;
+}
+
+} // namespace android
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_REQUEST_SCHEDULER_H
+#define SECRIL_SHIM_REQUEST_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Priority lanes in front of the vendor onRequest.
+ *
+ * Call control, SMS and data call setup/teardown requests always go
+ * straight to the modem. Other data and bulk/query requests may each have
+ * "maxOutstanding" requests in the modem; beyond that they are held here,
+ * so a backlog of queries never sits in the modem's command queue ahead
+ * of a dial or an SMS ack. Commands that keep the modem busy for seconds,
+ * like a manual network search, get a lane of their own with a single
+ * slot, so they hold up neither data nor the other queries. Held requests
+ * are released in order, round robin across sockets within a lane. A
+ * request held for "starvationNs" goes to the modem whatever the budget,
+ * which bounds the time any request spends here.
+ */
+class RequestScheduler {
+public:
+    enum Lane {
+        LANE_CALL,
+        LANE_SMS,
+        LANE_DATA,
+        LANE_BULK,
+        LANE_LONG,
+        LANE_COUNT,
+        LANE_NONE = LANE_COUNT,     /* not scheduled */
+    };
+
+    struct Held {
+        int request;
+        RIL_Token token;
+        int socketId;
+        Lane lane;
+        int64_t queuedNs;
+
+        void *data() { return mData; }
+        size_t size() const { return mSize; }
+
+    private:
+        friend class RequestScheduler;
+
+        std::vector<std::string> mStrings;
+        std::vector<char *> mPointers;
+        std::vector<uint8_t> mBytes;
+        void *mData = nullptr;
+        size_t mSize = 0;
+    };
+
+    struct LaneStats {
+        uint64_t dispatched;
+        uint64_t held;
+        uint64_t starved;       /* released over the budget after starvationNs */
+        int64_t maxWaitNs;
+    };
+
+    /* Long commands the modem works on at once */
+    static const size_t kLongBudget = 1;
+
+    RequestScheduler(size_t maxOutstanding, int64_t starvationNs);
+
+    /* Budget of the data and bulk lanes; 0 turns holding off. */
+    void configure(size_t maxOutstanding, int64_t starvationNs);
+
+    static Lane laneOf(int request);
+    static const char *laneName(Lane lane);
+
+    /*
+     * Returns true if the request must be dispatched now, false if it was
+     * held and will come back through next(). Callers should also try
+     * next() once starvationNs() has passed after a request was held.
+     */
+    bool submit(int request, const void *data, size_t datalen, RIL_Token t, int socketId,
+            int64_t nowNs);
+
+    /* Returns true if "t" used the budget and held requests are waiting. */
+    bool complete(RIL_Token t);
+
+    /* Pops the next held request if the budget allows. */
+    std::unique_ptr<Held> next(int64_t nowNs);
+
+    int64_t starvationNs() const;
+    LaneStats stats(Lane lane) const;
+    size_t heldCount() const;
+
+private:
+    enum Payload {
+        PAYLOAD_VOID,
+        PAYLOAD_FLAT,       /* no pointers, a byte copy will do */
+        PAYLOAD_STRINGS,    /* char *[] */
+        PAYLOAD_OPAQUE,     /* unknown layout, never held */
+    };
+
+    static Lane classify(int request, Payload *payload);
+    static bool copyPayload(Payload payload, const void *data, size_t datalen, Held *held);
+    bool popLocked(Lane lane, int64_t nowNs, bool starvedOnly, std::unique_ptr<Held> *out);
+    bool hasRoomLocked(Lane lane) const;
+    void trackLocked(RIL_Token t, Lane lane);
+
+    mutable std::mutex mLock;
+    size_t mMaxOutstanding;
+    int64_t mStarvationNs;
+    std::map<RIL_Token, Lane> mOutstanding;
+    size_t mLaneOutstanding[LANE_COUNT];
+    /* Per lane, per socket FIFOs and the socket to serve next */
+    std::map<int, std::deque<std::unique_ptr<Held>>> mHeld[LANE_COUNT];
+    int mNextSocket[LANE_COUNT];
+    size_t mHeldCount;
+    LaneStats mStats[LANE_COUNT];
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_REQUEST_SCHEDULER_H
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RequestStats.h"
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mSum = 0;
+    mMax = 0;
+}
+
+int LatencyHistogram::bucketOf(uint64_t valueUs)
+{
+    if (valueUs < (1u << SUB_BITS)) {
+        return static_cast<int>(valueUs);
+    }
+
+    int exponent = 63 - __builtin_clzll(valueUs);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+
+    int sub = static_cast<int>(valueUs >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return ((exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < (1 << SUB_BITS)) {
+        return static_cast<uint64_t>(bucket);
+    }
+
+    int exponent = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = static_cast<uint64_t>(bucket & ((1 << SUB_BITS) - 1));
+    return (((1ULL << SUB_BITS) + sub + 1) << (exponent - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueUs)
+{
+    mBuckets[bucketOf(valueUs)]++;
+    mCount++;
+    mSum += valueUs;
+    if (valueUs > mMax) {
+        mMax = valueUs;
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const
+{
+    if (mCount == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * mCount + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            return bound < mMax ? bound : mMax;
+        }
+    }
+
+    return mMax;
+}
+
+void RequestStats::record(int request, uint64_t latencyUs, int error)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    Entry& entry = mRequests[request];
+
+    entry.latency.record(latencyUs);
+    entry.errors[error]++;
+    mGeneration++;
+}
+
+void RequestStats::reset()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mRequests.clear();
+    mGeneration++;
+}
+
+uint64_t RequestStats::generation() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mGeneration;
+}
+
+void RequestStats::dump(int fd) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    dprintf(fd, "Vendor RIL request latency (dispatch to completion, us):\n");
+    dprintf(fd, "  %7s %8s %10s %10s %10s %10s  %s\n",
+            "request", "count", "mean", "p50", "p99", "max", "errors");
+
+    for (const auto& it : mRequests) {
+        const LatencyHistogram& latency = it.second.latency;
+        char errors[256];
+        size_t len = 0;
+
+        errors[0] = '\0';
+        for (const auto& error : it.second.errors) {
+            int written = snprintf(errors + len, sizeof(errors) - len, "%s%d:%" PRIu32,
+                    len ? " " : "", error.first, error.second);
+            if (written < 0 || static_cast<size_t>(written) >= sizeof(errors) - len) {
+                break;
+            }
+            len += written;
+        }
+
+        dprintf(fd, "  %7d %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+                "  %s\n", it.first, latency.count(), latency.mean(), latency.percentile(50),
+                latency.percentile(99), latency.max(), errors);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_REQUEST_STATS_H
+#define SECRIL_SHIM_REQUEST_STATS_H
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+
+namespace android {
+
+/*
+ * Log-linear latency histogram. Every power of two is split into
+ * 2^SUB_BITS linear buckets, so any recorded value is reported with at
+ * most 1/2^SUB_BITS relative error, at a fixed memory cost.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 3;
+    static const int MAX_EXPONENT = 35; /* ~9.5 hours in us */
+    static const int BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) << SUB_BITS;
+
+    LatencyHistogram();
+
+    void record(uint64_t valueUs);
+    void reset();
+
+    uint64_t count() const { return mCount; }
+    uint64_t max() const { return mMax; }
+    uint64_t mean() const { return mCount ? mSum / mCount : 0; }
+
+    /* Value at or below which "percentile" percent of the samples fall. */
+    uint64_t percentile(double percentile) const;
+
+    static int bucketOf(uint64_t valueUs);
+    static uint64_t bucketUpperBound(int bucket);
+
+private:
+    uint32_t mBuckets[BUCKETS];
+    uint64_t mCount;
+    uint64_t mSum;
+    uint64_t mMax;
+};
+
+/*
+ * Per RIL request id latency and result accounting. Latency is measured
+ * between the shim handing a request to the vendor RIL and the vendor RIL
+ * completing it, which excludes all framework and libril queueing.
+ */
+class RequestStats {
+public:
+    void record(int request, uint64_t latencyUs, int error);
+    void reset();
+
+    /* Writes a dumpsys style report to "fd". */
+    void dump(int fd) const;
+
+    /* Incremented on every record(), lets callers skip redundant dumps. */
+    uint64_t generation() const;
+
+private:
+    struct Entry {
+        LatencyHistogram latency;
+        std::map<int, uint32_t> errors;
+    };
+
+    mutable std::mutex mLock;
+    std::map<int, Entry> mRequests;
+    uint64_t mGeneration = 0;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_REQUEST_STATS_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "SimIoCache.h"
+
+/* TS 102.221 10.1.2 */
+#define SIM_CMD_READ_BINARY 176
+#define SIM_CMD_READ_RECORD 178
+#define SIM_CMD_GET_RESPONSE 192
+#define SIM_CMD_UPDATE_BINARY 214
+#define SIM_CMD_UPDATE_RECORD 220
+
+namespace android {
+
+/* Files the modem updates on its own, without a refresh */
+static bool isModemManaged(int fileid)
+{
+    switch (fileid) {
+        case 0x6F08:    /* EF_KEYS */
+        case 0x6F09:    /* EF_KEYSPS */
+        case 0x6F5B:    /* EF_START_HFN */
+        case 0x6F73:    /* EF_PSLOCI */
+        case 0x6F7B:    /* EF_FPLMN */
+        case 0x6F7E:    /* EF_LOCI */
+        case 0x6FE3:    /* EF_EPSLOCI */
+        case 0x6FE4:    /* EF_EPSNSC */
+            return true;
+        default:
+            return false;
+    }
+}
+
+SimIoCache::SimIoCache(size_t maxEntries)
+    : mEnabled(true),
+      mMaxEntries(maxEntries),
+      mHits(0),
+      mMisses(0)
+{
+}
+
+void SimIoCache::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mEnabled = enabled;
+    if (!enabled) {
+        clearLocked();
+    }
+}
+
+bool SimIoCache::isCacheable(const RIL_SIM_IO_v6 *io, size_t datalen)
+{
+    if (io == NULL || datalen < sizeof(RIL_SIM_IO_v6)) {
+        return false;
+    }
+
+    switch (io->command) {
+        case SIM_CMD_READ_BINARY:
+        case SIM_CMD_READ_RECORD:
+        case SIM_CMD_GET_RESPONSE:
+            break;
+        default:
+            return false;
+    }
+
+    /* PIN2 protected reads are left to the modem, so a wrong PIN2 still fails */
+    if (io->pin2 != NULL && io->pin2[0] != '\0') {
+        return false;
+    }
+
+    return !isModemManaged(io->fileid);
+}
+
+std::string SimIoCache::keyOf(const RIL_SIM_IO_v6 *io, int socketId)
+{
+    char numbers[64];
+
+    snprintf(numbers, sizeof(numbers), "%d:%d:%d:%d:%d:%d:%d:", socketId, io->cla,
+            io->command, io->fileid, io->p1, io->p2, io->p3);
+
+    std::string key(numbers);
+    key += io->path != NULL ? io->path : "";
+    key += ':';
+    key += io->aidPtr != NULL ? io->aidPtr : "";
+    return key;
+}
+
+bool SimIoCache::lookup(const RIL_SIM_IO_v6 *io, size_t datalen, int socketId, Response *out)
+{
+    if (!isCacheable(io, datalen)) {
+        return false;
+    }
+
+    std::string key = keyOf(io, socketId);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mEnabled) {
+        return false;
+    }
+
+    auto it = mEntries.find(key);
+    if (it == mEntries.end()) {
+        mMisses++;
+        return false;
+    }
+
+    *out = it->second.response;
+    mHits++;
+    return true;
+}
+
+void SimIoCache::onDispatch(int request, const void *data, size_t datalen, RIL_Token t,
+        int socketId)
+{
+    const RIL_SIM_IO_v6 *io = static_cast<const RIL_SIM_IO_v6 *>(data);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mEnabled) {
+        return;
+    }
+
+    switch (request) {
+        case RIL_REQUEST_SIM_IO:
+            if (io == NULL || datalen < sizeof(RIL_SIM_IO_v6)) {
+                break;
+            }
+            if (io->command == SIM_CMD_UPDATE_BINARY || io->command == SIM_CMD_UPDATE_RECORD) {
+                invalidateLocked(io->fileid);
+            } else if (isCacheable(io, datalen)) {
+                mPending[t] = PendingRead{keyOf(io, socketId), io->fileid};
+            }
+            break;
+        case RIL_REQUEST_WRITE_SMS_TO_SIM:
+        case RIL_REQUEST_DELETE_SMS_ON_SIM:
+            invalidateLocked(EF_SMS);
+            break;
+        case RIL_REQUEST_ACCESS_PHONEBOOK_ENTRY:
+            /* The modem picks the ADN/ANR/EMAIL records itself */
+            clearLocked();
+            break;
+    }
+}
+
+void SimIoCache::onComplete(RIL_Token t, RIL_Errno e, const void *response, size_t responselen)
+{
+    const RIL_SIM_IO_Response *io = static_cast<const RIL_SIM_IO_Response *>(response);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mPending.find(t);
+    if (it == mPending.end()) {
+        return;
+    }
+
+    PendingRead pending = std::move(it->second);
+    mPending.erase(it);
+
+    if (e != RIL_E_SUCCESS || io == NULL || responselen < sizeof(RIL_SIM_IO_Response) ||
+            io->sw1 != 0x90 || io->sw2 != 0x00 || mEntries.size() >= mMaxEntries) {
+        return;
+    }
+
+    Entry& entry = mEntries[pending.key];
+    entry.fileid = pending.fileid;
+    entry.response.sw1 = io->sw1;
+    entry.response.sw2 = io->sw2;
+    entry.response.hasResponse = io->simResponse != NULL;
+    entry.response.simResponse = io->simResponse != NULL ? io->simResponse : "";
+}
+
+void SimIoCache::invalidateLocked(int fileid)
+{
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (it->second.fileid == fileid) {
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    /* Reads of the file already on their way back may predate the change */
+    for (auto it = mPending.begin(); it != mPending.end();) {
+        if (it->second.fileid == fileid) {
+            it = mPending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SimIoCache::invalidate(int fileid)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    invalidateLocked(fileid);
+}
+
+void SimIoCache::clearLocked()
+{
+    mEntries.clear();
+    mPending.clear();
+}
+
+void SimIoCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    clearLocked();
+}
+
+void SimIoCache::onSimRefresh(const void *data, size_t datalen)
+{
+    /* RIL_SimRefreshResponse_v7 and the older int[2] form start the same way */
+    const int *refresh = static_cast<const int *>(data);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (refresh != NULL && datalen >= 2 * sizeof(int) &&
+            refresh[0] == SIM_FILE_UPDATE && refresh[1] != 0) {
+        invalidateLocked(refresh[1]);
+    } else {
+        clearLocked();
+    }
+}
+
+uint64_t SimIoCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mHits;
+}
+
+uint64_t SimIoCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mMisses;
+}
+
+size_t SimIoCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEntries.size();
+}
+
+} // namespace android
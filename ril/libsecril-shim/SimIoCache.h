@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_SIM_IO_CACHE_H
+#define SECRIL_SHIM_SIM_IO_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Read-through cache for RIL_REQUEST_SIM_IO. Successful READ BINARY, READ
+ * RECORD and GET RESPONSE results are kept per (socket, aid, path, fileid,
+ * command, p1, p2, p3) and served without a modem round trip until the
+ * file is written through the RIL, named in a SIM refresh, or the card
+ * state changes.
+ *
+ * Reads that are in flight while an invalidation happens are not cached,
+ * so a stale response can never be stored after the invalidation.
+ */
+class SimIoCache {
+public:
+    enum {
+        EF_SMS = 0x6F3C,
+    };
+
+    /* A cached response; "simResponse" is valid while "hasResponse" is set. */
+    struct Response {
+        int sw1;
+        int sw2;
+        bool hasResponse;
+        std::string simResponse;
+    };
+
+    explicit SimIoCache(size_t maxEntries);
+
+    void setEnabled(bool enabled);
+
+    /* Fills "out" and returns true if "io" can be answered from memory. */
+    bool lookup(const RIL_SIM_IO_v6 *io, size_t datalen, int socketId, Response *out);
+
+    /*
+     * Called when a request goes to the modem. Remembers cacheable reads
+     * under their token and invalidates the files that writes touch.
+     */
+    void onDispatch(int request, const void *data, size_t datalen, RIL_Token t,
+            int socketId);
+
+    /* Stores the response of a read remembered by onDispatch. */
+    void onComplete(RIL_Token t, RIL_Errno e, const void *response, size_t responselen);
+
+    /* Drops every entry for "fileid", on any socket. */
+    void invalidate(int fileid);
+    void clear();
+
+    /* Applies a RIL_UNSOL_SIM_REFRESH payload. */
+    void onSimRefresh(const void *data, size_t datalen);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        int fileid;
+        Response response;
+    };
+
+    struct PendingRead {
+        std::string key;
+        int fileid;
+    };
+
+    static bool isCacheable(const RIL_SIM_IO_v6 *io, size_t datalen);
+    static std::string keyOf(const RIL_SIM_IO_v6 *io, int socketId);
+    void invalidateLocked(int fileid);
+    void clearLocked();
+
+    mutable std::mutex mLock;
+    bool mEnabled;
+    size_t mMaxEntries;
+    uint64_t mHits;
+    uint64_t mMisses;
+    std::unordered_map<std::string, Entry> mEntries;
+    std::unordered_map<RIL_Token, PendingRead> mPending;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_SIM_IO_CACHE_H
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "SmsBatcher.h"
+
+namespace android {
+
+SmsBatcher::SmsBatcher(size_t maxOutstanding)
+    : mExpectMore(0)
+{
+    configure(maxOutstanding);
+}
+
+void SmsBatcher::configure(size_t maxOutstanding)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mMaxOutstanding = maxOutstanding > 0 ? maxOutstanding : 1;
+}
+
+bool SmsBatcher::handles(int request)
+{
+    switch (request) {
+        case RIL_REQUEST_SEND_SMS:
+        case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
+        case RIL_REQUEST_CDMA_SEND_SMS:
+        case RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int SmsBatcher::expectMoreVariant(int request)
+{
+    switch (request) {
+        case RIL_REQUEST_SEND_SMS:
+            return RIL_REQUEST_SEND_SMS_EXPECT_MORE;
+        case RIL_REQUEST_CDMA_SEND_SMS:
+            return RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE;
+        default:
+            return request;
+    }
+}
+
+/* The plain request an EXPECT_MORE variant belongs to */
+int SmsBatcher::baseRequest(int request)
+{
+    switch (request) {
+        case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
+            return RIL_REQUEST_SEND_SMS;
+        case RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE:
+            return RIL_REQUEST_CDMA_SEND_SMS;
+        default:
+            return request;
+    }
+}
+
+int SmsBatcher::submit(int request, const void *data, size_t datalen, RIL_Token t,
+        int socketId)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    /* Nothing queued behind it, so as the framework asked */
+    if (mOutstanding.size() < mMaxOutstanding && mQueue.empty()) {
+        mOutstanding.insert(t);
+        return request;
+    }
+
+    /* libril frees the request data once onRequest returns, keep a copy */
+    std::unique_ptr<Submission> submission(new Submission());
+    submission->request = request;
+    submission->dispatchAs = request;
+    submission->token = t;
+    submission->socketId = socketId;
+
+    switch (request) {
+        case RIL_REQUEST_SEND_SMS:
+        case RIL_REQUEST_SEND_SMS_EXPECT_MORE: {
+            const char * const *strings = static_cast<const char * const *>(data);
+            size_t count = datalen / sizeof(char *);
+
+            if (data == NULL || count == 0) {
+                break;
+            }
+
+            submission->mStrings.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                submission->mStrings.emplace_back(strings[i] ? strings[i] : "");
+            }
+            for (size_t i = 0; i < count; i++) {
+                submission->mPointers.push_back(
+                        strings[i] ? &submission->mStrings[i][0] : NULL);
+            }
+            submission->mData = submission->mPointers.data();
+            submission->mSize = datalen;
+            break;
+        }
+        case RIL_REQUEST_CDMA_SEND_SMS:
+        case RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE:
+            if (data == NULL || datalen != sizeof(RIL_CDMA_SMS_Message)) {
+                break;
+            }
+            memcpy(&submission->mCdma, data, sizeof(RIL_CDMA_SMS_Message));
+            submission->mData = &submission->mCdma;
+            submission->mSize = datalen;
+            break;
+    }
+
+    if (submission->mData == NULL) {
+        /* Unknown layout, cannot defer it: let the modem sort it out */
+        mOutstanding.insert(t);
+        return request;
+    }
+
+    mQueue.push_back(std::move(submission));
+    return -1;
+}
+
+bool SmsBatcher::complete(RIL_Token t)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mOutstanding.erase(t) == 0) {
+        return false;
+    }
+
+    return !mQueue.empty();
+}
+
+std::unique_ptr<SmsBatcher::Submission> SmsBatcher::next()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mQueue.empty() || mOutstanding.size() >= mMaxOutstanding) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Submission> submission = std::move(mQueue.front());
+    mQueue.pop_front();
+
+    /* Only hold the link for another message of the same kind */
+    submission->dispatchAs = submission->request;
+    if (!mQueue.empty() &&
+            baseRequest(mQueue.front()->request) == baseRequest(submission->request)) {
+        int variant = expectMoreVariant(submission->request);
+        if (variant != submission->request) {
+            submission->dispatchAs = variant;
+            mExpectMore++;
+        }
+    }
+    mOutstanding.insert(submission->token);
+    return submission;
+}
+
+uint64_t SmsBatcher::expectMoreCount() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mExpectMore;
+}
+
+} // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_SMS_BATCHER_H
+#define SECRIL_SHIM_SMS_BATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Keeps the modem's SMS link up across bursts of outgoing messages.
+ *
+ * At most "maxOutstanding" submissions are handed to the modem at a time;
+ * the rest are queued with a private copy of their data and dispatched as
+ * earlier ones complete. A submission leaving the queue with another one
+ * still waiting behind it is sent as the EXPECT_MORE variant of the
+ * request, so the modem does not tear the relay link down between
+ * messages. Nothing else is, since the modem would then hold the link
+ * open for a message that never comes.
+ */
+class SmsBatcher {
+public:
+    struct Submission {
+        int request;        /* request id as issued by the framework */
+        int dispatchAs;     /* request id to hand to the modem */
+        RIL_Token token;
+        int socketId;
+
+        void *data() { return mData; }
+        size_t size() const { return mSize; }
+
+    private:
+        friend class SmsBatcher;
+
+        std::vector<std::string> mStrings;
+        std::vector<char *> mPointers;
+        RIL_CDMA_SMS_Message mCdma;
+        void *mData = nullptr;
+        size_t mSize = 0;
+    };
+
+    explicit SmsBatcher(size_t maxOutstanding);
+
+    void configure(size_t maxOutstanding);
+
+    static bool handles(int request);
+
+    /*
+     * Returns the request id the submission must be dispatched as right
+     * now, or -1 if it was queued and will come back through next().
+     */
+    int submit(int request, const void *data, size_t datalen, RIL_Token t, int socketId);
+
+    /*
+     * Accounts for the completion of "t". Returns true if "t" was an SMS
+     * submission and a queued one can now be dispatched.
+     */
+    bool complete(RIL_Token t);
+
+    /* Pops the next queued submission if an outstanding slot is free. */
+    std::unique_ptr<Submission> next();
+
+    uint64_t expectMoreCount() const;
+
+private:
+    static int expectMoreVariant(int request);
+    static int baseRequest(int request);
+
+    mutable std::mutex mLock;
+    size_t mMaxOutstanding;
+    std::set<RIL_Token> mOutstanding;
+    std::deque<std::unique_ptr<Submission>> mQueue;
+    uint64_t mExpectMore;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_SMS_BATCHER_H
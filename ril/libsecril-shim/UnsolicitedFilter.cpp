@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "UnsolicitedFilter.h"
+
+namespace android {
+
+static const int64_t NS_PER_HOUR = 3600 * 1000000000LL;
+
+UnsolicitedFilter::UnsolicitedFilter()
+    : mFilter(ALL_REPORTS),
+      mScreenOn(true),
+      mScreenOffSinceNs(0),
+      mScreenOffTotalNs(0),
+      mForwardedScreenOff(0),
+      mDroppedScreenOff(0),
+      mDropped(0),
+      mForwarded(0)
+{
+}
+
+void UnsolicitedFilter::setScreenLocked(bool on, int64_t nowNs)
+{
+    if (on == mScreenOn) {
+        return;
+    }
+
+    if (on) {
+        mScreenOffTotalNs += nowNs - mScreenOffSinceNs;
+    } else {
+        mScreenOffSinceNs = nowNs;
+    }
+    mScreenOn = on;
+}
+
+void UnsolicitedFilter::onScreenState(bool on, int64_t nowNs)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    /* The screen state is all that is left of the framework's filter */
+    mFilter = on ? ALL_REPORTS : 0;
+    setScreenLocked(on, nowNs);
+}
+
+int UnsolicitedFilter::filter() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mFilter;
+}
+
+bool UnsolicitedFilter::reportsDormancy() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return (mFilter & RIL_UR_DATA_CALL_DORMANCY_CHANGED) != 0;
+}
+
+bool UnsolicitedFilter::admits(int unsol) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    switch (unsol) {
+        case RIL_UNSOL_SIGNAL_STRENGTH:
+            return (mFilter & RIL_UR_SIGNAL_STRENGTH) != 0;
+        default:
+            return true;
+    }
+}
+
+void UnsolicitedFilter::account(bool forwarded)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (forwarded) {
+        mForwarded++;
+    } else {
+        mDropped++;
+    }
+
+    if (!mScreenOn) {
+        if (forwarded) {
+            mForwardedScreenOff++;
+        } else {
+            mDroppedScreenOff++;
+        }
+    }
+}
+
+int64_t UnsolicitedFilter::screenOffNsLocked(int64_t nowNs) const
+{
+    return mScreenOffTotalNs + (mScreenOn ? 0 : nowNs - mScreenOffSinceNs);
+}
+
+void UnsolicitedFilter::dump(int fd) const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t nowNs = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    int64_t offNs = screenOffNsLocked(nowNs);
+    double hours = static_cast<double>(offNs) / NS_PER_HOUR;
+
+    dprintf(fd, "\nURC filter 0x%x, screen %s\n", mFilter, mScreenOn ? "on" : "off");
+    dprintf(fd, "Screen off %.2f h: %" PRIu64 " URCs forwarded (%.1f wakeups/h), "
+            "%" PRIu64 " dropped (%.1f/h)\n", hours, mForwardedScreenOff,
+            hours > 0 ? mForwardedScreenOff / hours : 0.0, mDroppedScreenOff,
+            hours > 0 ? mDroppedScreenOff / hours : 0.0);
+    dprintf(fd, "All URCs: %" PRIu64 " forwarded, %" PRIu64 " dropped\n", mForwarded, mDropped);
+}
+
+} // namespace android
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECRIL_SHIM_UNSOLICITED_FILTER_H
+#define SECRIL_SHIM_UNSOLICITED_FILTER_H
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include <telephony/ril.h>
+
+namespace android {
+
+/*
+ * Drops the URCs the modem keeps sending while the screen is off.
+ *
+ * With RIL version 12 libril answers SET_UNSOLICITED_RESPONSE_FILTER
+ * itself and turns SEND_DEVICE_STATE into RIL_REQUEST_SCREEN_STATE, so the
+ * screen state is all the shim gets to see. Screen on admits every report,
+ * screen off excludes signal strength and data call dormancy changes.
+ * Whatever the modem still sends and the filter excludes is dropped before
+ * it reaches libril, so it neither takes the RIL wakelock nor wakes the
+ * framework.
+ *
+ * Every URC the shim forwards wakes the framework, so forwarded and dropped
+ * URCs are counted while the screen is off to report wakeups per hour.
+ */
+class UnsolicitedFilter {
+public:
+    static const int ALL_REPORTS = RIL_UR_SIGNAL_STRENGTH | RIL_UR_FULL_NETWORK_STATE |
+            RIL_UR_DATA_CALL_DORMANCY_CHANGED;
+
+    UnsolicitedFilter();
+
+    /* libril passed RIL_REQUEST_SCREEN_STATE on to the modem. */
+    void onScreenState(bool on, int64_t nowNs);
+
+    int filter() const;
+    bool reportsDormancy() const;
+
+    /* Returns false if "unsol" is excluded by the filter. */
+    bool admits(int unsol) const;
+
+    /* Called once per URC the modem sent, with whether libril got it. */
+    void account(bool forwarded);
+
+    void dump(int fd) const;
+
+private:
+    void setScreenLocked(bool on, int64_t nowNs);
+    int64_t screenOffNsLocked(int64_t nowNs) const;
+
+    mutable std::mutex mLock;
+    int mFilter;
+    bool mScreenOn;
+    int64_t mScreenOffSinceNs;
+    int64_t mScreenOffTotalNs;
+    uint64_t mForwardedScreenOff;
+    uint64_t mDroppedScreenOff;
+    uint64_t mDropped;
+    uint64_t mForwarded;
+};
+
+} // namespace android
+
+#endif // SECRIL_SHIM_UNSOLICITED_FILTER_H
@@ -0,0 +1,1154 @@
+/*
+ * Copyright (C) 2020 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "secril-shim"
+#define ATRACE_TAG ATRACE_TAG_RIL
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cutils/properties.h>
+#include <cutils/trace.h>
+#include <log/log.h>
+
+#include <telephony/ril.h>
+
+#include "ActivityAccountant.h"
+#include "CellInfoTracker.h"
+#include "DataCallTracker.h"
+#include "DataProfileCache.h"
+#include "LceEstimator.h"
+#include "LceShared.h"
+#include "NetworkScanStreamer.h"
+#include "PhonebookLoader.h"
+#include "RequestScheduler.h"
+#include "RequestStats.h"
+#include "SimIoCache.h"
+#include "SmsBatcher.h"
+#include "UnsolicitedFilter.h"
+
+#ifndef RIL_SHIM_TARGET
+#define RIL_SHIM_TARGET "libsec-ril.so"
+#endif
+
+#ifndef RIL_SHIM_SLOT
+#define RIL_SHIM_SLOT 0
+#endif
+
+#if defined(ANDROID_MULTI_SIM)
+#define SHIM_SOCKET_PARAM , RIL_SOCKET_ID socket_id
+#define SHIM_SOCKET_ARG , socket_id
+#define SHIM_SOCKET_VALUE socket_id
+#else
+#define SHIM_SOCKET_PARAM
+#define SHIM_SOCKET_ARG
+#define SHIM_SOCKET_VALUE 0
+#endif
+
+/*
+ * Minimum signal change, in dB, for a cell to be reported again. A negative
+ * value turns the filter off and every list is reported, 0 reports any change.
+ */
+#define CELL_INFO_THRESHOLD_PROP "persist.vendor.radio.cellinfo_threshold_db"
+#define CELL_INFO_THRESHOLD_DEFAULT 2
+
+/* Outgoing SMS bursts, see SmsBatcher */
+#define SMS_BATCHING_PROP "persist.vendor.radio.sms_batching"
+#define SMS_MAX_OUTSTANDING_PROP "persist.vendor.radio.sms_max_outstanding"
+#define SMS_MAX_OUTSTANDING_DEFAULT 2
+
+/* Data and bulk requests allowed in the modem at once, see RequestScheduler. 0 disables */
+#define SCHED_MAX_OUTSTANDING_PROP "persist.vendor.radio.sched_max_outstanding"
+#define SCHED_MAX_OUTSTANDING_DEFAULT 4
+#define SCHED_STARVATION_NS (10 * 1000000000LL)
+
+/* SIM_IO read-through cache, see SimIoCache */
+#define SIM_IO_CACHE_PROP "persist.vendor.radio.sim_io_cache"
+#define SIM_IO_CACHE_MAX_ENTRIES 4096
+
+/*
+ * USIM phonebook entry requests kept in flight ahead of the framework, 0
+ * disables. Off until the SecPhonebookEntry layout is confirmed against the
+ * vendor RIL; responses of any other size are never stored either way.
+ */
+#define PB_PREFETCH_DEPTH_PROP "persist.vendor.radio.pb_prefetch_depth"
+#define PB_PREFETCH_DEPTH_DEFAULT 0
+
+/* Data profiles pushed again at SIM ready, see DataProfileCache */
+#define DATA_PROFILE_PREPUSH_PROP "persist.vendor.radio.data_profile_prepush"
+
+/* Drop DATA_CALL_LIST_CHANGED when no call changed, see DataCallTracker */
+#define DATA_CALL_FILTER_PROP "persist.vendor.radio.data_call_filter"
+
+/* LCE reporting interval the shim subscribes with at radio on, 0 disables. See LceEstimator */
+#define LCE_INTERVAL_PROP "persist.vendor.radio.lce_interval_ms"
+#define LCE_INTERVAL_DEFAULT 1000
+#define LCE_TIME_CONSTANT_NS (5 * 1000000000LL)
+
+/* GET_ACTIVITY_INFO sampling, attributed to features in the stats dump. See ActivityAccountant */
+#define ACTIVITY_SAMPLING_PROP "persist.vendor.radio.activity_sampling"
+#define ACTIVITY_MIN_INTERVAL_NS (30 * 1000000000LL)
+#define ACTIVITY_MAX_INTERVAL_NS (960 * 1000000000LL)
+
+/* START_NETWORK_SCAN split into per band sub-scans with partial results, see NetworkScanStreamer */
+#define SCAN_STREAMING_PROP "persist.vendor.radio.scan_streaming"
+
+/* Request latency report, refreshed when new completions were recorded */
+#define STATS_DUMP_PATH "/data/vendor/secradio/secril-shim-stats"
+#define STATS_DUMP_INTERVAL_SEC 60
+
+struct PendingRequest {
+    int request;
+    int64_t startNs;
+};
+
+using namespace android;
+
+static const struct RIL_Env *sRilEnv;
+static const RIL_RadioFunctions *sVendorFunctions;
+/* The vendor RIL can report URCs before its RIL_Init has returned */
+static std::atomic<bool> sVendorReady;
+
+static struct RIL_Env sShimEnv;
+static RIL_RadioFunctions sShimFunctions;
+
+static std::mutex sRequestLock;
+static std::unordered_map<RIL_Token, PendingRequest> sPendingRequests;
+static RequestStats sRequestStats;
+static uint64_t sDumpedGeneration;
+
+static std::mutex sCellInfoLock;
+static CellInfoTracker sCellInfo(CELL_INFO_THRESHOLD_DEFAULT);
+static bool sCellInfoFilter = true;
+
+static SmsBatcher sSmsBatcher(SMS_MAX_OUTSTANDING_DEFAULT);
+static bool sSmsBatching = true;
+
+static RequestScheduler sScheduler(SCHED_MAX_OUTSTANDING_DEFAULT, SCHED_STARVATION_NS);
+
+static SimIoCache sSimIoCache(SIM_IO_CACHE_MAX_ENTRIES);
+
+static PhonebookLoader sPhonebook(PB_PREFETCH_DEPTH_DEFAULT);
+
+static DataProfileCache sDataProfiles;
+static bool sDataProfilePrepush = true;
+static std::atomic<bool> sSimReady;
+static std::atomic<int> sDataSocket;
+/* Token of the shim's own SET_DATA_PROFILE, never seen by libril */
+static char sProfilePushToken;
+
+static std::mutex sDataCallListLock;
+static DataCallTracker sDataCallList;
+static bool sDataCallFilter = true;
+static uint64_t sDataCallListsDropped;
+
+enum LceState {
+    LCE_IDLE,
+    LCE_STARTING,
+    LCE_ACTIVE,         /* the shim's own PUSH subscription is running */
+    LCE_UNSUPPORTED,
+};
+
+static LceEstimator sLce(LCE_TIME_CONSTANT_NS);
+static LcePublisher sLcePublisher;
+static int sLceIntervalMs = LCE_INTERVAL_DEFAULT;
+static std::atomic<int> sLceState;
+static std::atomic<unsigned int> sLceActualIntervalMs;
+static std::atomic<int> sRadioSocket;
+/* The framework asked for LCE reports itself and gets them forwarded */
+static std::atomic<bool> sLceForward;
+/* Token of the shim's own START_LCE, never seen by libril */
+static char sLceStartToken;
+
+static ActivityAccountant sActivity(ACTIVITY_MIN_INTERVAL_NS, ACTIVITY_MAX_INTERVAL_NS);
+/* Token of the shim's own GET_ACTIVITY_INFO, never seen by libril */
+static char sActivityToken;
+
+static UnsolicitedFilter sUnsolFilter;
+
+static NetworkScanStreamer sNetworkScan;
+static bool sScanStreaming = true;
+/* Token of the shim's own sub-scans after the first, never seen by libril */
+static char sNetworkScanToken;
+/* Framework token the first sub-scan of the open session went out with */
+static std::atomic<RIL_Token> sNetworkScanFirstToken(NULL);
+
+static int64_t nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Request the shim issued under one of its own static tokens, or -1. The
+ * same token can be in flight twice, e.g. two SCREEN_STATE changes in a
+ * row, and is tracked only once, so it is recognised by address instead.
+ */
+static int shimTokenRequest(RIL_Token t)
+{
+    if (t == &sNetworkScanToken) {
+        return RIL_REQUEST_START_NETWORK_SCAN;
+    } else if (t == &sActivityToken) {
+        return RIL_REQUEST_GET_ACTIVITY_INFO;
+    } else if (t == &sLceStartToken) {
+        return RIL_REQUEST_START_LCE;
+    } else if (t == &sProfilePushToken) {
+        return RIL_REQUEST_SET_DATA_PROFILE;
+    }
+    return -1;
+}
+
+static void trackRequest(RIL_Token t, int request)
+{
+    int64_t now = nowNs();
+
+    std::lock_guard<std::mutex> lock(sRequestLock);
+    sPendingRequests[t] = PendingRequest{request, now};
+}
+
+static int untrackRequest(RIL_Token t, RIL_Errno e)
+{
+    PendingRequest pending;
+    int64_t latencyUs;
+
+    {
+        std::lock_guard<std::mutex> lock(sRequestLock);
+        auto it = sPendingRequests.find(t);
+        if (it == sPendingRequests.end()) {
+            return -1;
+        }
+
+        pending = it->second;
+        sPendingRequests.erase(it);
+    }
+
+    latencyUs = (nowNs() - pending.startNs) / 1000;
+    sRequestStats.record(pending.request, latencyUs, e);
+    /* The shim's own requests, its activity poll above all, are not a feature's load */
+    if (shimTokenRequest(t) < 0) {
+        sActivity.onRequest(pending.request, latencyUs);
+    }
+
+    if (ATRACE_ENABLED()) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "ril%d.req%d.us", RIL_SHIM_SLOT, pending.request);
+        ATRACE_INT(name, static_cast<int32_t>(latencyUs > INT32_MAX ? INT32_MAX : latencyUs));
+    }
+
+    return pending.request;
+}
+
+static void dumpSchedulerStats(int fd)
+{
+    dprintf(fd, "\n%-6s %12s %10s %10s %12s\n", "lane", "dispatched", "held", "starved",
+            "max wait ms");
+    for (int lane = 0; lane < RequestScheduler::LANE_COUNT; lane++) {
+        RequestScheduler::Lane l = static_cast<RequestScheduler::Lane>(lane);
+        RequestScheduler::LaneStats stats = sScheduler.stats(l);
+
+        dprintf(fd, "%-6s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRId64 "\n",
+                RequestScheduler::laneName(l), stats.dispatched, stats.held, stats.starved,
+                stats.maxWaitNs / 1000000);
+    }
+}
+
+static void dumpRequestStats(void *param __unused)
+{
+    static const struct timeval interval = { STATS_DUMP_INTERVAL_SEC, 0 };
+    uint64_t generation = sRequestStats.generation();
+
+    if (generation != sDumpedGeneration) {
+        char path[64], tmpPath[72];
+        int fd;
+
+        snprintf(path, sizeof(path), "%s-%d.txt", STATS_DUMP_PATH, RIL_SHIM_SLOT);
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+        fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        if (fd >= 0) {
+            sRequestStats.dump(fd);
+            dprintf(fd, "\nSIM_IO cache: %zu entries, %" PRIu64 " hits, %" PRIu64 " misses\n",
+                    sSimIoCache.size(), sSimIoCache.hits(), sSimIoCache.misses());
+            dprintf(fd, "Phonebook: %zu entries stored, %" PRIu64 " served\n",
+                    sPhonebook.size(), sPhonebook.hits());
+            dumpSchedulerStats(fd);
+            sActivity.dump(fd);
+            sUnsolFilter.dump(fd);
+            dprintf(fd, "Network scans: %" PRIu64 " cells streamed, %" PRIu64
+                    " duplicates dropped\n", sNetworkScan.cellsForwarded(),
+                    sNetworkScan.duplicatesDropped());
+            {
+                LceEstimate lce;
+                if (sLcePublisher.read(&lce) && lce.samples > 0) {
+                    dprintf(fd, "LCE: %u kbps (last %u), confidence %u, %u reports, "
+                            "%" PRIu64 " overruns\n", lce.kbps, lce.lastKbps, lce.confidence,
+                            lce.samples, sLce.overruns());
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(sDataCallListLock);
+                dprintf(fd, "Data call lists: %zu calls tracked, %" PRIu64 " unchanged dropped\n",
+                        sDataCallList.size(), sDataCallListsDropped);
+            }
+            close(fd);
+            if (rename(tmpPath, path) == 0) {
+                sDumpedGeneration = generation;
+            }
+        } else {
+            ALOGW("%s: failed to open %s", __func__, tmpPath);
+        }
+    }
+
+    sRilEnv->RequestTimedCallback(dumpRequestStats, NULL, &interval);
+}
+
+static bool asCellInfoList(const void *data, size_t datalen,
+        const RIL_CellInfo_v12 **cells, size_t *count)
+{
+    if (data == NULL || datalen % sizeof(RIL_CellInfo_v12) != 0) {
+        return false;
+    }
+
+    *cells = static_cast<const RIL_CellInfo_v12 *>(data);
+    *count = datalen / sizeof(RIL_CellInfo_v12);
+    return true;
+}
+
+/*
+ * Returns true if the cell info list only differs from what the framework
+ * last saw by signal noise below the threshold, and can be dropped.
+ */
+static bool shouldSuppressCellInfo(const void *data, size_t datalen)
+{
+    const RIL_CellInfo_v12 *cells;
+    size_t count;
+    std::vector<CellInfoTracker::Change> changes;
+
+    if (!sCellInfoFilter || !asCellInfoList(data, datalen, &cells, &count)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(sCellInfoLock);
+    if (sCellInfo.update(cells, count, changes) == 0) {
+        return true;
+    }
+
+    /* The framework gets the whole list, so it becomes the new baseline */
+    sCellInfo.rebase(cells, count);
+    return false;
+}
+
+static void onCellInfoListComplete(RIL_Errno e, const void *response, size_t responselen)
+{
+    const RIL_CellInfo_v12 *cells;
+    size_t count;
+
+    if (e != RIL_E_SUCCESS || !asCellInfoList(response, responselen, &cells, &count)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(sCellInfoLock);
+    sCellInfo.rebase(cells, count);
+}
+
+static bool asDataCallList(const void *data, size_t datalen,
+        const RIL_Data_Call_Response_v11 **calls, size_t *count)
+{
+    if (datalen % sizeof(RIL_Data_Call_Response_v11) != 0 || (data == NULL && datalen != 0)) {
+        return false;
+    }
+
+    *calls = static_cast<const RIL_Data_Call_Response_v11 *>(data);
+    *count = datalen / sizeof(RIL_Data_Call_Response_v11);
+    return true;
+}
+
+/*
+ * Returns true if no call in the list differs from what the framework last
+ * saw. The URC always carries the complete list, since the framework takes
+ * a missing call as torn down, so a list with any change goes out whole.
+ */
+static bool shouldSuppressDataCallList(const void *data, size_t datalen)
+{
+    const RIL_Data_Call_Response_v11 *calls;
+    size_t count;
+    std::vector<DataCallTracker::Change> changes;
+
+    if (!sDataCallFilter || !asDataCallList(data, datalen, &calls, &count)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(sDataCallListLock);
+    if (sDataCallList.update(calls, count, changes) == 0) {
+        sDataCallListsDropped++;
+        return true;
+    }
+
+    for (const DataCallTracker::Change& change : changes) {
+        ALOGV("%s: cid %d %s", __func__, change.cid,
+                change.kind == DataCallTracker::CALL_ADDED ? "added" :
+                change.kind == DataCallTracker::CALL_REMOVED ? "removed" : "changed");
+    }
+    return false;
+}
+
+static void onDataCallComplete(int request, RIL_Token t, RIL_Errno e, const void *response,
+        size_t responselen)
+{
+    const RIL_Data_Call_Response_v11 *calls;
+    size_t count;
+
+    std::lock_guard<std::mutex> lock(sDataCallListLock);
+    switch (request) {
+        case RIL_REQUEST_DATA_CALL_LIST:
+            if (e == RIL_E_SUCCESS && asDataCallList(response, responselen, &calls, &count)) {
+                sDataCallList.rebase(calls, count);
+            }
+            break;
+        case RIL_REQUEST_SETUP_DATA_CALL:
+            if (e == RIL_E_SUCCESS && response != NULL &&
+                    responselen == sizeof(RIL_Data_Call_Response_v11)) {
+                sDataCallList.upsert(*static_cast<const RIL_Data_Call_Response_v11 *>(response));
+            }
+            break;
+        case RIL_REQUEST_DEACTIVATE_DATA_CALL:
+            sDataCallList.onDeactivateComplete(t, e);
+            break;
+    }
+}
+
+static void dispatchRequest(int request, int dispatchAs, void *data, size_t datalen,
+        RIL_Token t SHIM_SOCKET_PARAM)
+{
+    trackRequest(t, request);
+    sSimIoCache.onDispatch(request, data, datalen, t, SHIM_SOCKET_VALUE);
+    sVendorFunctions->onRequest(dispatchAs, data, datalen, t SHIM_SOCKET_ARG);
+}
+
+static void dispatchHeldRequests(void *param __unused)
+{
+    std::unique_ptr<RequestScheduler::Held> held;
+
+    while ((held = sScheduler.next(nowNs())) != nullptr) {
+#if defined(ANDROID_MULTI_SIM)
+        RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(held->socketId);
+#endif
+        dispatchRequest(held->request, held->request, held->data(), held->size(),
+                held->token SHIM_SOCKET_ARG);
+    }
+}
+
+static void dispatchQueuedSms(void *param __unused)
+{
+    std::unique_ptr<SmsBatcher::Submission> submission;
+
+    while ((submission = sSmsBatcher.next()) != nullptr) {
+#if defined(ANDROID_MULTI_SIM)
+        RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(submission->socketId);
+#endif
+        dispatchRequest(submission->request, submission->dispatchAs, submission->data(),
+                submission->size(), submission->token SHIM_SOCKET_ARG);
+    }
+}
+
+/* Hands the modem the framework's last data profiles as soon as the SIM is ready */
+static void pushDataProfiles(void *param __unused)
+{
+    std::vector<DataProfileCache::Profile> profiles;
+
+    if (!sDataProfilePrepush || !sSimReady ||
+            !sDataProfiles.profilesToPush(&sProfilePushToken, &profiles)) {
+        return;
+    }
+
+#if defined(ANDROID_MULTI_SIM)
+    RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(sDataSocket.load());
+#endif
+    DataProfileCache::ProfileSet set(profiles);
+
+    ALOGD("%s: pushing %zu data profiles", __func__, profiles.size());
+    dispatchRequest(RIL_REQUEST_SET_DATA_PROFILE, RIL_REQUEST_SET_DATA_PROFILE, set.data(),
+            set.size(), &sProfilePushToken SHIM_SOCKET_ARG);
+}
+
+/* Subscribes to LCE reports once per radio on, so nobody has to poll the modem */
+static void startLce(void *param __unused)
+{
+    int expected = LCE_IDLE;
+    int request[2] = { sLceIntervalMs, 0 /* PUSH */ };
+
+    if (sLceIntervalMs <= 0 || !sLceState.compare_exchange_strong(expected, LCE_STARTING)) {
+        return;
+    }
+
+#if defined(ANDROID_MULTI_SIM)
+    RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(sRadioSocket.load());
+#endif
+    dispatchRequest(RIL_REQUEST_START_LCE, RIL_REQUEST_START_LCE, request, sizeof(request),
+            &sLceStartToken SHIM_SOCKET_ARG);
+}
+
+static void onLceStartComplete(RIL_Errno e, const void *response, size_t responselen)
+{
+    const RIL_LceStatusInfo *status = static_cast<const RIL_LceStatusInfo *>(response);
+
+    if (e == RIL_E_SUCCESS && status != NULL && responselen == sizeof(*status) &&
+            status->lce_status == 1) {
+        sLceActualIntervalMs = status->actual_interval_ms;
+        sLceState = LCE_ACTIVE;
+    } else if (e == RIL_E_LCE_NOT_SUPPORTED || e == RIL_E_REQUEST_NOT_SUPPORTED ||
+            (e == RIL_E_SUCCESS && status != NULL && status->lce_status == -1)) {
+        ALOGI("%s: modem has no LCE, leaving it to the framework", __func__);
+        sLceState = LCE_UNSUPPORTED;
+    } else {
+        /* Try again at the next radio on */
+        sLceState = LCE_IDLE;
+    }
+}
+
+static void drainLce(void *param __unused)
+{
+    if (sLce.drain() > 0) {
+        sLcePublisher.publish(sLce.estimate());
+    }
+}
+
+static void resetLce(void *param __unused)
+{
+    sLce.drain();
+    sLce.reset();
+    sLcePublisher.publish(sLce.estimate());
+}
+
+/* Answers the framework's LCE requests while the shim's subscription runs. */
+static bool completeFromLce(int request, RIL_Token t)
+{
+    if (sLceState != LCE_ACTIVE) {
+        return false;
+    }
+
+    switch (request) {
+        case RIL_REQUEST_START_LCE: {
+            RIL_LceStatusInfo status = { 1, sLceActualIntervalMs.load() };
+            sLceForward = true;
+            sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, &status, sizeof(status));
+            return true;
+        }
+        case RIL_REQUEST_STOP_LCE: {
+            RIL_LceStatusInfo status = { 0, 0 };
+            sLceForward = false;
+            sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, &status, sizeof(status));
+            return true;
+        }
+        case RIL_REQUEST_PULL_LCEDATA: {
+            LceEstimate estimate;
+            if (!sLcePublisher.read(&estimate) || estimate.samples == 0) {
+                return false;
+            }
+            RIL_LceDataInfo info = {
+                estimate.kbps,
+                estimate.confidence,
+                static_cast<unsigned char>(estimate.suspended ? 1 : 0),
+            };
+            sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, &info, sizeof(info));
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static void sampleActivity(void *param __unused)
+{
+#if defined(ANDROID_MULTI_SIM)
+    RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(sRadioSocket.load());
+#endif
+    dispatchRequest(RIL_REQUEST_GET_ACTIVITY_INFO, RIL_REQUEST_GET_ACTIVITY_INFO, NULL, 0,
+            &sActivityToken SHIM_SOCKET_ARG);
+}
+
+/* Any GET_ACTIVITY_INFO response is a sample, the framework's included. */
+static void onActivityInfoComplete(RIL_Token t, RIL_Errno e, const void *response,
+        size_t responselen)
+{
+    int64_t delayNs = ACTIVITY_MAX_INTERVAL_NS;
+
+    if (e == RIL_E_SUCCESS && response != NULL && responselen == sizeof(RIL_ActivityStatsInfo)) {
+        delayNs = sActivity.onSample(*static_cast<const RIL_ActivityStatsInfo *>(response),
+                nowNs());
+    } else if (t == &sActivityToken && e == RIL_E_REQUEST_NOT_SUPPORTED) {
+        ALOGI("%s: modem has no activity info, sampling stopped", __func__);
+        return;
+    }
+
+    if (t == &sActivityToken) {
+        struct timeval delay = {
+            static_cast<time_t>(delayNs / 1000000000LL),
+            static_cast<suseconds_t>(delayNs % 1000000000LL / 1000),
+        };
+        sRilEnv->RequestTimedCallback(sampleActivity, NULL, &delay);
+    }
+}
+
+static void emitNetworkScanResult(RIL_ScanStatus status, RIL_Errno error,
+        std::vector<RIL_CellInfo_v12>& cells)
+{
+#if defined(ANDROID_MULTI_SIM)
+    RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(sNetworkScan.socketId());
+#endif
+    RIL_NetworkScanResult result = {
+        status,
+        static_cast<uint32_t>(cells.size()),
+        cells.empty() ? NULL : cells.data(),
+        error,
+    };
+
+    sRilEnv->OnUnsolicitedResponse(RIL_UNSOL_NETWORK_SCAN_RESULT, &result, sizeof(result)
+            SHIM_SOCKET_ARG);
+}
+
+static void issueNetworkScan(void *param __unused)
+{
+    RIL_NetworkScanRequest request;
+
+    if (!sNetworkScan.nextScan(&request)) {
+        return;
+    }
+
+#if defined(ANDROID_MULTI_SIM)
+    RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(sNetworkScan.socketId());
+#endif
+    dispatchRequest(RIL_REQUEST_START_NETWORK_SCAN, RIL_REQUEST_START_NETWORK_SCAN, &request,
+            sizeof(request), &sNetworkScanToken SHIM_SOCKET_ARG);
+}
+
+/* Returns false if the modem's scan result was replaced by the shim's own. */
+static bool onNetworkScanResult(const void *data, size_t datalen)
+{
+    std::vector<RIL_CellInfo_v12> fresh;
+    RIL_Errno error = RIL_E_SUCCESS;
+
+    switch (sNetworkScan.onResult(data, datalen, fresh, &error)) {
+        case NetworkScanStreamer::OUTCOME_IGNORED:
+            return true;
+        case NetworkScanStreamer::OUTCOME_DROPPED:
+            break;
+        case NetworkScanStreamer::OUTCOME_PARTIAL:
+            if (!fresh.empty()) {
+                emitNetworkScanResult(PARTIAL, RIL_E_SUCCESS, fresh);
+            }
+            break;
+        case NetworkScanStreamer::OUTCOME_NEXT:
+            if (!fresh.empty()) {
+                emitNetworkScanResult(PARTIAL, RIL_E_SUCCESS, fresh);
+            }
+            sRilEnv->RequestTimedCallback(issueNetworkScan, NULL, NULL);
+            break;
+        case NetworkScanStreamer::OUTCOME_DONE:
+            emitNetworkScanResult(COMPLETE, RIL_E_SUCCESS, fresh);
+            break;
+        case NetworkScanStreamer::OUTCOME_FAILED:
+            emitNetworkScanResult(COMPLETE, error, fresh);
+            break;
+    }
+
+    return false;
+}
+
+static void onNetworkScanStartComplete(RIL_Token t, RIL_Errno e)
+{
+    /* libril reuses request tokens once answered, forget it either way */
+    RIL_Token first = t;
+    bool owned = t != &sNetworkScanToken &&
+            sNetworkScanFirstToken.compare_exchange_strong(first, NULL);
+
+    if (e == RIL_E_SUCCESS) {
+        return;
+    }
+
+    if (t == &sNetworkScanToken) {
+        std::vector<RIL_CellInfo_v12> none;
+
+        /* The framework only learns through the result stream */
+        sNetworkScan.onScanFailed();
+        emitNetworkScanResult(COMPLETE, e, none);
+    } else if (owned) {
+        /* The framework's own request carried the first sub-scan and gets the error */
+        sNetworkScan.onScanFailed();
+    }
+}
+
+static void onSimStatusComplete(RIL_Errno e, const void *response, size_t responselen)
+{
+    const RIL_CardStatus_v6 *status = static_cast<const RIL_CardStatus_v6 *>(response);
+    int index;
+
+    if (e != RIL_E_SUCCESS || status == NULL || responselen != sizeof(RIL_CardStatus_v6)) {
+        return;
+    }
+
+    if (status->card_state != RIL_CARDSTATE_PRESENT) {
+        /* Whatever card comes next gets the framework's profiles for it */
+        sDataProfiles.forgetProfiles();
+    }
+
+    index = status->gsm_umts_subscription_app_index;
+    sSimReady = status->card_state == RIL_CARDSTATE_PRESENT && index >= 0 &&
+            index < status->num_applications && index < RIL_CARD_MAX_APPS &&
+            status->applications[index].app_state == RIL_APPSTATE_READY;
+    if (sSimReady) {
+        sRilEnv->RequestTimedCallback(pushDataProfiles, NULL, NULL);
+    }
+}
+
+static void issuePhonebookFetches(void *param __unused)
+{
+    PhonebookLoader::Fetch fetch;
+
+    while (sPhonebook.nextFetch(&fetch)) {
+#if defined(ANDROID_MULTI_SIM)
+        RIL_SOCKET_ID socket_id = static_cast<RIL_SOCKET_ID>(fetch.socketId);
+#endif
+        SecPhonebookEntryRequest request = {
+            fetch.command,
+            fetch.fileid,
+            fetch.index,
+            fetch.hasPin2 ? &fetch.pin2[0] : NULL,
+        };
+
+        dispatchRequest(RIL_REQUEST_GET_PHONEBOOK_ENTRY, RIL_REQUEST_GET_PHONEBOOK_ENTRY,
+                &request, sizeof(request), fetch.token SHIM_SOCKET_ARG);
+    }
+}
+
+/* Returns true if the response belonged to a prefetch and must not reach libril. */
+static bool onPhonebookComplete(RIL_Token t, RIL_Errno e, void *response, size_t responselen)
+{
+    std::vector<RIL_Token> waiters;
+    PhonebookLoader::Completion completion;
+
+    completion = sPhonebook.onComplete(t, e, response, responselen, waiters);
+    if (completion == PhonebookLoader::COMPLETION_UNTRACKED) {
+        return false;
+    }
+
+    for (RIL_Token waiter : waiters) {
+        sRilEnv->OnRequestComplete(waiter, e, response, responselen);
+    }
+
+    sRilEnv->RequestTimedCallback(issuePhonebookFetches, NULL, NULL);
+    return completion == PhonebookLoader::COMPLETION_CONSUMED;
+}
+
+static void onRequestCompleteShim(RIL_Token t, RIL_Errno e, void *response, size_t responselen)
+{
+    int request = untrackRequest(t, e);
+    int shimRequest = shimTokenRequest(t);
+
+    if (shimRequest >= 0) {
+        request = shimRequest;
+    }
+
+    if (sScheduler.complete(t)) {
+        sRilEnv->RequestTimedCallback(dispatchHeldRequests, NULL, NULL);
+    }
+
+    switch (request) {
+        case RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO:
+        case RIL_REQUEST_GET_PHONEBOOK_ENTRY:
+            if (onPhonebookComplete(t, e, response, responselen)) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_GET_SIM_STATUS:
+            onSimStatusComplete(e, response, responselen);
+            break;
+        case RIL_REQUEST_START_NETWORK_SCAN:
+            onNetworkScanStartComplete(t, e);
+            if (t == &sNetworkScanToken) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_GET_ACTIVITY_INFO:
+            onActivityInfoComplete(t, e, response, responselen);
+            if (t == &sActivityToken) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_START_LCE:
+            if (t == &sLceStartToken) {
+                onLceStartComplete(e, response, responselen);
+                return;
+            }
+            break;
+        case RIL_REQUEST_SET_DATA_PROFILE:
+            sDataProfiles.onComplete(t, e);
+            if (t == &sProfilePushToken) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_SETUP_DATA_CALL:
+        case RIL_REQUEST_DEACTIVATE_DATA_CALL:
+        case RIL_REQUEST_DATA_CALL_LIST:
+            onDataCallComplete(request, t, e, response, responselen);
+            break;
+        case RIL_REQUEST_GET_CELL_INFO_LIST:
+            onCellInfoListComplete(e, response, responselen);
+            break;
+        case RIL_REQUEST_SIM_IO:
+            sSimIoCache.onComplete(t, e, response, responselen);
+            break;
+        case RIL_REQUEST_SEND_SMS:
+        case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
+        case RIL_REQUEST_CDMA_SEND_SMS:
+        case RIL_REQUEST_CDMA_SEND_SMS_EXPECT_MORE:
+            if (sSmsBatcher.complete(t)) {
+                /* Dispatch from the libril event loop, not the vendor's thread */
+                sRilEnv->RequestTimedCallback(dispatchQueuedSms, NULL, NULL);
+            }
+            break;
+    }
+
+    if (shimRequest >= 0) {
+        /* libril never issued this token */
+        return;
+    }
+
+    sRilEnv->OnRequestComplete(t, e, response, responselen);
+}
+
+/* Keeps the shim's state in step with an URC. Returns false if libril must not see it. */
+static bool filterUnsolicited(int unsolResponse, const void *data, size_t datalen SHIM_SOCKET_PARAM)
+{
+    if (!sUnsolFilter.admits(unsolResponse)) {
+        return false;
+    }
+
+    switch (unsolResponse) {
+        case RIL_UNSOL_CELL_INFO_LIST:
+            if (shouldSuppressCellInfo(data, datalen)) {
+                ALOGV("%s: dropping unchanged cell info list", __func__);
+                return false;
+            }
+            break;
+        case RIL_UNSOL_LCEDATA_RECV:
+            if (sLceState == LCE_ACTIVE && data != NULL && datalen == sizeof(RIL_LceDataInfo)) {
+                sLce.push(*static_cast<const RIL_LceDataInfo *>(data), nowNs());
+                sRilEnv->RequestTimedCallback(drainLce, NULL, NULL);
+                if (!sLceForward) {
+                    return false;
+                }
+            }
+            break;
+        case RIL_UNSOL_NETWORK_SCAN_RESULT:
+            if (!onNetworkScanResult(data, datalen)) {
+                return false;
+            }
+            break;
+        case RIL_UNSOL_DATA_CALL_LIST_CHANGED:
+            if (shouldSuppressDataCallList(data, datalen)) {
+                ALOGV("%s: dropping unchanged data call list", __func__);
+                return false;
+            }
+            break;
+        case RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED: {
+            if (!sVendorReady) {
+                /* Nothing to tear down yet; radio on comes with a later change */
+                break;
+            }
+#if defined(ANDROID_MULTI_SIM)
+            RIL_RadioState state = sVendorFunctions->onStateRequest(socket_id);
+#else
+            RIL_RadioState state = sVendorFunctions->onStateRequest();
+#endif
+            {
+                std::lock_guard<std::mutex> lock(sCellInfoLock);
+                sCellInfo.clear();
+            }
+            sRadioSocket = SHIM_SOCKET_VALUE;
+            if (state != RADIO_STATE_ON) {
+                /* The framework tears every call down with the radio */
+                {
+                    std::lock_guard<std::mutex> lock(sDataCallListLock);
+                    sDataCallList.clear();
+                }
+                sDataProfiles.invalidateProfiles();
+                sNetworkScan.cancel();
+
+                /* The modem's LCE subscription does not survive the radio either */
+                int active = LCE_ACTIVE;
+                if (sLceState.compare_exchange_strong(active, LCE_IDLE)) {
+                    sRilEnv->RequestTimedCallback(resetLce, NULL, NULL);
+                }
+            } else {
+                sRilEnv->RequestTimedCallback(pushDataProfiles, NULL, NULL);
+                sRilEnv->RequestTimedCallback(startLce, NULL, NULL);
+            }
+            break;
+        }
+        case RIL_UNSOL_SIM_REFRESH:
+            sSimIoCache.onSimRefresh(data, datalen);
+            sPhonebook.clear();
+            break;
+        case RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED:
+        case RIL_UNSOL_SIM_SWAP_STATE_CHANGED:
+            sSimIoCache.clear();
+            sPhonebook.clear();
+            if (unsolResponse == RIL_UNSOL_SIM_SWAP_STATE_CHANGED) {
+                sDataProfiles.forgetProfiles();
+            }
+            /* Ready again once the framework's GET_SIM_STATUS says so */
+            sSimReady = false;
+            break;
+        case RIL_UNSOL_PB_INIT_COMPLETE:
+            sPhonebook.clear();
+            break;
+        case RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM:
+            sSimIoCache.invalidate(SimIoCache::EF_SMS);
+            break;
+    }
+
+    return true;
+}
+
+static void onUnsolicitedResponseShim(int unsolResponse, const void *data,
+        size_t datalen SHIM_SOCKET_PARAM)
+{
+    bool forward;
+
+    /* The modem did the work even if the URC is dropped */
+    sActivity.onUnsolicited(unsolResponse);
+
+    forward = filterUnsolicited(unsolResponse, data, datalen SHIM_SOCKET_ARG);
+    sUnsolFilter.account(forward);
+    if (forward) {
+        sRilEnv->OnUnsolicitedResponse(unsolResponse, data, datalen SHIM_SOCKET_ARG);
+    }
+}
+
+/* Answers repeated SIM file reads from memory. Returns true if "t" was completed. */
+static bool completeFromSimIoCache(const void *data, size_t datalen, RIL_Token t SHIM_SOCKET_PARAM)
+{
+    SimIoCache::Response cached;
+    RIL_SIM_IO_Response response;
+
+    if (!sSimIoCache.lookup(static_cast<const RIL_SIM_IO_v6 *>(data), datalen,
+            SHIM_SOCKET_VALUE, &cached)) {
+        return false;
+    }
+
+    response.sw1 = cached.sw1;
+    response.sw2 = cached.sw2;
+    response.simResponse = cached.hasResponse ? &cached.simResponse[0] : NULL;
+    sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
+    return true;
+}
+
+/* Returns true if "t" was completed from, or parked on, the phonebook prefetch. */
+static bool completeFromPhonebook(const void *data, size_t datalen, RIL_Token t SHIM_SOCKET_PARAM)
+{
+    PhonebookLoader::Entry entry;
+
+    switch (sPhonebook.lookup(data, datalen, t, SHIM_SOCKET_VALUE, &entry)) {
+        case PhonebookLoader::LOOKUP_HIT:
+            sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, &entry.entry, sizeof(entry.entry));
+            return true;
+        case PhonebookLoader::LOOKUP_PARKED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void onRequestShim(int request, void *data, size_t datalen, RIL_Token t SHIM_SOCKET_PARAM)
+{
+    int dispatchAs = request;
+
+    switch (request) {
+        case RIL_REQUEST_SIM_IO:
+            if (completeFromSimIoCache(data, datalen, t SHIM_SOCKET_ARG)) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_GET_PHONEBOOK_STORAGE_INFO:
+            sPhonebook.onStorageInfoRequest(t, data, datalen);
+            break;
+        case RIL_REQUEST_GET_PHONEBOOK_ENTRY:
+            if (completeFromPhonebook(data, datalen, t SHIM_SOCKET_ARG)) {
+                return;
+            }
+            sRilEnv->RequestTimedCallback(issuePhonebookFetches, NULL, NULL);
+            break;
+        case RIL_REQUEST_ACCESS_PHONEBOOK_ENTRY:
+            sPhonebook.clear();
+            break;
+        case RIL_REQUEST_SET_DATA_PROFILE:
+            sDataSocket = SHIM_SOCKET_VALUE;
+            if (sDataProfiles.onSetProfiles(t, data, datalen) && sDataProfilePrepush) {
+                /* Already pushed at SIM ready */
+                sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+                return;
+            }
+            break;
+        case RIL_REQUEST_START_NETWORK_SCAN:
+            if (sScanStreaming && sNetworkScan.start(data, datalen, SHIM_SOCKET_VALUE)) {
+                RIL_NetworkScanRequest first;
+
+                /* The first sub-scan carries the framework's token and its answer */
+                sNetworkScan.nextScan(&first);
+                sNetworkScanFirstToken = t;
+                dispatchRequest(request, request, &first, sizeof(first), t SHIM_SOCKET_ARG);
+                return;
+            }
+            break;
+        case RIL_REQUEST_STOP_NETWORK_SCAN:
+            if (sNetworkScan.active() && !sNetworkScan.cancel()) {
+                /* Between sub-scans: nothing runs in the modem */
+                sRilEnv->OnRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+                return;
+            }
+            break;
+        case RIL_REQUEST_SCREEN_STATE: {
+            const int *on = static_cast<const int *>(data);
+            if (on != NULL && datalen >= sizeof(int)) {
+                sUnsolFilter.onScreenState(on[0] != 0, nowNs());
+                std::lock_guard<std::mutex> lock(sDataCallListLock);
+                sDataCallList.setReportDormancy(sUnsolFilter.reportsDormancy());
+            }
+            break;
+        }
+        case RIL_REQUEST_START_LCE:
+        case RIL_REQUEST_STOP_LCE:
+        case RIL_REQUEST_PULL_LCEDATA:
+            if (completeFromLce(request, t)) {
+                return;
+            }
+            break;
+        case RIL_REQUEST_DEACTIVATE_DATA_CALL: {
+            std::lock_guard<std::mutex> lock(sDataCallListLock);
+            sDataCallList.onDeactivateRequest(t, data, datalen);
+            break;
+        }
+    }
+
+    if (!sScheduler.submit(request, data, datalen, t, SHIM_SOCKET_VALUE, nowNs())) {
+        static const struct timeval starvation = { SCHED_STARVATION_NS / 1000000000LL, 0 };
+
+        /* Re-check once the request could be starving, even if nothing completes */
+        sRilEnv->RequestTimedCallback(dispatchHeldRequests, NULL, &starvation);
+        return;
+    }
+
+    if (sSmsBatching && SmsBatcher::handles(request)) {
+        dispatchAs = sSmsBatcher.submit(request, data, datalen, t, SHIM_SOCKET_VALUE);
+        if (dispatchAs < 0) {
+            return;
+        }
+    }
+
+    dispatchRequest(request, dispatchAs, data, datalen, t SHIM_SOCKET_ARG);
+}
+
+const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
+{
+    const RIL_RadioFunctions *(*vendorRilInit)(const struct RIL_Env *, int, char **);
+    void *handle;
+    int threshold;
+    int maxOutstanding;
+    int prefetchDepth;
+    int schedOutstanding;
+    char lcePath[64];
+
+    handle = dlopen(RIL_SHIM_TARGET, RTLD_NOW);
+    if (handle == NULL) {
+        ALOGE("%s: failed to load %s: %s", __func__, RIL_SHIM_TARGET, dlerror());
+        return NULL;
+    }
+
+    vendorRilInit = reinterpret_cast<const RIL_RadioFunctions *(*)(
+            const struct RIL_Env *, int, char **)>(dlsym(handle, "RIL_Init"));
+    if (vendorRilInit == NULL) {
+        ALOGE("%s: %s has no RIL_Init: %s", __func__, RIL_SHIM_TARGET, dlerror());
+        dlclose(handle);
+        return NULL;
+    }
+
+    threshold = property_get_int32(CELL_INFO_THRESHOLD_PROP, CELL_INFO_THRESHOLD_DEFAULT);
+    sCellInfoFilter = threshold >= 0;
+    sCellInfo.setThresholdDb(threshold);
+
+    sSmsBatching = property_get_bool(SMS_BATCHING_PROP, true);
+    maxOutstanding = property_get_int32(SMS_MAX_OUTSTANDING_PROP, SMS_MAX_OUTSTANDING_DEFAULT);
+    sSmsBatcher.configure(maxOutstanding > 0 ? maxOutstanding : 1);
+
+    sDataProfilePrepush = property_get_bool(DATA_PROFILE_PREPUSH_PROP, true);
+    sDataCallFilter = property_get_bool(DATA_CALL_FILTER_PROP, true);
+    sScanStreaming = property_get_bool(SCAN_STREAMING_PROP, true);
+
+    sLceIntervalMs = property_get_int32(LCE_INTERVAL_PROP, LCE_INTERVAL_DEFAULT);
+    snprintf(lcePath, sizeof(lcePath), "%s-%d", LCE_SHARED_PATH, RIL_SHIM_SLOT);
+    if (sLceIntervalMs > 0 && !sLcePublisher.open(lcePath)) {
+        ALOGW("%s: failed to map %s, LCE estimate stays in process", __func__, lcePath);
+    }
+
+    schedOutstanding = property_get_int32(SCHED_MAX_OUTSTANDING_PROP,
+            SCHED_MAX_OUTSTANDING_DEFAULT);
+    sScheduler.configure(schedOutstanding > 0 ? schedOutstanding : 0, SCHED_STARVATION_NS);
+
+    sSimIoCache.setEnabled(property_get_bool(SIM_IO_CACHE_PROP, true));
+
+    prefetchDepth = property_get_int32(PB_PREFETCH_DEPTH_PROP, PB_PREFETCH_DEPTH_DEFAULT);
+    sPhonebook.configure(prefetchDepth > 0 ? prefetchDepth : 0);
+
+    sRilEnv = env;
+    memcpy(&sShimEnv, env, sizeof(sShimEnv));
+    sShimEnv.OnRequestComplete = onRequestCompleteShim;
+    sShimEnv.OnUnsolicitedResponse = onUnsolicitedResponseShim;
+
+    sVendorFunctions = vendorRilInit(&sShimEnv, argc, argv);
+    if (sVendorFunctions == NULL) {
+        ALOGE("%s: %s RIL_Init failed", __func__, RIL_SHIM_TARGET);
+        return NULL;
+    }
+
+    sVendorReady = true;
+
+    memcpy(&sShimFunctions, sVendorFunctions, sizeof(sShimFunctions));
+    sShimFunctions.onRequest = onRequestShim;
+
+    dumpRequestStats(NULL);
+
+    if (property_get_bool(ACTIVITY_SAMPLING_PROP, true)) {
+        static const struct timeval first = { ACTIVITY_MIN_INTERVAL_NS / 1000000000LL, 0 };
+        sRilEnv->RequestTimedCallback(sampleActivity, NULL, &first);
+    }
+
+    ALOGI("%s: wrapping %s (version %d)", __func__, RIL_SHIM_TARGET, sShimFunctions.version);
+    return &sShimFunctions;
+}